@@ -0,0 +1,7664 @@
+/*
+    libnotepad2bmp
+
+    Copyright © 2025 Tony Smith. All rights reserved.
+
+    Version 0.5.0
+
+    MIT License
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <poll.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
+#if defined(__linux__) && !defined(N2B_NO_IO_URING)
+#include <sys/syscall.h>
+#include <linux/stat.h>
+#include <linux/io_uring.h>
+// Screenshot files are opened straight into the ring's own file table,
+// which needs Linux 5.19's sparse registration
+#if defined(__NR_io_uring_setup) && defined(IORING_RSRC_REGISTER_SPARSE)
+#define USE_IO_URING
+#endif
+#endif
+#include "libnotepad2bmp.h"
+
+
+/*
+    CONSTANTS
+*/
+#define MAX_EXPANDED_BYTE_SIZE                  (8 * N2B_SCALE_FACTOR)
+#define RLE_ROW_SIZE_MAX(w)                     ((w) * 2 + 2)
+// Worst case: every pixel a two-byte run, plus each row's end marker
+#define RLE_DATA_SIZE_MAX(w, h)                 (RLE_ROW_SIZE_MAX(w) * (h))
+// Room to work on a default scaled row, at a byte per pixel
+#define ROW_BUFFER_SIZE                         (N2B_WIDTH * N2B_SCALE_FACTOR)
+
+#define BI_RGB                                  0
+#define BI_RLE8                                 1
+#define BI_RLE4                                 2
+#define BI_BITFIELDS                            3
+#define SCALED_DOTS_PER_METRE                   0x2138
+#define UNSCALED_DOTS_PER_METRE                 0x0B13
+
+// PNG: signature, IHDR, PLTE, pHYs, IDAT and IEND, plus the
+// zlib header and checksum. Chunks add a length, type and CRC
+#define PNG_CHUNK_OVERHEAD                      12
+#define PNG_FIXED_SIZE                          (8 + (PNG_CHUNK_OVERHEAD + 13) + (PNG_CHUNK_OVERHEAD + 6) + (PNG_CHUNK_OVERHEAD + 9) + PNG_CHUNK_OVERHEAD + PNG_CHUNK_OVERHEAD + 6)
+#define PNG_FILTER_NONE                         0
+#define PNG_FILTER_SUB                          1
+#define PNG_FILTER_UP                           2
+#define PNG_FILTER_AVERAGE                      3
+#define PNG_FILTER_PAETH                        4
+// Compressed data is gathered into IDAT chunks of about this size
+#define PNG_IDAT_SIZE                           32768
+
+// PNG colour types, for reading images in
+#define PNG_COLOUR_GREY                         0
+#define PNG_COLOUR_RGB                          2
+#define PNG_COLOUR_PALETTE                      3
+#define PNG_COLOUR_GREY_ALPHA                   4
+#define PNG_COLOUR_RGBA                         6
+
+// Deflate: fixed Huffman codes, greedy LZ77 matching
+#define DEFLATE_WINDOW_SIZE                     32768
+#define DEFLATE_MATCH_MIN                       3
+#define DEFLATE_MATCH_MAX                       258
+#define DEFLATE_HASH_BITS                       13
+#define DEFLATE_CHAIN_MAX                       8
+#define DEFLATE_INSERT_MAX                      16
+#define DEFLATE_NICE_LENGTH                     32
+#define DEFLATE_END_OF_BLOCK                    256
+
+// PCX: 1bpp, run-length encoded, lines padded to an even number of bytes
+#define PCX_HEADER_SIZE                         128
+#define PCX_RUN_MAX                             63
+#define PCX_X_MAX_INDEX                         8
+#define PCX_Y_MAX_INDEX                         10
+#define PCX_H_RESOLUTION_INDEX                  12
+#define PCX_V_RESOLUTION_INDEX                  14
+#define PCX_PALETTE_INDEX                       16
+#define PCX_PLANES_INDEX                        65
+#define PCX_LINE_SIZE_INDEX                     66
+#define PCX_PALETTE_INFO_INDEX                  68
+
+// GIF: two colours, so codes start at three bits, and at most 4096 codes
+#define GIF_MIN_CODE_SIZE                       2
+#define GIF_MAX_CODES                           4096
+#define GIF_DISPOSE_NONE                        0x04
+#define LZW_TABLE_SIZE                          8191
+
+// Bump this when the BMP output changes, so old cache entries are ignored
+#define CACHE_FORMAT_VERSION                    1
+#define CACHE_KEY_LENGTH                        32
+#define CACHE_TEMP_PREFIX                       ".n2b-"
+#define CACHE_TEMP_AGE_MAX                      3600
+#define CACHE_ENTRY_MODE                        0444
+#define CACHE_COPY_SIZE                         65536
+
+// Images are written to files through a buffer of this size: big
+// enough for a default scaled BMP, even compressed, to go out in one write
+#define SINK_BUFFER_SIZE                        (1024 * 1024)
+
+// Images of this many pixels or more are encoded on several threads,
+// when allowed, a band of this many source rows per thread at a time
+#define PARALLEL_PIXELS_MIN                     (512 * 1024)
+#define PARALLEL_BAND_ROWS                      4
+
+// Otherwise rows are encoded together until they could fill this much
+#define INLINE_BAND_SIZE                        (64 * 1024)
+
+// Converting many files through io_uring: screenshots are read a window
+// at a time, while the window before is encoded and the one before that
+// written. Only small images gain from this: for larger ones, copying the
+// data costs far more than the system calls, so they're streamed, one
+// file at a time, as are fewer files than a ring is worth setting up for
+#define RING_JOBS_MIN                           8
+#define RING_WINDOW_MAX                         32
+#define RING_MEMORY_MAX                         (4 * 1024 * 1024)
+#define RING_IMAGE_SIZE_MAX                     (64 * 1024)
+#define RING_OP_OPEN_SOURCE                     0
+#define RING_OP_READ                            1
+#define RING_OP_CLOSE_SOURCE                    2
+#define RING_OP_STAT_TARGET                     3
+#define RING_OP_UNLINK                          4
+#define RING_OP_OPEN_TARGET                     5
+#define RING_OP_WRITE                           6
+#define RING_OP_CLOSE_TARGET                    7
+
+// Importing images: BMPs and PNGs of up to this many pixels, read
+// whole, or from a pipe this much at a time. Rows are laid out as
+// palette indices or grey levels, as whole-byte channels, or as BMP
+// bit fields. Pixels darker than the threshold level become ink
+#define IMPORT_PIXELS_MAX                       (32 * 1024 * 1024)
+#define IMPORT_READ_SIZE                        65536
+#define IMPORT_LAYOUT_INDEXED                   0
+#define IMPORT_LAYOUT_CHANNELS                  1
+#define IMPORT_LAYOUT_FIELDS                    2
+#define PAPER_LEVEL                             255
+#define INK_THRESHOLD                           128
+
+// Reading text: glyphs are 48 bits, so can never fill an empty font
+// table slot. Rows of text can be up to TEXT_COLUMNS_MAX cells wide
+#define GLYPH_BITS                              (N2B_GLYPH_WIDTH * N2B_GLYPH_HEIGHT)
+#define GLYPH_MASK                              ((UINT64_C(1) << GLYPH_BITS) - 1)
+#define FONT_SLOT_EMPTY                         UINT64_MAX
+#define FONT_ROW_SIZE                           8
+#define TEXT_COLUMNS_MAX                        128
+
+// XMODEM: control bytes, block sizes, and how long to wait, in
+// milliseconds, for the sender to start, for each block, and for each
+// part of a block. The receiver asks for CRCs a few times before falling
+// back to checksums, and gives up after too many timeouts or bad blocks
+#define XMODEM_SOH                              0x01
+#define XMODEM_STX                              0x02
+#define XMODEM_EOT                              0x04
+#define XMODEM_ACK                              0x06
+#define XMODEM_NAK                              0x15
+#define XMODEM_CAN                              0x18
+#define XMODEM_CRC                              'C'
+#define XMODEM_BLOCK_SIZE                       128
+#define XMODEM_LONG_BLOCK_SIZE                  1024
+#define XMODEM_START_TIMEOUT                    3000
+#define XMODEM_BLOCK_TIMEOUT                    10000
+#define XMODEM_BYTE_TIMEOUT                     1000
+#define XMODEM_CRC_TRIES                        3
+#define XMODEM_TRIES_MAX                        10
+#define XMODEM_TIMED_OUT                        -1
+#define XMODEM_LINE_FAILED                      -2
+
+// Inflate: codes of up to this many bits are decoded with one lookup
+#define INFLATE_FAST_BITS                       10
+#define INFLATE_CODE_LENGTH_MAX                 15
+
+// Dump scanning: dumps are read a chunk at a time, keeping enough
+// of what came before to hold a screen and any screen overlapping it.
+// A screen needs at least most of a line of text's rows to have pixels set
+#define SCAN_CHUNK_SIZE                         65536
+#define SCAN_HISTORY_SIZE                       (2 * N2B_RAW_DATA_SIZE)
+#define SCAN_ROWS_SET_MIN                       6
+
+// FAT file systems, as on NC200 disks: the boot sector's BIOS parameter
+// block, then the FATs, the root directory of 32-byte entries with 8.3
+// names, and the clusters of file data, numbered from 2
+#define FAT_BOOT_SIZE                           512
+#define FAT_SECTOR_SIZE_INDEX                   11
+#define FAT_CLUSTER_SECTORS_INDEX               13
+#define FAT_RESERVED_SECTORS_INDEX              14
+#define FAT_COUNT_INDEX                         16
+#define FAT_ROOT_ENTRIES_INDEX                  17
+#define FAT_TOTAL_SECTORS_INDEX                 19
+#define FAT_MEDIA_INDEX                         21
+#define FAT_FAT_SECTORS_INDEX                   22
+#define FAT_TOTAL_SECTORS_LONG_INDEX            32
+#define FAT_SECTOR_SIZE_MIN                     512
+#define FAT_SECTOR_SIZE_MAX                     4096
+#define FAT_MEDIA_MIN                           0xF0
+#define FAT12_CLUSTERS_MAX                      4084
+#define FAT16_CLUSTERS_MAX                      65524
+#define FAT_FIRST_CLUSTER                       2
+#define FAT_ENTRY_SIZE                          32
+#define FAT_ENTRY_NAME_SIZE                     8
+#define FAT_ENTRY_EXTENSION_SIZE                3
+#define FAT_ENTRY_ATTRIBUTES_INDEX              11
+#define FAT_ENTRY_CLUSTER_INDEX                 26
+#define FAT_ENTRY_SIZE_INDEX                    28
+#define FAT_ENTRY_END                           0x00
+#define FAT_ENTRY_DELETED                       0xE5
+#define FAT_ATTRIBUTES_LONG_NAME                0x0F
+#define FAT_ATTRIBUTES_NOT_FILE                 0x18    // A directory or the volume label
+#define FAT_SCREENSHOT_NAME                     "S       "
+
+// +3DOS file headers: a signature, the file's length, header included,
+// and in the last byte, the sum of all the others
+#define PLUS3DOS_SIGNATURE                      "PLUS3DOS\x1A"
+#define PLUS3DOS_SIGNATURE_SIZE                 9
+#define PLUS3DOS_LENGTH_INDEX                   11
+#define PLUS3DOS_CHECKSUM_INDEX                 (N2B_HEADER_SIZE - 1)
+
+#define BMP_V1_HEADER_DATA_SIZE                 62
+#define BMP_V5_HEADER_DATA_SIZE                 146
+
+#define BMP_HEADER_FILE_SIZE_INDEX              2
+#define DIB_V5_HEADER_WIDTH_INDEX               4
+#define DIB_V5_HEADER_HEIGHT_INDEX              8
+#define DIB_V5_HEADER_BITS_PER_PIXEL_INDEX      14
+#define DIB_V5_HEADER_COMPRESSION_INDEX         16
+#define DIB_V5_HEADER_DATA_SIZE_INDEX           20
+#define DIB_V5_HEADER_H_RESOLUTION_INDEX        24
+#define DIB_V5_HEADER_V_RESOLUTION_INDEX        28
+
+
+/*
+    STRUCTURES
+*/
+// The start of the stage being timed, in wall clock and thread CPU time
+typedef struct {
+    struct timespec     wall;
+    struct timespec     cpu;
+} StageTimer;
+
+// A bitmap on its way to an image format: the pixels, already enlarged
+// by any edge-aware scaler, how many times to repeat them, and the rest
+// of the settings a format might need
+typedef struct {
+    const N2BBitmap*    bitmap;
+    unsigned int        factor;         // The scale, or if uneven, the most times a pixel is repeated
+    bool                even;           // Is every pixel repeated `factor` times? If not, some are once less
+    uint32_t            width;          // Of the output image, in pixels
+    uint32_t            height;
+    unsigned int        depth;
+    bool                compress;
+    uint32_t            resolution;     // Dots per metre
+    unsigned int        threads;
+    N2BStats*           stats;
+    StageTimer*         timer;
+} EncodeJob;
+
+// Where an encoder's output goes: a caller's buffer, which must hold all
+// of it, or a file or a write handler, through a buffer that's written
+// out as it fills
+typedef struct {
+    uint8_t*            data;
+    size_t              size;           // Bytes in the buffer
+    size_t              capacity;
+    FILE*               file;           // Or NULL to keep the output in the buffer
+    N2BWriteHandler     handler;        // Or to pass it to this instead, if set
+    void*               context;
+    bool                streams;        // Output goes to the file or handler, or is discarded if neither is set
+    size_t              total;          // Bytes output so far
+    bool                failed;         // Out of room, or a write failed
+    N2BStats*           stats;          // Writes are timed as the write stage
+    StageTimer*         timer;
+} ImageSink;
+
+// An output format: `size_max()` gives the largest image `encode()` can
+// write, and `encode()` writes it a band at a time, returning `false` if
+// memory runs out
+typedef struct {
+    const char*         name;
+    const char*         extension;
+    bool                one_bit;        // Always 1bpp, with no options to set
+    size_t              (*size_max)(const EncodeJob* job);
+    bool                (*encode)(const EncodeJob* job, ImageSink* sink);
+} FormatBackend;
+
+// The expansion of every source byte at one scale and depth: the shared
+// table for 1x and 3x, or one built for the job at other scales. Uneven
+// scales repeat each source pixel its own number of times instead
+typedef struct {
+    const uint8_t*      entries;
+    unsigned int        entry_size;     // Bytes per entry: the scale times the depth
+    uint8_t*            owned;          // The built table or repeats, freed with the expander
+    const uint8_t*      repeats;        // Times each source pixel is repeated, or NULL to use the table
+    unsigned int        depth;
+    uint32_t            width;          // Of an unevenly expanded row, in pixels
+} Expander;
+
+// Encodes a band of rows, counted in the order the format stores them,
+// returning `false` if out of memory. Each call gets its own scratch
+// buffer, so bands can be encoded on several threads at once
+typedef bool (*BandEncoder)(const EncodeJob* job, void* context, uint32_t first_row, uint32_t row_count, uint8_t* scratch, uint8_t* target, size_t* size);
+
+// The bands of a large image being encoded on worker threads. Each band
+// goes into the next free slot, and is held there until the bands
+// before it have been written out
+typedef struct {
+    const EncodeJob*    job;
+    BandEncoder         encode_band;
+    void*               context;
+    size_t              band_capacity;
+    size_t              scratch_size;
+    uint32_t            band_count;
+    uint32_t            next_band;      // The next band for a worker to take
+    uint32_t            written;        // Bands written out so far
+    unsigned int        slot_count;
+    uint8_t*            slots;          // `slot_count` buffers, each of `band_capacity` bytes
+    size_t*             sizes;
+    bool*               ready;
+    bool                failed;
+    pthread_mutex_t     lock;
+    pthread_cond_t      changed;
+} BandQueue;
+
+// A PNG deflated a band per thread: each band's checksum and length,
+// kept by its first source row, to be combined in order
+typedef struct {
+    const Expander*     expander;
+    uint32_t            row_size;
+    uint32_t*           adlers;
+    size_t*             lengths;
+} PNGBands;
+
+// Deflate output: bits are packed least significant first
+typedef struct {
+    uint8_t*            target;
+    uint64_t            bits;
+    unsigned int        bit_count;
+} BitWriter;
+
+// A deflate stream fed a band of data at a time. The window holds the
+// data matches can refer back to, and slides along as it fills
+typedef struct {
+    uint8_t*            window;
+    int32_t*            chain;          // The previous position with the same hash, per window byte
+    int32_t*            heads;          // The latest position with each hash
+    size_t              size;           // Bytes in the window
+    size_t              capacity;
+    size_t              position;       // Of the next byte to deflate
+    uint32_t            row_size;
+    uint32_t            adler;
+    BitWriter           writer;
+} DeflateStream;
+
+// LZW output, gathered into GIF data sub-blocks of up to 255 bytes
+typedef struct {
+    uint8_t             block[256];
+    unsigned int        block_size;
+    uint32_t            bits;
+    unsigned int        bit_count;
+} LZWWriter;
+
+// The layout of a FAT file system at the start of a dump. Offsets
+// and sizes are in bytes
+typedef struct {
+    uint32_t            cluster_size;
+    uint32_t            cluster_count;
+    bool                is_fat12;
+    uint64_t            fat_start;
+    uint32_t            fat_size;       // Just as much of the first FAT as the clusters need
+    uint64_t            root_start;
+    uint32_t            root_size;
+    uint64_t            data_start;
+} FatVolume;
+
+// A screenshot file listed in a dump's directory, gathered a cluster at
+// a time as the dump is read. Its data is only held while that goes on
+typedef struct {
+    char                name[FAT_ENTRY_NAME_SIZE + FAT_ENTRY_EXTENSION_SIZE + 2];
+    uint32_t            size;
+    uint32_t            clusters_left;
+    uint64_t            offset;         // Of its first cluster
+    uint8_t*            data;
+} DumpFile;
+
+// One cluster of a screenshot file, and where it goes in the file
+typedef struct {
+    uint32_t            cluster;
+    uint32_t            file;
+    uint32_t            position;
+} DumpPiece;
+
+// Where and how `n2b_extract_dump()` writes the screens it finds
+typedef struct {
+    const char*         outdir;
+    const char*         name;
+    const N2BOptions*   options;
+    uint8_t*            data;
+    size_t              size;
+    size_t              count;
+} DumpTarget;
+
+// An image being imported as a screenshot, read a row at a time as grey
+// levels, from 0 for black to PAPER_LEVEL. Rows are `stride` bytes apart,
+// from the top row, so bottom-up BMPs have a negative stride
+typedef struct {
+    uint32_t            width;
+    uint32_t            height;
+    const uint8_t*      pixels;         // The top row
+    ptrdiff_t           stride;
+    unsigned int        layout;
+    unsigned int        bits;           // Per pixel
+    unsigned int        offsets[4];     // Channels: of the red, green, blue and alpha bytes
+    bool                has_alpha;
+    uint32_t            masks[3];       // Bit fields: of red, green and blue
+    unsigned int        shifts[3];
+    uint8_t             key[6];         // A PNG's transparent colour, as its bytes
+    unsigned int        key_size;
+    uint8_t             levels[256];    // Indexed: the grey level of each index
+    uint8_t*            owned;          // Inflated or unpacked pixels, freed with the image
+} ImportImage;
+
+// Inflate input: bits are taken least significant first
+typedef struct {
+    const uint8_t*      data;
+    size_t              size;
+    size_t              position;
+    uint64_t            bits;
+    unsigned int        bit_count;
+    bool                overrun;        // Set if more bits were wanted than the data holds
+} BitReader;
+
+// A Huffman code being decoded. Codes of up to INFLATE_FAST_BITS are
+// looked up straight from the next bits, giving the symbol shifted
+// left four bits and the code length, or 0 for a longer code, which is
+// found from the number of codes of each length
+typedef struct {
+    uint16_t            fast[1 << INFLATE_FAST_BITS];
+    uint16_t            counts[INFLATE_CODE_LENGTH_MAX + 1];
+    uint16_t            symbols[288];
+} HuffmanCode;
+
+// A cache entry considered for trimming
+typedef struct {
+    char                name[CACHE_KEY_LENGTH + 5];
+    time_t              mtime;
+    uint64_t            size;
+} CacheEntry;
+
+
+#ifdef USE_IO_URING
+// An io_uring instance with its queues mapped. SQEs are added at
+// `sq_next`, and the kernel is only told of them when they're submitted
+typedef struct {
+    int                 fd;
+    unsigned int        entries;
+    unsigned int        sq_next;
+    unsigned int        queued;
+    unsigned int*       sq_head;
+    unsigned int*       sq_tail;
+    unsigned int        sq_mask;
+    struct io_uring_sqe* sqes;
+    unsigned int*       cq_head;
+    unsigned int*       cq_tail;
+    unsigned int        cq_mask;
+    struct io_uring_cqe* cqes;
+    void*               sq_ring;
+    size_t              sq_ring_size;
+    void*               cq_ring;
+    size_t              cq_ring_size;
+    size_t              sqes_size;
+} Ring;
+
+// Screenshot files going through a ring a window at a time. Windows take
+// turns with two sets of buffers and file slots, so one can be read or
+// written while the other is encoded. Each image has its own slot
+typedef struct {
+    Ring                ring;
+    N2BFileJob*         jobs;
+    size_t              job_count;
+    const N2BOptions*   options;
+    size_t              count;
+    size_t              window;
+    size_t              image_capacity;
+    uint8_t*            raw;            // 2 x window screenshots, of up to N2B_SOURCE_SIZE_MAX
+    size_t*             raw_sizes;      // Of each job's screenshot, as read
+    uint8_t*            images;         // 2 x window x count images of `image_capacity`
+    size_t*             image_sizes;    // Of each image, or 0 if it isn't to be written
+    struct statx*       targets;        // Of each image's file, if it exists already
+    size_t              first[2];       // Of each set's window being read and encoded
+    size_t              written[2];     // Of each set's window being written
+    size_t              reads[2];       // Completions still to come for each set
+    size_t              writes[2];
+    bool                failed;         // The ring itself failed
+} RingBatch;
+#endif
+
+
+/*
+    FORWARD DECLARATIONS
+*/
+static void     build_expansion_tables(void);
+static void     fill_expansion_table(uint8_t* table, unsigned int factor, unsigned int depth);
+static bool     expander_init(Expander* expander, unsigned int factor, unsigned int depth);
+static void     expander_free(Expander* expander);
+static bool     expander_init_for_job(Expander* expander, const EncodeJob* job, unsigned int depth);
+static void     expand_row(const uint8_t* source, uint32_t length, uint8_t* target, const uint8_t* table, unsigned int entry_size);
+static void     expand_row_unevenly(const uint8_t* source, uint32_t length, uint8_t* target, const uint8_t* repeats, unsigned int depth, uint32_t width);
+static void     expand(const Expander* expander, const uint8_t* source, uint32_t length, uint8_t* target);
+static void     size_job(EncodeJob* job, unsigned int scale, unsigned int dpi);
+static uint32_t scaled_start(uint32_t index, uint32_t source_size, uint32_t target_size);
+static unsigned int row_repeat(const EncodeJob* job, uint32_t row);
+static uint32_t row_stride(uint32_t width, unsigned int depth);
+static uint32_t rle_encode_row(const uint8_t* pixels, uint32_t width, unsigned int depth, uint8_t* target);
+static uint32_t encode_rle_row(const uint8_t* source, uint32_t length, uint32_t width, const Expander* expander, unsigned int depth, uint8_t* pixels, uint8_t* target);
+static void     set_header_value(uint8_t* data, uint32_t value);
+static void     set_short_value(uint8_t* data, uint32_t value);
+static int      check_options(const N2BBitmap* bitmap, const N2BOptions* options, unsigned int* depth);
+static size_t   plus3dos_length(const uint8_t* data, size_t size);
+static int      read_source(const char* inpath, uint8_t* buffer, const uint8_t** data, size_t* size, void** mapping);
+static void     release_source(void* mapping, size_t size);
+static int      write_target(const char* outpath, const uint8_t* data, size_t size);
+static FILE*    open_target(const char* outpath);
+static bool     close_target(FILE* file);
+static void     sink_put(ImageSink* sink, const void* data, size_t size);
+static uint8_t* sink_space(ImageSink* sink, size_t size);
+static void     sink_release(ImageSink* sink, size_t size);
+static bool     sink_flush(ImageSink* sink);
+static bool     sink_write(ImageSink* sink, const void* data, size_t size);
+static bool     runs_in_parallel(const EncodeJob* job);
+static bool     encode_bands(const EncodeJob* job, ImageSink* sink, BandEncoder encode_band, void* context, size_t row_size_max, size_t scratch_size, bool bottom_up, size_t* total);
+static void*    band_worker(void* argument);
+static int      encode_image(const N2BBitmap* bitmap, const N2BOptions* options, ImageSink* sink, StageTimer* timer);
+static int      write_image(const char* outpath, const N2BBitmap* bitmap, const N2BOptions* options, uint8_t* buffer, size_t buffer_size, StageTimer* timer, size_t* written);
+static void     stage_start(const N2BStats* stats, StageTimer* timer);
+static void     stage_end(N2BStats* stats, unsigned int stage, StageTimer* timer);
+static uint64_t elapsed_ns(const struct timespec* start, const struct timespec* end);
+static int      convert_screen(const N2BBitmap* bitmap, const char* outpath, const N2BOptions* options, uint8_t** buffer, size_t* buffer_size);
+static size_t   bmp_size_max(const EncodeJob* job);
+static bool     encode_bmp(const EncodeJob* job, ImageSink* sink);
+static bool     encode_bmp_band(const EncodeJob* job, void* context, uint32_t first_row, uint32_t row_count, uint8_t* scratch, uint8_t* target, size_t* size);
+static bool     encode_rle_band(const EncodeJob* job, void* context, uint32_t first_row, uint32_t row_count, uint8_t* scratch, uint8_t* target, size_t* size);
+static size_t   png_size_max(const EncodeJob* job);
+static bool     encode_png(const EncodeJob* job, ImageSink* sink);
+static bool     encode_png_band(const EncodeJob* job, void* context, uint32_t first_row, uint32_t row_count, uint8_t* scratch, uint8_t* target, size_t* size);
+static uint32_t fill_png_band(const EncodeJob* job, const Expander* expander, uint32_t row, uint32_t row_size, uint8_t* band);
+static size_t   pcx_size_max(const EncodeJob* job);
+static bool     encode_pcx(const EncodeJob* job, ImageSink* sink);
+static bool     encode_pcx_band(const EncodeJob* job, void* context, uint32_t first_row, uint32_t row_count, uint8_t* scratch, uint8_t* target, size_t* size);
+static uint32_t pcx_encode_line(const uint8_t* line, uint32_t length, uint8_t* target);
+static size_t   raw_size_max(const EncodeJob* job);
+static bool     encode_raw(const EncodeJob* job, ImageSink* sink);
+static bool     encode_raw_band(const EncodeJob* job, void* context, uint32_t first_row, uint32_t row_count, uint8_t* scratch, uint8_t* target, size_t* size);
+static void     expand_line(const N2BBitmap* bitmap, uint32_t row, const Expander* expander, uint8_t* target);
+static uint32_t dots_per_metre(unsigned int factor, unsigned int dpi);
+static uint8_t* scale_edges(const N2BBitmap* bitmap, unsigned int scaler, N2BBitmap* scaled);
+static inline uint64_t read_word(const uint8_t* bytes);
+static void     build_scaler_tables(void);
+static size_t   finish_png_chunk(uint8_t* chunk, const char* type, uint32_t length);
+static void     put_big_endian(uint8_t* data, uint32_t value);
+static void     build_deflate_tables(void);
+static uint32_t crc32_update(uint32_t crc, const uint8_t* data, size_t size);
+static uint32_t adler32(uint32_t adler, const uint8_t* data, size_t size);
+static uint32_t adler32_combine(uint32_t first, uint32_t second, size_t second_size);
+static bool     deflate_init(DeflateStream* stream, uint32_t row_size, size_t band_size, size_t total_size, uint8_t* target, bool whole);
+static void     deflate_preset(DeflateStream* stream, const uint8_t* data, size_t size);
+static void     deflate_band(DeflateStream* stream, const uint8_t* data, size_t size);
+static void     deflate_window(DeflateStream* stream, size_t limit);
+static void     deflate_finish(DeflateStream* stream);
+static void     deflate_flush(DeflateStream* stream);
+static void     deflate_free(DeflateStream* stream);
+static uint32_t match_length(const uint8_t* data, size_t position, size_t candidate, size_t size);
+static void     put_bits(BitWriter* writer, uint32_t value, unsigned int count);
+static void     put_symbol(BitWriter* writer, unsigned int symbol);
+static bool     append_data(N2BAnimation* animation, const uint8_t* data, size_t size);
+static int      add_frame(N2BAnimation* animation, const N2BBitmap* bitmap, uint32_t x, uint32_t y, uint32_t width, uint32_t height);
+static bool     lzw_encode(N2BAnimation* animation, const uint8_t* indices, size_t count);
+static bool     lzw_put_code(N2BAnimation* animation, LZWWriter* writer, unsigned int code, unsigned int width);
+static bool     lzw_flush(N2BAnimation* animation, LZWWriter* writer);
+static int      open_dump(const char* inpath, int* fd, uint8_t* boot, size_t* boot_size);
+static int      read_dump(int fd, uint8_t* data, size_t size, size_t* count);
+static int      skip_dump(int fd, uint64_t* position, uint64_t target, uint8_t* scratch, size_t scratch_size);
+static bool     find_fat_volume(const uint8_t* boot, size_t boot_size, FatVolume* volume);
+static uint32_t next_cluster(const uint8_t* fat, const FatVolume* volume, uint32_t cluster);
+static bool     is_screenshot_entry(const uint8_t* entry, char* name);
+static int      compare_pieces(const void* a, const void* b);
+static int      walk_dump(int fd, const FatVolume* volume, size_t boot_size, N2BScanHandler handler, void* context);
+static int      scan_dump(int fd, const uint8_t* prefix, size_t prefix_size, N2BScanHandler handler, void* context, size_t* ambiguous);
+static unsigned int count_bits(uint64_t bits);
+static bool     runs_on(const uint8_t* screen);
+static int      extract_screen(const N2BBitmap* bitmap, const char* name, uint64_t offset, void* context);
+static void     hash_screen(const uint8_t* raw, size_t raw_size, uint64_t seed, uint64_t hash[2]);
+static bool     make_cache_path(const N2BBitmap* bitmap, const N2BOptions* options, unsigned int depth, char* path, size_t path_size);
+static bool     fetch_cached(const char* cache_path, const char* outpath, bool link_output, size_t* size);
+static bool     store_cached(const char* cache_path, const N2BBitmap* bitmap, const N2BOptions* options, uint8_t* buffer, size_t buffer_size, StageTimer* timer, size_t* size);
+static int      compare_cache_entries(const void* a, const void* b);
+static int      read_image_file(const char* inpath, uint8_t** data, size_t* size, bool* mapped);
+static int      open_bmp(const uint8_t* data, size_t size, ImportImage* image);
+static bool     unpack_bmp_rle(const uint8_t* data, size_t size, unsigned int bits, ImportImage* image);
+static int      open_png(const uint8_t* data, size_t size, ImportImage* image);
+static bool     unfilter_png(uint8_t* data, uint32_t row_size, uint32_t height, unsigned int pixel_size);
+static void     read_levels(const ImportImage* image, uint32_t row, uint8_t* levels);
+static inline uint8_t grey_level(unsigned int red, unsigned int green, unsigned int blue);
+static bool     fit_to_screen(const ImportImage* image, uint8_t* screen);
+static void     resize_span(uint32_t index, uint32_t source_size, uint32_t target_size, uint32_t* start, uint32_t* end);
+static void     dither_screen(const uint8_t* screen, unsigned int dither, uint8_t* raw);
+static void     pack_row(const uint8_t* levels, const uint8_t* thresholds, uint8_t* target);
+static void     diffuse_errors(const uint8_t* screen, uint8_t* raw);
+static void     read_cells(const N2BBitmap* bitmap, uint32_t text_row, uint32_t columns, uint64_t* cells);
+static inline uint32_t glyph_slot(uint64_t glyph);
+static int      find_glyph(const N2BFont* font, uint64_t glyph);
+static int      xmodem_read_byte(int fd, int timeout);
+static bool     xmodem_read(int fd, uint8_t* data, size_t size, int timeout);
+static bool     xmodem_send(int fd, uint8_t byte);
+static void     xmodem_purge(int fd);
+static void     xmodem_cancel(int fd);
+static bool     xmodem_check(const uint8_t* data, size_t size, bool use_crc);
+static size_t   xmodem_screenshot_size(const uint8_t* raw, size_t received, size_t block_size);
+static bool     inflate_zlib(const uint8_t* data, size_t size, uint8_t* target, size_t target_size);
+static bool     inflate_stored(BitReader* reader, uint8_t* target, size_t target_size, size_t* written);
+static bool     inflate_block(BitReader* reader, const HuffmanCode* literals, const HuffmanCode* distances, uint8_t* target, size_t target_size, size_t* written);
+static bool     read_dynamic_codes(BitReader* reader, HuffmanCode* literals, HuffmanCode* distances);
+static bool     build_huffman(HuffmanCode* code, const uint8_t* lengths, unsigned int count);
+static int      read_symbol(BitReader* reader, const HuffmanCode* code);
+static uint32_t get_bits(BitReader* reader, unsigned int count);
+static void     fill_bits(BitReader* reader);
+static uint32_t get_header_value(const uint8_t* data);
+static uint32_t get_short_value(const uint8_t* data);
+static uint32_t get_big_endian(const uint8_t* data);
+#ifdef USE_IO_URING
+static bool     ring_init(Ring* ring, unsigned int entries, unsigned int file_count);
+static void     ring_free(Ring* ring);
+static struct io_uring_sqe* ring_next(Ring* ring, uint8_t opcode, uint64_t user_data);
+static bool     ring_enter(Ring* ring, unsigned int wait_count);
+static bool     convert_files_ring(N2BFileJob* jobs, size_t job_count, const N2BOptions* options, size_t count);
+static void     ring_queue_reads(RingBatch* batch, unsigned int set, size_t first);
+static void     ring_encode(RingBatch* batch, unsigned int set);
+static void     ring_queue_writes(RingBatch* batch, unsigned int set);
+static bool     ring_wait(RingBatch* batch, size_t* pending);
+static void     ring_complete(RingBatch* batch, const struct io_uring_cqe* cqe);
+#endif
+
+
+/*
+    BMP HEADER DATA
+    These are stock values for the size and type of file we are generating. They comprise:
+
+    1. BMP general header
+    2. Device-independent bitmap header (multiple versions included; version 5 used)
+    3. Colour look-up table
+
+    For more on the BMP format see https://en.wikipedia.org/wiki/BMP_file_format
+*/
+static const uint8_t BMP_HEADER[14] = {
+    0x42,0x4D,                  // TYPE (BM)
+    0x92,0x10,0x00,0x00,        // FILE SIZE (4096+14+124+8)
+    0x00,0x00,0x00,0x00,        // RESERVED
+    0x92,0x00,0x00,0x00         // Offset to the pixel data (14+40+8)
+};
+
+/*
+char DIB_V1_HEADER[40] = {
+    0x28,0x00,0x00,0x00,        // HEADER SIZE (40 bytes)
+    0xE0,0x01,0x00,0x00,        // IMAGE WIDTH (480)
+    0x40,0x00,0x00,0x00,        // IMAGE HEIGHT (64)
+    0x01,0x00,                  // COLOUR PLANES (1)
+    0x01,0x00,                  // BITS PER PIXEL (1)
+    0x00,0x00,0x00,0x00,        // COMPRESSION (0)
+    0x00,0x10,0x00,0x00,        // DATA SIZE (4096)
+    0x13,0x0B,0x00,0x00,        // HORIZONTAL RESOLUTION in DOTS PER METRE (calculated from 72dpi)
+    0x13,0x0B,0x00,0x00,        // VERTICAL RESOLUTION in DOTS PER METRE (calculated from 72dpi)
+    0x02,0x00,0x00,0x00,        // NO. COLOURS IN THE PALETTE
+    0x00,0x00,0x00,0x00         // IMPORTANT COLOURS (0 = ALL)
+};
+
+char DIB_V4_HEADER[108] = {
+    0x6C,0x00,0x00,0x00,        // HEADER SIZE (108 bytes)
+    0xE0,0x01,0x00,0x00,        // IMAGE WIDTH (480)
+    0x40,0x00,0x00,0x00,        // IMAGE HEIGHT (64)
+    0x01,0x00,                  // COLOUR PLANES (1)
+    0x01,0x00,                  // BITS PER PIXEL (1)
+    0x00,0x00,0x00,0x00,        // COMPRESSION (0)
+    0x00,0x10,0x00,0x00,        // DATA SIZE (4096)
+    0x13,0x0B,0x00,0x00,        // HORIZONTAL RESOLUTION in DOTS PER METRE (calculated from 72dpi)
+    0x13,0x0B,0x00,0x00,        // VERTICAL RESOLUTION in DOTS PER METRE (calculated from 72dpi)
+    0x02,0x00,0x00,0x00,        // NO. COLOURS IN THE PALETTE
+    0x00,0x00,0x00,0x00,        // IMPORTANT COLOURS (0 = ALL)
+    0x00,0x00,0x00,0x00,        // R MASK
+    0x00,0x00,0x00,0x00,        // G MASK
+    0x00,0x00,0x00,0x00,        // B MASK
+    0x00,0x00,0x00,0x00,        // A MASK
+    0x42,0x47,0x52,0x73,        // COLOUR SPACE TYPE (sRGB)
+    0x00,0x00,0x00,0x00,        // ENDPOINTS
+    0x00,0x00,0x00,0x00,
+    0x00,0x00,0x00,0x00,
+    0x00,0x00,0x00,0x00,
+    0x00,0x00,0x00,0x00,
+    0x00,0x00,0x00,0x00,
+    0x00,0x00,0x00,0x00,
+    0x00,0x00,0x00,0x00,
+    0x00,0x00,0x00,0x00,
+    0x00,0x00,0x00,0x00,        // R GAMMA
+    0x00,0x00,0x00,0x00,        // G GAMMA
+    0x00,0x00,0x00,0x00,        // B GAMMA
+};
+*/
+
+static const uint8_t DIB_V5_HEADER[124] = {
+    0x7C,0x00,0x00,0x00,        // HEADER SIZE (124 bytes)
+    0xE0,0x01,0x00,0x00,        // IMAGE WIDTH (480)
+    0x40,0x00,0x00,0x00,        // IMAGE HEIGHT (64)
+    0x01,0x00,                  // COLOUR PLANES (1)
+    0x01,0x00,                  // BITS PER PIXEL (1)
+    0x00,0x00,0x00,0x00,        // COMPRESSION (0)
+    0x00,0x10,0x00,0x00,        // DATA SIZE (4096)
+    0x13,0x0B,0x00,0x00,        // HORIZONTAL RESOLUTION in DOTS PER METRE (calculated from 72dpi)
+    0x13,0x0B,0x00,0x00,        // VERTICAL RESOLUTION in DOTS PER METRE (calculated from 72dpi)
+    0x02,0x00,0x00,0x00,        // NO. COLOURS IN THE PALETTE
+    0x00,0x00,0x00,0x00,        // IMPORTANT COLOURS (0 = ALL)
+    0x00,0x00,0x00,0x00,        // R MASK
+    0x00,0x00,0x00,0x00,        // G MASK
+    0x00,0x00,0x00,0x00,        // B MASK
+    0x00,0x00,0x00,0x00,        // A MASK
+    0x42,0x47,0x52,0x73,        // COLOUR SPACE TYPE (sRGB)
+    0x00,0x00,0x00,0x00,        // ENDPOINTS
+    0x00,0x00,0x00,0x00,
+    0x00,0x00,0x00,0x00,
+    0x00,0x00,0x00,0x00,
+    0x00,0x00,0x00,0x00,
+    0x00,0x00,0x00,0x00,
+    0x00,0x00,0x00,0x00,
+    0x00,0x00,0x00,0x00,
+    0x00,0x00,0x00,0x00,
+    0x00,0x00,0x00,0x00,        // R GAMMA
+    0x00,0x00,0x00,0x00,        // G GAMMA
+    0x00,0x00,0x00,0x00,        // B GAMMA
+    0x00,0x00,0x00,0x00,        // INTENT
+    0x00,0x00,0x00,0x00,        // PROFILE DATA
+    0x00,0x00,0x00,0x00,        // PROFILE SIZE
+    0x00,0x00,0x00,0x00         // RESERVED
+};
+
+// This CLT contains two colours: white and black
+// (plus an optional 'LCD green' alternative for white)
+static const uint8_t BMP_CLT[8] = {
+    //0x70,0x9D,0xA8,0x00,      // LCD GREEN IN BGRA
+    0xFF,0xFF,0xFF,0x00,        // WHITE IN BGRA
+    0x00,0x00,0x00,0x00         // BLACK IN BGRA
+};
+
+
+/*
+    SCALING DATA
+*/
+// FROM 0.5.0
+// Expansion of every possible source byte at each common scale (1x, 3x)
+// and bit depth (1, 4, 8 bits per pixel), built on first use. Each
+// table's entries are packed, the scale times the depth bytes apart
+static const unsigned int DEPTHS[3] = {1, 4, 8};
+static uint8_t EXPANSION_TABLES[2][3][256 * MAX_EXPANDED_BYTE_SIZE];
+static pthread_once_t expansion_tables_once = PTHREAD_ONCE_INIT;
+
+// Deflate length and distance codes (RFC 1951 3.2.5)
+static const uint16_t LENGTH_BASES[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                          35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t LENGTH_EXTRA_BITS[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                              3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t DISTANCE_BASES[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                                            257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const uint8_t DISTANCE_EXTRA_BITS[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                                                7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+// Ordered dithering thresholds: an 8x8 Bayer matrix, spread over the grey levels
+static const uint8_t ORDERED_THRESHOLDS[8][8] = {
+    {  2, 130,  34, 162,  10, 138,  42, 170},
+    {194,  66, 226,  98, 202,  74, 234, 106},
+    { 50, 178,  18, 146,  58, 186,  26, 154},
+    {242, 114, 210,  82, 250, 122, 218,  90},
+    { 14, 142,  46, 174,   6, 134,  38, 166},
+    {206,  78, 238, 110, 198,  70, 230, 102},
+    { 62, 190,  30, 158,  54, 182,  22, 150},
+    {254, 126, 222,  94, 246, 118, 214,  86}
+};
+
+// Built on first use: the fixed Huffman codes, bit-reversed for output, the
+// length code for each match length, and the CRC-32 table
+static uint16_t FIXED_CODES[288];
+static uint8_t FIXED_CODE_LENGTHS[288];
+static uint8_t LENGTH_CODES[DEFLATE_MATCH_MAX + 1];
+static uint32_t CRC_TABLE[256];
+static pthread_once_t deflate_tables_once = PTHREAD_ONCE_INIT;
+
+// Built on first use: the edge-aware scalers' bit-spreading tables,
+// which space a byte's pixels two or three bits apart, MSB first
+static uint16_t SPREAD2_TABLE[256];
+static uint32_t SPREAD3_TABLE[256];
+static pthread_once_t scaler_tables_once = PTHREAD_ONCE_INIT;
+
+// The screen geometries, indexed by N2B_GEOMETRY_ value
+static const N2BGeometry GEOMETRIES[N2B_GEOMETRY_COUNT] = {
+    {"NC100", N2B_WIDTH, N2B_HEIGHT, N2B_RAW_ROW_SIZE, N2B_RAW_DATA_SIZE},
+    {"NC200", N2B_WIDTH, N2B_HEIGHT_MAX, N2B_RAW_ROW_SIZE, N2B_RAW_DATA_SIZE_MAX}
+};
+
+// The output formats, indexed by N2B_FORMAT_ value
+static const FormatBackend FORMAT_BACKENDS[N2B_FORMAT_COUNT] = {
+    {"bmp", ".bmp", false, bmp_size_max, encode_bmp},
+    {"png", ".png", true, png_size_max, encode_png},
+    {"pcx", ".pcx", true, pcx_size_max, encode_pcx},
+    {"raw", ".raw", true, raw_size_max, encode_raw}
+};
+
+
+/*
+    PUBLIC FUNCTIONS
+*/
+
+/*
+    Set conversion options to their defaults: scaled, at the default
+    bit depth, and uncompressed.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - options: Pointer to the options to set.
+*/
+void n2b_options_init(N2BOptions* options) {
+
+    options->scale = N2B_SCALE_FACTOR;
+    options->depth = 0;
+    options->compress = false;
+    options->format = N2B_FORMAT_BMP;
+    options->scaler = N2B_SCALER_NEAREST;
+    options->dpi = 0;
+    options->threads = 0;
+    options->stats = NULL;
+    options->cache_dir = NULL;
+    options->cache_links = false;
+}
+
+
+/*
+    Get a screen geometry's description.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - geometry: The geometry, eg. N2B_GEOMETRY_NC200.
+
+    - Returns: Pointer to the geometry, or NULL if there's no such geometry.
+*/
+const N2BGeometry* n2b_geometry(unsigned int geometry) {
+
+    return geometry < N2B_GEOMETRY_COUNT ? &GEOMETRIES[geometry] : NULL;
+}
+
+
+/*
+    Work out a screenshot's geometry. Screenshots carry no header of their
+    own, so each geometry is known by its size: a +3DOS header, left by
+    copying the file through Amstrad disc software, is skipped, and the
+    length it gives is used instead of the data's. Data of no geometry's
+    size, but long enough, is taken to start with an NC100 screen, as
+    it always was before NC200 screens were read.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - raw:      Pointer to the screenshot data.
+        - raw_size: The number of bytes of screenshot data.
+        - offset:   Pointer to a variable set to the screen's offset in the data.
+
+    - Returns: Pointer to the geometry, or NULL if the data is too short for any.
+*/
+const N2BGeometry* n2b_detect_geometry(const uint8_t* raw, size_t raw_size, size_t* offset) {
+
+    *offset = 0;
+    size_t length = plus3dos_length(raw, raw_size);
+    if (length > 0) {
+        *offset = N2B_HEADER_SIZE;
+        raw_size = (length < raw_size ? length : raw_size) - N2B_HEADER_SIZE;
+    }
+
+    for (unsigned int i = 0 ; i < N2B_GEOMETRY_COUNT ; ++i) {
+        if (raw_size == GEOMETRIES[i].raw_size) return &GEOMETRIES[i];
+    }
+
+    return raw_size >= GEOMETRIES[N2B_GEOMETRY_NC100].raw_size ? &GEOMETRIES[N2B_GEOMETRY_NC100] : NULL;
+}
+
+
+/*
+    Decode a raw screenshot, of whichever geometry its size gives. The
+    bitmap refers to the screenshot's visible bytes in place, skipping
+    any file header, and the padding with its stride, so no data is
+    copied and the raw data must outlive the bitmap.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - raw:      Pointer to the screenshot data.
+        - raw_size: The number of bytes of screenshot data.
+        - bitmap:   Pointer to the bitmap to set.
+
+    - Returns: 0 on success or an error value.
+*/
+int n2b_decode(const uint8_t* raw, size_t raw_size, N2BBitmap* bitmap) {
+
+    size_t offset = 0;
+    const N2BGeometry* geometry = n2b_detect_geometry(raw, raw_size, &offset);
+    if (geometry == NULL) return N2B_ERROR_READ_SOURCE_FILE;
+
+    bitmap->width = geometry->width;
+    bitmap->height = geometry->height;
+    bitmap->stride = geometry->stride;
+    bitmap->pixels = raw + offset;
+    return N2B_ERROR_NONE;
+}
+
+
+/*
+    Calculate the largest image that `n2b_encode()` can produce for a
+    bitmap with the given options. For uncompressed BMPs and raw
+    bitmaps, this is the exact size.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - bitmap:  Pointer to the decoded screen.
+        - options: Pointer to the output options.
+
+    - Returns: The size in bytes, or 0 if the options are invalid.
+*/
+size_t n2b_encoded_size_max(const N2BBitmap* bitmap, const N2BOptions* options) {
+
+    unsigned int depth = 0;
+    if (check_options(bitmap, options, &depth) != N2B_ERROR_NONE) return 0;
+
+    EncodeJob job = {
+        .bitmap = bitmap,
+        .depth = depth,
+        .compress = options->compress
+    };
+
+    size_job(&job, options->scale, options->dpi);
+    return FORMAT_BACKENDS[options->format].size_max(&job);
+}
+
+
+/*
+    Encode a bitmap in the output format set by the options. The headers
+    are built per call, so calls may run concurrently on any number of
+    threads.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - bitmap:      Pointer to the decoded screen.
+        - options:     Pointer to the output options.
+        - target:      Pointer to the buffer to write the image into.
+        - target_size: The size of the buffer in bytes.
+        - written:     Pointer to a variable set to the size of the image.
+
+    - Returns: 0 on success or an error value.
+*/
+int n2b_encode(const N2BBitmap* bitmap, const N2BOptions* options, uint8_t* target, size_t target_size, size_t* written) {
+
+    unsigned int depth = 0;
+    int error = check_options(bitmap, options, &depth);
+    if (error != N2B_ERROR_NONE) return error;
+    if (target_size < n2b_encoded_size_max(bitmap, options)) return N2B_ERROR_BUFFER_TOO_SMALL;
+
+    StageTimer timer;
+    stage_start(options->stats, &timer);
+    ImageSink sink = {.data = target, .capacity = target_size};
+    error = encode_image(bitmap, options, &sink, &timer);
+    *written = sink.total;
+    return error;
+}
+
+
+/*
+    Encode a bitmap in the output format set by the options, passing the
+    image to a handler a buffer's worth at a time, so that an image of any
+    size takes the same memory. With no handler, the image is encoded but
+    not output, to find its exact size, eg. to send ahead of it.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - bitmap:  Pointer to the decoded screen.
+        - options: Pointer to the output options.
+        - handler: The function to pass each piece of the image to, or NULL.
+        - context: Pointer passed to the handler.
+        - written: Pointer to a variable set to the size of the image.
+
+    - Returns: 0 on success or an error value: `N2B_ERROR_WRITE_BMP_FILE`
+               if the handler failed.
+*/
+int n2b_encode_stream(const N2BBitmap* bitmap, const N2BOptions* options, N2BWriteHandler handler, void* context, size_t* written) {
+
+    unsigned int depth = 0;
+    int error = check_options(bitmap, options, &depth);
+    if (error != N2B_ERROR_NONE) return error;
+
+    uint8_t* buffer = malloc(SINK_BUFFER_SIZE);
+    if (buffer == NULL) return N2B_ERROR_NO_MEMORY;
+
+    StageTimer timer;
+    stage_start(options->stats, &timer);
+    ImageSink sink = {.data = buffer, .capacity = SINK_BUFFER_SIZE, .handler = handler, .context = context, .streams = true};
+    error = encode_image(bitmap, options, &sink, &timer);
+    *written = sink.total;
+    free(buffer);
+    return error;
+}
+
+
+/*
+    Get the file name extension for an output format.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - format: The format, eg. `N2B_FORMAT_PNG`.
+
+    - Returns: The extension, including the dot.
+*/
+const char* n2b_format_extension(unsigned int format) {
+
+    return FORMAT_BACKENDS[format < N2B_FORMAT_COUNT ? format : N2B_FORMAT_BMP].extension;
+}
+
+
+/*
+    Look up an output format by name, eg. `pcx`.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - name: Pointer to the name, in lower case.
+
+    - Returns: The format, or N2B_FORMAT_COUNT if there's none of that name.
+*/
+unsigned int n2b_format_from_name(const char* name) {
+
+    unsigned int format = 0;
+    while (format < N2B_FORMAT_COUNT && strcmp(FORMAT_BACKENDS[format].name, name) != 0) format++;
+    return format;
+}
+
+
+/*
+    Convert a single screenshot file to an image file.
+
+    FROM 0.4.0
+
+    FROM 0.5.0 -- read the source in one go, then assemble the whole BMP
+                  in memory and write it with a single call, instead of
+                  a stdio call per byte.
+
+    - Parameters:
+        - inpath:  Pointer to the path to the source file, or `-` for stdin.
+        - outpath: Pointer to the path to the destination file, or `-` for stdout.
+        - options: Pointer to the output options.
+
+    - Returns: 0 on success or an error value.
+ */
+int n2b_convert_file(const char* inpath, const char* outpath, const N2BOptions* options) {
+
+    size_t failed_index = 0;
+    return n2b_convert_file_multi(inpath, &outpath, options, 1, &failed_index);
+}
+
+
+/*
+    Convert a single screenshot file to any number of image files, each
+    with its own options, eg. a BMP and a PCX. The screenshot is read and
+    decoded once, and every image is encoded from the same bitmap. An
+    image that fails doesn't stop the rest being written.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - inpath:       Pointer to the path to the source file, or `-` for stdin.
+        - outpaths:     Pointer to the list of destination paths, any of which may be `-`.
+        - options:      Pointer to the list of output options, one per destination.
+        - count:        The number of destinations.
+        - failed_index: Pointer to a variable set to the index of the first
+                        destination that failed, or `count` if the source did.
+
+    - Returns: 0 on success or the first error value.
+*/
+int n2b_convert_file_multi(const char* inpath, const char* const* outpaths, const N2BOptions* options, size_t count, size_t* failed_index) {
+
+    N2BStats* stats = options[0].stats;
+    StageTimer timer;
+    stage_start(stats, &timer);
+    *failed_index = count;
+
+    // Get the Amstrad screen grab data, including the four padding
+    // bytes per row and any file header, which the bitmap skips
+    uint8_t buffer[N2B_SOURCE_SIZE_MAX];
+    const uint8_t* original = NULL;
+    size_t size = 0;
+    void* mapping = NULL;
+    int error = read_source(inpath, buffer, &original, &size, &mapping);
+    if (error != N2B_ERROR_NONE) {
+        if (stats != NULL) stats->failures++;
+        return error;
+    }
+
+    stage_end(stats, N2B_STAGE_READ, &timer);
+    error = n2b_convert_raw(original, size, outpaths, options, count, failed_index);
+    release_source(mapping, size);
+    return error;
+}
+
+
+/*
+    Convert a screenshot in memory to any number of image files, each
+    with its own options, as `n2b_convert_file_multi()` does once it has
+    read the screenshot.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - raw:          Pointer to the screenshot data.
+        - raw_size:     The number of bytes of screenshot data.
+        - outpaths:     Pointer to the list of destination paths, any of which may be `-`.
+        - options:      Pointer to the list of output options, one per destination.
+        - count:        The number of destinations.
+        - failed_index: Pointer to a variable set to the index of the first
+                        destination that failed, or `count` if none did.
+
+    - Returns: 0 on success or the first error value.
+*/
+int n2b_convert_raw(const uint8_t* raw, size_t raw_size, const char* const* outpaths, const N2BOptions* options, size_t count, size_t* failed_index) {
+
+    N2BStats* stats = options[0].stats;
+    *failed_index = count;
+
+    N2BBitmap bitmap;
+    int error = n2b_decode(raw, raw_size, &bitmap);
+    if (error != N2B_ERROR_NONE) {
+        if (stats != NULL) stats->failures++;
+        return error;
+    }
+
+    // Images are encoded one at a time, so can share a buffer
+    uint8_t* image = NULL;
+    size_t image_size = 0;
+    for (size_t i = 0 ; i < count ; ++i) {
+        int target_error = convert_screen(&bitmap, outpaths[i], &options[i], &image, &image_size);
+        if (target_error != N2B_ERROR_NONE && error == N2B_ERROR_NONE) {
+            error = target_error;
+            *failed_index = i;
+        }
+    }
+
+    free(image);
+    if (stats != NULL) {
+        if (error == N2B_ERROR_NONE) {
+            stats->files++;
+            stats->bytes_read += raw_size;
+        } else {
+            stats->failures++;
+        }
+    }
+
+    return error;
+}
+
+
+/*
+    Convert many screenshot files, each to any number of image files, as
+    `n2b_convert_file_multi()` does. Where io_uring is available, the files
+    are read and the images written in large batches through it, with as few
+    system calls as possible, overlapped with encoding. Otherwise, or if the
+    images can't go through the ring, the files are converted one at a time.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - jobs:      Pointer to the list of files to convert, each of which
+                     records its own outcome.
+        - job_count: The number of files.
+        - options:   Pointer to the list of output options, one per image.
+        - count:     The number of images per file.
+
+    - Returns: 0 if every file was converted, or the first error value.
+*/
+int n2b_convert_files(N2BFileJob* jobs, size_t job_count, const N2BOptions* options, size_t count) {
+
+    for (size_t i = 0 ; i < job_count ; ++i) {
+        jobs[i].error = N2B_ERROR_NONE;
+        jobs[i].failed_index = count;
+    }
+
+#ifdef USE_IO_URING
+    bool converted = convert_files_ring(jobs, job_count, options, count);
+#else
+    bool converted = false;
+#endif
+
+    if (!converted) {
+        for (size_t i = 0 ; i < job_count ; ++i) {
+            jobs[i].error = n2b_convert_file_multi(jobs[i].inpath, jobs[i].outpaths, options, count, &jobs[i].failed_index);
+        }
+    }
+
+    for (size_t i = 0 ; i < job_count ; ++i) {
+        if (jobs[i].error != N2B_ERROR_NONE) return jobs[i].error;
+    }
+
+    return N2B_ERROR_NONE;
+}
+
+
+/*
+    Check whether `n2b_convert_files()` can use io_uring: the library must
+    be built for Linux, and the kernel must be 5.19 or later and allow it.
+
+    FROM 0.5.0
+
+    - Returns: Whether io_uring is available.
+*/
+bool n2b_io_uring_available(void) {
+
+#ifdef USE_IO_URING
+    Ring ring;
+    if (!ring_init(&ring, 1, 1)) return false;
+    ring_free(&ring);
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+#ifdef USE_IO_URING
+/*
+    Set up an io_uring instance, with a file table of the size given.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - ring:       Pointer to the ring to set up.
+        - entries:    The number of submissions that can be queued at once.
+        - file_count: The number of files that can be open in the ring at once.
+
+    - Returns: Whether the ring could be set up.
+*/
+static bool ring_init(Ring* ring, unsigned int entries, unsigned int file_count) {
+
+    memset(ring, 0, sizeof(Ring));
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = entries * 2;
+    ring->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0) return false;
+
+    // Completions must never be dropped, or a file's outcome would be lost
+    if ((params.features & IORING_FEAT_NODROP) == 0) {
+        ring_free(ring);
+        return false;
+    }
+
+    // Recent kernels map both queues' rings together
+    ring->entries = params.sq_entries;
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    bool single_map = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_map && ring->cq_ring_size > ring->sq_ring_size) ring->sq_ring_size = ring->cq_ring_size;
+
+    void* map = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    ring->sq_ring = map != MAP_FAILED ? map : NULL;
+    if (single_map) {
+        ring->cq_ring = ring->sq_ring;
+    } else {
+        map = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        ring->cq_ring = map != MAP_FAILED ? map : NULL;
+    }
+
+    map = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    ring->sqes = map != MAP_FAILED ? map : NULL;
+    if (ring->sq_ring == NULL || ring->cq_ring == NULL || ring->sqes == NULL) {
+        ring_free(ring);
+        return false;
+    }
+
+    uint8_t* sq = (uint8_t*)ring->sq_ring;
+    uint8_t* cq = (uint8_t*)ring->cq_ring;
+    ring->sq_head = (unsigned int*)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned int*)(sq + params.sq_off.tail);
+    ring->sq_mask = *(unsigned int*)(sq + params.sq_off.ring_mask);
+    ring->cq_head = (unsigned int*)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned int*)(cq + params.cq_off.tail);
+    ring->cq_mask = *(unsigned int*)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+    ring->sq_next = *ring->sq_tail;
+
+    // Each SQE stays in its own place in the ring
+    unsigned int* sq_array = (unsigned int*)(sq + params.sq_off.array);
+    for (unsigned int i = 0 ; i < ring->entries ; ++i) sq_array[i] = i;
+
+    // An empty file table, for files to be opened into, so that a file's
+    // open, read or write, and close can all be submitted together
+    struct io_uring_rsrc_register files;
+    memset(&files, 0, sizeof(files));
+    files.nr = file_count;
+    files.flags = IORING_RSRC_REGISTER_SPARSE;
+    if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_FILES2, &files, sizeof(files)) < 0) {
+        ring_free(ring);
+        return false;
+    }
+
+    return true;
+}
+
+
+/*
+    Release an io_uring instance. Anything still in flight is cancelled.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - ring: Pointer to the ring.
+*/
+static void ring_free(Ring* ring) {
+
+    if (ring->sqes != NULL) munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring != NULL && ring->cq_ring != ring->sq_ring) munmap(ring->cq_ring, ring->cq_ring_size);
+    if (ring->sq_ring != NULL) munmap(ring->sq_ring, ring->sq_ring_size);
+    if (ring->fd >= 0) close(ring->fd);
+    ring->fd = -1;
+}
+
+
+/*
+    Add a submission to a ring, to go to the kernel with the next
+    `ring_enter()`. If the queue is full, it's submitted now.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - ring:      Pointer to the ring.
+        - opcode:    The operation, eg. IORING_OP_READ.
+        - user_data: The value its completion will carry.
+
+    - Returns: Pointer to the cleared submission, to fill in.
+*/
+static struct io_uring_sqe* ring_next(Ring* ring, uint8_t opcode, uint64_t user_data) {
+
+    while (ring->sq_next - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->entries) {
+        if (!ring_enter(ring, 0)) break;
+    }
+
+    struct io_uring_sqe* sqe = &ring->sqes[ring->sq_next & ring->sq_mask];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sqe->opcode = opcode;
+    sqe->user_data = user_data;
+    ring->sq_next++;
+    ring->queued++;
+    return sqe;
+}
+
+
+/*
+    Submit what has been queued on a ring, and wait for completions.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - ring:       Pointer to the ring.
+        - wait_count: The number of completions to wait for, or 0 not to wait.
+
+    - Returns: Whether the ring is still usable. A ring that is busy, eg.
+               because its completions need reaping first, still is.
+*/
+static bool ring_enter(Ring* ring, unsigned int wait_count) {
+
+    __atomic_store_n(ring->sq_tail, ring->sq_next, __ATOMIC_RELEASE);
+    while (true) {
+        long result = syscall(__NR_io_uring_enter, ring->fd, ring->queued, wait_count, wait_count > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if (result >= 0) {
+            ring->queued -= (unsigned int)result;
+            return true;
+        }
+
+        if (errno != EINTR) return errno == EBUSY || errno == EAGAIN;
+    }
+}
+
+
+/*
+    Convert screenshot files through io_uring. Each window's files are opened,
+    read and closed, and the images' files stat'ed, in one go. While they're
+    read, the window before is encoded, and its images are then opened,
+    written and closed in one go, while the next window is read and encoded.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - jobs:      Pointer to the list of files to convert.
+        - job_count: The number of files.
+        - options:   Pointer to the list of output options, one per image.
+        - count:     The number of images per file.
+
+    - Returns: Whether the files were converted, or false if io_uring can't
+               be used, in which case none have been touched.
+*/
+static bool convert_files_ring(N2BFileJob* jobs, size_t job_count, const N2BOptions* options, size_t count) {
+
+    // Setting up a ring takes more calls than a few files would save
+    if (job_count < RING_JOBS_MIN || count == 0 || count > UINT16_MAX) return false;
+
+    // Cached images are linked, not written, and stdin and stdout are read
+    // and written as they are
+    for (size_t i = 0 ; i < count ; ++i) {
+        if (options[i].cache_dir != NULL) return false;
+    }
+
+    for (size_t i = 0 ; i < job_count ; ++i) {
+        if (strcmp(jobs[i].inpath, "-") == 0) return false;
+        for (size_t j = 0 ; j < count ; ++j) {
+            if (strcmp(jobs[i].outpaths[j], "-") == 0) return false;
+        }
+    }
+
+    // Images are given room for the largest screen's, at each set of options
+    uint8_t blank[N2B_RAW_DATA_SIZE_MAX] = {0};
+    N2BBitmap bitmap;
+    n2b_decode(blank, N2B_RAW_DATA_SIZE_MAX, &bitmap);
+    size_t image_capacity = 0;
+    for (size_t i = 0 ; i < count ; ++i) {
+        size_t size = n2b_encoded_size_max(&bitmap, &options[i]);
+        if (size == 0 || size > RING_IMAGE_SIZE_MAX) return false;
+        if (size > image_capacity) image_capacity = size;
+    }
+
+    size_t window = RING_MEMORY_MAX / (2 * count * image_capacity);
+    if (window > RING_WINDOW_MAX) window = RING_WINDOW_MAX;
+    if (window > job_count) window = job_count;
+    if (window == 0) window = 1;
+
+    // A window's reads take three submissions per file plus a stat per image,
+    // and its writes four per image
+    size_t image_count = 2 * window * count;
+    size_t entries = window * (3 + 5 * count);
+    size_t file_count = 2 * window + image_count;
+    if (entries > 4096) return false;
+
+    RingBatch batch = {
+        .jobs = jobs,
+        .job_count = job_count,
+        .options = options,
+        .count = count,
+        .window = window,
+        .image_capacity = image_capacity,
+        .raw = malloc(2 * window * N2B_SOURCE_SIZE_MAX),
+        .raw_sizes = calloc(job_count, sizeof(size_t)),
+        .images = malloc(image_count * image_capacity),
+        .image_sizes = calloc(image_count, sizeof(size_t)),
+        .targets = calloc(image_count, sizeof(struct statx)),
+        .failed = false
+    };
+
+    bool ready = batch.raw != NULL && batch.raw_sizes != NULL && batch.images != NULL && batch.image_sizes != NULL && batch.targets != NULL
+              && ring_init(&batch.ring, (unsigned int)entries, (unsigned int)file_count);
+    if (!ready) {
+        free(batch.raw);
+        free(batch.raw_sizes);
+        free(batch.images);
+        free(batch.image_sizes);
+        free(batch.targets);
+        return false;
+    }
+
+    N2BStats* stats = options[0].stats;
+    StageTimer timer;
+    size_t finished = 0;
+    unsigned int set = 0;
+    ring_queue_reads(&batch, 0, 0);
+    for (size_t first = 0 ; first < job_count && !batch.failed ; first += window, set ^= 1) {
+        // Read the next window while this one is encoded. Waiting for this
+        // one's reads submits them, and the last window's writes too
+        if (first + window < job_count) ring_queue_reads(&batch, set ^ 1, first + window);
+        stage_start(stats, &timer);
+        if (!ring_wait(&batch, &batch.reads[set])) break;
+        stage_end(stats, N2B_STAGE_READ, &timer);
+
+        // This set's images were last used two windows ago
+        if (!ring_wait(&batch, &batch.writes[set])) break;
+        stage_end(stats, N2B_STAGE_WRITE, &timer);
+        finished = first >= window ? first - window : 0;
+
+        ring_encode(&batch, set);
+        ring_queue_writes(&batch, set);
+    }
+
+    stage_start(stats, &timer);
+    if (ring_wait(&batch, &batch.writes[0]) && ring_wait(&batch, &batch.writes[1])) finished = job_count;
+    stage_end(stats, N2B_STAGE_WRITE, &timer);
+    ring_free(&batch.ring);
+
+    for (size_t i = 0 ; i < finished ; ++i) {
+        if (stats == NULL) break;
+        if (jobs[i].error == N2B_ERROR_NONE) {
+            stats->files++;
+            stats->bytes_read += batch.raw_sizes[i];
+        } else {
+            stats->failures++;
+        }
+    }
+
+    // Should the ring fail part way, convert what's left the usual way
+    for (size_t i = finished ; i < job_count ; ++i) {
+        jobs[i].error = n2b_convert_file_multi(jobs[i].inpath, jobs[i].outpaths, options, count, &jobs[i].failed_index);
+    }
+
+    free(batch.raw);
+    free(batch.raw_sizes);
+    free(batch.images);
+    free(batch.image_sizes);
+    free(batch.targets);
+    return true;
+}
+
+
+/*
+    Queue the reads for a window of screenshot files: each is opened into
+    the ring's file table, read and closed, as one linked chain, and each
+    image's file is stat'ed, to see whether it's linked to a cache entry.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - batch: Pointer to the batch.
+        - set:   The set of buffers and file slots to use, 0 or 1.
+        - first: The index of the window's first job.
+*/
+static void ring_queue_reads(RingBatch* batch, unsigned int set, size_t first) {
+
+    batch->first[set] = first;
+    size_t end = first + batch->window < batch->job_count ? first + batch->window : batch->job_count;
+    for (size_t i = first ; i < end ; ++i) {
+        size_t index = set * batch->window + (i - first);
+        uint64_t tag = ((uint64_t)i << 24) | (set << 4);
+
+        // A read that fails still lets the close go ahead
+        struct io_uring_sqe* sqe = ring_next(&batch->ring, IORING_OP_OPENAT, tag | RING_OP_OPEN_SOURCE);
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (uint64_t)(uintptr_t)batch->jobs[i].inpath;
+        sqe->open_flags = O_RDONLY;
+        sqe->file_index = (uint32_t)index + 1;
+        sqe->flags = IOSQE_IO_LINK;
+
+        sqe = ring_next(&batch->ring, IORING_OP_READ, tag | RING_OP_READ);
+        sqe->fd = (int32_t)index;
+        sqe->addr = (uint64_t)(uintptr_t)(batch->raw + index * N2B_SOURCE_SIZE_MAX);
+        sqe->len = N2B_SOURCE_SIZE_MAX;
+        sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+
+        sqe = ring_next(&batch->ring, IORING_OP_CLOSE, tag | RING_OP_CLOSE_SOURCE);
+        sqe->file_index = (uint32_t)index + 1;
+        batch->reads[set] += 3;
+
+        for (size_t j = 0 ; j < batch->count ; ++j) {
+            struct statx* target = &batch->targets[index * batch->count + j];
+            memset(target, 0, sizeof(struct statx));
+            sqe = ring_next(&batch->ring, IORING_OP_STATX, tag | (j << 8) | RING_OP_STAT_TARGET);
+            sqe->fd = AT_FDCWD;
+            sqe->addr = (uint64_t)(uintptr_t)batch->jobs[i].outpaths[j];
+            sqe->len = STATX_TYPE | STATX_NLINK;
+            sqe->off = (uint64_t)(uintptr_t)target;
+            sqe->statx_flags = AT_SYMLINK_NOFOLLOW;
+            batch->reads[set]++;
+        }
+    }
+}
+
+
+/*
+    Decode and encode a window of screenshots that has been read.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - batch: Pointer to the batch.
+        - set:   The window's set of buffers, 0 or 1.
+*/
+static void ring_encode(RingBatch* batch, unsigned int set) {
+
+    size_t first = batch->first[set];
+    size_t end = first + batch->window < batch->job_count ? first + batch->window : batch->job_count;
+    for (size_t i = first ; i < end ; ++i) {
+        N2BFileJob* job = &batch->jobs[i];
+        size_t index = set * batch->window + (i - first);
+        size_t* sizes = &batch->image_sizes[index * batch->count];
+        for (size_t j = 0 ; j < batch->count ; ++j) sizes[j] = 0;
+        if (job->error != N2B_ERROR_NONE) continue;
+
+        N2BBitmap bitmap;
+        n2b_decode(batch->raw + index * N2B_SOURCE_SIZE_MAX, batch->raw_sizes[i], &bitmap);
+        for (size_t j = 0 ; j < batch->count ; ++j) {
+            uint8_t* image = batch->images + (index * batch->count + j) * batch->image_capacity;
+            int error = n2b_encode(&bitmap, &batch->options[j], image, batch->image_capacity, &sizes[j]);
+            if (error != N2B_ERROR_NONE) {
+                sizes[j] = 0;
+                if (job->error == N2B_ERROR_NONE) {
+                    job->error = error;
+                    job->failed_index = j;
+                }
+            }
+        }
+    }
+}
+
+
+/*
+    Queue the writes for a window of encoded images: each image file is
+    opened into the ring's file table, written and closed, as one linked
+    chain. As `open_target()` does, a file linked to a cache entry is
+    unlinked first, so that it's replaced rather than overwritten.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - batch: Pointer to the batch.
+        - set:   The window's set of buffers and file slots, 0 or 1.
+*/
+static void ring_queue_writes(RingBatch* batch, unsigned int set) {
+
+    size_t first = batch->first[set];
+    size_t end = first + batch->window < batch->job_count ? first + batch->window : batch->job_count;
+    batch->written[set] = first;
+    for (size_t i = first ; i < end ; ++i) {
+        size_t index = set * batch->window + (i - first);
+        for (size_t j = 0 ; j < batch->count ; ++j) {
+            size_t image_index = index * batch->count + j;
+            size_t slot = 2 * batch->window + image_index;
+            if (batch->image_sizes[image_index] == 0) continue;
+
+            const char* outpath = batch->jobs[i].outpaths[j];
+            const struct statx* target = &batch->targets[image_index];
+            uint64_t tag = ((uint64_t)i << 24) | (j << 8) | (set << 4);
+            struct io_uring_sqe* sqe;
+            if (S_ISREG(target->stx_mode) && target->stx_nlink > 1) {
+                sqe = ring_next(&batch->ring, IORING_OP_UNLINKAT, tag | RING_OP_UNLINK);
+                sqe->fd = AT_FDCWD;
+                sqe->addr = (uint64_t)(uintptr_t)outpath;
+                sqe->flags = IOSQE_IO_HARDLINK;
+                batch->writes[set]++;
+            }
+
+            sqe = ring_next(&batch->ring, IORING_OP_OPENAT, tag | RING_OP_OPEN_TARGET);
+            sqe->fd = AT_FDCWD;
+            sqe->addr = (uint64_t)(uintptr_t)outpath;
+            sqe->open_flags = O_WRONLY | O_CREAT | O_TRUNC;
+            sqe->len = 0666;
+            sqe->file_index = (uint32_t)slot + 1;
+            sqe->flags = IOSQE_IO_LINK;
+
+            sqe = ring_next(&batch->ring, IORING_OP_WRITE, tag | RING_OP_WRITE);
+            sqe->fd = (int32_t)slot;
+            sqe->addr = (uint64_t)(uintptr_t)(batch->images + image_index * batch->image_capacity);
+            sqe->len = (uint32_t)batch->image_sizes[image_index];
+            sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+
+            sqe = ring_next(&batch->ring, IORING_OP_CLOSE, tag | RING_OP_CLOSE_TARGET);
+            sqe->file_index = (uint32_t)slot + 1;
+            batch->writes[set] += 3;
+        }
+    }
+}
+
+
+/*
+    Submit anything queued, then reap completions until there are none
+    still to come for the count given.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - batch:   Pointer to the batch.
+        - pending: Pointer to the count of completions to wait for.
+
+    - Returns: Whether they all came, or false if the ring failed.
+*/
+static bool ring_wait(RingBatch* batch, size_t* pending) {
+
+    Ring* ring = &batch->ring;
+    while (!batch->failed) {
+        unsigned int head = *ring->cq_head;
+        unsigned int tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+        for ( ; head != tail ; ++head) ring_complete(batch, &ring->cqes[head & ring->cq_mask]);
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+
+        // Every submission completes, so wait for all those to come at once,
+        // rather than wake for each
+        if (*pending == 0 && ring->queued == 0) return true;
+        if (!ring_enter(ring, (unsigned int)*pending)) batch->failed = true;
+    }
+
+    return false;
+}
+
+
+/*
+    Record the outcome of a completed submission against its job. Those
+    cancelled because an earlier link in their chain failed are counted,
+    but the error is the earlier one's.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - batch: Pointer to the batch.
+        - cqe:   Pointer to the completion.
+*/
+static void ring_complete(RingBatch* batch, const struct io_uring_cqe* cqe) {
+
+    unsigned int op = cqe->user_data & 0x0F;
+    unsigned int set = (cqe->user_data >> 4) & 0x01;
+    size_t j = (cqe->user_data >> 8) & 0xFFFF;
+    size_t i = cqe->user_data >> 24;
+    N2BFileJob* job = &batch->jobs[i];
+    int result = cqe->res;
+    if (op <= RING_OP_STAT_TARGET) {
+        batch->reads[set]--;
+    } else {
+        batch->writes[set]--;
+    }
+
+    // Unlinks and stats may fail harmlessly, as may closes after a failure.
+    // The next window may be being read into this set while it's written
+    int error = N2B_ERROR_NONE;
+    size_t image_size = 0;
+    if (op == RING_OP_WRITE) image_size = batch->image_sizes[(set * batch->window + (i - batch->written[set])) * batch->count + j];
+    if (op == RING_OP_OPEN_SOURCE && result < 0) {
+        error = N2B_ERROR_OPEN_SOURCE_FILE;
+        j = batch->count;
+    } else if (op == RING_OP_READ && result < N2B_RAW_DATA_SIZE && result != -ECANCELED) {
+        error = N2B_ERROR_READ_SOURCE_FILE;
+        j = batch->count;
+    } else if (op == RING_OP_READ && result > 0) {
+        batch->raw_sizes[i] = (size_t)result;
+    } else if (op == RING_OP_OPEN_TARGET && result < 0) {
+        error = N2B_ERROR_OPEN_BMP_FILE;
+    } else if (op == RING_OP_WRITE && result != -ECANCELED && (result < 0 || (size_t)result != image_size)) {
+        error = N2B_ERROR_WRITE_BMP_FILE;
+    } else if (op == RING_OP_CLOSE_TARGET && result < 0 && result != -ECANCELED && result != -EBADF) {
+        error = N2B_ERROR_WRITE_BMP_FILE;
+    } else if (op == RING_OP_WRITE && result > 0 && batch->options[0].stats != NULL) {
+        batch->options[0].stats->bytes_written += (uint64_t)result;
+    }
+
+    if (error != N2B_ERROR_NONE && job->error == N2B_ERROR_NONE) {
+        job->error = error;
+        job->failed_index = j;
+    }
+}
+#endif
+
+
+/*
+    Start building an animated GIF. The GIF is written at the scale set
+    in the options, by nearest neighbour; it can't take a target
+    resolution, and other options don't apply.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - animation: Pointer to the animation to set up.
+        - options:   Pointer to the output options.
+        - delay:     The time each screen is shown for, in hundredths of a second.
+
+    - Returns: 0 on success or an error value.
+*/
+int n2b_animation_init(N2BAnimation* animation, const N2BOptions* options, unsigned int delay) {
+
+    memset(animation, 0, sizeof(N2BAnimation));
+    if (options->scale == 0 || options->scale > N2B_SCALE_MAX) return N2B_ERROR_BAD_OPTIONS;
+    if (options->scaler != N2B_SCALER_NEAREST || options->dpi != 0 || delay > UINT16_MAX) return N2B_ERROR_BAD_OPTIONS;
+    animation->scale = options->scale;
+    animation->delay = delay;
+    return N2B_ERROR_NONE;
+}
+
+
+/*
+    Add a screen to an animation. The first screen is stored whole. After
+    that, each screen's packed rows are compared with the last screen's
+    and only the rectangle that holds the changes is stored. A screen
+    that hasn't changed just lengthens the last frame's delay.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - animation: Pointer to the animation.
+        - bitmap:    Pointer to the decoded screen, which must be the same
+                     size as the first.
+
+    - Returns: 0 on success or an error value.
+*/
+int n2b_animation_add(N2BAnimation* animation, const N2BBitmap* bitmap) {
+
+    uint32_t row_bytes = bitmap->width / 8;
+    if (bitmap->width == 0 || bitmap->width > N2B_WIDTH || bitmap->width % 8 != 0 || bitmap->height == 0) return N2B_ERROR_BAD_OPTIONS;
+
+    if (animation->frame_count == 0) {
+        animation->width = bitmap->width;
+        animation->height = bitmap->height;
+        animation->previous = malloc((size_t)row_bytes * bitmap->height);
+        if (animation->previous == NULL) return N2B_ERROR_NO_MEMORY;
+
+        // GIF header and logical screen descriptor
+        uint32_t width = bitmap->width * animation->scale;
+        uint32_t height = bitmap->height * animation->scale;
+        uint8_t header[13] = {'G', 'I', 'F', '8', '9', 'a',
+                              width & 0xFF, width >> 8, height & 0xFF, height >> 8,
+                              0x80, 0x00, 0x00};
+
+        // Two-colour global colour table, from the BMP's BGRA colours
+        uint8_t colours[6] = {BMP_CLT[2], BMP_CLT[1], BMP_CLT[0], BMP_CLT[6], BMP_CLT[5], BMP_CLT[4]};
+
+        // Application extension to loop forever
+        static const uint8_t loop[19] = {0x21, 0xFF, 0x0B, 'N', 'E', 'T', 'S', 'C', 'A', 'P', 'E', '2', '.', '0',
+                                         0x03, 0x01, 0x00, 0x00, 0x00};
+
+        if (!append_data(animation, header, sizeof(header)) || !append_data(animation, colours, sizeof(colours))
+            || !append_data(animation, loop, sizeof(loop))) return N2B_ERROR_NO_MEMORY;
+        return add_frame(animation, bitmap, 0, 0, bitmap->width, bitmap->height);
+    }
+
+    if (bitmap->width != animation->width || bitmap->height != animation->height) return N2B_ERROR_BAD_OPTIONS;
+
+    // Find the smallest rectangle covering every changed pixel
+    uint32_t left = UINT32_MAX, right = 0, top = UINT32_MAX, bottom = 0;
+    for (uint32_t row = 0 ; row < bitmap->height ; ++row) {
+        const uint8_t* current = bitmap->pixels + row * bitmap->stride;
+        const uint8_t* previous = animation->previous + row * row_bytes;
+        if (memcmp(current, previous, row_bytes) == 0) continue;
+
+        if (top == UINT32_MAX) top = row;
+        bottom = row;
+        for (uint32_t byte = 0 ; byte < row_bytes ; ++byte) {
+            unsigned int changes = current[byte] ^ previous[byte];
+            if (changes == 0) continue;
+
+            unsigned int first = 0, last = 7;
+            while (!(changes & (0x80 >> first))) first++;
+            while (!(changes & (0x80 >> last))) last--;
+            if (byte * 8 + first < left) left = byte * 8 + first;
+            if (byte * 8 + last > right) right = byte * 8 + last;
+        }
+    }
+
+    if (top == UINT32_MAX) {
+        // No change, so show the last frame for longer
+        uint8_t* delay = animation->data + animation->delay_offset;
+        unsigned int total = (delay[0] | (delay[1] << 8)) + animation->delay;
+        if (total > UINT16_MAX) total = UINT16_MAX;
+        delay[0] = total & 0xFF;
+        delay[1] = total >> 8;
+        return N2B_ERROR_NONE;
+    }
+
+    return add_frame(animation, bitmap, left, top, right - left + 1, bottom - top + 1);
+}
+
+
+/*
+    Complete an animated GIF.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - animation: Pointer to the animation.
+        - data:      Pointer to a variable set to the GIF data, which
+                     remains owned by the animation.
+        - size:      Pointer to a variable set to the size of the GIF.
+
+    - Returns: 0 on success or an error value.
+*/
+int n2b_animation_finish(N2BAnimation* animation, const uint8_t** data, size_t* size) {
+
+    if (animation->frame_count == 0) return N2B_ERROR_BAD_OPTIONS;
+
+    static const uint8_t trailer = 0x3B;
+    if (!append_data(animation, &trailer, 1)) return N2B_ERROR_NO_MEMORY;
+    *data = animation->data;
+    *size = animation->size;
+    return N2B_ERROR_NONE;
+}
+
+
+/*
+    Release an animation's memory.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - animation: Pointer to the animation.
+*/
+void n2b_animation_free(N2BAnimation* animation) {
+
+    free(animation->previous);
+    free(animation->data);
+    animation->previous = NULL;
+    animation->data = NULL;
+    animation->size = 0;
+    animation->capacity = 0;
+}
+
+
+/*
+    Convert a series of screenshot files, in order, to the frames of
+    an animated GIF file.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - inpaths:      Pointer to the list of source file paths, any of which may be `-`.
+        - count:        The number of paths in the list.
+        - outpath:      Pointer to the path to the destination file, or `-` for stdout.
+        - options:      Pointer to the output options.
+        - delay:        The time each screen is shown for, in hundredths of a second.
+        - failed_index: Pointer to a variable set to the index of the path
+                        that failed, or `count` if the GIF could not be made.
+
+    - Returns: 0 on success or an error value.
+*/
+int n2b_animate_files(const char* const* inpaths, size_t count, const char* outpath, const N2BOptions* options, unsigned int delay, size_t* failed_index) {
+
+    *failed_index = count;
+    N2BAnimation animation;
+    int error = n2b_animation_init(&animation, options, delay);
+    if (error != N2B_ERROR_NONE) return error;
+
+    uint8_t buffer[N2B_SOURCE_SIZE_MAX];
+    for (size_t i = 0 ; i < count ; ++i) {
+        const uint8_t* original = NULL;
+        size_t size = 0;
+        void* mapping = NULL;
+        error = read_source(inpaths[i], buffer, &original, &size, &mapping);
+        if (error == N2B_ERROR_NONE) {
+            N2BBitmap bitmap;
+            error = n2b_decode(original, size, &bitmap);
+            if (error == N2B_ERROR_NONE) error = n2b_animation_add(&animation, &bitmap);
+            release_source(mapping, size);
+        }
+
+        if (error != N2B_ERROR_NONE) {
+            *failed_index = i;
+            n2b_animation_free(&animation);
+            return error;
+        }
+    }
+
+    const uint8_t* gif = NULL;
+    size_t gif_size = 0;
+    error = n2b_animation_finish(&animation, &gif, &gif_size);
+    if (error == N2B_ERROR_NONE) error = write_target(outpath, gif, gif_size);
+    n2b_animation_free(&animation);
+    return error;
+}
+
+
+/*
+    Read the screenshot files listed in the root directory of a memory
+    card or disk dump's FAT file system, in a single sequential pass, and
+    pass each one to a handler with its name. Screenshots are the files
+    named `s`, eg. `s.a`, that are the size of one.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - inpath:  Pointer to the path to the dump, or `-` for stdin.
+        - handler: The function to call with each screen, its file name and its offset in the dump.
+        - context: Pointer passed on to the handler.
+
+    - Returns: 0 on success, the handler's value if it returned non-zero,
+               N2B_ERROR_NO_DIRECTORY if the dump doesn't start with a FAT
+               file system, or another error value.
+*/
+int n2b_walk_dump(const char* inpath, N2BScanHandler handler, void* context) {
+
+    int fd = -1;
+    uint8_t boot[FAT_BOOT_SIZE];
+    size_t boot_size = 0;
+    int error = open_dump(inpath, &fd, boot, &boot_size);
+    if (error != N2B_ERROR_NONE) return error;
+
+    FatVolume volume;
+    error = find_fat_volume(boot, boot_size, &volume) ? walk_dump(fd, &volume, boot_size, handler, context) : N2B_ERROR_NO_DIRECTORY;
+    if (fd != STDIN_FILENO) close(fd);
+    return error;
+}
+
+
+/*
+    Scan a memory card or RAM dump for screens by their layout, in a
+    single sequential pass, and pass each one found to a handler. Screens
+    that could start at more than one offset are skipped and counted.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - inpath:    Pointer to the path to the dump, or `-` for stdin.
+        - handler:   The function to call with each screen and its offset in the dump.
+        - context:   Pointer passed on to the handler.
+        - ambiguous: Pointer to a variable set to the number of screens skipped.
+
+    - Returns: 0 on success, the handler's value if it returned non-zero,
+               or an error value.
+*/
+int n2b_scan_dump(const char* inpath, N2BScanHandler handler, void* context, size_t* ambiguous) {
+
+    *ambiguous = 0;
+    int fd = -1;
+    uint8_t boot[FAT_BOOT_SIZE];
+    size_t boot_size = 0;
+    int error = open_dump(inpath, &fd, boot, &boot_size);
+    if (error != N2B_ERROR_NONE) return error;
+
+    error = scan_dump(fd, boot, boot_size, handler, context, ambiguous);
+    if (fd != STDIN_FILENO) close(fd);
+    return error;
+}
+
+
+/*
+    Convert every screenshot in a memory card or disk dump to a file,
+    without writing the screenshots out first. If the dump has a FAT file
+    system, its `s.*` files are converted, each named after its file, eg.
+    `s.a.bmp`. Otherwise, only if asked to, the dump is scanned for screens
+    by their layout, each named after the dump and the screen's offset in
+    it, eg. `card-0001a0c0.bmp`.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - inpath:    Pointer to the path to the dump, or `-` for stdin.
+        - outdir:    Pointer to the path to the directory to write the files to.
+        - options:   Pointer to the output options.
+        - scan:      Whether to scan a dump with no file system.
+        - count:     Pointer to a variable set to the number of screens written.
+        - ambiguous: Pointer to a variable set to the number of screens a scan skipped.
+
+    - Returns: 0 on success, N2B_ERROR_NO_DIRECTORY if the dump has no file
+               system to walk and `scan` isn't set, or another error value.
+*/
+int n2b_extract_dump(const char* inpath, const char* outdir, const N2BOptions* options, bool scan, size_t* count, size_t* ambiguous) {
+
+    *count = 0;
+    *ambiguous = 0;
+
+    // Images are written one at a time, so one buffer serves them all
+    uint8_t blank[N2B_RAW_DATA_SIZE] = {0};
+    N2BBitmap bitmap;
+    n2b_decode(blank, N2B_RAW_DATA_SIZE, &bitmap);
+    unsigned int depth = 0;
+    int error = check_options(&bitmap, options, &depth);
+    if (error != N2B_ERROR_NONE) return error;
+
+    // Name scanned screens' files after the dump, less its directory and extension
+    char name[NAME_MAX + 1] = "dump";
+    if (strcmp(inpath, "-") != 0) {
+        const char* file_name = strrchr(inpath, '/');
+        file_name = file_name != NULL ? file_name + 1 : inpath;
+        snprintf(name, sizeof(name), "%s", file_name);
+        char* extension = strrchr(name, '.');
+        if (extension != NULL && extension != name) *extension = '\0';
+    }
+
+    int fd = -1;
+    uint8_t boot[FAT_BOOT_SIZE];
+    size_t boot_size = 0;
+    error = open_dump(inpath, &fd, boot, &boot_size);
+    if (error != N2B_ERROR_NONE) return error;
+
+    DumpTarget target = {
+        .outdir = outdir,
+        .name = name,
+        .options = options,
+        .size = SINK_BUFFER_SIZE,
+        .count = 0
+    };
+
+    target.data = malloc(target.size);
+    FatVolume volume;
+    if (target.data == NULL) {
+        error = N2B_ERROR_NO_MEMORY;
+    } else if (find_fat_volume(boot, boot_size, &volume)) {
+        error = walk_dump(fd, &volume, boot_size, extract_screen, &target);
+    } else if (scan) {
+        error = scan_dump(fd, boot, boot_size, extract_screen, &target, ambiguous);
+    } else {
+        error = N2B_ERROR_NO_DIRECTORY;
+    }
+
+    free(target.data);
+    if (fd != STDIN_FILENO) close(fd);
+    *count = target.count;
+    return error;
+}
+
+
+/*
+    Turn a BMP or PNG image into a raw NC100 screenshot, eg. to put a
+    picture on the screen. The image is resized to fit the screen, keeping
+    its shape, by averaging the pixels each screen pixel covers, and is
+    centred on white. The grey levels are then made black and white by
+    a threshold, an ordered dither or Floyd-Steinberg error diffusion.
+
+    BMPs can be 1, 4, 8, 16, 24 or 32bpp, and run-length encoded; PNGs
+    can be of any type, but not interlaced. Transparent areas are white.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - image:      Pointer to the image file data.
+        - image_size: The number of bytes of image data.
+        - dither:     How to dither: N2B_DITHER_NONE, N2B_DITHER_ORDERED
+                      or N2B_DITHER_FLOYD_STEINBERG.
+        - raw:        Pointer to a N2B_RAW_DATA_SIZE buffer for the screenshot.
+
+    - Returns: 0 on success or an error value.
+*/
+int n2b_import(const uint8_t* image, size_t image_size, unsigned int dither, uint8_t* raw) {
+
+    if (dither >= N2B_DITHER_COUNT) return N2B_ERROR_BAD_OPTIONS;
+
+    ImportImage source;
+    bool is_bmp = image_size >= 2 && image[0] == 'B' && image[1] == 'M';
+    int error = is_bmp ? open_bmp(image, image_size, &source) : open_png(image, image_size, &source);
+    if (error != N2B_ERROR_NONE) return error;
+
+    uint8_t screen[N2B_WIDTH * N2B_HEIGHT];
+    bool fitted = fit_to_screen(&source, screen);
+    free(source.owned);
+    if (!fitted) return N2B_ERROR_NO_MEMORY;
+
+    dither_screen(screen, dither, raw);
+    return N2B_ERROR_NONE;
+}
+
+
+/*
+    Turn a BMP or PNG image file into a raw NC100 screenshot file, as
+    `n2b_import()` does.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - inpath:  Pointer to the path to the image, or `-` for stdin.
+        - outpath: Pointer to the path to the screenshot, or `-` for stdout.
+        - dither:  How to dither, eg. N2B_DITHER_FLOYD_STEINBERG.
+
+    - Returns: 0 on success or an error value.
+*/
+int n2b_import_file(const char* inpath, const char* outpath, unsigned int dither) {
+
+    uint8_t* data = NULL;
+    size_t size = 0;
+    bool mapped = false;
+    int error = read_image_file(inpath, &data, &size, &mapped);
+    if (error != N2B_ERROR_NONE) return error;
+
+    uint8_t raw[N2B_RAW_DATA_SIZE];
+    error = n2b_import(data, size, dither, raw);
+    if (mapped) {
+        munmap(data, size);
+    } else {
+        free(data);
+    }
+
+    if (error == N2B_ERROR_NONE) error = write_target(outpath, raw, N2B_RAW_DATA_SIZE);
+    return error;
+}
+
+
+/*
+    Get a font ready for reading text from its glyphs, as dumped from
+    ROM: eight bytes per character, in code order from 0, a byte per row
+    of pixels, top row first. The six pixels of each row are in either
+    the top six bits or the bottom six, whichever the glyphs leave
+    clear the other two of; a set bit is ink.
+
+    The glyphs are hashed for `n2b_read_text()`. Control characters
+    aren't text, so their glyphs are left out, and where characters look
+    the same, the one with the lower code is read.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - font: Pointer to the font to set up.
+        - data: Pointer to the glyph data.
+        - size: The number of bytes of glyph data, up to
+                N2B_GLYPH_COUNT_MAX glyphs of eight bytes.
+
+    - Returns: 0 on success or an error value.
+*/
+int n2b_font_init(N2BFont* font, const uint8_t* data, size_t size) {
+
+    if (size == 0 || size % FONT_ROW_SIZE != 0 || size > N2B_GLYPH_COUNT_MAX * FONT_ROW_SIZE) return N2B_ERROR_BAD_FONT;
+
+    unsigned int used = 0;
+    for (size_t i = 0 ; i < size ; ++i) used |= data[i];
+    unsigned int shift = 0;
+    if ((used & 0x03) == 0) {
+        shift = 2;
+    } else if ((used & 0xC0) != 0) {
+        return N2B_ERROR_BAD_FONT;
+    }
+
+    for (unsigned int i = 0 ; i < N2B_FONT_TABLE_SIZE ; ++i) font->glyphs[i] = FONT_SLOT_EMPTY;
+    memset(font->codes, 0, sizeof(font->codes));
+
+    size_t count = size / FONT_ROW_SIZE;
+    for (size_t code = 0 ; code < count ; ++code) {
+        if (code < ' ' || code == 0x7F) continue;
+
+        uint64_t glyph = 0;
+        for (unsigned int row = 0 ; row < N2B_GLYPH_HEIGHT ; ++row) {
+            glyph = (glyph << N2B_GLYPH_WIDTH) | ((data[code * FONT_ROW_SIZE + row] >> shift) & 0x3F);
+        }
+
+        // The table is twice the size of the largest font, so always has a free slot
+        uint32_t slot = glyph_slot(glyph);
+        while (font->glyphs[slot] != FONT_SLOT_EMPTY && font->glyphs[slot] != glyph) slot = (slot + 1) & (N2B_FONT_TABLE_SIZE - 1);
+        if (font->glyphs[slot] == glyph) continue;
+        font->glyphs[slot] = glyph;
+        font->codes[slot] = (uint8_t)code;
+    }
+
+    return N2B_ERROR_NONE;
+}
+
+
+/*
+    Get a font ready for reading text from a ROM font dump file, as
+    `n2b_font_init()` does.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - font: Pointer to the font to set up.
+        - path: Pointer to the path to the font file, or `-` for stdin.
+
+    - Returns: 0 on success or an error value.
+*/
+int n2b_font_load(N2BFont* font, const char* path) {
+
+    uint8_t* data = NULL;
+    size_t size = 0;
+    bool mapped = false;
+    int error = read_image_file(path, &data, &size, &mapped);
+    if (error != N2B_ERROR_NONE) return error;
+
+    error = n2b_font_init(font, data, size);
+    if (mapped) {
+        munmap(data, size);
+    } else {
+        free(data);
+    }
+
+    return error;
+}
+
+
+/*
+    Read the text on a screen. Every cell of a row of text is gathered
+    at once, a pixel row at a time: three bytes hold four cells' rows, so
+    each cell takes six bits per row and no pixel is handled on its own.
+    Each cell is then looked up in the font, and if it isn't there, looked
+    up again inverted, as highlighted text is drawn in inverse video.
+
+    Each row of text becomes a line, ending in a newline, without its
+    trailing spaces. Cells matching no glyph read as N2B_TEXT_UNKNOWN.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - bitmap:    Pointer to the screen.
+        - font:      Pointer to the font, set up by `n2b_font_init()`.
+        - text:      Pointer to the buffer for the text.
+        - text_size: The size of the buffer: N2B_TEXT_SIZE_MAX will always
+                     do for an NC100 or NC200 screen.
+        - written:   Pointer to a variable set to the length of the text.
+
+    - Returns: 0 on success or an error value.
+*/
+int n2b_read_text(const N2BBitmap* bitmap, const N2BFont* font, char* text, size_t text_size, size_t* written) {
+
+    uint32_t columns = bitmap->width / N2B_GLYPH_WIDTH;
+    uint32_t rows = bitmap->height / N2B_GLYPH_HEIGHT;
+    if (columns > TEXT_COLUMNS_MAX) return N2B_ERROR_BAD_OPTIONS;
+    if (text_size < (size_t)rows * (columns + 1)) return N2B_ERROR_BUFFER_TOO_SMALL;
+
+    uint64_t cells[TEXT_COLUMNS_MAX];
+    size_t length = 0;
+    for (uint32_t row = 0 ; row < rows ; ++row) {
+        read_cells(bitmap, row, columns, cells);
+        size_t line_end = length;
+        for (uint32_t column = 0 ; column < columns ; ++column) {
+            int code = find_glyph(font, cells[column]);
+            if (code < 0) code = find_glyph(font, cells[column] ^ GLYPH_MASK);
+            if (code < 0) code = N2B_TEXT_UNKNOWN;
+            text[length++] = (char)code;
+            if (code != ' ') line_end = length;
+        }
+
+        length = line_end;
+        text[length++] = '\n';
+    }
+
+    *written = length;
+    return N2B_ERROR_NONE;
+}
+
+
+/*
+    Read the text on a screenshot file into a text file, as
+    `n2b_read_text()` does.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - inpath:  Pointer to the path to the screenshot, or `-` for stdin.
+        - outpath: Pointer to the path to the text file, or `-` for stdout.
+        - font:    Pointer to the font, set up by `n2b_font_init()`.
+
+    - Returns: 0 on success or an error value.
+*/
+int n2b_text_file(const char* inpath, const char* outpath, const N2BFont* font) {
+
+    uint8_t buffer[N2B_SOURCE_SIZE_MAX];
+    const uint8_t* raw = NULL;
+    size_t size = 0;
+    void* mapping = NULL;
+    int error = read_source(inpath, buffer, &raw, &size, &mapping);
+    if (error != N2B_ERROR_NONE) return error;
+
+    N2BBitmap bitmap;
+    char text[N2B_TEXT_SIZE_MAX];
+    size_t length = 0;
+    error = n2b_decode(raw, size, &bitmap);
+    if (error == N2B_ERROR_NONE) error = n2b_read_text(&bitmap, font, text, sizeof(text), &length);
+    release_source(mapping, size);
+
+    if (error == N2B_ERROR_NONE) error = write_target(outpath, (const uint8_t*)text, length);
+    return error;
+}
+
+
+/*
+    Receive a screenshot sent by XMODEM. The receiver asks for XMODEM-CRC
+    first, and settles for the original checksums if the sender doesn't
+    answer. 1KB blocks are taken too, in case the sender uses them.
+
+    Each block goes straight into the screenshot, and is acknowledged
+    before anything else is done with it. XMODEM pads the last block, so
+    an NC100 screen can't be told from the first half of an NC200 one
+    until the sender ends the transfer. Then the received length, less
+    the padding, must be a screenshot's, with or without a +3DOS header,
+    and the handler gets the screenshot and its size. A transfer that
+    runs on past the largest screenshot is cancelled.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - fd:      The descriptor to receive on, eg. of a serial port.
+        - raw:     Pointer to the N2B_SOURCE_SIZE_MAX buffer for the screenshot.
+        - handler: Function to call with the screenshot once it has arrived, or NULL.
+        - context: Pointer passed on to the handler.
+
+    - Returns: 0 on success, N2B_ERROR_READ_SOURCE_FILE if the transfer ended
+               without a whole screen, N2B_ERROR_BAD_SIZE if more or other
+               than a screenshot was sent, the handler's error, or another
+               error value.
+*/
+int n2b_receive_xmodem(int fd, uint8_t* raw, N2BReceiveHandler handler, void* context) {
+
+    // Block number, its complement, the data and a CRC or checksum
+    uint8_t block[XMODEM_LONG_BLOCK_SIZE + 4];
+    uint8_t expected = 1;
+    size_t received = 0;
+    size_t last_size = XMODEM_BLOCK_SIZE;
+    unsigned int tries = 0;
+    bool use_crc = true;
+    bool started = false;
+
+    if (!xmodem_send(fd, XMODEM_CRC)) return N2B_ERROR_TRANSFER;
+    while (1) {
+        int start = xmodem_read_byte(fd, started ? XMODEM_BLOCK_TIMEOUT : XMODEM_START_TIMEOUT);
+        if (start == XMODEM_LINE_FAILED) return N2B_ERROR_TRANSFER;
+        if (start == XMODEM_TIMED_OUT) {
+            if (++tries > XMODEM_TRIES_MAX) {
+                xmodem_cancel(fd);
+                return N2B_ERROR_TRANSFER;
+            }
+
+            // Keep asking for CRCs for a while; a sender that ignores
+            // them wants checksums
+            if (!started && tries == XMODEM_CRC_TRIES) use_crc = false;
+            if (!xmodem_send(fd, !started && use_crc ? XMODEM_CRC : XMODEM_NAK)) return N2B_ERROR_TRANSFER;
+            continue;
+        }
+
+        if (start == XMODEM_EOT) {
+            xmodem_send(fd, XMODEM_ACK);
+            break;
+        }
+
+        if (start == XMODEM_CAN) {
+            if (xmodem_read_byte(fd, XMODEM_BYTE_TIMEOUT) == XMODEM_CAN) return N2B_ERROR_TRANSFER;
+            continue;
+        }
+
+        // Anything else between blocks is line noise
+        if (start != XMODEM_SOH && start != XMODEM_STX) continue;
+
+        started = true;
+        size_t size = start == XMODEM_STX ? XMODEM_LONG_BLOCK_SIZE : XMODEM_BLOCK_SIZE;
+        if (!xmodem_read(fd, block, size + (use_crc ? 4 : 3), XMODEM_BYTE_TIMEOUT)
+            || (uint8_t)(block[0] + block[1]) != 0xFF || !xmodem_check(block + 2, size, use_crc)) {
+            xmodem_purge(fd);
+            if (++tries > XMODEM_TRIES_MAX) {
+                xmodem_cancel(fd);
+                return N2B_ERROR_TRANSFER;
+            }
+
+            if (!xmodem_send(fd, XMODEM_NAK)) return N2B_ERROR_TRANSFER;
+            continue;
+        }
+
+        tries = 0;
+
+        // A block sent again because its ACK was lost is already stored
+        if (block[0] == (uint8_t)(expected - 1)) {
+            if (!xmodem_send(fd, XMODEM_ACK)) return N2B_ERROR_TRANSFER;
+            continue;
+        }
+
+        if (block[0] != expected) {
+            xmodem_cancel(fd);
+            return N2B_ERROR_TRANSFER;
+        }
+
+        // Only the last block may hold padding, so one that starts past
+        // the largest screenshot can't be part of one
+        if (received >= N2B_SOURCE_SIZE_MAX) {
+            xmodem_cancel(fd);
+            return N2B_ERROR_BAD_SIZE;
+        }
+
+        size_t wanted = N2B_SOURCE_SIZE_MAX - received;
+        memcpy(raw + received, block + 2, size < wanted ? size : wanted);
+        received += size;
+        last_size = size;
+        expected++;
+        if (!xmodem_send(fd, XMODEM_ACK)) return N2B_ERROR_TRANSFER;
+    }
+
+    if (received < N2B_RAW_DATA_SIZE) return N2B_ERROR_READ_SOURCE_FILE;
+    size_t raw_size = xmodem_screenshot_size(raw, received, last_size);
+    if (raw_size == 0) return N2B_ERROR_BAD_SIZE;
+    if (raw_size > received) return N2B_ERROR_READ_SOURCE_FILE;
+    return handler != NULL ? handler(raw, raw_size, context) : N2B_ERROR_NONE;
+}
+
+
+/*
+    Trim a BMP and PNG cache directory to a maximum size by removing the least
+    recently used entries. Cache hits mark entries as used, so this is
+    an approximate LRU order based on modification times. Temporary
+    files left by interrupted conversions are removed too.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - cache_dir: Pointer to the path to the cache directory.
+        - size_max:  The number of bytes of images to keep at most.
+
+    - Returns: 0 on success or an error value.
+*/
+int n2b_cache_trim(const char* cache_dir, uint64_t size_max) {
+
+    DIR* dir = opendir(cache_dir);
+    if (dir == NULL) return N2B_ERROR_OPEN_CACHE;
+
+    CacheEntry* entries = NULL;
+    size_t entry_count = 0;
+    size_t entry_capacity = 0;
+    uint64_t total_size = 0;
+    time_t now = time(NULL);
+    char path[PATH_MAX];
+    struct dirent* item;
+    while ((item = readdir(dir)) != NULL) {
+        if (snprintf(path, sizeof(path), "%s/%s", cache_dir, item->d_name) >= (int)sizeof(path)) continue;
+        struct stat file_info;
+        if (lstat(path, &file_info) != 0 || !S_ISREG(file_info.st_mode)) continue;
+
+        if (strncmp(item->d_name, CACHE_TEMP_PREFIX, strlen(CACHE_TEMP_PREFIX)) == 0) {
+            if (now - file_info.st_mtime > CACHE_TEMP_AGE_MAX) unlink(path);
+            continue;
+        }
+
+        // Only count files with cache entry names
+        if (strlen(item->d_name) != CACHE_KEY_LENGTH + 4 || item->d_name[CACHE_KEY_LENGTH] != '.') continue;
+        if (entry_count == entry_capacity) {
+            entry_capacity = entry_capacity == 0 ? 256 : entry_capacity * 2;
+            CacheEntry* more = realloc(entries, entry_capacity * sizeof(CacheEntry));
+            if (more == NULL) {
+                free(entries);
+                closedir(dir);
+                return N2B_ERROR_NO_MEMORY;
+            }
+
+            entries = more;
+        }
+
+        strcpy(entries[entry_count].name, item->d_name);
+        entries[entry_count].mtime = file_info.st_mtime;
+        entries[entry_count].size = (uint64_t)file_info.st_size;
+        total_size += entries[entry_count].size;
+        entry_count++;
+    }
+
+    closedir(dir);
+
+    // Remove the oldest entries first
+    if (total_size > size_max) {
+        qsort(entries, entry_count, sizeof(CacheEntry), compare_cache_entries);
+        for (size_t i = 0 ; i < entry_count && total_size > size_max ; ++i) {
+            snprintf(path, sizeof(path), "%s/%s", cache_dir, entries[i].name);
+            if (unlink(path) == 0) total_size -= entries[i].size;
+        }
+    }
+
+    free(entries);
+    return N2B_ERROR_NONE;
+}
+
+
+/*
+    Clear a stats record.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - stats: Pointer to the stats to clear.
+*/
+void n2b_stats_init(N2BStats* stats) {
+
+    memset(stats, 0, sizeof(N2BStats));
+}
+
+
+/*
+    Add one stats record into another, eg. to total those kept by
+    separate threads.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - total: Pointer to the stats to add to.
+        - part:  Pointer to the stats to add.
+*/
+void n2b_stats_merge(N2BStats* total, const N2BStats* part) {
+
+    for (unsigned int i = 0 ; i < N2B_STAGE_COUNT ; ++i) {
+        total->wall_ns[i] += part->wall_ns[i];
+        total->cpu_ns[i] += part->cpu_ns[i];
+    }
+
+    total->bytes_read += part->bytes_read;
+    total->bytes_written += part->bytes_written;
+    total->files += part->files;
+    total->failures += part->failures;
+    total->cache_hits += part->cache_hits;
+}
+
+
+/*
+    Get the name of a conversion stage, for reports.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - stage: A stage index, eg. `N2B_STAGE_READ`.
+
+    - Returns: The stage's name, or `unknown`.
+*/
+const char* n2b_stage_name(unsigned int stage) {
+
+    static const char* names[N2B_STAGE_COUNT] = {"read", "decode", "scale", "header", "write"};
+    return stage < N2B_STAGE_COUNT ? names[stage] : "unknown";
+}
+
+
+/*
+    PRIVATE FUNCTIONS
+*/
+
+/*
+    Check conversion options, and resolve the default bit depth.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - bitmap:  Pointer to the decoded screen.
+        - options: Pointer to the output options.
+        - depth:   Pointer to a variable set to the bit depth to use.
+
+    - Returns: 0 if the options are valid, otherwise an error value.
+*/
+static int check_options(const N2BBitmap* bitmap, const N2BOptions* options, unsigned int* depth) {
+
+    if (options->scale == 0 || options->scale > N2B_SCALE_MAX) return N2B_ERROR_BAD_OPTIONS;
+
+    // A target resolution sets the scale, so can't be used with edge-aware scalers
+    if (options->dpi != 0 && (options->dpi < N2B_DPI_NATIVE || options->dpi > N2B_DPI_MAX)) return N2B_ERROR_BAD_OPTIONS;
+    if (options->dpi != 0 && options->scaler != N2B_SCALER_NEAREST) return N2B_ERROR_BAD_OPTIONS;
+
+    // Edge-aware scalers work at their own scale only
+    if (options->scaler >= N2B_SCALER_COUNT) return N2B_ERROR_BAD_OPTIONS;
+    if (options->scaler == N2B_SCALER_SCALE2X && options->scale != 2) return N2B_ERROR_BAD_OPTIONS;
+    if (options->scaler == N2B_SCALER_SCALE3X && options->scale != 3) return N2B_ERROR_BAD_OPTIONS;
+    if (bitmap->width == 0 || bitmap->width > N2B_WIDTH || bitmap->width % 8 != 0) return N2B_ERROR_BAD_OPTIONS;
+
+    bool scaled = options->dpi != 0 ? options->dpi > N2B_DPI_NATIVE : options->scale > 1;
+    *depth = options->depth;
+    if (*depth == 0) *depth = (scaled || options->compress) ? 8 : 1;
+    if (*depth != 1 && *depth != 4 && *depth != 8) return N2B_ERROR_BAD_OPTIONS;
+
+    // BMP only supports run-length encoding of 4bpp and 8bpp images
+    if (options->compress && *depth == 1) return N2B_ERROR_BAD_OPTIONS;
+
+    // Formats other than BMP are always 1bpp, and compressed their own way
+    if (options->format >= N2B_FORMAT_COUNT) return N2B_ERROR_BAD_OPTIONS;
+    if (FORMAT_BACKENDS[options->format].one_bit) {
+        if (options->compress || (options->depth != 0 && options->depth != 1)) return N2B_ERROR_BAD_OPTIONS;
+        *depth = 1;
+    }
+
+    return N2B_ERROR_NONE;
+}
+
+
+/*
+    Build the expansion tables for the common scales, 1x and 3x, at
+    every supported bit depth.
+
+    FROM 0.5.0
+*/
+static void build_expansion_tables(void) {
+
+    for (unsigned int f = 0 ; f < 2 ; ++f) {
+        unsigned int factor = f == 0 ? 1 : N2B_SCALE_FACTOR;
+        for (unsigned int d = 0 ; d < 3 ; ++d) fill_expansion_table(EXPANSION_TABLES[f][d], factor, DEPTHS[d]);
+    }
+}
+
+
+/*
+    Fill an expansion table: the packed output for each of the 256
+    possible 1bpp source bytes. Each source pixel is repeated across
+    `factor` output pixels, each of which takes `depth` bits, most
+    significant first.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - table:  Pointer to the table, of 256 times `factor * depth` bytes.
+        - factor: The scale factor.
+        - depth:  The number of bits per output pixel: 1, 4 or 8.
+*/
+static void fill_expansion_table(uint8_t* table, unsigned int factor, unsigned int depth) {
+
+    unsigned int entry_size = factor * depth;
+    for (unsigned int byte = 0 ; byte < 256 ; ++byte) {
+        uint8_t* entry = table + byte * entry_size;
+        memset(entry, 0, entry_size);
+        for (unsigned int i = 0 ; i < 8 * factor ; ++i) {
+            unsigned int pixel = (byte >> (7 - (i / factor))) & 0x01;
+            unsigned int bit = i * depth;
+            entry[bit / 8] |= pixel << (8 - depth - (bit % 8));
+        }
+    }
+}
+
+
+/*
+    Get the expansion table for a scale and bit depth. The common scales
+    share tables built once; others get a table of their own, which at
+    most takes 256 x N2B_SCALE_MAX bytes per bit of depth.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - expander: Pointer to the expander to set up.
+        - factor:   The scale factor, 1 to N2B_SCALE_MAX.
+        - depth:    The number of bits per output pixel: 1, 4 or 8.
+
+    - Returns: `true` on success, or `false` if out of memory.
+*/
+static bool expander_init(Expander* expander, unsigned int factor, unsigned int depth) {
+
+    expander->entry_size = factor * depth;
+    expander->owned = NULL;
+    expander->repeats = NULL;
+    if (factor == 1 || factor == N2B_SCALE_FACTOR) {
+        pthread_once(&expansion_tables_once, build_expansion_tables);
+        expander->entries = EXPANSION_TABLES[factor == 1 ? 0 : 1][depth == 1 ? 0 : (depth == 4 ? 1 : 2)];
+        return true;
+    }
+
+    expander->owned = malloc(256 * expander->entry_size);
+    if (expander->owned == NULL) return false;
+    fill_expansion_table(expander->owned, factor, depth);
+    expander->entries = expander->owned;
+    return true;
+}
+
+
+/*
+    Release an expander's table, if it was built for it.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - expander: Pointer to the expander.
+*/
+static void expander_free(Expander* expander) {
+
+    free(expander->owned);
+    expander->owned = NULL;
+}
+
+
+/*
+    Set up the expander for a job's scale and a bit depth. Even scales
+    use an expansion table; uneven ones get the number of times to repeat
+    each source pixel across, which at most takes N2B_WIDTH bytes.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - expander: Pointer to the expander to set up.
+        - job:      Pointer to the bitmap and its settings.
+        - depth:    The number of bits per output pixel: 1, 4 or 8.
+
+    - Returns: `true` on success, or `false` if out of memory.
+*/
+static bool expander_init_for_job(Expander* expander, const EncodeJob* job, unsigned int depth) {
+
+    expander->repeats = NULL;
+    expander->depth = depth;
+    expander->width = job->width;
+    if (job->even) return expander_init(expander, job->factor, depth);
+
+    const N2BBitmap* bitmap = job->bitmap;
+    expander->entries = NULL;
+    expander->entry_size = 0;
+    expander->owned = malloc(bitmap->width);
+    if (expander->owned == NULL) return false;
+    for (uint32_t col = 0 ; col < bitmap->width ; ++col) {
+        expander->owned[col] = (uint8_t)(scaled_start(col + 1, bitmap->width, job->width) - scaled_start(col, bitmap->width, job->width));
+    }
+
+    expander->repeats = expander->owned;
+    return true;
+}
+
+
+/*
+    Expand one row of 1bpp source data, copying whole entries from an
+    expansion table. Each common entry size gets its own loop, so the
+    copies are inlined rather than calls to `memcpy()`, and 1x 1bpp rows,
+    which need no expansion, are copied in one go.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - source:     Pointer to the row's 1bpp pixel data.
+        - length:     The number of bytes in the source row.
+        - target:     Pointer to the row's output.
+        - table:      Pointer to the expansion table to use.
+        - entry_size: The number of output bytes per source byte.
+*/
+static void expand_row(const uint8_t* source, uint32_t length, uint8_t* target, const uint8_t* table, unsigned int entry_size) {
+
+    #define EXPAND_ROW_WITH_ENTRY_SIZE(size) \
+        for (uint32_t col = 0 ; col < length ; ++col) { \
+            memcpy(target, table + source[col] * (size), size); \
+            target += size; \
+        }
+
+    switch(entry_size) {
+        case 1:
+            memcpy(target, source, length);
+            break;
+        case 3:
+            EXPAND_ROW_WITH_ENTRY_SIZE(3)
+            break;
+        case 4:
+            EXPAND_ROW_WITH_ENTRY_SIZE(4)
+            break;
+        case 8:
+            EXPAND_ROW_WITH_ENTRY_SIZE(8)
+            break;
+        case 12:
+            EXPAND_ROW_WITH_ENTRY_SIZE(12)
+            break;
+        case 24:
+            EXPAND_ROW_WITH_ENTRY_SIZE(24)
+            break;
+        default:
+            EXPAND_ROW_WITH_ENTRY_SIZE(entry_size)
+    }
+
+    #undef EXPAND_ROW_WITH_ENTRY_SIZE
+}
+
+
+/*
+    Expand one row of 1bpp source data, repeating each pixel its own
+    number of times, as when scaling to a resolution that isn't a whole
+    multiple of the screen's. The row is cleared, then each black pixel's
+    run is filled in: a byte at a time at 8bpp, otherwise a pixel at a
+    time. Only source rows are expanded, so this needn't be fast.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - source:  Pointer to the row's 1bpp pixel data.
+        - length:  The number of bytes in the source row.
+        - target:  Pointer to the row's output.
+        - repeats: Pointer to the number of times to repeat each source pixel.
+        - depth:   The number of bits per output pixel: 1, 4 or 8.
+        - width:   The number of pixels in the output row.
+*/
+static void expand_row_unevenly(const uint8_t* source, uint32_t length, uint8_t* target, const uint8_t* repeats, unsigned int depth, uint32_t width) {
+
+    memset(target, 0, ((size_t)width * depth + 7) / 8);
+    uint32_t x = 0;
+    for (uint32_t i = 0 ; i < length * 8 ; ++i) {
+        unsigned int repeat = repeats[i];
+        if ((source[i / 8] >> (7 - (i % 8))) & 0x01) {
+            if (depth == 8) {
+                memset(target + x, 1, repeat);
+            } else {
+                for (uint32_t bit = x * depth ; bit < (x + repeat) * depth ; bit += depth) target[bit / 8] |= 1 << (8 - depth - (bit % 8));
+            }
+        }
+
+        x += repeat;
+    }
+}
+
+
+/*
+    Expand one row of 1bpp source data with an expander, by table or
+    by uneven repeats.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - expander: Pointer to the expander.
+        - source:   Pointer to the row's 1bpp pixel data.
+        - length:   The number of bytes in the source row.
+        - target:   Pointer to the row's output.
+*/
+static void expand(const Expander* expander, const uint8_t* source, uint32_t length, uint8_t* target) {
+
+    if (expander->repeats != NULL) {
+        expand_row_unevenly(source, length, target, expander->repeats, expander->depth, expander->width);
+    } else {
+        expand_row(source, length, target, expander->entries, expander->entry_size);
+    }
+}
+
+
+/*
+    Set the size of a job's output image, and how many times its pixels
+    are repeated to fill it. A target resolution that's a whole multiple
+    of the screen's is just a scale; any other is met as closely as whole
+    pixels allow, repeating some source pixels one more time than others.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - job:   Pointer to the job, with its bitmap set.
+        - scale: The scale factor to use if there's no target resolution.
+        - dpi:   The target resolution, or 0 for none.
+*/
+static void size_job(EncodeJob* job, unsigned int scale, unsigned int dpi) {
+
+    const N2BBitmap* bitmap = job->bitmap;
+    if (dpi != 0 && dpi % N2B_DPI_NATIVE == 0) scale = dpi / N2B_DPI_NATIVE;
+    job->factor = scale;
+    job->even = true;
+    job->width = bitmap->width * scale;
+    job->height = bitmap->height * scale;
+    if (dpi == 0 || dpi % N2B_DPI_NATIVE == 0) return;
+
+    // Round to the nearest pixel, and note the most any pixel is repeated
+    job->even = false;
+    job->width = (bitmap->width * dpi + N2B_DPI_NATIVE / 2) / N2B_DPI_NATIVE;
+    job->height = (bitmap->height * dpi + N2B_DPI_NATIVE / 2) / N2B_DPI_NATIVE;
+    unsigned int across = (job->width + bitmap->width - 1) / bitmap->width;
+    unsigned int down = (job->height + bitmap->height - 1) / bitmap->height;
+    job->factor = across > down ? across : down;
+}
+
+
+/*
+    Find the first output pixel that nearest neighbour scaling takes from
+    a source pixel, or row: output pixel `x` shows source pixel
+    `(2x + 1) * source_size / (2 * target_size)`, the one under its centre.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - index:       The source pixel, or `source_size` for the end of the row.
+        - source_size: The number of source pixels.
+        - target_size: The number of output pixels, no fewer than the source's.
+
+    - Returns: The output pixel.
+*/
+static uint32_t scaled_start(uint32_t index, uint32_t source_size, uint32_t target_size) {
+
+    return (uint32_t)((2 * (uint64_t)index * target_size + source_size - 1) / (2 * (uint64_t)source_size));
+}
+
+
+/*
+    Get the number of times a job repeats a source row down the image.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - job: Pointer to the bitmap and its settings.
+        - row: The source row.
+
+    - Returns: The number of output rows.
+*/
+static unsigned int row_repeat(const EncodeJob* job, uint32_t row) {
+
+    if (job->even) return job->factor;
+    return scaled_start(row + 1, job->bitmap->height, job->height) - scaled_start(row, job->bitmap->height, job->height);
+}
+
+
+/*
+    Calculate the size of a BMP pixel row, which must be padded to
+    a multiple of four bytes.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - width: The image width in pixels.
+        - depth: The number of bits per pixel.
+
+    - Returns: The row size in bytes.
+*/
+static uint32_t row_stride(uint32_t width, unsigned int depth) {
+
+    return ((width * depth + 31) / 32) * 4;
+}
+
+
+/*
+    Enlarge a screen with an edge-aware pixel-art scaler, Scale2x (EPX)
+    or Scale3x, which round off diagonal edges rather than just
+    replicating pixels. Rather than look up each pixel's 3x3 neighbourhood
+    in turn, the scalers' rules are applied to 64 pixels at a time with
+    bitwise operations on a padded copy of the screen, in which the edge
+    rows and pixels are repeated. Each output sub-pixel is then a word,
+    and the tables interleave its bytes into the output rows. Output is
+    1bpp, packed like the source.
+
+        A B C
+        D E F
+        G H I
+
+    FROM 0.5.0
+
+    - Parameters:
+        - bitmap: Pointer to the decoded screen.
+        - scaler: N2B_SCALER_SCALE2X or N2B_SCALER_SCALE3X.
+        - scaled: Pointer to the bitmap to set to the enlarged screen.
+
+    - Returns: The enlarged pixels, which the caller must free, or NULL
+               if out of memory.
+*/
+static uint8_t* scale_edges(const N2BBitmap* bitmap, unsigned int scaler, N2BBitmap* scaled) {
+
+    pthread_once(&scaler_tables_once, build_scaler_tables);
+
+    unsigned int factor = scaler == N2B_SCALER_SCALE2X ? 2 : 3;
+    uint32_t length = bitmap->width / 8;
+    uint32_t stride = length * factor;
+    size_t scaled_size = (size_t)stride * bitmap->height * factor;
+
+    // Padded rows have at least one spare byte, for the right edge
+    uint32_t word_count = (length + 8) / 8;
+    uint32_t padded_stride = word_count * 8;
+    uint8_t* pixels = malloc(scaled_size + (size_t)padded_stride * (bitmap->height + 2));
+    if (pixels == NULL) return NULL;
+
+    uint8_t* padded = pixels + scaled_size;
+    for (uint32_t row = 0 ; row < bitmap->height + 2 ; ++row) {
+        uint32_t source_row = row == 0 ? 0 : (row > bitmap->height ? bitmap->height - 1 : row - 1);
+        const uint8_t* source = bitmap->pixels + source_row * bitmap->stride;
+        uint8_t* copy = padded + (size_t)row * padded_stride;
+        memcpy(copy, source, length);
+        memset(copy + length, (source[length - 1] & 0x01) ? 0xFF : 0x00, padded_stride - length);
+    }
+
+    for (uint32_t row = 0 ; row < bitmap->height ; ++row) {
+        const uint8_t* rows[3] = {
+            padded + (size_t)row * padded_stride,
+            padded + (size_t)(row + 1) * padded_stride,
+            padded + (size_t)(row + 2) * padded_stride
+        };
+
+        // The word before each row's first repeats its first pixel
+        uint64_t words[3], previous[3];
+        for (unsigned int i = 0 ; i < 3 ; ++i) {
+            words[i] = read_word(rows[i]);
+            previous[i] = words[i] >> 63;
+        }
+
+        uint8_t* target = pixels + (size_t)row * factor * stride;
+        for (uint32_t word = 0 ; word < word_count ; ++word) {
+            uint64_t left[3], right[3];
+            for (unsigned int i = 0 ; i < 3 ; ++i) {
+                uint64_t next = word + 1 < word_count ? read_word(rows[i] + (word + 1) * 8) : 0;
+                left[i] = words[i] >> 1 | previous[i] << 63;
+                right[i] = words[i] << 1 | next >> 63;
+                previous[i] = words[i];
+                words[i] = next;
+            }
+
+            uint64_t a = left[0], b = previous[0], c = right[0];
+            uint64_t d = left[1], e = previous[1], f = right[1];
+            uint64_t g = left[2], h = previous[2], i = right[2];
+
+            // The four edge conditions both scalers share: eg. the top left
+            // sub-pixel takes D's colour when D == B, B != F and D != H
+            uint64_t edges = (b ^ h) & (d ^ f);
+            uint64_t top_left = ~(d ^ b) & edges;
+            uint64_t top_right = ~(b ^ f) & edges;
+            uint64_t bottom_left = ~(d ^ h) & edges;
+            uint64_t bottom_right = ~(h ^ f) & edges;
+
+            uint32_t byte_count = length - word * 8 < 8 ? length - word * 8 : 8;
+            if (factor == 2) {
+                uint64_t e0 = e ^ (top_left & (d ^ e));
+                uint64_t e1 = e ^ (top_right & (f ^ e));
+                uint64_t e2 = e ^ (bottom_left & (d ^ e));
+                uint64_t e3 = e ^ (bottom_right & (f ^ e));
+                uint8_t* out = target + word * 16;
+                for (uint32_t byte = 0 ; byte < byte_count ; ++byte) {
+                    uint32_t top = SPREAD2_TABLE[e0 >> 56] | SPREAD2_TABLE[e1 >> 56] >> 1;
+                    uint32_t bottom = SPREAD2_TABLE[e2 >> 56] | SPREAD2_TABLE[e3 >> 56] >> 1;
+                    out[0] = (uint8_t)(top >> 8);
+                    out[1] = (uint8_t)top;
+                    out[stride] = (uint8_t)(bottom >> 8);
+                    out[stride + 1] = (uint8_t)bottom;
+                    out += 2;
+                    e0 <<= 8;
+                    e1 <<= 8;
+                    e2 <<= 8;
+                    e3 <<= 8;
+                }
+            } else {
+                uint64_t top_edge = (top_left & (e ^ c)) | (top_right & (e ^ a));
+                uint64_t left_edge = (top_left & (e ^ g)) | (bottom_left & (e ^ a));
+                uint64_t right_edge = (top_right & (e ^ i)) | (bottom_right & (e ^ c));
+                uint64_t bottom_edge = (bottom_left & (e ^ i)) | (bottom_right & (e ^ g));
+                uint64_t lines[3][3] = {
+                    { e ^ (top_left & (d ^ e)), e ^ (top_edge & (b ^ e)), e ^ (top_right & (f ^ e)) },
+                    { e ^ (left_edge & (d ^ e)), e, e ^ (right_edge & (f ^ e)) },
+                    { e ^ (bottom_left & (d ^ e)), e ^ (bottom_edge & (h ^ e)), e ^ (bottom_right & (f ^ e)) }
+                };
+
+                for (unsigned int line = 0 ; line < 3 ; ++line) {
+                    uint8_t* out = target + line * stride + word * 24;
+                    uint64_t first = lines[line][0], second = lines[line][1], third = lines[line][2];
+                    for (uint32_t byte = 0 ; byte < byte_count ; ++byte) {
+                        uint32_t bits = SPREAD3_TABLE[first >> 56] | SPREAD3_TABLE[second >> 56] >> 1 | SPREAD3_TABLE[third >> 56] >> 2;
+                        out[0] = (uint8_t)(bits >> 16);
+                        out[1] = (uint8_t)(bits >> 8);
+                        out[2] = (uint8_t)bits;
+                        out += 3;
+                        first <<= 8;
+                        second <<= 8;
+                        third <<= 8;
+                    }
+                }
+            }
+        }
+    }
+
+    scaled->width = bitmap->width * factor;
+    scaled->height = bitmap->height * factor;
+    scaled->stride = stride;
+    scaled->pixels = pixels;
+    return pixels;
+}
+
+
+/*
+    Read eight bytes of pixels as a word, leftmost pixel uppermost.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - bytes: Pointer to the pixels.
+
+    - Returns: The word.
+*/
+static inline uint64_t read_word(const uint8_t* bytes) {
+
+    uint64_t word = 0;
+    for (unsigned int i = 0 ; i < 8 ; ++i) word = word << 8 | bytes[i];
+    return word;
+}
+
+
+/*
+    Build the edge-aware scalers' tables, which space out a byte's
+    pixels so that each can be followed by its other sub-pixels.
+
+    FROM 0.5.0
+*/
+static void build_scaler_tables(void) {
+
+    for (unsigned int byte = 0 ; byte < 256 ; ++byte) {
+        uint32_t spread2 = 0, spread3 = 0;
+        for (unsigned int pixel = 0 ; pixel < 8 ; ++pixel) {
+            if (byte & (0x80 >> pixel)) {
+                spread2 |= 0x8000 >> (pixel * 2);
+                spread3 |= 0x800000 >> (pixel * 3);
+            }
+        }
+
+        SPREAD2_TABLE[byte] = (uint16_t)spread2;
+        SPREAD3_TABLE[byte] = spread3;
+    }
+}
+
+
+/*
+    Get the resolution of an image scaled by the given factor, or to
+    a target resolution, which is converted to the nearest dot per metre.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - factor: The scale factor.
+        - dpi:    The target resolution in dots per inch, or 0 for none.
+
+    - Returns: The resolution in dots per metre.
+*/
+static uint32_t dots_per_metre(unsigned int factor, unsigned int dpi) {
+
+    if (dpi != 0) return (dpi * 10000 + 127) / 254;
+    return factor == N2B_SCALE_FACTOR ? SCALED_DOTS_PER_METRE : UNSCALED_DOTS_PER_METRE * factor;
+}
+
+
+/*
+    Run-length encode one row of pixels as BMP BI_RLE8 or BI_RLE4 data.
+    Runs of three or more identical pixels are written in encoded mode;
+    pixels between them are written in absolute mode, or as one-pixel
+    runs when there are too few for absolute mode. The caller ends the
+    row with an end-of-line or end-of-bitmap marker.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - pixels: Pointer to the row's pixel values, one byte per pixel.
+        - width:  The number of pixels in the row.
+        - depth:  The number of bits per pixel: 4 or 8.
+        - target: Pointer to the output buffer.
+
+    - Returns: The number of bytes written.
+*/
+static uint32_t rle_encode_row(const uint8_t* pixels, uint32_t width, unsigned int depth, uint8_t* target) {
+
+    uint8_t* out = target;
+    uint32_t i = 0;
+
+    while (i < width) {
+        // Measure the run starting here
+        uint32_t run = 1;
+        while (i + run < width && run < 255 && pixels[i + run] == pixels[i]) run++;
+
+        if (run >= 3) {
+            *out++ = (uint8_t)run;
+            *out++ = depth == 8 ? pixels[i] : (uint8_t)((pixels[i] << 4) | pixels[i]);
+            i += run;
+            continue;
+        }
+
+        // Gather literal pixels up to the start of the next long run
+        uint32_t end = i;
+        while (end < width && end - i < 255) {
+            if (end + 2 < width && pixels[end] == pixels[end + 1] && pixels[end] == pixels[end + 2]) break;
+            end++;
+        }
+
+        uint32_t count = end - i;
+        if (count < 3) {
+            // Absolute mode needs at least three pixels
+            for (uint32_t j = i ; j < end ; ++j) {
+                *out++ = 1;
+                *out++ = depth == 8 ? pixels[j] : (uint8_t)(pixels[j] << 4);
+            }
+        } else {
+            *out++ = 0;
+            *out++ = (uint8_t)count;
+            uint32_t bytes = 0;
+            if (depth == 8) {
+                memcpy(out, &pixels[i], count);
+                bytes = count;
+            } else {
+                for (uint32_t j = 0 ; j < count ; j += 2) {
+                    uint8_t low = j + 1 < count ? pixels[i + j + 1] : 0;
+                    out[bytes++] = (uint8_t)((pixels[i + j] << 4) | low);
+                }
+            }
+
+            out += bytes;
+
+            // Absolute runs must end on a 16-bit boundary
+            if (bytes & 1) *out++ = 0;
+        }
+
+        i = end;
+    }
+
+    return (uint32_t)(out - target);
+}
+
+
+/*
+    Upscale and run-length encode one source row as BMP BI_RLE8 or
+    BI_RLE4 data, ending with an end-of-line marker. The encoded row
+    is then repeated for the other scaled rows.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - source:   Pointer to the row's 1bpp pixel data.
+        - length:   The number of bytes in the source row.
+        - width:    The number of pixels in the scaled row.
+        - expander: Pointer to the 8bpp expander for the scale.
+        - depth:    The number of bits per pixel: 4 or 8.
+        - pixels:   Pointer to a buffer for the scaled row, one byte per pixel.
+        - target:   Pointer to the encoded row, which must have room for
+                    RLE_ROW_SIZE_MAX() bytes.
+
+    - Returns: The number of bytes written.
+*/
+static uint32_t encode_rle_row(const uint8_t* source, uint32_t length, uint32_t width, const Expander* expander, unsigned int depth, uint8_t* pixels, uint8_t* target) {
+
+    expand(expander, source, length, pixels);
+    uint32_t size = rle_encode_row(pixels, width, depth, target);
+    target[size++] = 0;
+    target[size++] = 0;
+    return size;
+}
+
+
+/*
+    Write a 32-bit value into header data in BMP's little-endian order.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - data:  Pointer to the first of the value's four bytes.
+        - value: The value to write.
+*/
+static void set_header_value(uint8_t* data, uint32_t value) {
+
+    data[0] = (uint8_t)(value & 0xFF);
+    data[1] = (uint8_t)((value & 0xFF00) >> 8);
+    data[2] = (uint8_t)((value & 0xFF0000) >> 16);
+    data[3] = (uint8_t)((value & 0xFF000000) >> 24);
+}
+
+
+/*
+    Write a 16-bit value into header data in little-endian order, as
+    PCX does.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - data:  Pointer to the first of the value's two bytes.
+        - value: The value to write.
+*/
+static void set_short_value(uint8_t* data, uint32_t value) {
+
+    data[0] = (uint8_t)(value & 0xFF);
+    data[1] = (uint8_t)((value & 0xFF00) >> 8);
+}
+
+
+/*
+    Read a 32-bit value from BMP header data, in little-endian order.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - data: Pointer to the first of the value's four bytes.
+
+    - Returns: The value.
+*/
+static uint32_t get_header_value(const uint8_t* data) {
+
+    return (uint32_t)data[0] | (uint32_t)data[1] << 8 | (uint32_t)data[2] << 16 | (uint32_t)data[3] << 24;
+}
+
+
+/*
+    Read a 16-bit value in little-endian order.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - data: Pointer to the first of the value's two bytes.
+
+    - Returns: The value.
+*/
+static uint32_t get_short_value(const uint8_t* data) {
+
+    return (uint32_t)data[0] | (uint32_t)data[1] << 8;
+}
+
+
+/*
+    Encode a decoded screen with the given options and write it to a
+    file, unless the cache holds the same image, in which case that is
+    copied, or linked if asked, to the destination instead. Bytes written and cache
+    hits are added to the options' stats.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - bitmap:      Pointer to the decoded screen.
+        - outpath:     Pointer to the path to the destination file, or `-` for stdout.
+        - options:     Pointer to the output options.
+        - buffer:      Pointer to a variable holding the output buffer, which is
+                       allocated if it's NULL. The caller frees it.
+        - buffer_size: Pointer to a variable holding the buffer's size.
+
+    - Returns: 0 on success or an error value.
+*/
+static int convert_screen(const N2BBitmap* bitmap, const char* outpath, const N2BOptions* options, uint8_t** buffer, size_t* buffer_size) {
+
+    N2BStats* stats = options->stats;
+    StageTimer timer;
+    stage_start(stats, &timer);
+
+    // Reuse the image of an identical screen converted with the same options
+    char cache_path[PATH_MAX];
+    unsigned int depth = 0;
+    bool use_cache = options->cache_dir != NULL
+                  && check_options(bitmap, options, &depth) == N2B_ERROR_NONE
+                  && make_cache_path(bitmap, options, depth, cache_path, sizeof(cache_path));
+    size_t image_size = 0;
+    if (use_cache && fetch_cached(cache_path, outpath, options->cache_links, &image_size)) {
+        stage_end(stats, N2B_STAGE_WRITE, &timer);
+        if (stats != NULL) {
+            stats->cache_hits++;
+            stats->bytes_written += image_size;
+        }
+
+        return N2B_ERROR_NONE;
+    }
+
+    // The image is written out as it's encoded, through a buffer whose
+    // size doesn't depend on the scale
+    if (*buffer == NULL) {
+        *buffer = malloc(SINK_BUFFER_SIZE);
+        *buffer_size = *buffer != NULL ? SINK_BUFFER_SIZE : 0;
+        if (*buffer == NULL) return N2B_ERROR_NO_MEMORY;
+    }
+
+    // A new cache entry is copied or linked to the destination, so is
+    // encoded only once
+    stage_end(stats, N2B_STAGE_DECODE, &timer);
+    int error = N2B_ERROR_NONE;
+    if (!use_cache || !store_cached(cache_path, bitmap, options, *buffer, *buffer_size, &timer, &image_size)
+                   || !fetch_cached(cache_path, outpath, options->cache_links, NULL)) {
+        error = write_image(outpath, bitmap, options, *buffer, *buffer_size, &timer, &image_size);
+    }
+
+    stage_end(stats, N2B_STAGE_WRITE, &timer);
+    if (error == N2B_ERROR_NONE && stats != NULL) stats->bytes_written += image_size;
+    return error;
+}
+
+
+/*
+    Get a screenshot's data, up to the largest screen's and a file header's
+    worth, for `n2b_decode()` to tell its geometry from. Regular files are
+    memory-mapped, so the data is decoded straight from the page cache;
+    anything else, including stdin when the path is `-`, is read into
+    the supplied buffer.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - inpath:  Pointer to the path to the source file, or `-` for stdin.
+        - buffer:  Pointer to a N2B_SOURCE_SIZE_MAX buffer for read-in data.
+        - data:    Pointer to a variable set to the screenshot data.
+        - size:    Pointer to a variable set to the size of the data.
+        - mapping: Pointer to a variable set to the mapping, if one was made.
+
+    - Returns: 0 on success or an error value.
+*/
+static int read_source(const char* inpath, uint8_t* buffer, const uint8_t** data, size_t* size, void** mapping) {
+
+    *data = buffer;
+    *size = 0;
+    *mapping = NULL;
+
+    if (strcmp(inpath, "-") == 0) {
+        *size = fread(buffer, 1, N2B_SOURCE_SIZE_MAX, stdin);
+        return *size >= N2B_RAW_DATA_SIZE ? N2B_ERROR_NONE : N2B_ERROR_READ_SOURCE_FILE;
+    }
+
+    int fd = open(inpath, O_RDONLY);
+    if (fd == -1) return N2B_ERROR_OPEN_SOURCE_FILE;
+
+    struct stat file_info;
+    if (fstat(fd, &file_info) == 0 && S_ISREG(file_info.st_mode)) {
+        if (file_info.st_size < N2B_RAW_DATA_SIZE) {
+            close(fd);
+            return N2B_ERROR_READ_SOURCE_FILE;
+        }
+
+        size_t length = file_info.st_size < N2B_SOURCE_SIZE_MAX ? (size_t)file_info.st_size : N2B_SOURCE_SIZE_MAX;
+        void* map = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            close(fd);
+            *data = map;
+            *size = length;
+            *mapping = map;
+            return N2B_ERROR_NONE;
+        }
+    }
+
+    // Not mappable, eg. a pipe, so read it in
+    size_t count = 0;
+    while (count < N2B_SOURCE_SIZE_MAX) {
+        ssize_t result = read(fd, buffer + count, N2B_SOURCE_SIZE_MAX - count);
+        if (result <= 0) break;
+        count += result;
+    }
+
+    close(fd);
+    *size = count;
+    return count >= N2B_RAW_DATA_SIZE ? N2B_ERROR_NONE : N2B_ERROR_READ_SOURCE_FILE;
+}
+
+
+/*
+    Release a screenshot's data mapping, if it has one.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - mapping: Pointer to the mapping, or NULL.
+        - size:    The size of the mapping.
+*/
+static void release_source(void* mapping, size_t size) {
+
+    if (mapping != NULL) munmap(mapping, size);
+}
+
+
+/*
+    Get the length a +3DOS file header gives its file, if the data starts
+    with one: its signature is there, and its checksum is right.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - data: Pointer to the file's data.
+        - size: The number of bytes of data.
+
+    - Returns: The file's length, header included, or 0 if there's no header.
+*/
+static size_t plus3dos_length(const uint8_t* data, size_t size) {
+
+    if (size < N2B_HEADER_SIZE || memcmp(data, PLUS3DOS_SIGNATURE, PLUS3DOS_SIGNATURE_SIZE) != 0) return 0;
+
+    uint8_t sum = 0;
+    for (size_t i = 0 ; i < PLUS3DOS_CHECKSUM_INDEX ; ++i) sum += data[i];
+    if (sum != data[PLUS3DOS_CHECKSUM_INDEX]) return 0;
+
+    size_t length = (size_t)data[PLUS3DOS_LENGTH_INDEX] | ((size_t)data[PLUS3DOS_LENGTH_INDEX + 1] << 8)
+                  | ((size_t)data[PLUS3DOS_LENGTH_INDEX + 2] << 16) | ((size_t)data[PLUS3DOS_LENGTH_INDEX + 3] << 24);
+    return length > N2B_HEADER_SIZE ? length : 0;
+}
+
+
+/*
+    Write a complete BMP to a file, or to stdout when the path is `-`.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - outpath: Pointer to the path to the destination file, or `-`.
+        - data:    Pointer to the BMP data.
+        - size:    The number of bytes to write.
+
+    - Returns: 0 on success or an error value.
+*/
+static int write_target(const char* outpath, const uint8_t* data, size_t size) {
+
+    FILE* outfile = open_target(outpath);
+    if (outfile == NULL) return N2B_ERROR_OPEN_BMP_FILE;
+    size_t count = fwrite(data, 1, size, outfile);
+    if (!close_target(outfile) || count != size) return N2B_ERROR_WRITE_BMP_FILE;
+    return N2B_ERROR_NONE;
+}
+
+
+/*
+    Open a file to write an image to, or get stdout when the path is `-`.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - outpath: Pointer to the path to the destination file, or `-`.
+
+    - Returns: The file, or NULL if it couldn't be opened.
+*/
+static FILE* open_target(const char* outpath) {
+
+    if (strcmp(outpath, "-") == 0) return stdout;
+
+    // A BMP linked to a cache entry must be replaced, not overwritten,
+    // or the cached copy would change too
+    struct stat file_info;
+    if (lstat(outpath, &file_info) == 0 && S_ISREG(file_info.st_mode) && file_info.st_nlink > 1) unlink(outpath);
+    return fopen(outpath, "wb");
+}
+
+
+/*
+    Finish writing an image file opened by `open_target()`. Stdout is
+    flushed rather than closed.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - file: The file.
+
+    - Returns: `true` if everything written got there, otherwise `false`.
+*/
+static bool close_target(FILE* file) {
+
+    if (file == stdout) return fflush(stdout) == 0 && !ferror(stdout);
+    return fclose(file) == 0;
+}
+
+
+/*
+    Add data to an image's output. A streaming output's buffer is written
+    out when the data won't fit, and data bigger than the buffer is written
+    straight through. A caller's buffer that runs out of room marks the sink failed.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - sink: Pointer to the output.
+        - data: Pointer to the data.
+        - size: The number of bytes of data.
+*/
+static void sink_put(ImageSink* sink, const void* data, size_t size) {
+
+    if (sink->failed) return;
+    if (size > sink->capacity - sink->size) {
+        if (!sink->streams || !sink_flush(sink)) {
+            sink->failed = true;
+            return;
+        }
+
+        if (size > sink->capacity) {
+            if (!sink_write(sink, data, size)) sink->failed = true;
+            sink->total += size;
+            return;
+        }
+    }
+
+    memcpy(sink->data + sink->size, data, size);
+    sink->size += size;
+    sink->total += size;
+}
+
+
+/*
+    Make room in an image's output for data to be built in place. A
+    streaming output's buffer is written out first if the data won't fit; a band of
+    the largest scaled image always fits in an empty buffer.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - sink: Pointer to the output.
+        - size: The number of bytes of room needed.
+
+    - Returns: Pointer to the room, or NULL if the sink has failed or
+               can't make room, which fails it.
+*/
+static uint8_t* sink_space(ImageSink* sink, size_t size) {
+
+    if (sink->failed) return NULL;
+    if (size > sink->capacity - sink->size) {
+        if (!sink->streams || !sink_flush(sink) || size > sink->capacity) {
+            sink->failed = true;
+            return NULL;
+        }
+    }
+
+    uint8_t* space = sink->data + sink->size;
+    sink->size += size;
+    sink->total += size;
+    return space;
+}
+
+
+/*
+    Give back the unused end of the room last made with `sink_space()`,
+    when data of uncertain size has been built there.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - sink: Pointer to the output.
+        - size: The number of bytes of room not used.
+*/
+static void sink_release(ImageSink* sink, size_t size) {
+
+    sink->size -= size;
+    sink->total -= size;
+}
+
+
+/*
+    Write out whatever a streaming output's buffer holds.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - sink: Pointer to the output.
+
+    - Returns: `true` if all the output so far has been written, otherwise `false`.
+*/
+static bool sink_flush(ImageSink* sink) {
+
+    if (!sink->streams || sink->size == 0 || sink->failed) return !sink->failed;
+
+    if (!sink_write(sink, sink->data, sink->size)) sink->failed = true;
+    sink->size = 0;
+    return !sink->failed;
+}
+
+
+/*
+    Pass data on from a streaming output to its file or write handler,
+    or drop it if there's neither, when the image is only being measured.
+    The time taken counts towards the write stage, and the time before
+    it towards scaling.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - sink: Pointer to the output.
+        - data: Pointer to the data.
+        - size: The number of bytes of data.
+
+    - Returns: `true` if the data was written, otherwise `false`.
+*/
+static bool sink_write(ImageSink* sink, const void* data, size_t size) {
+
+    bool success = true;
+    stage_end(sink->stats, N2B_STAGE_SCALE, sink->timer);
+    if (sink->file != NULL) success = fwrite(data, 1, size, sink->file) == size;
+    else if (sink->handler != NULL) success = sink->handler(data, size, sink->context);
+    stage_end(sink->stats, N2B_STAGE_WRITE, sink->timer);
+    return success;
+}
+
+
+/*
+    Encode a bitmap in the output format set by the options, streaming
+    it to a sink one band of source rows at a time, so the memory used
+    doesn't grow with the scale.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - bitmap:  Pointer to the decoded screen.
+        - options: Pointer to the output options, which have been checked.
+        - sink:    Pointer to the output.
+        - timer:   Pointer to the running stage timer.
+
+    - Returns: 0 on success or an error value.
+*/
+static int encode_image(const N2BBitmap* bitmap, const N2BOptions* options, ImageSink* sink, StageTimer* timer) {
+
+    unsigned int depth = 0;
+    int error = check_options(bitmap, options, &depth);
+    if (error != N2B_ERROR_NONE) return error;
+    sink->stats = options->stats;
+    sink->timer = timer;
+
+    // Edge-aware scalers enlarge the screen first, as a 1bpp bitmap
+    // which is then encoded without further scaling
+    unsigned int factor = options->scale;
+    unsigned int pixel_factor = factor;
+    N2BBitmap scaled;
+    uint8_t* scaled_pixels = NULL;
+    if (options->scaler != N2B_SCALER_NEAREST) {
+        scaled_pixels = scale_edges(bitmap, options->scaler, &scaled);
+        if (scaled_pixels == NULL) return N2B_ERROR_NO_MEMORY;
+        bitmap = &scaled;
+        pixel_factor = 1;
+    }
+
+    // Hand the pixels to the output format's encoder
+    EncodeJob job = {
+        .bitmap = bitmap,
+        .depth = depth,
+        .compress = options->compress,
+        .resolution = dots_per_metre(factor, options->dpi),
+        .threads = options->threads,
+        .stats = options->stats,
+        .timer = timer
+    };
+
+    size_job(&job, pixel_factor, options->dpi);
+
+    bool ok = FORMAT_BACKENDS[options->format].encode(&job, sink);
+    free(scaled_pixels);
+    stage_end(options->stats, N2B_STAGE_SCALE, timer);
+    if (ok) sink_flush(sink);
+    if (!ok) return N2B_ERROR_NO_MEMORY;
+    if (sink->failed) return sink->streams ? N2B_ERROR_WRITE_BMP_FILE : N2B_ERROR_BUFFER_TOO_SMALL;
+    return N2B_ERROR_NONE;
+}
+
+
+/*
+    Encode a bitmap straight to a file, or to stdout when the path is `-`.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - outpath:     Pointer to the path to the destination file, or `-`.
+        - bitmap:      Pointer to the decoded screen.
+        - options:     Pointer to the output options.
+        - buffer:      Pointer to the output buffer.
+        - buffer_size: The size of the buffer.
+        - timer:       Pointer to the running stage timer.
+        - written:     Pointer to a variable set to the size of the image.
+
+    - Returns: 0 on success or an error value.
+*/
+static int write_image(const char* outpath, const N2BBitmap* bitmap, const N2BOptions* options, uint8_t* buffer, size_t buffer_size, StageTimer* timer, size_t* written) {
+
+    unsigned int depth = 0;
+    int error = check_options(bitmap, options, &depth);
+    if (error != N2B_ERROR_NONE) return error;
+
+    FILE* outfile = open_target(outpath);
+    if (outfile == NULL) return N2B_ERROR_OPEN_BMP_FILE;
+
+    ImageSink sink = {.data = buffer, .capacity = buffer_size, .file = outfile, .streams = true};
+    error = encode_image(bitmap, options, &sink, timer);
+    if (!close_target(outfile) && error == N2B_ERROR_NONE) error = N2B_ERROR_WRITE_BMP_FILE;
+    *written = sink.total;
+    return error;
+}
+
+
+/*
+    Decide whether to encode an image on several threads: only if it's
+    allowed, and the image is big enough to repay starting them.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - job: Pointer to the bitmap and its settings.
+
+    - Returns: `true` to use threads, otherwise `false`.
+*/
+static bool runs_in_parallel(const EncodeJob* job) {
+
+    return job->threads > 1 && (uint64_t)job->width * job->height >= PARALLEL_PIXELS_MIN;
+}
+
+
+/*
+    Encode an image a band of source rows at a time, and write the bands
+    out in order, or just measure them. Large images, when threads are
+    allowed, have their bands encoded by worker threads, PARALLEL_BAND_ROWS
+    source rows to a band, while this thread writes each one out as soon
+    as those before it have gone; no more bands are held at once than
+    there are workers. Otherwise bands of up to INLINE_BAND_SIZE bytes
+    are encoded in turn, straight into the sink's buffer.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - job:          Pointer to the bitmap and its settings.
+        - sink:         Pointer to the output, or NULL just to measure it.
+        - encode_band:  The format's band encoder.
+        - context:      Pointer to the encoder's own settings.
+        - row_size_max: The most output one output row can take.
+        - scratch_size: The size of the scratch buffer the encoder needs.
+        - bottom_up:    Does the format store the bottom row first?
+        - total:        Pointer to a variable set to the size of the output.
+
+    - Returns: `true` on success, or `false` if out of memory.
+*/
+static bool encode_bands(const EncodeJob* job, ImageSink* sink, BandEncoder encode_band, void* context, size_t row_size_max, size_t scratch_size, bool bottom_up, size_t* total) {
+
+    const N2BBitmap* bitmap = job->bitmap;
+    *total = 0;
+    if (runs_in_parallel(job)) {
+        BandQueue queue = {
+            .job = job,
+            .encode_band = encode_band,
+            .context = context,
+            .band_capacity = row_size_max * job->factor * PARALLEL_BAND_ROWS,
+            .scratch_size = scratch_size,
+            .band_count = (bitmap->height + PARALLEL_BAND_ROWS - 1) / PARALLEL_BAND_ROWS
+        };
+
+        queue.slot_count = job->threads < queue.band_count ? job->threads : queue.band_count;
+        queue.slots = malloc(queue.slot_count * queue.band_capacity);
+        queue.sizes = calloc(queue.slot_count, sizeof(size_t));
+        queue.ready = calloc(queue.slot_count, sizeof(bool));
+        pthread_t* workers = malloc(queue.slot_count * sizeof(pthread_t));
+        if (queue.slots == NULL || queue.sizes == NULL || queue.ready == NULL || workers == NULL) {
+            free(queue.slots);
+            free(queue.sizes);
+            free(queue.ready);
+            free(workers);
+            return false;
+        }
+
+        pthread_mutex_init(&queue.lock, NULL);
+        pthread_cond_init(&queue.changed, NULL);
+        unsigned int started = 0;
+        while (started < queue.slot_count && pthread_create(&workers[started], NULL, band_worker, &queue) == 0) started++;
+
+        // Write out the bands in order, freeing each one's slot for the next
+        for (uint32_t band = 0 ; band < queue.band_count && started > 0 ; ++band) {
+            unsigned int slot = band % queue.slot_count;
+            pthread_mutex_lock(&queue.lock);
+            while (!queue.ready[slot] && !queue.failed) pthread_cond_wait(&queue.changed, &queue.lock);
+            bool failed = queue.failed;
+            pthread_mutex_unlock(&queue.lock);
+            if (failed) break;
+
+            if (sink != NULL) sink_put(sink, queue.slots + slot * queue.band_capacity, queue.sizes[slot]);
+            *total += queue.sizes[slot];
+
+            pthread_mutex_lock(&queue.lock);
+            queue.ready[slot] = false;
+            queue.written++;
+            pthread_cond_broadcast(&queue.changed);
+            pthread_mutex_unlock(&queue.lock);
+        }
+
+        for (unsigned int i = 0 ; i < started ; ++i) pthread_join(workers[i], NULL);
+        pthread_mutex_destroy(&queue.lock);
+        pthread_cond_destroy(&queue.changed);
+        free(queue.slots);
+        free(queue.sizes);
+        free(queue.ready);
+        free(workers);
+
+        // With no threads to be had, fall back to encoding the rows here
+        if (started > 0) return !queue.failed;
+    }
+
+    uint8_t scratch_buffer[ROW_BUFFER_SIZE];
+    uint8_t* scratch = scratch_size > sizeof(scratch_buffer) ? malloc(scratch_size) : scratch_buffer;
+    size_t measured_size = row_size_max * job->factor;
+    if (measured_size < INLINE_BAND_SIZE) measured_size = INLINE_BAND_SIZE;
+    uint8_t* measured = sink == NULL ? malloc(measured_size) : NULL;
+    bool ok = scratch != NULL && (sink != NULL || measured != NULL);
+    for (uint32_t row = 0 ; row < bitmap->height && ok ; ) {
+        // Take in as many rows as fit the band, but always at least one
+        uint32_t row_count = 0;
+        size_t capacity = 0;
+        while (row + row_count < bitmap->height) {
+            uint32_t next = row + row_count;
+            size_t room = row_size_max * row_repeat(job, bottom_up ? bitmap->height - 1 - next : next);
+            if (row_count > 0 && capacity + room > INLINE_BAND_SIZE) break;
+            capacity += room;
+            row_count++;
+        }
+
+        uint8_t* target = sink != NULL ? sink_space(sink, capacity) : measured;
+        if (target == NULL) break;
+
+        size_t size = 0;
+        ok = encode_band(job, context, row, row_count, scratch, target, &size);
+        if (sink != NULL) sink_release(sink, capacity - size);
+        *total += size;
+        row += row_count;
+    }
+
+    if (scratch != scratch_buffer) free(scratch);
+    free(measured);
+    return ok;
+}
+
+
+/*
+    Take bands from a queue and encode them until none are left. A band
+    waits for its slot to be freed by the band written out before it.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - argument: Pointer to the band queue.
+
+    - Returns: NULL.
+*/
+static void* band_worker(void* argument) {
+
+    BandQueue* queue = (BandQueue*)argument;
+    uint32_t height = queue->job->bitmap->height;
+    uint8_t* scratch = malloc(queue->scratch_size > 0 ? queue->scratch_size : 1);
+
+    pthread_mutex_lock(&queue->lock);
+    if (scratch == NULL) queue->failed = true;
+    while (!queue->failed && queue->next_band < queue->band_count) {
+        uint32_t band = queue->next_band++;
+        while (!queue->failed && band >= queue->written + queue->slot_count) pthread_cond_wait(&queue->changed, &queue->lock);
+        if (queue->failed) break;
+        pthread_mutex_unlock(&queue->lock);
+
+        unsigned int slot = band % queue->slot_count;
+        uint32_t first_row = band * PARALLEL_BAND_ROWS;
+        uint32_t row_count = height - first_row < PARALLEL_BAND_ROWS ? height - first_row : PARALLEL_BAND_ROWS;
+        size_t size = 0;
+        bool ok = queue->encode_band(queue->job, queue->context, first_row, row_count, scratch, queue->slots + slot * queue->band_capacity, &size);
+
+        pthread_mutex_lock(&queue->lock);
+        if (!ok) queue->failed = true;
+        queue->sizes[slot] = size;
+        queue->ready[slot] = true;
+        pthread_cond_broadcast(&queue->changed);
+    }
+
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+    free(scratch);
+    return NULL;
+}
+
+
+/*
+    Note the start of a timed stage. Nothing is read when stats are
+    not being kept, so timing costs nothing unless asked for.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - stats: Pointer to the stats being kept, or NULL.
+        - timer: Pointer to the timer to start.
+*/
+static void stage_start(const N2BStats* stats, StageTimer* timer) {
+
+    if (stats == NULL) return;
+    clock_gettime(CLOCK_MONOTONIC, &timer->wall);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &timer->cpu);
+}
+
+
+/*
+    Add the time since a timer was started to a stage's totals, and
+    restart the timer for the next stage.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - stats: Pointer to the stats being kept, or NULL.
+        - stage: The stage index.
+        - timer: Pointer to the timer.
+*/
+static void stage_end(N2BStats* stats, unsigned int stage, StageTimer* timer) {
+
+    if (stats == NULL) return;
+    struct timespec wall, cpu;
+    clock_gettime(CLOCK_MONOTONIC, &wall);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+    stats->wall_ns[stage] += elapsed_ns(&timer->wall, &wall);
+    stats->cpu_ns[stage] += elapsed_ns(&timer->cpu, &cpu);
+    timer->wall = wall;
+    timer->cpu = cpu;
+}
+
+
+/*
+    Calculate the time between two clock readings.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - start: Pointer to the earlier reading.
+        - end:   Pointer to the later reading.
+
+    - Returns: The difference in nanoseconds.
+*/
+static uint64_t elapsed_ns(const struct timespec* start, const struct timespec* end) {
+
+    return (uint64_t)(end->tv_sec - start->tv_sec) * 1000000000ULL + (uint64_t)end->tv_nsec - (uint64_t)start->tv_nsec;
+}
+
+
+/*
+    Open a memory card or disk dump for one sequential pass and read its
+    first sector, which says whether it holds a file system.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - inpath:    Pointer to the path to the dump, or `-` for stdin.
+        - fd:        Pointer to a variable set to the dump's file descriptor.
+        - boot:      Pointer to a buffer of FAT_BOOT_SIZE bytes for the first sector.
+        - boot_size: Pointer to a variable set to the number of bytes read, less for a short dump.
+
+    - Returns: 0 on success or an error value.
+*/
+static int open_dump(const char* inpath, int* fd, uint8_t* boot, size_t* boot_size) {
+
+    *fd = strcmp(inpath, "-") == 0 ? STDIN_FILENO : open(inpath, O_RDONLY);
+    if (*fd == -1) return N2B_ERROR_OPEN_SOURCE_FILE;
+#ifdef POSIX_FADV_SEQUENTIAL
+    if (*fd != STDIN_FILENO) posix_fadvise(*fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    int error = read_dump(*fd, boot, FAT_BOOT_SIZE, boot_size);
+    if (error != N2B_ERROR_NONE && *fd != STDIN_FILENO) close(*fd);
+    return error;
+}
+
+
+/*
+    Read from a dump until a buffer is full or the dump ends.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - fd:    The dump's file descriptor.
+        - data:  Pointer to the buffer.
+        - size:  The number of bytes to read.
+        - count: Pointer to a variable set to the number of bytes read.
+
+    - Returns: 0 on success or an error value.
+*/
+static int read_dump(int fd, uint8_t* data, size_t size, size_t* count) {
+
+    *count = 0;
+    while (*count < size) {
+        ssize_t got = read(fd, data + *count, size - *count);
+        if (got < 0 && errno == EINTR) continue;
+        if (got < 0) return N2B_ERROR_READ_SOURCE_FILE;
+        if (got == 0) break;
+        *count += (size_t)got;
+    }
+
+    return N2B_ERROR_NONE;
+}
+
+
+/*
+    Move forward through a dump, seeking where it can be and reading
+    and discarding data where it can't, eg. from a pipe.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - fd:           The dump's file descriptor.
+        - position:     Pointer to the current offset in the dump, which is updated.
+        - target:       The offset to move to, at or after the current one.
+        - scratch:      Pointer to a buffer for discarded data.
+        - scratch_size: The size of the buffer.
+
+    - Returns: 0 on success, or N2B_ERROR_READ_SOURCE_FILE if the dump
+               ends first.
+*/
+static int skip_dump(int fd, uint64_t* position, uint64_t target, uint8_t* scratch, size_t scratch_size) {
+
+    if (target <= *position) return N2B_ERROR_NONE;
+    if (lseek(fd, (off_t)target, SEEK_SET) != (off_t)-1) {
+        *position = target;
+        return N2B_ERROR_NONE;
+    }
+
+    while (*position < target) {
+        size_t wanted = target - *position < scratch_size ? (size_t)(target - *position) : scratch_size;
+        size_t count = 0;
+        int error = read_dump(fd, scratch, wanted, &count);
+        if (error != N2B_ERROR_NONE) return error;
+        if (count < wanted) return N2B_ERROR_READ_SOURCE_FILE;
+        *position += count;
+    }
+
+    return N2B_ERROR_NONE;
+}
+
+
+/*
+    Check whether a dump starts with a FAT12 or FAT16 file system, as
+    an NC200 disk or a PC-formatted card does, and if so, work out where
+    its parts are. The boot sector's values must all be in range and
+    fit together, so other data is very unlikely to pass.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - boot:      Pointer to the dump's first sector.
+        - boot_size: The number of bytes of it read.
+        - volume:    Pointer to the layout to set.
+
+    - Returns: `true` if the dump has a file system, otherwise `false`.
+*/
+static bool find_fat_volume(const uint8_t* boot, size_t boot_size, FatVolume* volume) {
+
+    if (boot_size < FAT_BOOT_SIZE || (boot[0] != 0xEB && boot[0] != 0xE9)) return false;
+
+    uint32_t sector_size = get_short_value(boot + FAT_SECTOR_SIZE_INDEX);
+    uint32_t cluster_sectors = boot[FAT_CLUSTER_SECTORS_INDEX];
+    uint32_t reserved_sectors = get_short_value(boot + FAT_RESERVED_SECTORS_INDEX);
+    uint32_t fat_count = boot[FAT_COUNT_INDEX];
+    uint32_t root_entries = get_short_value(boot + FAT_ROOT_ENTRIES_INDEX);
+    uint32_t total_sectors = get_short_value(boot + FAT_TOTAL_SECTORS_INDEX);
+    if (total_sectors == 0) total_sectors = get_header_value(boot + FAT_TOTAL_SECTORS_LONG_INDEX);
+    uint32_t fat_sectors = get_short_value(boot + FAT_FAT_SECTORS_INDEX);
+
+    if (sector_size < FAT_SECTOR_SIZE_MIN || sector_size > FAT_SECTOR_SIZE_MAX || (sector_size & (sector_size - 1)) != 0) return false;
+    if (cluster_sectors == 0 || (cluster_sectors & (cluster_sectors - 1)) != 0) return false;
+    if (reserved_sectors == 0 || fat_count == 0 || fat_count > 2 || root_entries == 0 || fat_sectors == 0) return false;
+    if (boot[FAT_MEDIA_INDEX] < FAT_MEDIA_MIN) return false;
+
+    uint32_t root_sectors = (root_entries * FAT_ENTRY_SIZE + sector_size - 1) / sector_size;
+    uint64_t data_sector = (uint64_t)reserved_sectors + (uint64_t)fat_count * fat_sectors + root_sectors;
+    if (total_sectors <= data_sector) return false;
+    uint64_t cluster_count = (total_sectors - data_sector) / cluster_sectors;
+    if (cluster_count == 0 || cluster_count > FAT16_CLUSTERS_MAX) return false;
+
+    // The FAT must have an entry for every cluster
+    volume->is_fat12 = cluster_count <= FAT12_CLUSTERS_MAX;
+    uint64_t fat_size = volume->is_fat12 ? (cluster_count + FAT_FIRST_CLUSTER) * 3 / 2 + 1 : (cluster_count + FAT_FIRST_CLUSTER) * 2;
+    if (fat_size > (uint64_t)fat_sectors * sector_size) return false;
+
+    volume->cluster_size = sector_size * cluster_sectors;
+    volume->cluster_count = (uint32_t)cluster_count;
+    volume->fat_start = (uint64_t)reserved_sectors * sector_size;
+    volume->fat_size = (uint32_t)fat_size;
+    volume->root_start = volume->fat_start + (uint64_t)fat_count * fat_sectors * sector_size;
+    volume->root_size = root_entries * FAT_ENTRY_SIZE;
+    volume->data_start = data_sector * sector_size;
+    return true;
+}
+
+
+/*
+    Look up the cluster that follows another in a file.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - fat:     Pointer to the first FAT.
+        - volume:  Pointer to the file system's layout.
+        - cluster: The cluster, which must be in range.
+
+    - Returns: The next cluster's number, which is out of range at the
+               end of the file or if the FAT is damaged.
+*/
+static uint32_t next_cluster(const uint8_t* fat, const FatVolume* volume, uint32_t cluster) {
+
+    if (!volume->is_fat12) return get_short_value(fat + cluster * 2);
+    uint32_t value = get_short_value(fat + cluster * 3 / 2);
+    return cluster & 1 ? value >> 4 : value & 0xFFF;
+}
+
+
+/*
+    Check whether a directory entry is for a screenshot file: a file,
+    not deleted, named `S` with an extension, eg. `S.A`.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - entry: Pointer to the 32-byte directory entry.
+        - name:  Pointer to a buffer of at least 13 bytes for the file's name, in lower case, eg. `s.a`.
+
+    - Returns: `true` if the entry is for a screenshot, otherwise `false`.
+*/
+static bool is_screenshot_entry(const uint8_t* entry, char* name) {
+
+    uint8_t attributes = entry[FAT_ENTRY_ATTRIBUTES_INDEX];
+    if (entry[0] == FAT_ENTRY_DELETED || attributes == FAT_ATTRIBUTES_LONG_NAME || (attributes & FAT_ATTRIBUTES_NOT_FILE) != 0) return false;
+    if (memcmp(entry, FAT_SCREENSHOT_NAME, FAT_ENTRY_NAME_SIZE) != 0 || entry[FAT_ENTRY_NAME_SIZE] == ' ') return false;
+
+    // The name is used for the output file's, so take only plain characters
+    size_t length = 0;
+    name[length++] = 's';
+    name[length++] = '.';
+    for (unsigned int i = 0 ; i < FAT_ENTRY_EXTENSION_SIZE ; ++i) {
+        uint8_t c = entry[FAT_ENTRY_NAME_SIZE + i];
+        if (c == ' ') break;
+        if (c <= ' ' || c >= 0x7F || c == '/' || c == '\\' || c == '.') return false;
+        name[length++] = c >= 'A' && c <= 'Z' ? (char)(c - 'A' + 'a') : (char)c;
+    }
+
+    name[length] = '\0';
+    return true;
+}
+
+
+/*
+    Order the clusters of a dump's screenshot files by their place in
+    the dump: a comparison function for `qsort()`.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - a: Pointer to the first `DumpPiece`.
+        - b: Pointer to the second `DumpPiece`.
+
+    - Returns: Less than, equal to or greater than 0 as the first comes
+               before, with or after the second.
+*/
+static int compare_pieces(const void* a, const void* b) {
+
+    const DumpPiece* first = a;
+    const DumpPiece* second = b;
+    if (first->cluster != second->cluster) return first->cluster < second->cluster ? -1 : 1;
+    if (first->file != second->file) return first->file < second->file ? -1 : 1;
+    return 0;
+}
+
+
+/*
+    Read a dump's screenshot files through its FAT file system. The FAT
+    and root directory come first in the dump, so they're read, the
+    files' clusters are listed and sorted, and then the clusters are read
+    in the order they come, skipping the rest, so the dump is read once
+    from start to end. Each file is passed on as soon as its last cluster
+    arrives. Files whose size isn't a screenshot's, or whose chain of
+    clusters is damaged, are passed over.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - fd:        The dump's file descriptor.
+        - volume:    Pointer to the file system's layout.
+        - boot_size: The number of bytes of the dump already read.
+        - handler:   The function to call with each screen, its file name and its offset in the dump.
+        - context:   Pointer passed on to the handler.
+
+    - Returns: 0 on success, the handler's value if it returned non-zero,
+               or an error value.
+*/
+static int walk_dump(int fd, const FatVolume* volume, size_t boot_size, N2BScanHandler handler, void* context) {
+
+    uint64_t position = boot_size;
+    uint8_t* fat = malloc(volume->fat_size);
+    uint8_t* root = malloc(volume->root_size);
+    uint8_t* cluster_data = malloc(volume->cluster_size);
+    DumpFile* files = NULL;
+    DumpPiece* pieces = NULL;
+    size_t file_count = 0;
+    size_t piece_count = 0;
+    size_t count = 0;
+    int error = fat == NULL || root == NULL || cluster_data == NULL ? N2B_ERROR_NO_MEMORY : N2B_ERROR_NONE;
+
+    if (error == N2B_ERROR_NONE) error = skip_dump(fd, &position, volume->fat_start, cluster_data, volume->cluster_size);
+    if (error == N2B_ERROR_NONE) error = read_dump(fd, fat, volume->fat_size, &count);
+    if (error == N2B_ERROR_NONE && count < volume->fat_size) error = N2B_ERROR_READ_SOURCE_FILE;
+    position += count;
+    if (error == N2B_ERROR_NONE) error = skip_dump(fd, &position, volume->root_start, cluster_data, volume->cluster_size);
+    if (error == N2B_ERROR_NONE) error = read_dump(fd, root, volume->root_size, &count);
+    if (error == N2B_ERROR_NONE && count < volume->root_size) error = N2B_ERROR_READ_SOURCE_FILE;
+    position += count;
+
+    // List the screenshot files and their clusters
+    size_t entry_count = volume->root_size / FAT_ENTRY_SIZE;
+    if (error == N2B_ERROR_NONE) {
+        files = malloc(entry_count * sizeof(DumpFile));
+        if (files == NULL) error = N2B_ERROR_NO_MEMORY;
+    }
+
+    for (size_t i = 0 ; i < entry_count && error == N2B_ERROR_NONE ; ++i) {
+        const uint8_t* entry = root + i * FAT_ENTRY_SIZE;
+        if (entry[0] == FAT_ENTRY_END) break;
+
+        DumpFile* file = &files[file_count];
+        file->size = get_header_value(entry + FAT_ENTRY_SIZE_INDEX);
+        if (!is_screenshot_entry(entry, file->name) || file->size < N2B_RAW_DATA_SIZE || file->size > N2B_SOURCE_SIZE_MAX) continue;
+
+        uint32_t first = get_short_value(entry + FAT_ENTRY_CLUSTER_INDEX);
+        uint32_t needed = (file->size + volume->cluster_size - 1) / volume->cluster_size;
+        DumpPiece* more = realloc(pieces, (piece_count + needed) * sizeof(DumpPiece));
+        if (more == NULL) {
+            error = N2B_ERROR_NO_MEMORY;
+            break;
+        }
+
+        pieces = more;
+        uint32_t cluster = first;
+        uint32_t found = 0;
+        while (found < needed && cluster >= FAT_FIRST_CLUSTER && cluster < volume->cluster_count + FAT_FIRST_CLUSTER) {
+            pieces[piece_count + found] = (DumpPiece){.cluster = cluster, .file = (uint32_t)file_count, .position = found * volume->cluster_size};
+            found++;
+            cluster = next_cluster(fat, volume, cluster);
+        }
+
+        if (found < needed) continue;
+        file->clusters_left = needed;
+        file->offset = volume->data_start + (uint64_t)(first - FAT_FIRST_CLUSTER) * volume->cluster_size;
+        file->data = NULL;
+        piece_count += needed;
+        file_count++;
+    }
+
+    // Read the clusters in order, each once even if files share it
+    if (error == N2B_ERROR_NONE && piece_count > 0) qsort(pieces, piece_count, sizeof(DumpPiece), compare_pieces);
+    for (size_t i = 0 ; i < piece_count && error == N2B_ERROR_NONE ; ++i) {
+        const DumpPiece* piece = &pieces[i];
+        if (i == 0 || pieces[i - 1].cluster != piece->cluster) {
+            error = skip_dump(fd, &position, volume->data_start + (uint64_t)(piece->cluster - FAT_FIRST_CLUSTER) * volume->cluster_size, cluster_data, volume->cluster_size);
+            if (error == N2B_ERROR_NONE) error = read_dump(fd, cluster_data, volume->cluster_size, &count);
+            position += count;
+
+            // The dump may end within a file's last cluster, after the file
+            if (error == N2B_ERROR_NONE && count < volume->cluster_size) {
+                for (size_t j = i ; j < piece_count && pieces[j].cluster == piece->cluster ; ++j) {
+                    if (files[pieces[j].file].size - pieces[j].position > count) error = N2B_ERROR_READ_SOURCE_FILE;
+                }
+            }
+
+            if (error != N2B_ERROR_NONE) break;
+        }
+
+        DumpFile* file = &files[piece->file];
+        if (file->data == NULL) {
+            file->data = malloc(file->size);
+            if (file->data == NULL) {
+                error = N2B_ERROR_NO_MEMORY;
+                break;
+            }
+        }
+
+        uint32_t size = file->size - piece->position < volume->cluster_size ? file->size - piece->position : volume->cluster_size;
+        memcpy(file->data + piece->position, cluster_data, size);
+        if (--file->clusters_left > 0) continue;
+
+        N2BBitmap bitmap;
+        if (n2b_decode(file->data, file->size, &bitmap) == N2B_ERROR_NONE) error = handler(&bitmap, file->name, file->offset, context);
+        free(file->data);
+        file->data = NULL;
+    }
+
+    for (size_t i = 0 ; i < file_count ; ++i) free(files[i].data);
+    free(files);
+    free(pieces);
+    free(cluster_data);
+    free(root);
+    free(fat);
+    return error;
+}
+
+
+/*
+    Scan a dump for screens by their layout, in a single sequential pass.
+
+    The NC100 doesn't mark screenshots out, so they're found by their
+    layout instead: 64 rows of 64 bytes, each ending with four zero
+    padding bytes. Every byte offset is tried, so screens needn't be
+    aligned in the dump. Zero fill with a few short records in it has
+    the same layout, so a match also needs at least SCAN_ROWS_SET_MIN
+    rows with pixels set, mustn't start with the end of data running on
+    from before it, and mustn't take in a +3DOS file header, which can
+    only belong to a file, though it may start right after one.
+
+    A screen's blank edges can let it match a row or a few bytes either
+    side of where it really starts. Of a set of overlapping matches, the
+    one with the most non-blank rows is taken, and if two or more tie,
+    the screen's offset can't be told, so it's skipped rather than
+    guessed at. This skips a screen in zero fill whose top or bottom row
+    is blank, and screens that lie back to back.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - fd:          The dump's file descriptor.
+        - prefix:      Pointer to the start of the dump, already read.
+        - prefix_size: The number of bytes of it, up to FAT_BOOT_SIZE.
+        - handler:     The function to call with each screen and its offset in the dump.
+        - context:     Pointer passed on to the handler.
+        - ambiguous:   Pointer to a variable to add the number of screens skipped to.
+
+    - Returns: 0 on success, the handler's value if it returned non-zero,
+               or an error value.
+*/
+static int scan_dump(int fd, const uint8_t* prefix, size_t prefix_size, N2BScanHandler handler, void* context, size_t* ambiguous) {
+
+    uint8_t* buffer = malloc(SCAN_HISTORY_SIZE + SCAN_CHUNK_SIZE);
+    if (buffer == NULL) return N2B_ERROR_NO_MEMORY;
+
+    // Rows are tracked in 64 lanes, one per possible alignment of a
+    // screen: the number of rows in a row with zero padding, and which
+    // of the last 64 of those have pixels set
+    unsigned int runs[N2B_RAW_ROW_SIZE] = {0};
+    uint64_t rows_set[N2B_RAW_ROW_SIZE] = {0};
+    uint64_t base = 0;
+    size_t filled = 0;
+    size_t count = prefix_size;
+    memcpy(buffer, prefix, prefix_size);
+    uint64_t set_end = 0;
+    uint64_t free_start = 0;
+    bool pending = false;
+    bool pending_tied = false;
+    uint64_t pending_start = 0;
+    unsigned int pending_rows = 0;
+    bool header_seen = false;
+    uint64_t header_start = 0;
+    int error = N2B_ERROR_NONE;
+
+    while (error == N2B_ERROR_NONE) {
+        if (count == 0) {
+            // Keep only the tail of the data already scanned
+            if (filled == SCAN_HISTORY_SIZE + SCAN_CHUNK_SIZE) {
+                memmove(buffer, buffer + SCAN_CHUNK_SIZE, SCAN_HISTORY_SIZE);
+                base += SCAN_CHUNK_SIZE;
+                filled = SCAN_HISTORY_SIZE;
+            }
+
+            ssize_t got = read(fd, buffer + filled, SCAN_HISTORY_SIZE + SCAN_CHUNK_SIZE - filled);
+            if (got < 0 && errno == EINTR) continue;
+            if (got < 0) error = N2B_ERROR_READ_SOURCE_FILE;
+            if (got <= 0) break;
+            count = (size_t)got;
+        }
+
+        for (size_t i = filled ; i < filled + count && error == N2B_ERROR_NONE ; ++i) {
+            uint64_t position = base + i;
+            if (buffer[i] != 0) set_end = position + 1;
+            if (buffer[i] == PLUS3DOS_SIGNATURE[PLUS3DOS_SIGNATURE_SIZE - 1] && i + 1 >= PLUS3DOS_SIGNATURE_SIZE
+                && memcmp(buffer + i + 1 - PLUS3DOS_SIGNATURE_SIZE, PLUS3DOS_SIGNATURE, PLUS3DOS_SIGNATURE_SIZE) == 0) {
+                header_seen = true;
+                header_start = position + 1 - PLUS3DOS_SIGNATURE_SIZE;
+            }
+
+            // No later match can overlap the pending screen, so hand it on,
+            // unless another match was as good
+            if (pending && position >= pending_start + SCAN_HISTORY_SIZE - 1) {
+                if (pending_tied) {
+                    (*ambiguous)++;
+                } else {
+                    N2BBitmap bitmap;
+                    n2b_decode(buffer + (pending_start - base), N2B_RAW_DATA_SIZE, &bitmap);
+                    error = handler(&bitmap, NULL, pending_start, context);
+                }
+
+                free_start = pending_start + N2B_RAW_DATA_SIZE;
+                pending = false;
+            }
+
+            // Check the row that ends with this byte: a non-zero byte since
+            // its visible part means its padding isn't blank
+            if (position + 1 < N2B_RAW_ROW_SIZE) continue;
+            uint64_t row = position + 1 - N2B_RAW_ROW_SIZE;
+            unsigned int lane = row % N2B_RAW_ROW_SIZE;
+            if (set_end > row + N2B_WIDTH / 8) {
+                runs[lane] = 0;
+                rows_set[lane] = 0;
+                continue;
+            }
+
+            rows_set[lane] = rows_set[lane] << 1 | (set_end > row ? 1 : 0);
+            if (runs[lane] < N2B_HEIGHT) runs[lane]++;
+            if (runs[lane] < N2B_HEIGHT || rows_set[lane] == 0) continue;
+
+            uint64_t start = position + 1 - N2B_RAW_DATA_SIZE;
+            if (start < free_start) continue;
+            unsigned int rows = count_bits(rows_set[lane]);
+            if (rows < SCAN_ROWS_SET_MIN) continue;
+            bool after_header = header_seen && header_start + N2B_HEADER_SIZE == start;
+            if (header_seen && header_start + N2B_HEADER_SIZE > start) continue;
+            if (!after_header && start > 0 && runs_on(buffer + (start - base))) continue;
+            if (!pending || rows > pending_rows) {
+                pending = true;
+                pending_tied = false;
+                pending_start = start;
+                pending_rows = rows;
+            } else if (rows == pending_rows) {
+                pending_tied = true;
+            }
+        }
+
+        filled += count;
+        count = 0;
+    }
+
+    if (pending && error == N2B_ERROR_NONE) {
+        if (pending_tied) {
+            (*ambiguous)++;
+        } else {
+            N2BBitmap bitmap;
+            n2b_decode(buffer + (pending_start - base), N2B_RAW_DATA_SIZE, &bitmap);
+            error = handler(&bitmap, NULL, pending_start, context);
+        }
+    }
+
+    free(buffer);
+    return error;
+}
+
+
+/*
+    Count the set bits in a word.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - bits: The word.
+
+    - Returns: The number of bits set.
+*/
+static unsigned int count_bits(uint64_t bits) {
+
+    unsigned int count = 0;
+    for ( ; bits != 0 ; bits &= bits - 1) count++;
+    return count;
+}
+
+
+/*
+    Check whether a possible screen in a dump is really the tail of some
+    other data: whatever comes before it runs on, unbroken, into its top
+    row and stops there, leaving the rest of the row blank.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - screen: Pointer to the possible screen, which must have a byte before it.
+
+    - Returns: `true` if the top row is the end of earlier data, otherwise `false`.
+*/
+static bool runs_on(const uint8_t* screen) {
+
+    if (screen[-1] == 0 || screen[0] == 0) return false;
+
+    uint32_t end = 0;
+    while (end < N2B_WIDTH / 8 && screen[end] != 0) end++;
+    for (uint32_t i = end ; i < N2B_WIDTH / 8 ; ++i) {
+        if (screen[i] != 0) return false;
+    }
+
+    return end < N2B_WIDTH / 8;
+}
+
+
+/*
+    Write out a screen found in a dump: the handler `n2b_extract_dump()`
+    walks or scans the dump with. A screen from a file is named after
+    the file, and one found by a scan after the dump and its offset.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - bitmap:  Pointer to the screen.
+        - name:    Pointer to the name of the screen's file, or NULL.
+        - offset:  The screen's offset in the dump.
+        - context: Pointer to the `DumpTarget`.
+
+    - Returns: 0 on success or an error value.
+*/
+static int extract_screen(const N2BBitmap* bitmap, const char* name, uint64_t offset, void* context) {
+
+    DumpTarget* target = context;
+    N2BStats* stats = target->options->stats;
+    const char* extension = n2b_format_extension(target->options->format);
+    char path[PATH_MAX];
+    int length = name != NULL ? snprintf(path, sizeof(path), "%s/%s%s", target->outdir, name, extension)
+                              : snprintf(path, sizeof(path), "%s/%s-%08llx%s", target->outdir, target->name, (unsigned long long)offset, extension);
+    if (length >= (int)sizeof(path)) {
+        if (stats != NULL) stats->failures++;
+        return N2B_ERROR_OPEN_BMP_FILE;
+    }
+
+    size_t size = 0;
+    StageTimer timer;
+    stage_start(stats, &timer);
+    int error = write_image(path, bitmap, target->options, target->data, target->size, &timer, &size);
+
+    if (error == N2B_ERROR_NONE) target->count++;
+    if (stats != NULL) {
+        if (error == N2B_ERROR_NONE) {
+            stats->files++;
+            stats->bytes_read += (uint64_t)bitmap->stride * bitmap->height;
+            stats->bytes_written += size;
+        } else {
+            stats->failures++;
+        }
+    }
+
+    return error;
+}
+
+
+/*
+    Hash a raw screen into 128 bits: two 64-bit lanes, each mixing in
+    the data a word at a time, so hashing costs far less than scaling.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - raw:      Pointer to the screen data.
+        - raw_size: The number of bytes of screen data, a multiple of eight.
+        - seed:     A value mixed into the hash, eg. the output options.
+        - hash:     The two 64-bit values to set.
+*/
+static void hash_screen(const uint8_t* raw, size_t raw_size, uint64_t seed, uint64_t hash[2]) {
+
+    const uint64_t k1 = 0x9E3779B97F4A7C15ULL;
+    const uint64_t k2 = 0xC2B2AE3D27D4EB4FULL;
+    uint64_t h1 = seed ^ k1;
+    uint64_t h2 = seed ^ k2;
+
+    for (size_t i = 0 ; i < raw_size ; i += 8) {
+        uint64_t word;
+        memcpy(&word, raw + i, 8);
+        h1 = (h1 ^ (word * k2)) * k1;
+        h1 = (h1 << 31) | (h1 >> 33);
+        h2 = (h2 + (word * k1)) * k2;
+        h2 = (h2 << 29) | (h2 >> 35);
+    }
+
+    // Finalise each lane so every input bit affects every output bit
+    for (unsigned int i = 0 ; i < 2 ; ++i) {
+        uint64_t h = (i == 0 ? h1 : h2) ^ raw_size;
+        h ^= h >> 33;
+        h *= 0xFF51AFD7ED558CCDULL;
+        h ^= h >> 33;
+        h *= 0xC4CEB9FE1A85EC53ULL;
+        h ^= h >> 33;
+        hash[i] = h;
+    }
+}
+
+
+/*
+    Build the path of the cache entry for a screen converted with the
+    given options: the screen's hash, seeded with the options, in hex,
+    plus the output format's extension. The hash takes in the whole
+    screen, padding and all, so screens of different sizes differ.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - bitmap:    Pointer to the decoded screen.
+        - options:   Pointer to the output options.
+        - depth:     The output depth, with any default applied.
+        - path:      Pointer to the buffer for the path.
+        - path_size: The size of the buffer.
+
+    - Returns: `true` if the path fitted, otherwise `false`.
+*/
+static bool make_cache_path(const N2BBitmap* bitmap, const N2BOptions* options, unsigned int depth, char* path, size_t path_size) {
+
+    uint64_t seed = (uint64_t)options->scale | ((uint64_t)depth << 8) | ((uint64_t)options->compress << 16)
+                  | ((uint64_t)options->format << 20) | ((uint64_t)CACHE_FORMAT_VERSION << 24) | ((uint64_t)options->scaler << 32)
+                  | ((uint64_t)options->dpi << 40);
+    uint64_t hash[2];
+    hash_screen(bitmap->pixels, (size_t)bitmap->stride * bitmap->height, seed, hash);
+    int length = snprintf(path, path_size, "%s/%016llx%016llx%s", options->cache_dir, (unsigned long long)hash[0], (unsigned long long)hash[1],
+                          n2b_format_extension(options->format));
+    return length > 0 && (size_t)length < path_size;
+}
+
+
+/*
+    Copy a cached image to its destination. Where the file system can,
+    the copy is a reflink, which shares the entry's blocks until either
+    file changes. If asked, files get a hard link to the entry instead,
+    where possible, which is read-only like the entry. An entry that has
+    been made writable may have been changed, so is removed rather than
+    used. The entry's modification time is updated to mark its use.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - cache_path:  Pointer to the path to the cache entry.
+        - outpath:     Pointer to the path to the destination file, or `-`.
+        - link_output: Hard-link the destination to the entry, rather than copy it?
+        - size:        Pointer to a variable set to the image's size, or NULL.
+
+    - Returns: `true` if the image was cached and copied, otherwise `false`.
+*/
+static bool fetch_cached(const char* cache_path, const char* outpath, bool link_output, size_t* size) {
+
+    int fd = open(cache_path, O_RDONLY);
+    if (fd == -1) return false;
+
+    struct stat file_info;
+    if (fstat(fd, &file_info) != 0 || !S_ISREG(file_info.st_mode) || file_info.st_size <= BMP_V5_HEADER_DATA_SIZE) {
+        close(fd);
+        return false;
+    }
+
+    if ((file_info.st_mode & (S_IWUSR | S_IWGRP | S_IWOTH)) != 0) {
+        close(fd);
+        unlink(cache_path);
+        return false;
+    }
+
+    futimens(fd, NULL);
+    if (size != NULL) *size = (size_t)file_info.st_size;
+
+    // Replace an existing regular file with a link. Leave anything
+    // else, eg. a device, to be written to
+    bool is_stdout = strcmp(outpath, "-") == 0;
+    if (link_output && !is_stdout) {
+        struct stat target_info;
+        if (lstat(outpath, &target_info) == 0 && S_ISREG(target_info.st_mode)) {
+            if (target_info.st_ino == file_info.st_ino && target_info.st_dev == file_info.st_dev) {
+                close(fd);
+                return true;
+            }
+
+            unlink(outpath);
+        }
+
+        if (link(cache_path, outpath) == 0) {
+            close(fd);
+            return true;
+        }
+    }
+
+    FILE* file = open_target(outpath);
+    if (file == NULL) {
+        close(fd);
+        return false;
+    }
+
+    bool success = false;
+#ifdef FICLONE
+    if (!is_stdout) success = ioctl(fileno(file), FICLONE, fd) == 0;
+#endif
+
+    // Copy the data instead
+    uint8_t* data = success ? NULL : malloc(CACHE_COPY_SIZE);
+    if (data != NULL) {
+        size_t copied = 0;
+        while (copied < (size_t)file_info.st_size) {
+            ssize_t count = read(fd, data, CACHE_COPY_SIZE);
+            if (count < 0 && errno == EINTR) continue;
+            if (count <= 0 || fwrite(data, 1, (size_t)count, file) != (size_t)count) break;
+            copied += (size_t)count;
+        }
+
+        success = copied == (size_t)file_info.st_size;
+        free(data);
+    }
+
+    close(fd);
+    if (!close_target(file)) success = false;
+    return success;
+}
+
+
+/*
+    Encode an image into the cache. It's written to a temporary file which
+    is then renamed, so other threads and processes never see a partial
+    entry.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - cache_path:  Pointer to the path to the cache entry.
+        - bitmap:      Pointer to the decoded screen.
+        - options:     Pointer to the output options.
+        - buffer:      Pointer to the output buffer.
+        - buffer_size: The size of the buffer.
+        - timer:       Pointer to the running stage timer.
+        - size:        Pointer to a variable set to the size of the image.
+
+    - Returns: `true` if the entry was added, otherwise `false`.
+*/
+static bool store_cached(const char* cache_path, const N2BBitmap* bitmap, const N2BOptions* options, uint8_t* buffer, size_t buffer_size, StageTimer* timer, size_t* size) {
+
+    char temp_path[PATH_MAX];
+    const char* name = strrchr(cache_path, '/');
+    int dir_length = (int)(name - cache_path);
+    if (snprintf(temp_path, sizeof(temp_path), "%.*s/" CACHE_TEMP_PREFIX "XXXXXX", dir_length, cache_path) >= (int)sizeof(temp_path)) return false;
+
+    int fd = mkstemp(temp_path);
+    if (fd == -1) return false;
+    FILE* file = fdopen(fd, "wb");
+    if (file == NULL) {
+        close(fd);
+        unlink(temp_path);
+        return false;
+    }
+
+    // Entries are read-only, so an output file linked to one can't be
+    // changed in place, and so change the entry too
+    ImageSink sink = {.data = buffer, .capacity = buffer_size, .file = file, .streams = true};
+    bool success = encode_image(bitmap, options, &sink, timer) == N2B_ERROR_NONE && fchmod(fd, CACHE_ENTRY_MODE) == 0;
+    if (fclose(file) != 0) success = false;
+    if (success) success = rename(temp_path, cache_path) == 0;
+    if (!success) unlink(temp_path);
+    *size = sink.total;
+    return success;
+}
+
+
+/*
+    Order cache entries oldest first, for `qsort()`.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - a: Pointer to a cache entry.
+        - b: Pointer to another cache entry.
+
+    - Returns: Negative, zero or positive as `a` is older, the same age as or newer than `b`.
+*/
+static int compare_cache_entries(const void* a, const void* b) {
+
+    time_t a_time = ((const CacheEntry*)a)->mtime;
+    time_t b_time = ((const CacheEntry*)b)->mtime;
+    return (a_time > b_time) - (a_time < b_time);
+}
+
+
+/*
+    Get an image or font file's data. Regular files are memory-mapped;
+    anything else, including stdin when the path is `-`, is read into a buffer
+    that grows as it fills.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - inpath: Pointer to the path to the image, or `-` for stdin.
+        - data:   Pointer to a variable set to the data.
+        - size:   Pointer to a variable set to the number of bytes of data.
+        - mapped: Pointer to a variable set to `true` if the data is mapped,
+                  or `false` if it must be freed.
+
+    - Returns: 0 on success or an error value.
+*/
+static int read_image_file(const char* inpath, uint8_t** data, size_t* size, bool* mapped) {
+
+    *data = NULL;
+    *size = 0;
+    *mapped = false;
+
+    int fd = strcmp(inpath, "-") == 0 ? STDIN_FILENO : open(inpath, O_RDONLY);
+    if (fd == -1) return N2B_ERROR_OPEN_SOURCE_FILE;
+
+    struct stat file_info;
+    if (fd != STDIN_FILENO && fstat(fd, &file_info) == 0 && S_ISREG(file_info.st_mode) && file_info.st_size > 0) {
+        void* map = mmap(NULL, file_info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            close(fd);
+            *data = map;
+            *size = file_info.st_size;
+            *mapped = true;
+            return N2B_ERROR_NONE;
+        }
+    }
+
+    size_t capacity = 0;
+    int error = N2B_ERROR_NONE;
+    while (error == N2B_ERROR_NONE) {
+        if (*size == capacity) {
+            capacity += capacity == 0 ? IMPORT_READ_SIZE : capacity;
+            uint8_t* grown = realloc(*data, capacity);
+            if (grown == NULL) {
+                error = N2B_ERROR_NO_MEMORY;
+                break;
+            }
+
+            *data = grown;
+        }
+
+        ssize_t count = read(fd, *data + *size, capacity - *size);
+        if (count < 0 && errno == EINTR) continue;
+        if (count < 0) error = N2B_ERROR_READ_SOURCE_FILE;
+        if (count <= 0) break;
+        *size += count;
+    }
+
+    if (fd != STDIN_FILENO) close(fd);
+    if (error == N2B_ERROR_NONE && *size == 0) error = N2B_ERROR_READ_SOURCE_FILE;
+    if (error != N2B_ERROR_NONE) {
+        free(*data);
+        *data = NULL;
+    }
+
+    return error;
+}
+
+
+/*
+    Set up a BMP for importing. Uncompressed pixels are read in place;
+    run-length encoded ones are unpacked first.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - data:  Pointer to the BMP file data.
+        - size:  The number of bytes of data.
+        - image: Pointer to the image to set up.
+
+    - Returns: 0 on success or an error value.
+*/
+static int open_bmp(const uint8_t* data, size_t size, ImportImage* image) {
+
+    memset(image, 0, sizeof(ImportImage));
+    if (size < 26) return N2B_ERROR_BAD_IMAGE;
+
+    // Old OS/2 headers have 16-bit sizes and three-byte colours
+    uint32_t offset = get_header_value(data + 10);
+    uint32_t header_size = get_header_value(data + 14);
+    int64_t width, height;
+    unsigned int bits;
+    uint32_t compression = BI_RGB;
+    uint32_t colour_count = 0;
+    unsigned int colour_size = 4;
+    if (header_size == 12) {
+        width = get_short_value(data + 18);
+        height = get_short_value(data + 20);
+        bits = get_short_value(data + 24);
+        colour_size = 3;
+    } else if (header_size >= 40 && size >= 54) {
+        width = (int32_t)get_header_value(data + 18);
+        height = (int32_t)get_header_value(data + 22);
+        bits = get_short_value(data + 28);
+        compression = get_header_value(data + 30);
+        colour_count = get_header_value(data + 46);
+    } else {
+        return N2B_ERROR_BAD_IMAGE;
+    }
+
+    // A negative height marks a top-down BMP
+    bool bottom_up = height > 0;
+    if (height < 0) height = -height;
+    if (width <= 0 || height == 0 || (uint64_t)width * (uint64_t)height > IMPORT_PIXELS_MAX) return N2B_ERROR_BAD_IMAGE;
+    image->width = (uint32_t)width;
+    image->height = (uint32_t)height;
+
+    if (bits == 1 || bits == 4 || bits == 8) {
+        if (colour_count == 0 || colour_count > (1u << bits)) colour_count = 1u << bits;
+        size_t table = 14 + (size_t)header_size;
+        for (uint32_t i = 0 ; i < colour_count && table + (i + 1) * colour_size <= size ; ++i) {
+            const uint8_t* colour = data + table + i * colour_size;
+            image->levels[i] = grey_level(colour[2], colour[1], colour[0]);
+        }
+
+        image->layout = IMPORT_LAYOUT_INDEXED;
+        image->bits = bits;
+        if ((compression == BI_RLE8 && bits == 8) || (compression == BI_RLE4 && bits == 4)) {
+            if (offset >= size) return N2B_ERROR_BAD_IMAGE;
+            return unpack_bmp_rle(data + offset, size - offset, bits, image) ? N2B_ERROR_NONE : N2B_ERROR_NO_MEMORY;
+        }
+
+        if (compression != BI_RGB) return N2B_ERROR_BAD_IMAGE;
+    } else if (bits == 24 || (bits == 32 && compression == BI_RGB)) {
+        if (compression != BI_RGB) return N2B_ERROR_BAD_IMAGE;
+        image->layout = IMPORT_LAYOUT_CHANNELS;
+        image->bits = bits;
+        image->offsets[0] = 2;
+        image->offsets[1] = 1;
+        image->offsets[2] = 0;
+    } else if (bits == 16 || bits == 32) {
+        // 16bpp BMPs without masks are 5-5-5
+        image->layout = IMPORT_LAYOUT_FIELDS;
+        image->bits = bits;
+        image->masks[0] = 0x7C00;
+        image->masks[1] = 0x03E0;
+        image->masks[2] = 0x001F;
+        if (compression == BI_BITFIELDS) {
+            if (size < 66) return N2B_ERROR_BAD_IMAGE;
+            for (unsigned int i = 0 ; i < 3 ; ++i) image->masks[i] = get_header_value(data + 54 + i * 4);
+        } else if (compression != BI_RGB) {
+            return N2B_ERROR_BAD_IMAGE;
+        }
+
+        for (unsigned int i = 0 ; i < 3 ; ++i) {
+            if (image->masks[i] == 0) continue;
+            while (((image->masks[i] >> image->shifts[i]) & 0x01) == 0) image->shifts[i]++;
+        }
+    } else {
+        return N2B_ERROR_BAD_IMAGE;
+    }
+
+    // Rows are padded to whole 32-bit words
+    size_t stride = ((size_t)image->width * bits + 31) / 32 * 4;
+    if (offset > size || stride * image->height > size - offset) return N2B_ERROR_BAD_IMAGE;
+    image->pixels = data + offset + (bottom_up ? stride * (image->height - 1) : 0);
+    image->stride = bottom_up ? -(ptrdiff_t)stride : (ptrdiff_t)stride;
+    return N2B_ERROR_NONE;
+}
+
+
+/*
+    Unpack a run-length encoded BMP's pixels to a byte per pixel, top
+    row first. Pixels the encoding skips over are left at index 0.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - data:  Pointer to the encoded pixels.
+        - size:  The number of bytes of encoded pixels.
+        - bits:  The depth: 8 for `BI_RLE8` or 4 for `BI_RLE4`.
+        - image: Pointer to the image, which takes the unpacked pixels.
+
+    - Returns: `true` on success, or `false` if out of memory.
+*/
+static bool unpack_bmp_rle(const uint8_t* data, size_t size, unsigned int bits, ImportImage* image) {
+
+    uint32_t width = image->width;
+    uint32_t height = image->height;
+    uint8_t* pixels = calloc((size_t)width * height, 1);
+    if (pixels == NULL) return false;
+
+    // Rows are encoded bottom up, so `y` counts up from the bottom row
+    uint32_t x = 0;
+    uint32_t y = 0;
+    size_t i = 0;
+    while (i + 1 < size && y < height) {
+        unsigned int count = data[i];
+        unsigned int value = data[i + 1];
+        uint8_t* row = pixels + (size_t)(height - 1 - y) * width;
+        i += 2;
+
+        if (count > 0) {
+            // A run, alternating between two pixels at 4bpp
+            for (unsigned int n = 0 ; n < count && x < width ; ++n, ++x) {
+                row[x] = bits == 8 ? (uint8_t)value : (uint8_t)((n & 1) ? value & 0x0F : value >> 4);
+            }
+        } else if (value == 0) {
+            x = 0;
+            y++;
+        } else if (value == 1) {
+            break;
+        } else if (value == 2) {
+            if (i + 1 >= size) break;
+            x += data[i];
+            y += data[i + 1];
+            i += 2;
+        } else {
+            // Literal pixels, padded to a whole number of 16-bit words
+            size_t length = bits == 8 ? value : (value + 1) / 2;
+            if (length > size - i) break;
+            for (unsigned int n = 0 ; n < value && x < width ; ++n, ++x) {
+                row[x] = bits == 8 ? data[i + n] : (uint8_t)((n & 1) ? data[i + n / 2] & 0x0F : data[i + n / 2] >> 4);
+            }
+
+            i += (length + 1) & ~(size_t)1;
+        }
+    }
+
+    image->owned = pixels;
+    image->pixels = pixels;
+    image->stride = width;
+    image->bits = 8;
+    return true;
+}
+
+
+/*
+    Set up a PNG for importing: gather and inflate its image data, and
+    undo the row filters. Grey levels of up to 8 bits and palette colours
+    are looked up by index; all other pixels are read channel by channel,
+    using the most significant byte of 16-bit samples.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - data:  Pointer to the PNG file data.
+        - size:  The number of bytes of data.
+        - image: Pointer to the image to set up.
+
+    - Returns: 0 on success or an error value.
+*/
+static int open_png(const uint8_t* data, size_t size, ImportImage* image) {
+
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A};
+    memset(image, 0, sizeof(ImportImage));
+    if (size < 8 || memcmp(data, signature, 8) != 0) return N2B_ERROR_BAD_IMAGE;
+
+    // Find the header, palette and transparency, and total up the image
+    // data, which may be split over any number of chunks
+    const uint8_t* header = NULL;
+    const uint8_t* palette = NULL;
+    uint32_t palette_size = 0;
+    const uint8_t* transparency = NULL;
+    uint32_t transparency_size = 0;
+    const uint8_t* first_data = NULL;
+    size_t compressed_size = 0;
+    unsigned int data_count = 0;
+    size_t position = 8;
+    while (position + PNG_CHUNK_OVERHEAD <= size) {
+        uint32_t length = get_big_endian(data + position);
+        const uint8_t* type = data + position + 4;
+        const uint8_t* body = data + position + 8;
+        if (length > size - position - PNG_CHUNK_OVERHEAD) return N2B_ERROR_BAD_IMAGE;
+
+        if (memcmp(type, "IHDR", 4) == 0 && length >= 13) {
+            header = body;
+        } else if (memcmp(type, "PLTE", 4) == 0) {
+            palette = body;
+            palette_size = length / 3;
+        } else if (memcmp(type, "tRNS", 4) == 0) {
+            transparency = body;
+            transparency_size = length;
+        } else if (memcmp(type, "IDAT", 4) == 0) {
+            if (data_count++ == 0) first_data = body;
+            compressed_size += length;
+        } else if (memcmp(type, "IEND", 4) == 0) {
+            break;
+        }
+
+        position += PNG_CHUNK_OVERHEAD + length;
+    }
+
+    if (header == NULL || data_count == 0) return N2B_ERROR_BAD_IMAGE;
+
+    // Only deflate, the standard filters and non-interlaced images are read
+    uint32_t width = get_big_endian(header);
+    uint32_t height = get_big_endian(header + 4);
+    unsigned int depth = header[8];
+    unsigned int colour = header[9];
+    if (header[10] != 0 || header[11] != 0 || header[12] != 0) return N2B_ERROR_BAD_IMAGE;
+    if (width == 0 || height == 0 || (uint64_t)width * height > IMPORT_PIXELS_MAX) return N2B_ERROR_BAD_IMAGE;
+
+    unsigned int channels = 0;
+    if (colour == PNG_COLOUR_GREY || colour == PNG_COLOUR_PALETTE) channels = 1;
+    if (colour == PNG_COLOUR_GREY_ALPHA) channels = 2;
+    if (colour == PNG_COLOUR_RGB) channels = 3;
+    if (colour == PNG_COLOUR_RGBA) channels = 4;
+    bool depth_valid = depth == 1 || depth == 2 || depth == 4 || depth == 8 || depth == 16;
+    if (channels == 0 || !depth_valid || (depth < 8 && channels > 1) || (depth == 16 && colour == PNG_COLOUR_PALETTE)) return N2B_ERROR_BAD_IMAGE;
+    if (colour == PNG_COLOUR_PALETTE && palette == NULL) return N2B_ERROR_BAD_IMAGE;
+
+    image->width = width;
+    image->height = height;
+    image->bits = channels * depth;
+    if (depth <= 8 && channels == 1) {
+        image->layout = IMPORT_LAYOUT_INDEXED;
+        if (colour == PNG_COLOUR_PALETTE) {
+            for (uint32_t i = 0 ; i < palette_size && i < 256 ; ++i) {
+                unsigned int level = grey_level(palette[i * 3], palette[i * 3 + 1], palette[i * 3 + 2]);
+                unsigned int alpha = i < transparency_size ? transparency[i] : 0xFF;
+                image->levels[i] = (uint8_t)((level * alpha + PAPER_LEVEL * (0xFF - alpha) + 127) / 0xFF);
+            }
+        } else {
+            unsigned int maximum = (1u << depth) - 1;
+            for (unsigned int i = 0 ; i <= maximum ; ++i) image->levels[i] = (uint8_t)(i * 0xFF / maximum);
+            if (transparency_size >= 2) {
+                unsigned int key = (unsigned int)transparency[0] << 8 | transparency[1];
+                if (key <= maximum) image->levels[key] = PAPER_LEVEL;
+            }
+        }
+    } else {
+        // Channels are read from the most significant byte of each sample
+        unsigned int sample_size = depth / 8;
+        image->layout = IMPORT_LAYOUT_CHANNELS;
+        for (unsigned int i = 0 ; i < 3 ; ++i) image->offsets[i] = channels >= 3 ? i * sample_size : 0;
+        image->has_alpha = colour == PNG_COLOUR_GREY_ALPHA || colour == PNG_COLOUR_RGBA;
+        image->offsets[3] = (channels - 1) * sample_size;
+
+        // A transparent colour is given as 16-bit samples, whatever the depth
+        if (!image->has_alpha && transparency_size >= channels * 2) {
+            for (unsigned int i = 0 ; i < channels ; ++i) {
+                for (unsigned int j = 0 ; j < sample_size ; ++j) image->key[i * sample_size + j] = transparency[i * 2 + 2 - sample_size + j];
+            }
+
+            image->key_size = channels * sample_size;
+        }
+    }
+
+    // Join up image data split over several chunks
+    const uint8_t* compressed = first_data;
+    uint8_t* joined = NULL;
+    if (data_count > 1) {
+        joined = malloc(compressed_size);
+        if (joined == NULL) return N2B_ERROR_NO_MEMORY;
+        size_t joined_size = 0;
+        for (position = 8 ; position + PNG_CHUNK_OVERHEAD <= size ; ) {
+            uint32_t length = get_big_endian(data + position);
+            if (memcmp(data + position + 4, "IDAT", 4) == 0) {
+                memcpy(joined + joined_size, data + position + 8, length);
+                joined_size += length;
+            }
+
+            if (memcmp(data + position + 4, "IEND", 4) == 0) break;
+            position += PNG_CHUNK_OVERHEAD + length;
+        }
+
+        compressed = joined;
+    }
+
+    // Each row is preceded by its filter type
+    uint32_t row_size = (uint32_t)(((uint64_t)width * image->bits + 7) / 8);
+    size_t inflated_size = ((size_t)row_size + 1) * height;
+    image->owned = malloc(inflated_size);
+    int error = image->owned != NULL ? N2B_ERROR_NONE : N2B_ERROR_NO_MEMORY;
+    if (error == N2B_ERROR_NONE && !inflate_zlib(compressed, compressed_size, image->owned, inflated_size)) error = N2B_ERROR_BAD_IMAGE;
+    if (error == N2B_ERROR_NONE && !unfilter_png(image->owned, row_size, height, image->bits < 8 ? 1 : image->bits / 8)) error = N2B_ERROR_BAD_IMAGE;
+    free(joined);
+    if (error != N2B_ERROR_NONE) {
+        free(image->owned);
+        image->owned = NULL;
+        return error;
+    }
+
+    image->pixels = image->owned + 1;
+    image->stride = (ptrdiff_t)row_size + 1;
+    return N2B_ERROR_NONE;
+}
+
+
+/*
+    Undo the filters of an inflated PNG's rows in place. Each row starts
+    with its filter type, and is filtered against the unfiltered row
+    above it, or a row of zeros for the first.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - data:       Pointer to the inflated rows.
+        - row_size:   The number of bytes of pixels in a row.
+        - height:     The number of rows.
+        - pixel_size: The number of bytes per pixel, or 1 if less.
+
+    - Returns: `true` on success, or `false` if a filter type is unknown.
+*/
+static bool unfilter_png(uint8_t* data, uint32_t row_size, uint32_t height, unsigned int pixel_size) {
+
+    const uint8_t* above = NULL;
+    for (uint32_t y = 0 ; y < height ; ++y) {
+        uint8_t* row = data + (size_t)y * (row_size + 1) + 1;
+        switch (row[-1]) {
+            case PNG_FILTER_NONE:
+                break;
+            case PNG_FILTER_SUB:
+                for (uint32_t i = pixel_size ; i < row_size ; ++i) row[i] += row[i - pixel_size];
+                break;
+            case PNG_FILTER_UP:
+                if (above != NULL) {
+                    for (uint32_t i = 0 ; i < row_size ; ++i) row[i] += above[i];
+                }
+                break;
+            case PNG_FILTER_AVERAGE:
+                for (uint32_t i = 0 ; i < row_size ; ++i) {
+                    unsigned int left = i >= pixel_size ? row[i - pixel_size] : 0;
+                    unsigned int up = above != NULL ? above[i] : 0;
+                    row[i] += (uint8_t)((left + up) / 2);
+                }
+                break;
+            case PNG_FILTER_PAETH:
+                for (uint32_t i = 0 ; i < row_size ; ++i) {
+                    int left = i >= pixel_size ? row[i - pixel_size] : 0;
+                    int up = above != NULL ? above[i] : 0;
+                    int up_left = i >= pixel_size && above != NULL ? above[i - pixel_size] : 0;
+                    int estimate = left + up - up_left;
+                    int to_left = abs(estimate - left);
+                    int to_up = abs(estimate - up);
+                    int to_up_left = abs(estimate - up_left);
+                    if (to_left <= to_up && to_left <= to_up_left) {
+                        row[i] += (uint8_t)left;
+                    } else if (to_up <= to_up_left) {
+                        row[i] += (uint8_t)up;
+                    } else {
+                        row[i] += (uint8_t)up_left;
+                    }
+                }
+                break;
+            default:
+                return false;
+        }
+
+        above = row;
+    }
+
+    return true;
+}
+
+
+/*
+    Read a row of an imported image as grey levels, compositing any
+    transparency onto white.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - image:  Pointer to the image.
+        - row:    The row to read, counting from the top.
+        - levels: Pointer to the buffer for the row's levels, a byte per pixel.
+*/
+static void read_levels(const ImportImage* image, uint32_t row, uint8_t* levels) {
+
+    const uint8_t* pixels = image->pixels + (ptrdiff_t)row * image->stride;
+    uint32_t width = image->width;
+
+    if (image->layout == IMPORT_LAYOUT_INDEXED) {
+        if (image->bits == 8) {
+            for (uint32_t x = 0 ; x < width ; ++x) levels[x] = image->levels[pixels[x]];
+        } else {
+            unsigned int bits = image->bits;
+            unsigned int mask = (1u << bits) - 1;
+            for (uint32_t x = 0 ; x < width ; ++pixels) {
+                unsigned int byte = *pixels;
+                for (unsigned int shift = 8 ; shift > 0 && x < width ; ++x) {
+                    shift -= bits;
+                    levels[x] = image->levels[(byte >> shift) & mask];
+                }
+            }
+        }
+    } else if (image->layout == IMPORT_LAYOUT_CHANNELS) {
+        unsigned int pixel_size = image->bits / 8;
+        unsigned int red = image->offsets[0];
+        unsigned int green = image->offsets[1];
+        unsigned int blue = image->offsets[2];
+        unsigned int alpha = image->offsets[3];
+        for (uint32_t x = 0 ; x < width ; ++x) {
+            const uint8_t* pixel = pixels + (size_t)x * pixel_size;
+            levels[x] = grey_level(pixel[red], pixel[green], pixel[blue]);
+        }
+
+        if (image->has_alpha) {
+            for (uint32_t x = 0 ; x < width ; ++x) {
+                unsigned int opacity = pixels[(size_t)x * pixel_size + alpha];
+                levels[x] = (uint8_t)((levels[x] * opacity + PAPER_LEVEL * (0xFF - opacity) + 127) / 0xFF);
+            }
+        }
+
+        if (image->key_size > 0) {
+            for (uint32_t x = 0 ; x < width ; ++x) {
+                if (memcmp(pixels + (size_t)x * pixel_size, image->key, image->key_size) == 0) levels[x] = PAPER_LEVEL;
+            }
+        }
+    } else {
+        uint32_t maxima[3];
+        for (unsigned int i = 0 ; i < 3 ; ++i) maxima[i] = image->masks[i] >> image->shifts[i];
+        for (uint32_t x = 0 ; x < width ; ++x) {
+            uint32_t value = image->bits == 16 ? get_short_value(pixels + x * 2) : get_header_value(pixels + x * 4);
+            unsigned int channels[3] = {0, 0, 0};
+            for (unsigned int i = 0 ; i < 3 ; ++i) {
+                if (maxima[i] != 0) channels[i] = ((value & image->masks[i]) >> image->shifts[i]) * 0xFF / maxima[i];
+            }
+
+            levels[x] = grey_level(channels[0], channels[1], channels[2]);
+        }
+    }
+}
+
+
+/*
+    Get the grey level of a colour, weighting its channels by how bright
+    they look (ITU-R BT.601).
+
+    FROM 0.5.0
+
+    - Parameters:
+        - red:   The red channel, 0 to 255.
+        - green: The green channel, 0 to 255.
+        - blue:  The blue channel, 0 to 255.
+
+    - Returns: The level, 0 to 255.
+*/
+static inline uint8_t grey_level(unsigned int red, unsigned int green, unsigned int blue) {
+
+    return (uint8_t)((red * 77 + green * 150 + blue * 29) >> 8);
+}
+
+
+/*
+    Resize an imported image to fit the screen, keeping its shape, and
+    centre it on white. Each screen pixel is the average of the image
+    pixels it covers, or, when the image is enlarged, the nearest one.
+    Image rows are read once for each screen row they fall in, and
+    summed a column at a time.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - image:  Pointer to the image.
+        - screen: Pointer to the screen's grey levels, N2B_WIDTH by N2B_HEIGHT.
+
+    - Returns: `true` on success, or `false` if out of memory.
+*/
+static bool fit_to_screen(const ImportImage* image, uint8_t* screen) {
+
+    uint32_t width = image->width;
+    uint32_t height = image->height;
+    uint32_t fit_width = N2B_WIDTH;
+    uint32_t fit_height = N2B_HEIGHT;
+    if ((uint64_t)width * N2B_HEIGHT > (uint64_t)height * N2B_WIDTH) {
+        fit_height = (uint32_t)(((uint64_t)height * N2B_WIDTH + width / 2) / width);
+        if (fit_height == 0) fit_height = 1;
+    } else {
+        fit_width = (uint32_t)(((uint64_t)width * N2B_HEIGHT + height / 2) / height);
+        if (fit_width == 0) fit_width = 1;
+    }
+
+    // Images within a pixel of the screen's shape, such as screenshots
+    // scaled to a print resolution, fill it
+    if (fit_width + 1 >= N2B_WIDTH && fit_height + 1 >= N2B_HEIGHT) {
+        fit_width = N2B_WIDTH;
+        fit_height = N2B_HEIGHT;
+    }
+
+    // Each screen column's span of image columns is the same on every row
+    uint32_t first_columns[N2B_WIDTH];
+    uint32_t end_columns[N2B_WIDTH];
+    uint32_t column_min = width >= fit_width ? width / fit_width : 1;
+    for (uint32_t x = 0 ; x < fit_width ; ++x) resize_span(x, width, fit_width, &first_columns[x], &end_columns[x]);
+
+    uint8_t* levels = malloc(width);
+    uint32_t* sums = malloc(width * sizeof(uint32_t));
+    if (levels == NULL || sums == NULL) {
+        free(levels);
+        free(sums);
+        return false;
+    }
+
+    memset(screen, PAPER_LEVEL, N2B_WIDTH * N2B_HEIGHT);
+    uint8_t* origin = screen + (N2B_HEIGHT - fit_height) / 2 * N2B_WIDTH + (N2B_WIDTH - fit_width) / 2;
+    for (uint32_t y = 0 ; y < fit_height ; ++y) {
+        uint32_t first_row, end_row;
+        resize_span(y, height, fit_height, &first_row, &end_row);
+        read_levels(image, first_row, levels);
+
+        // Where each screen pixel is a single image pixel, as when the
+        // image is enlarged or already screen-sized, there's nothing to average
+        uint8_t* target = origin + y * N2B_WIDTH;
+        if (end_row - first_row == 1 && width <= fit_width) {
+            for (uint32_t x = 0 ; x < fit_width ; ++x) target[x] = levels[first_columns[x]];
+            continue;
+        }
+
+        for (uint32_t x = 0 ; x < width ; ++x) sums[x] = levels[x];
+        for (uint32_t row = first_row + 1 ; row < end_row ; ++row) {
+            read_levels(image, row, levels);
+            for (uint32_t x = 0 ; x < width ; ++x) sums[x] += levels[x];
+        }
+
+        // Spans are all one of two widths, so averages are taken by
+        // multiplying by the reciprocals of the two counts, corrected
+        // by one where that rounds down, rather than by dividing. Spans
+        // too big for that are rare enough to divide
+        uint32_t rows = end_row - first_row;
+        uint64_t counts[2] = {(uint64_t)column_min * rows, (uint64_t)(column_min + 1) * rows};
+        bool small = counts[1] <= UINT32_MAX / 0xFF;
+        uint64_t reciprocals[2] = {0, 0};
+        if (small) {
+            reciprocals[0] = ((uint64_t)1 << 32) / counts[0];
+            reciprocals[1] = ((uint64_t)1 << 32) / counts[1];
+        }
+
+        for (uint32_t x = 0 ; x < fit_width ; ++x) {
+            uint64_t total = 0;
+            for (uint32_t column = first_columns[x] ; column < end_columns[x] ; ++column) total += sums[column];
+            unsigned int wide = end_columns[x] - first_columns[x] - column_min;
+            if (small) {
+                uint32_t count = (uint32_t)counts[wide];
+                uint32_t value = (uint32_t)total + count / 2;
+                uint32_t level = (uint32_t)((value * reciprocals[wide]) >> 32);
+                if (value - level * count >= count) ++level;
+                target[x] = (uint8_t)level;
+            } else {
+                uint64_t count = counts[wide];
+                target[x] = (uint8_t)((total + count / 2) / count);
+            }
+        }
+    }
+
+    free(levels);
+    free(sums);
+    return true;
+}
+
+
+/*
+    Find the image pixels a screen pixel covers along a row or column:
+    all those that fall within it when shrinking, or the one nearest
+    its centre when enlarging.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - index:       The screen pixel.
+        - source_size: The image's size.
+        - target_size: The size it's being resized to.
+        - start:       Pointer to a variable set to the first image pixel.
+        - end:         Pointer to a variable set to the one after the last.
+*/
+static void resize_span(uint32_t index, uint32_t source_size, uint32_t target_size, uint32_t* start, uint32_t* end) {
+
+    if (source_size >= target_size) {
+        *start = (uint32_t)((uint64_t)index * source_size / target_size);
+        *end = (uint32_t)((uint64_t)(index + 1) * source_size / target_size);
+    } else {
+        *start = (uint32_t)(((uint64_t)index * 2 + 1) * source_size / (target_size * 2));
+        *end = *start + 1;
+    }
+}
+
+
+/*
+    Turn a screen of grey levels into a raw screenshot, a row at a time.
+    Thresholds and ordered dithering compare each level with the
+    threshold for its position; error diffusion carries each pixel's
+    error on to its neighbours.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - screen: Pointer to the screen's grey levels.
+        - dither: How to dither, eg. N2B_DITHER_ORDERED.
+        - raw:    Pointer to the N2B_RAW_DATA_SIZE buffer for the screenshot.
+*/
+static void dither_screen(const uint8_t* screen, unsigned int dither, uint8_t* raw) {
+
+    // Every row's padding is left clear
+    memset(raw, 0, N2B_RAW_DATA_SIZE);
+    if (dither == N2B_DITHER_FLOYD_STEINBERG) {
+        diffuse_errors(screen, raw);
+        return;
+    }
+
+    static const uint8_t flat[8] = {INK_THRESHOLD, INK_THRESHOLD, INK_THRESHOLD, INK_THRESHOLD,
+                                    INK_THRESHOLD, INK_THRESHOLD, INK_THRESHOLD, INK_THRESHOLD};
+    for (uint32_t row = 0 ; row < N2B_HEIGHT ; ++row) {
+        const uint8_t* thresholds = dither == N2B_DITHER_ORDERED ? ORDERED_THRESHOLDS[row & 0x07] : flat;
+        pack_row(screen + row * N2B_WIDTH, thresholds, raw + row * N2B_RAW_ROW_SIZE);
+    }
+}
+
+
+/*
+    Pack a row of grey levels into screenshot bytes, most significant
+    bit leftmost, setting the bits of levels below their thresholds.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - levels:     Pointer to the row's grey levels.
+        - thresholds: Pointer to the thresholds, which repeat every eight pixels.
+        - target:     Pointer to the row in the screenshot.
+*/
+static void pack_row(const uint8_t* levels, const uint8_t* thresholds, uint8_t* target) {
+
+    for (uint32_t i = 0 ; i < N2B_WIDTH / 8 ; ++i) {
+        const uint8_t* group = levels + i * 8;
+        unsigned int byte = 0;
+        for (unsigned int bit = 0 ; bit < 8 ; ++bit) byte |= (unsigned int)(group[bit] < thresholds[bit]) << (7 - bit);
+        target[i] = (uint8_t)byte;
+    }
+}
+
+
+/*
+    Dither a screen of grey levels by Floyd-Steinberg error diffusion:
+    each pixel's difference from black or white is passed on 7/16 to the
+    right, and 3/16, 5/16 and 1/16 to the row below. Only this row's and
+    the next row's errors are kept, in sixteenths, with a spare column
+    on the left so the edge needs no test.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - screen: Pointer to the screen's grey levels.
+        - raw:    Pointer to the screenshot, cleared.
+*/
+static void diffuse_errors(const uint8_t* screen, uint8_t* raw) {
+
+    // The errors bound for the pixel to the right and the two below
+    // that are still collecting are kept in locals, so each pixel makes
+    // one store, and each byte of the screenshot is written once
+    int32_t errors[2][N2B_WIDTH + 1];
+    memset(errors, 0, sizeof(errors));
+    for (uint32_t row = 0 ; row < N2B_HEIGHT ; ++row) {
+        const int32_t* current = errors[row & 0x01] + 1;
+        int32_t* next = errors[(row + 1) & 0x01] + 1;
+        const uint8_t* levels = screen + row * N2B_WIDTH;
+        uint8_t* target = raw + row * N2B_RAW_ROW_SIZE;
+        int32_t right = 0;
+        int32_t below_left = 0;
+        int32_t below = 0;
+        unsigned int byte = 0;
+        for (uint32_t x = 0 ; x < N2B_WIDTH ; ++x) {
+            int32_t value = levels[x] + (current[x] + right) / 16;
+            int32_t error = value;
+            byte <<= 1;
+            if (value < INK_THRESHOLD) {
+                byte |= 1;
+            } else {
+                error -= PAPER_LEVEL;
+            }
+
+            if ((x & 0x07) == 0x07) target[x >> 3] = (uint8_t)byte;
+            right = error * 7;
+            next[(int32_t)x - 1] = below_left + error * 3;
+            below_left = below + error * 5;
+            below = error;
+        }
+
+        next[N2B_WIDTH - 1] = below_left;
+    }
+}
+
+
+/*
+    Gather the cells of a row of text, each as the six bits of each of
+    its pixel rows, top row in the highest bits.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - bitmap:   Pointer to the screen.
+        - text_row: The row of text, counting from the top.
+        - columns:  The number of cells in the row.
+        - cells:    Pointer to the buffer for the cells.
+*/
+static void read_cells(const N2BBitmap* bitmap, uint32_t text_row, uint32_t columns, uint64_t* cells) {
+
+    uint32_t row_size = (bitmap->width + 7) / 8;
+    memset(cells, 0, columns * sizeof(uint64_t));
+    for (uint32_t line = 0 ; line < N2B_GLYPH_HEIGHT ; ++line) {
+        const uint8_t* pixels = bitmap->pixels + (size_t)(text_row * N2B_GLYPH_HEIGHT + line) * bitmap->stride;
+        uint32_t column = 0;
+        for (const uint8_t* group = pixels ; column + 4 <= columns ; column += 4, group += 3) {
+            uint32_t bits = ((uint32_t)group[0] << 16) | ((uint32_t)group[1] << 8) | group[2];
+            cells[column] = (cells[column] << N2B_GLYPH_WIDTH) | (bits >> 18);
+            cells[column + 1] = (cells[column + 1] << N2B_GLYPH_WIDTH) | ((bits >> 12) & 0x3F);
+            cells[column + 2] = (cells[column + 2] << N2B_GLYPH_WIDTH) | ((bits >> 6) & 0x3F);
+            cells[column + 3] = (cells[column + 3] << N2B_GLYPH_WIDTH) | (bits & 0x3F);
+        }
+
+        // Screens not a multiple of four cells wide end in a part group
+        for ( ; column < columns ; ++column) {
+            uint32_t position = column * N2B_GLYPH_WIDTH;
+            uint32_t index = position >> 3;
+            uint32_t bits = ((uint32_t)pixels[index] << 8) | (index + 1 < row_size ? pixels[index + 1] : 0);
+            cells[column] = (cells[column] << N2B_GLYPH_WIDTH) | ((bits >> (10 - (position & 0x07))) & 0x3F);
+        }
+    }
+}
+
+
+/*
+    Find the slot a glyph starts its search for in a font's table.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - glyph: The glyph's pixels.
+
+    - Returns: The slot.
+*/
+static inline uint32_t glyph_slot(uint64_t glyph) {
+
+    return (uint32_t)((glyph * UINT64_C(0x9E3779B97F4A7C15)) >> 55) & (N2B_FONT_TABLE_SIZE - 1);
+}
+
+
+/*
+    Look a cell up in a font.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - font:  Pointer to the font.
+        - glyph: The cell's pixels.
+
+    - Returns: The character code, or -1 if no glyph matches.
+*/
+static int find_glyph(const N2BFont* font, uint64_t glyph) {
+
+    for (uint32_t slot = glyph_slot(glyph) ; font->glyphs[slot] != FONT_SLOT_EMPTY ; slot = (slot + 1) & (N2B_FONT_TABLE_SIZE - 1)) {
+        if (font->glyphs[slot] == glyph) return font->codes[slot];
+    }
+
+    return -1;
+}
+
+
+/*
+    Wait for a byte from an XMODEM sender.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - fd:      The descriptor to read.
+        - timeout: How long to wait, in milliseconds.
+
+    - Returns: The byte, XMODEM_TIMED_OUT, or XMODEM_LINE_FAILED if the
+               line was closed or couldn't be read.
+*/
+static int xmodem_read_byte(int fd, int timeout) {
+
+    uint8_t byte = 0;
+    if (!xmodem_read(fd, &byte, 1, timeout)) {
+        struct pollfd line = {.fd = fd, .events = POLLIN};
+        return poll(&line, 1, 0) > 0 && (line.revents & (POLLHUP | POLLERR | POLLNVAL)) != 0 ? XMODEM_LINE_FAILED : XMODEM_TIMED_OUT;
+    }
+
+    return byte;
+}
+
+
+/*
+    Read bytes from an XMODEM sender, as many at a time as have
+    arrived, waiting up to the timeout for each batch.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - fd:      The descriptor to read.
+        - data:    Pointer to the buffer for the bytes.
+        - size:    The number of bytes to read.
+        - timeout: How long to wait for more bytes, in milliseconds.
+
+    - Returns: `true` if all the bytes were read, otherwise `false`.
+*/
+static bool xmodem_read(int fd, uint8_t* data, size_t size, int timeout) {
+
+    size_t count = 0;
+    while (count < size) {
+        struct pollfd line = {.fd = fd, .events = POLLIN};
+        int ready = poll(&line, 1, timeout);
+        if (ready < 0 && errno == EINTR) continue;
+        if (ready <= 0 || (line.revents & POLLIN) == 0) return false;
+
+        ssize_t result = read(fd, data + count, size - count);
+        if (result < 0 && (errno == EINTR || errno == EAGAIN)) continue;
+        if (result <= 0) return false;
+        count += result;
+    }
+
+    return true;
+}
+
+
+/*
+    Send a control byte to an XMODEM sender.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - fd:   The descriptor to write.
+        - byte: The byte, eg. XMODEM_ACK.
+
+    - Returns: `true` if the byte was sent, otherwise `false`.
+*/
+static bool xmodem_send(int fd, uint8_t byte) {
+
+    while (1) {
+        ssize_t result = write(fd, &byte, 1);
+        if (result == 1) return true;
+        if (result < 0 && errno == EINTR) continue;
+        return false;
+    }
+}
+
+
+/*
+    Discard the rest of a bad block: everything until the sender has
+    been quiet for a second, so it's waiting to be told to send again.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - fd: The descriptor to read.
+*/
+static void xmodem_purge(int fd) {
+
+    uint8_t discard[XMODEM_BLOCK_SIZE];
+    while (1) {
+        struct pollfd line = {.fd = fd, .events = POLLIN};
+        if (poll(&line, 1, XMODEM_BYTE_TIMEOUT) <= 0 || (line.revents & POLLIN) == 0) return;
+        if (read(fd, discard, sizeof(discard)) <= 0) return;
+    }
+}
+
+
+/*
+    Tell an XMODEM sender to give up.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - fd: The descriptor to write.
+*/
+static void xmodem_cancel(int fd) {
+
+    for (unsigned int i = 0 ; i < 3 ; ++i) xmodem_send(fd, XMODEM_CAN);
+}
+
+
+/*
+    Check a block's data against the CRC-16 (XMODEM's, big-endian) or
+    the eight-bit checksum that follows it.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - data:    Pointer to the data, followed by the check bytes.
+        - size:    The number of bytes of data.
+        - use_crc: Is there a CRC rather than a checksum?
+
+    - Returns: `true` if the data is intact, otherwise `false`.
+*/
+static bool xmodem_check(const uint8_t* data, size_t size, bool use_crc) {
+
+    if (!use_crc) {
+        uint8_t sum = 0;
+        for (size_t i = 0 ; i < size ; ++i) sum += data[i];
+        return sum == data[size];
+    }
+
+    uint16_t crc = 0;
+    for (size_t i = 0 ; i < size ; ++i) {
+        crc ^= (uint16_t)(data[i] << 8);
+        for (unsigned int bit = 0 ; bit < 8 ; ++bit) crc = (uint16_t)(crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1);
+    }
+
+    return crc == ((data[size] << 8) | data[size + 1]);
+}
+
+
+/*
+    Work out the size of a screenshot received by XMODEM: the length a
+    +3DOS header gives, or a screen's size, which the data received
+    must match, allowing for padding in the last block.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - raw:        Pointer to the data received.
+        - received:   The number of bytes received, padding included.
+        - block_size: The size of the last block.
+
+    - Returns: The screenshot's size, which may be more than was received
+               if a header gives it, or 0 if the data is no screenshot.
+*/
+static size_t xmodem_screenshot_size(const uint8_t* raw, size_t received, size_t block_size) {
+
+    size_t stored = received < N2B_SOURCE_SIZE_MAX ? received : N2B_SOURCE_SIZE_MAX;
+    size_t length = plus3dos_length(raw, stored);
+    size_t offset = length > 0 ? N2B_HEADER_SIZE : 0;
+    for (unsigned int i = 0 ; i < N2B_GEOMETRY_COUNT ; ++i) {
+        size_t size = offset + GEOMETRIES[i].raw_size;
+        if (length > 0 ? length != size : received < size || received - size >= block_size) continue;
+
+        // Anything past the block with the end of the screenshot is too much
+        return received > size && received - size >= block_size ? 0 : size;
+    }
+
+    return 0;
+}
+
+
+/*
+    Calculate the largest BMP that `encode_bmp()` can produce. For
+    uncompressed output, this is the exact size.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - job: Pointer to the bitmap and its settings.
+
+    - Returns: The size in bytes.
+*/
+static size_t bmp_size_max(const EncodeJob* job) {
+
+    if (job->compress) return BMP_V5_HEADER_DATA_SIZE + RLE_DATA_SIZE_MAX((size_t)job->width, job->height);
+    return BMP_V5_HEADER_DATA_SIZE + (size_t)row_stride(job->width, job->depth) * job->height;
+}
+
+
+/*
+    Encode a bitmap as a BMP, at any supported depth, optionally
+    run-length encoded. The stock headers are copied and then updated
+    for the image's size, depth and resolution. The pixels follow a
+    band of source rows at a time, bottom row first, as BMP reverses
+    Amstrad's row order. The size of compressed pixel data isn't known
+    until it's encoded, so if the image is sure to stay in the output
+    buffer, the headers are completed afterwards; if not, the rows are
+    all encoded once beforehand to find it.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - job:  Pointer to the bitmap and its settings.
+        - sink: Pointer to the output.
+
+    - Returns: `true` on success, or `false` if out of memory.
+*/
+static bool encode_bmp(const EncodeJob* job, ImageSink* sink) {
+
+    uint32_t stride = row_stride(job->width, job->depth);
+
+    // Compressed rows are expanded to a byte per pixel, then encoded
+    Expander expander;
+    if (!expander_init_for_job(&expander, job, job->compress ? 8 : job->depth)) return false;
+    BandEncoder encode_band = job->compress ? encode_rle_band : encode_bmp_band;
+    size_t row_size_max = job->compress ? RLE_ROW_SIZE_MAX((size_t)job->width) : stride;
+    size_t scratch_size = job->compress ? job->width : 0;
+
+    size_t pixel_data_size = (size_t)stride * job->height;
+    bool complete_later = job->compress && sink->capacity - sink->size >= bmp_size_max(job);
+    if (job->compress && !complete_later && !encode_bands(job, NULL, encode_band, &expander, row_size_max, scratch_size, true, &pixel_data_size)) {
+        expander_free(&expander);
+        return false;
+    }
+
+    // Copy in the stock headers and CLT, then set the sizes, depth and
+    // resolution, which vary with the options
+    uint8_t header[BMP_V5_HEADER_DATA_SIZE];
+    uint8_t* dib_header = header + sizeof(BMP_HEADER);
+    memcpy(header, BMP_HEADER, sizeof(BMP_HEADER));
+    memcpy(dib_header, DIB_V5_HEADER, sizeof(DIB_V5_HEADER));
+    memcpy(dib_header + sizeof(DIB_V5_HEADER), BMP_CLT, sizeof(BMP_CLT));
+    set_header_value(&header[BMP_HEADER_FILE_SIZE_INDEX], (uint32_t)(BMP_V5_HEADER_DATA_SIZE + pixel_data_size));
+    set_header_value(&dib_header[DIB_V5_HEADER_WIDTH_INDEX], job->width);
+    set_header_value(&dib_header[DIB_V5_HEADER_HEIGHT_INDEX], job->height);
+    set_header_value(&dib_header[DIB_V5_HEADER_DATA_SIZE_INDEX], (uint32_t)pixel_data_size);
+    set_header_value(&dib_header[DIB_V5_HEADER_H_RESOLUTION_INDEX], job->resolution);
+    set_header_value(&dib_header[DIB_V5_HEADER_V_RESOLUTION_INDEX], job->resolution);
+    dib_header[DIB_V5_HEADER_BITS_PER_PIXEL_INDEX] = (uint8_t)job->depth;
+    if (job->compress) dib_header[DIB_V5_HEADER_COMPRESSION_INDEX] = job->depth == 8 ? BI_RLE8 : BI_RLE4;
+    sink_put(sink, header, sizeof(header));
+    stage_end(job->stats, N2B_STAGE_HEADER, job->timer);
+
+    uint8_t* output_header = sink->data + sink->size - sizeof(header);
+    bool ok = encode_bands(job, sink, encode_band, &expander, row_size_max, scratch_size, true, &pixel_data_size);
+    if (ok && complete_later && !sink->failed) {
+        set_header_value(&output_header[BMP_HEADER_FILE_SIZE_INDEX], (uint32_t)(BMP_V5_HEADER_DATA_SIZE + pixel_data_size));
+        set_header_value(&output_header[sizeof(BMP_HEADER) + DIB_V5_HEADER_DATA_SIZE_INDEX], (uint32_t)pixel_data_size);
+    }
+
+    expander_free(&expander);
+    return ok;
+}
+
+
+/*
+    Encode a band of uncompressed BMP rows. Each source row is expanded
+    straight into the output, padded, then copied for its other rows.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - job:       Pointer to the bitmap and its settings.
+        - context:   Pointer to the expander for the scale and depth.
+        - first_row: The first row of the band, counting from the bottom.
+        - row_count: The number of source rows in the band.
+        - scratch:   Unused.
+        - target:    Pointer to the output.
+        - size:      Pointer to a variable set to the number of bytes written.
+
+    - Returns: `true`.
+*/
+static bool encode_bmp_band(const EncodeJob* job, void* context, uint32_t first_row, uint32_t row_count, uint8_t* scratch, uint8_t* target, size_t* size) {
+
+    (void)scratch;
+    const N2BBitmap* bitmap = job->bitmap;
+    const Expander* expander = (const Expander*)context;
+    uint32_t stride = row_stride(job->width, job->depth);
+    uint32_t used = (uint32_t)(((size_t)job->width * job->depth + 7) / 8);
+    uint8_t* out = target;
+    for (uint32_t i = first_row ; i < first_row + row_count ; ++i) {
+        uint32_t row = bitmap->height - 1 - i;
+        unsigned int repeat = row_repeat(job, row);
+        expand(expander, bitmap->pixels + row * bitmap->stride, bitmap->width / 8, out);
+        if (stride > used) memset(out + used, 0, stride - used);
+        for (unsigned int copy = 1 ; copy < repeat ; ++copy) memcpy(out + copy * stride, out, stride);
+        out += (size_t)stride * repeat;
+    }
+
+    *size = (size_t)(out - target);
+    return true;
+}
+
+
+/*
+    Encode a band of run-length encoded BMP rows. Each source row is
+    scaled and encoded once, then the encoded row is copied for its other
+    rows. The image's last row ends with an end-of-bitmap marker rather
+    than an end-of-line marker.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - job:       Pointer to the bitmap and its settings.
+        - context:   Pointer to the 8bpp expander for the scale.
+        - first_row: The first row of the band, counting from the bottom.
+        - row_count: The number of source rows in the band.
+        - scratch:   Pointer to room for a scaled row, at a byte per pixel.
+        - target:    Pointer to the output.
+        - size:      Pointer to a variable set to the number of bytes written.
+
+    - Returns: `true`.
+*/
+static bool encode_rle_band(const EncodeJob* job, void* context, uint32_t first_row, uint32_t row_count, uint8_t* scratch, uint8_t* target, size_t* size) {
+
+    const N2BBitmap* bitmap = job->bitmap;
+    const Expander* expander = (const Expander*)context;
+    uint8_t* out = target;
+    for (uint32_t i = first_row ; i < first_row + row_count ; ++i) {
+        uint32_t row = bitmap->height - 1 - i;
+        unsigned int repeat = row_repeat(job, row);
+        uint32_t encoded_size = encode_rle_row(bitmap->pixels + row * bitmap->stride, bitmap->width / 8, job->width, expander, job->depth, scratch, out);
+        for (unsigned int copy = 1 ; copy < repeat ; ++copy) memcpy(out + copy * encoded_size, out, encoded_size);
+        out += (size_t)encoded_size * repeat;
+        if (row == 0) out[-1] = 1;
+    }
+
+    *size = (size_t)(out - target);
+    return true;
+}
+
+
+/*
+    Calculate the largest PNG that `encode_png()` can produce: deflate's
+    fixed Huffman codes take at most nine bits per byte, and the data is
+    split into IDAT chunks, which, when deflated a band at a time, each
+    end with a flush.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - job: Pointer to the bitmap and its settings.
+
+    - Returns: The size in bytes.
+*/
+static size_t png_size_max(const EncodeJob* job) {
+
+    size_t filtered_size = (size_t)((job->width + 7) / 8 + 1) * job->height;
+    size_t deflated_size = (filtered_size * 9 + 7) / 8 + 4;
+    return PNG_FIXED_SIZE + deflated_size + (deflated_size / PNG_IDAT_SIZE + job->bitmap->height) * (PNG_CHUNK_OVERHEAD + 8);
+}
+
+
+/*
+    Encode a bitmap as a 1bpp palette PNG, using the BMP colours. Each
+    source row is expanded with the 1bpp expansion tables and deflated
+    as a band of scaled rows. A scaled row that repeats the one above it
+    uses the Up filter, which makes it all zeros; other rows are left
+    unfiltered, as the PNG spec suggests for palette images. The deflated
+    data is written out in IDAT chunks as it builds up.
+
+    Large images may be deflated on several threads instead, each taking
+    a band of source rows. Every band is a separate series of blocks,
+    given the rows just above it as a preset dictionary so matches can
+    still reach back into them, and ends with a flush to a byte boundary,
+    so the bands can go one after another into an IDAT chunk each. Their
+    checksums are combined for the end of the stream.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - job:  Pointer to the bitmap and its settings.
+        - sink: Pointer to the output.
+
+    - Returns: `true` on success, or `false` if out of memory.
+*/
+static bool encode_png(const EncodeJob* job, ImageSink* sink) {
+
+    const N2BBitmap* bitmap = job->bitmap;
+    unsigned int factor = job->factor;
+    uint32_t row_size = (job->width + 7) / 8 + 1;
+    size_t band_size = (size_t)row_size * factor;
+    Expander expander;
+    if (!expander_init_for_job(&expander, job, 1)) return false;
+
+    // Signature and header: 1bpp, palette colour, no interlacing
+    uint8_t header[8 + (PNG_CHUNK_OVERHEAD + 13) + (PNG_CHUNK_OVERHEAD + 6) + (PNG_CHUNK_OVERHEAD + 9)];
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A};
+    memcpy(header, signature, sizeof(signature));
+    uint8_t* header_chunk = header + sizeof(signature);
+    put_big_endian(header_chunk + 8, job->width);
+    put_big_endian(header_chunk + 12, job->height);
+    header_chunk[16] = 1;
+    header_chunk[17] = 3;
+    header_chunk[18] = 0;
+    header_chunk[19] = 0;
+    header_chunk[20] = 0;
+    header_chunk += finish_png_chunk(header_chunk, "IHDR", 13);
+
+    // The palette, from the BMP's BGRA colours
+    for (unsigned int i = 0 ; i < 2 ; ++i) {
+        header_chunk[8 + i * 3] = BMP_CLT[i * 4 + 2];
+        header_chunk[9 + i * 3] = BMP_CLT[i * 4 + 1];
+        header_chunk[10 + i * 3] = BMP_CLT[i * 4];
+    }
+
+    header_chunk += finish_png_chunk(header_chunk, "PLTE", 6);
+
+    // The resolution, matching the BMP's
+    put_big_endian(header_chunk + 8, job->resolution);
+    put_big_endian(header_chunk + 12, job->resolution);
+    header_chunk[16] = 1;
+    finish_png_chunk(header_chunk, "pHYs", 9);
+    sink_put(sink, header, sizeof(header));
+
+    if (runs_in_parallel(job)) {
+        // Each band's output is at most nine bits a byte, plus its chunk and flush
+        PNGBands bands = {
+            .expander = &expander,
+            .row_size = row_size,
+            .adlers = calloc(bitmap->height, sizeof(uint32_t)),
+            .lengths = calloc(bitmap->height, sizeof(size_t))
+        };
+
+        size_t total = 0;
+        bool ok = bands.adlers != NULL && bands.lengths != NULL
+               && encode_bands(job, sink, encode_png_band, &bands, (row_size * 9 + 7) / 8 + PNG_CHUNK_OVERHEAD + 16, band_size, false, &total);
+
+        // The stream ends with an empty final block and the combined checksum
+        uint32_t adler = 1;
+        for (uint32_t row = 0 ; ok && row < bitmap->height ; ++row) {
+            if (bands.lengths[row] > 0) adler = adler32_combine(adler, bands.adlers[row], bands.lengths[row]);
+        }
+
+        uint8_t end[PNG_CHUNK_OVERHEAD + 6 + PNG_CHUNK_OVERHEAD];
+        end[8] = 0x03;
+        end[9] = 0x00;
+        put_big_endian(end + 10, adler);
+        size_t end_size = finish_png_chunk(end, "IDAT", 6);
+        end_size += finish_png_chunk(end + end_size, "IEND", 0);
+        if (ok) sink_put(sink, end, end_size);
+        free(bands.adlers);
+        free(bands.lengths);
+        expander_free(&expander);
+        return ok;
+    }
+
+    // The band's copies of its first row are all filtered to zeros. A
+    // chunk is written out once it passes PNG_IDAT_SIZE bytes, so needs
+    // room for that and for the most a band can add
+    size_t chunk_capacity = PNG_CHUNK_OVERHEAD + PNG_IDAT_SIZE + ((band_size + DEFLATE_MATCH_MAX + DEFLATE_MATCH_MIN) * 9 + 7) / 8 + 16;
+    uint8_t* band = calloc(band_size, 1);
+    uint8_t* chunk = malloc(chunk_capacity);
+    DeflateStream stream;
+    if (band == NULL || chunk == NULL || !deflate_init(&stream, row_size, band_size, (size_t)row_size * job->height, chunk + 8, true)) {
+        free(band);
+        free(chunk);
+        expander_free(&expander);
+        return false;
+    }
+
+    band[0] = PNG_FILTER_NONE;
+    for (unsigned int copy = 1 ; copy < factor ; ++copy) band[copy * row_size] = PNG_FILTER_UP;
+
+    for (uint32_t row = 0 ; row < bitmap->height ; ++row) {
+        expand_line(bitmap, row, &expander, band + 1);
+        deflate_band(&stream, band, (size_t)row_size * row_repeat(job, row));
+        if (row == bitmap->height - 1) deflate_finish(&stream);
+
+        uint32_t idat_size = (uint32_t)(stream.writer.target - (chunk + 8));
+        if (idat_size >= PNG_IDAT_SIZE || row == bitmap->height - 1) {
+            sink_put(sink, chunk, finish_png_chunk(chunk, "IDAT", idat_size));
+            stream.writer.target = chunk + 8;
+        }
+    }
+
+    uint8_t end[PNG_CHUNK_OVERHEAD];
+    sink_put(sink, end, finish_png_chunk(end, "IEND", 0));
+    free(band);
+    free(chunk);
+    expander_free(&expander);
+    deflate_free(&stream);
+    return true;
+}
+
+
+/*
+    Deflate a band of PNG rows into an IDAT chunk of its own, for
+    `encode_png()`. The first band starts the zlib stream.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - job:       Pointer to the bitmap and its settings.
+        - context:   Pointer to the PNG's band settings, which take the
+                     band's checksum and length.
+        - first_row: The first source row of the band.
+        - row_count: The number of source rows in the band.
+        - scratch:   Pointer to room for a source row's scaled rows.
+        - target:    Pointer to the output.
+        - size:      Pointer to a variable set to the number of bytes written.
+
+    - Returns: `true` on success, or `false` if out of memory.
+*/
+static bool encode_png_band(const EncodeJob* job, void* context, uint32_t first_row, uint32_t row_count, uint8_t* scratch, uint8_t* target, size_t* size) {
+
+    PNGBands* bands = (PNGBands*)context;
+    uint32_t row_size = bands->row_size;
+    size_t data_size = 0;
+    for (uint32_t row = first_row ; row < first_row + row_count ; ++row) data_size += (size_t)row_size * row_repeat(job, row);
+
+    // The rows above the band make the dictionary, as far as the window reaches
+    size_t preset_size = first_row > 0 ? fill_png_band(job, bands->expander, first_row - 1, row_size, scratch) : 0;
+    size_t preset_start = preset_size > DEFLATE_WINDOW_SIZE ? preset_size - DEFLATE_WINDOW_SIZE : 0;
+
+    uint8_t* data = target + 8;
+    if (first_row == 0) {
+        *data++ = 0x78;
+        *data++ = 0x01;
+    }
+
+    DeflateStream stream;
+    if (!deflate_init(&stream, row_size, (size_t)row_size * job->factor, preset_size - preset_start + data_size, data, false)) return false;
+    deflate_preset(&stream, scratch + preset_start, preset_size - preset_start);
+    for (uint32_t row = first_row ; row < first_row + row_count ; ++row) {
+        deflate_band(&stream, scratch, fill_png_band(job, bands->expander, row, row_size, scratch));
+    }
+
+    deflate_flush(&stream);
+    bands->adlers[first_row] = stream.adler;
+    bands->lengths[first_row] = data_size;
+    *size = finish_png_chunk(target, "IDAT", (uint32_t)(stream.writer.target - (target + 8)));
+    deflate_free(&stream);
+    return true;
+}
+
+
+/*
+    Fill in the filtered PNG rows of one source row: the row itself,
+    unfiltered, then its copies, filtered Up to zeros.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - job:      Pointer to the bitmap and its settings.
+        - expander: Pointer to the 1bpp expander for the scale.
+        - row:      The source row.
+        - row_size: The size of a PNG row, including its filter byte.
+        - band:     Pointer to room for the rows.
+
+    - Returns: The number of bytes filled in.
+*/
+static uint32_t fill_png_band(const EncodeJob* job, const Expander* expander, uint32_t row, uint32_t row_size, uint8_t* band) {
+
+    unsigned int repeat = row_repeat(job, row);
+    band[0] = PNG_FILTER_NONE;
+    expand_line(job->bitmap, row, expander, band + 1);
+    memset(band + row_size, 0, (size_t)row_size * (repeat - 1));
+    for (unsigned int copy = 1 ; copy < repeat ; ++copy) band[copy * row_size] = PNG_FILTER_UP;
+    return row_size * repeat;
+}
+
+
+/*
+    Calculate the largest PCX that `encode_pcx()` can produce: at worst,
+    every byte of every line is written as a run of one.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - job: Pointer to the bitmap and its settings.
+
+    - Returns: The size in bytes.
+*/
+static size_t pcx_size_max(const EncodeJob* job) {
+
+    uint32_t line_size = (job->width + 15) / 16 * 2;
+    return PCX_HEADER_SIZE + (size_t)line_size * 2 * job->height;
+}
+
+
+/*
+    Encode a bitmap as a 1bpp, run-length encoded PCX. Readers often
+    ignore the palette of a 1bpp PCX and show clear bits as black, so
+    the pixels are inverted and the palette given in that order. Each
+    scaled line is encoded once, and written as many times as the scale.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - job:  Pointer to the bitmap and its settings.
+        - sink: Pointer to the output.
+
+    - Returns: `true` on success, or `false` if out of memory.
+*/
+static bool encode_pcx(const EncodeJob* job, ImageSink* sink) {
+
+    uint32_t line_size = (job->width + 15) / 16 * 2;
+    Expander expander;
+    if (!expander_init_for_job(&expander, job, 1)) return false;
+
+    // Header: version 5, run-length encoded, 1bpp, one plane, and the
+    // palette's two colours, ink then paper, from the BMP's BGRA colours
+    uint8_t header[PCX_HEADER_SIZE];
+    uint32_t dots_per_inch = (job->resolution * 254 + 5000) / 10000;
+    memset(header, 0, PCX_HEADER_SIZE);
+    header[0] = 0x0A;
+    header[1] = 5;
+    header[2] = 1;
+    header[3] = 1;
+    set_short_value(header + PCX_X_MAX_INDEX, job->width - 1);
+    set_short_value(header + PCX_Y_MAX_INDEX, job->height - 1);
+    set_short_value(header + PCX_H_RESOLUTION_INDEX, dots_per_inch);
+    set_short_value(header + PCX_V_RESOLUTION_INDEX, dots_per_inch);
+    for (unsigned int i = 0 ; i < 2 ; ++i) {
+        const uint8_t* colour = BMP_CLT + (1 - i) * 4;
+        header[PCX_PALETTE_INDEX + i * 3] = colour[2];
+        header[PCX_PALETTE_INDEX + i * 3 + 1] = colour[1];
+        header[PCX_PALETTE_INDEX + i * 3 + 2] = colour[0];
+    }
+
+    header[PCX_PLANES_INDEX] = 1;
+    set_short_value(header + PCX_LINE_SIZE_INDEX, line_size);
+    header[PCX_PALETTE_INFO_INDEX] = 1;
+    sink_put(sink, header, PCX_HEADER_SIZE);
+
+    size_t total = 0;
+    bool ok = encode_bands(job, sink, encode_pcx_band, &expander, (size_t)line_size * 2, (size_t)line_size * 3, false, &total);
+    expander_free(&expander);
+    return ok;
+}
+
+
+/*
+    Encode a band of PCX lines. Each source row is scaled into a line,
+    which is inverted and encoded once, then the encoded line is copied
+    out for each of its rows.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - job:       Pointer to the bitmap and its settings.
+        - context:   Pointer to the 1bpp expander for the scale.
+        - first_row: The first source row of the band.
+        - row_count: The number of source rows in the band.
+        - scratch:   Pointer to room for a line and its encoding.
+        - target:    Pointer to the output.
+        - size:      Pointer to a variable set to the number of bytes written.
+
+    - Returns: `true`.
+*/
+static bool encode_pcx_band(const EncodeJob* job, void* context, uint32_t first_row, uint32_t row_count, uint8_t* scratch, uint8_t* target, size_t* size) {
+
+    const Expander* expander = (const Expander*)context;
+    uint32_t line_size = (job->width + 15) / 16 * 2;
+    uint32_t used = (job->width + 7) / 8;
+    uint8_t* encoded = scratch + line_size;
+    uint8_t* out = target;
+    for (uint32_t row = first_row ; row < first_row + row_count ; ++row) {
+        expand_line(job->bitmap, row, expander, scratch);
+        for (uint32_t i = 0 ; i < used ; ++i) scratch[i] = ~scratch[i];
+
+        // The padding byte, if any, is paper
+        if (line_size > used) scratch[used] = 0xFF;
+        uint32_t length = pcx_encode_line(scratch, line_size, encoded);
+        unsigned int repeat = row_repeat(job, row);
+        for (unsigned int copy = 0 ; copy < repeat ; ++copy) {
+            memcpy(out, encoded, length);
+            out += length;
+        }
+    }
+
+    *size = (size_t)(out - target);
+    return true;
+}
+
+
+/*
+    Run-length encode a line of PCX data. Runs of up to 63 identical bytes
+    are written as a count byte (0xC0 + count) then the data byte. Single
+    bytes are written as is, unless their top two bits are set, in which
+    case they need a count of one to tell them from count bytes.
+
+    FROM 0.5.0 -- from `notepad2pcx`'s `encode_row()`
+
+    - Parameters:
+        - line:   Pointer to the line data.
+        - length: The number of bytes in the line.
+        - target: Pointer to the output buffer, which needs room for
+                  up to twice the line length.
+
+    - Returns: The number of bytes written.
+*/
+static uint32_t pcx_encode_line(const uint8_t* line, uint32_t length, uint8_t* target) {
+
+    uint32_t count = 0;
+    uint32_t i = 0;
+
+    while (i < length) {
+        uint32_t run = 1;
+        while (i + run < length && run < PCX_RUN_MAX && line[i + run] == line[i]) run++;
+
+        if (run > 1 || line[i] >= 0xC0) target[count++] = (uint8_t)(0xC0 | run);
+        target[count++] = line[i];
+        i += run;
+    }
+
+    return count;
+}
+
+
+/*
+    Calculate the size of a raw bitmap: packed 1bpp rows, with no header.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - job: Pointer to the bitmap and its settings.
+
+    - Returns: The size in bytes.
+*/
+static size_t raw_size_max(const EncodeJob* job) {
+
+    return (size_t)((job->bitmap->width * job->factor + 7) / 8) * job->bitmap->height * job->factor;
+}
+
+
+/*
+    Write a bitmap's pixels as they are held in memory, at the output
+    scale: 1bpp, most significant bit leftmost, top row first, with no
+    header or row padding. A set bit is a black pixel.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - job:  Pointer to the bitmap and its settings.
+        - sink: Pointer to the output.
+
+    - Returns: `true` on success, or `false` if out of memory.
+*/
+static bool encode_raw(const EncodeJob* job, ImageSink* sink) {
+
+    Expander expander;
+    if (!expander_init_for_job(&expander, job, 1)) return false;
+
+    size_t total = 0;
+    bool ok = encode_bands(job, sink, encode_raw_band, &expander, (job->width + 7) / 8, 0, false, &total);
+    expander_free(&expander);
+    return ok;
+}
+
+
+/*
+    Write a band of raw rows. Each source row is expanded straight into
+    the output, then copied for its other rows.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - job:       Pointer to the bitmap and its settings.
+        - context:   Pointer to the 1bpp expander for the scale.
+        - first_row: The first source row of the band.
+        - row_count: The number of source rows in the band.
+        - scratch:   Unused.
+        - target:    Pointer to the output.
+        - size:      Pointer to a variable set to the number of bytes written.
+
+    - Returns: `true`.
+*/
+static bool encode_raw_band(const EncodeJob* job, void* context, uint32_t first_row, uint32_t row_count, uint8_t* scratch, uint8_t* target, size_t* size) {
+
+    (void)scratch;
+    const Expander* expander = (const Expander*)context;
+    uint32_t row_size = (job->width + 7) / 8;
+    uint8_t* out = target;
+    for (uint32_t row = first_row ; row < first_row + row_count ; ++row) {
+        unsigned int repeat = row_repeat(job, row);
+        expand_line(job->bitmap, row, expander, out);
+        for (unsigned int copy = 1 ; copy < repeat ; ++copy) memcpy(out + copy * row_size, out, row_size);
+        out += (size_t)row_size * repeat;
+    }
+
+    *size = (size_t)(out - target);
+    return true;
+}
+
+
+/*
+    Write one row of a bitmap at 1bpp, scaled across by nearest neighbour.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - bitmap:   Pointer to the bitmap.
+        - row:      The row to write.
+        - expander: Pointer to the 1bpp expander for the scale.
+        - target:   Pointer to the buffer for the row.
+*/
+static void expand_line(const N2BBitmap* bitmap, uint32_t row, const Expander* expander, uint8_t* target) {
+
+    expand(expander, bitmap->pixels + row * bitmap->stride, bitmap->width / 8, target);
+}
+
+
+/*
+    Complete a PNG chunk whose data is already in place, adding its
+    length, type and CRC.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - chunk:  Pointer to the start of the chunk.
+        - type:   Pointer to the four-character chunk type.
+        - length: The number of bytes of chunk data.
+
+    - Returns: The size of the whole chunk in bytes.
+*/
+static size_t finish_png_chunk(uint8_t* chunk, const char* type, uint32_t length) {
+
+    pthread_once(&deflate_tables_once, build_deflate_tables);
+
+    put_big_endian(chunk, length);
+    memcpy(chunk + 4, type, 4);
+    uint32_t crc = crc32_update(0xFFFFFFFF, chunk + 4, length + 4) ^ 0xFFFFFFFF;
+    put_big_endian(chunk + 8 + length, crc);
+    return PNG_CHUNK_OVERHEAD + length;
+}
+
+
+/*
+    Write a 32-bit value most significant byte first, as PNG does.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - data:  Pointer to the four bytes to write.
+        - value: The value to write.
+*/
+static void put_big_endian(uint8_t* data, uint32_t value) {
+
+    data[0] = (uint8_t)(value >> 24);
+    data[1] = (uint8_t)(value >> 16);
+    data[2] = (uint8_t)(value >> 8);
+    data[3] = (uint8_t)value;
+}
+
+
+/*
+    Read a 32-bit value stored most significant byte first, as PNG does.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - data: Pointer to the four bytes to read.
+
+    - Returns: The value.
+*/
+static uint32_t get_big_endian(const uint8_t* data) {
+
+    return (uint32_t)data[0] << 24 | (uint32_t)data[1] << 16 | (uint32_t)data[2] << 8 | (uint32_t)data[3];
+}
+
+
+/*
+    Build the deflate and CRC tables. Huffman codes are sent most
+    significant bit first, so they are stored reversed, ready to pack.
+
+    FROM 0.5.0
+*/
+static void build_deflate_tables(void) {
+
+    for (unsigned int symbol = 0 ; symbol < 288 ; ++symbol) {
+        unsigned int code, length;
+        if (symbol < 144) {
+            code = 0x30 + symbol;
+            length = 8;
+        } else if (symbol < 256) {
+            code = 0x190 + symbol - 144;
+            length = 9;
+        } else if (symbol < 280) {
+            code = symbol - 256;
+            length = 7;
+        } else {
+            code = 0xC0 + symbol - 280;
+            length = 8;
+        }
+
+        unsigned int reversed = 0;
+        for (unsigned int i = 0 ; i < length ; ++i) reversed |= ((code >> i) & 0x01) << (length - 1 - i);
+        FIXED_CODES[symbol] = (uint16_t)reversed;
+        FIXED_CODE_LENGTHS[symbol] = (uint8_t)length;
+    }
+
+    unsigned int code = 0;
+    for (unsigned int length = DEFLATE_MATCH_MIN ; length <= DEFLATE_MATCH_MAX ; ++length) {
+        while (code < 28 && length >= LENGTH_BASES[code + 1]) code++;
+        LENGTH_CODES[length] = (uint8_t)code;
+    }
+
+    for (uint32_t n = 0 ; n < 256 ; ++n) {
+        uint32_t crc = n;
+        for (unsigned int bit = 0 ; bit < 8 ; ++bit) crc = (crc & 1) ? 0xEDB88320 ^ (crc >> 1) : crc >> 1;
+        CRC_TABLE[n] = crc;
+    }
+}
+
+
+/*
+    Add data to a running CRC-32.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - crc:  The CRC so far.
+        - data: Pointer to the data.
+        - size: The number of bytes of data.
+
+    - Returns: The updated CRC.
+*/
+static uint32_t crc32_update(uint32_t crc, const uint8_t* data, size_t size) {
+
+    for (size_t i = 0 ; i < size ; ++i) crc = CRC_TABLE[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return crc;
+}
+
+
+/*
+    Add data to a running Adler-32 checksum, which ends a zlib stream
+    and starts at 1.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - adler: The checksum so far.
+        - data:  Pointer to the data.
+        - size:  The number of bytes of data.
+
+    - Returns: The updated checksum.
+*/
+static uint32_t adler32(uint32_t adler, const uint8_t* data, size_t size) {
+
+    uint32_t a = adler & 0xFFFF, b = adler >> 16;
+    while (size > 0) {
+        // Sums can't overflow within 5552 bytes, so reduce them per block
+        size_t block = size < 5552 ? size : 5552;
+        size -= block;
+        while (block-- > 0) {
+            a += *data++;
+            b += a;
+        }
+
+        a %= 65521;
+        b %= 65521;
+    }
+
+    return (b << 16) | a;
+}
+
+
+/*
+    Combine the Adler-32 checksums of two runs of data into that of
+    the two together, as zlib's `adler32_combine()` does.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - first:       The checksum of the first run.
+        - second:      The checksum of the second run.
+        - second_size: The number of bytes in the second run.
+
+    - Returns: The checksum of both runs.
+*/
+static uint32_t adler32_combine(uint32_t first, uint32_t second, size_t second_size) {
+
+    uint32_t remainder = (uint32_t)(second_size % 65521);
+    uint32_t a = first & 0xFFFF;
+    uint32_t b = (uint32_t)(((uint64_t)remainder * a) % 65521);
+    a += (second & 0xFFFF) + 65521 - 1;
+    b += (first >> 16) + (second >> 16) + 65521 - remainder;
+    if (a >= 65521) a -= 65521;
+    if (a >= 65521) a -= 65521;
+    if (b >= 65521 * 2) b -= 65521 * 2;
+    if (b >= 65521) b -= 65521;
+    return (b << 16) | a;
+}
+
+
+/*
+    Start a zlib stream: a single block using the fixed Huffman codes,
+    with greedy LZ77 matching, fed a band of data at a time. The window
+    holds the last DEFLATE_WINDOW_SIZE bytes deflated and the bytes still
+    to do, and is slid back as it fills, so its size doesn't depend on
+    the total, but it's no bigger than the total needs. Or start just
+    a part of a stream, to be ended with `deflate_flush()`: a block that
+    isn't the last, with no zlib header.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - stream:     Pointer to the stream to set up.
+        - row_size:   The length of an image row, including its filter byte.
+        - band_size:  The most data a band will hold.
+        - total_size: The number of bytes of data to come, including any preset.
+        - target:     Pointer to the buffer for the output. Each call adds
+                      at most nine bits per byte of data it's yet to deflate,
+                      and the stream's start and end ten bytes more.
+        - whole:      Is this the whole stream, or a part of it?
+
+    - Returns: `true` on success, or `false` if out of memory.
+*/
+static bool deflate_init(DeflateStream* stream, uint32_t row_size, size_t band_size, size_t total_size, uint8_t* target, bool whole) {
+
+    pthread_once(&deflate_tables_once, build_deflate_tables);
+
+    stream->capacity = 2 * DEFLATE_WINDOW_SIZE + band_size + DEFLATE_MATCH_MAX + DEFLATE_MATCH_MIN;
+    if (stream->capacity > total_size) stream->capacity = total_size;
+    stream->window = malloc(stream->capacity);
+    stream->chain = malloc(stream->capacity * sizeof(int32_t));
+    stream->heads = malloc(((size_t)1 << DEFLATE_HASH_BITS) * sizeof(int32_t));
+    if (stream->window == NULL || stream->chain == NULL || stream->heads == NULL) {
+        deflate_free(stream);
+        return false;
+    }
+
+    memset(stream->heads, 0xFF, ((size_t)1 << DEFLATE_HASH_BITS) * sizeof(int32_t));
+    stream->size = 0;
+    stream->position = 0;
+    stream->row_size = row_size;
+    stream->adler = 1;
+
+    // zlib header: deflate with a 32KB window, fastest compression
+    if (whole) {
+        *target++ = 0x78;
+        *target++ = 0x01;
+    }
+
+    stream->writer = (BitWriter){.target = target, .bits = 0, .bit_count = 0};
+
+    // Final block, unless there's more to come, fixed Huffman codes
+    put_bits(&stream->writer, whole ? 1 : 0, 1);
+    put_bits(&stream->writer, 1, 2);
+    return true;
+}
+
+
+/*
+    Give a stream data to match against before it starts, as a zlib
+    preset dictionary does. The data goes into the window and the hash
+    chains, but isn't deflated or added to the checksum.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - stream: Pointer to a stream that hasn't been fed any data yet.
+        - data:   Pointer to the data.
+        - size:   The number of bytes of data, no more than DEFLATE_WINDOW_SIZE.
+*/
+static void deflate_preset(DeflateStream* stream, const uint8_t* data, size_t size) {
+
+    memcpy(stream->window, data, size);
+    for (size_t position = 0 ; position + DEFLATE_MATCH_MIN <= size ; ++position) {
+        uint32_t hash = ((data[position] << 10) ^ (data[position + 1] << 5) ^ data[position + 2]) & ((1 << DEFLATE_HASH_BITS) - 1);
+        stream->chain[position] = stream->heads[hash];
+        stream->heads[hash] = (int32_t)position;
+    }
+
+    stream->size = size;
+    stream->position = size;
+}
+
+
+/*
+    Add a band of data to a zlib stream. The band's last bytes are held
+    back until the next band arrives, so every match can run as far as
+    it would if all the data were deflated at once, and the output is
+    the same.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - stream: Pointer to the stream.
+        - data:   Pointer to the data to compress.
+        - size:   The number of bytes of data, no more than the band size.
+*/
+static void deflate_band(DeflateStream* stream, const uint8_t* data, size_t size) {
+
+    // Slide the window back if the band won't fit, keeping the data
+    // matches can still reach, and the hash chains that lead into it
+    if (stream->size + size > stream->capacity) {
+        size_t shift = stream->position - DEFLATE_WINDOW_SIZE;
+        size_t kept = stream->size - shift;
+        memmove(stream->window, stream->window + shift, kept);
+        memmove(stream->chain, stream->chain + shift, kept * sizeof(int32_t));
+        for (size_t i = 0 ; i < ((size_t)1 << DEFLATE_HASH_BITS) ; ++i) {
+            stream->heads[i] = stream->heads[i] >= (int32_t)shift ? stream->heads[i] - (int32_t)shift : -1;
+        }
+
+        for (size_t i = 0 ; i < kept ; ++i) {
+            stream->chain[i] = stream->chain[i] >= (int32_t)shift ? stream->chain[i] - (int32_t)shift : -1;
+        }
+
+        stream->size = kept;
+        stream->position -= shift;
+    }
+
+    stream->adler = adler32(stream->adler, data, size);
+    memcpy(stream->window + stream->size, data, size);
+    stream->size += size;
+
+    size_t held = DEFLATE_MATCH_MAX + DEFLATE_MATCH_MIN;
+    if (stream->size > held) deflate_window(stream, stream->size - held);
+}
+
+
+/*
+    Deflate the window's data up to a point. Screens are mostly runs of
+    one byte, and scaled screens repeat rows, so before searching the
+    hash chains each position tries a match one byte back, and one row
+    back.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - stream: Pointer to the stream.
+        - limit:  The position to stop at, though a match may run past it.
+*/
+static void deflate_window(DeflateStream* stream, size_t limit) {
+
+    const uint8_t* data = stream->window;
+    int32_t* heads = stream->heads;
+    int32_t* chain = stream->chain;
+    uint32_t row_size = stream->row_size;
+    BitWriter* writer = &stream->writer;
+    size_t size = stream->size;
+    size_t position = stream->position;
+    while (position < limit) {
+        uint32_t best_length = 0;
+        size_t best_distance = 0;
+
+        // Try the likeliest matches first: a run, and the row above
+        if (position >= 1 && data[position] == data[position - 1]) {
+            best_length = match_length(data, position, position - 1, size);
+            best_distance = 1;
+        }
+
+        if (position >= row_size && best_length < DEFLATE_NICE_LENGTH && data[position] == data[position - row_size]) {
+            uint32_t length = match_length(data, position, position - row_size, size);
+            if (length > best_length) {
+                best_length = length;
+                best_distance = row_size;
+            }
+        }
+
+        // Then look back through earlier strings with the same hash
+        uint32_t hash = 0;
+        if (position + DEFLATE_MATCH_MIN <= size && best_length < DEFLATE_NICE_LENGTH) {
+            hash = ((data[position] << 10) ^ (data[position + 1] << 5) ^ data[position + 2]) & ((1 << DEFLATE_HASH_BITS) - 1);
+            int32_t candidate = heads[hash];
+            for (unsigned int tries = 0 ; candidate >= 0 && tries < DEFLATE_CHAIN_MAX && best_length < DEFLATE_NICE_LENGTH && position + best_length < size ; ++tries) {
+                if (position - candidate > DEFLATE_WINDOW_SIZE) break;
+
+                // Skip candidates that can't beat the best match so far
+                if (data[candidate + best_length] != data[position + best_length] || data[candidate] != data[position]) {
+                    candidate = chain[candidate];
+                    continue;
+                }
+
+                uint32_t length = match_length(data, position, candidate, size);
+                if (length > best_length) {
+                    best_length = length;
+                    best_distance = position - candidate;
+                }
+
+                candidate = chain[candidate];
+            }
+        }
+
+        if (best_length < DEFLATE_MATCH_MIN) {
+            best_length = 1;
+            put_symbol(writer, data[position]);
+        } else {
+            unsigned int code = LENGTH_CODES[best_length];
+            put_symbol(writer, 257 + code);
+            put_bits(writer, best_length - LENGTH_BASES[code], LENGTH_EXTRA_BITS[code]);
+
+            // Distance codes are five bits, sent most significant first
+            unsigned int distance_code = 29;
+            while (DISTANCE_BASES[distance_code] > best_distance) distance_code--;
+            unsigned int reversed = 0;
+            for (unsigned int i = 0 ; i < 5 ; ++i) reversed |= ((distance_code >> i) & 0x01) << (4 - i);
+            put_bits(writer, reversed, 5);
+            put_bits(writer, (uint32_t)(best_distance - DISTANCE_BASES[distance_code]), DISTANCE_EXTRA_BITS[distance_code]);
+        }
+
+        // Add the positions covered to the hash chains. Inside long
+        // matches, which are mostly runs, that costs more than it saves
+        size_t end = position + best_length;
+        if (best_length > DEFLATE_INSERT_MAX) {
+            position = end;
+            continue;
+        }
+
+        for ( ; position < end ; ++position) {
+            if (position + DEFLATE_MATCH_MIN > size) continue;
+            hash = ((data[position] << 10) ^ (data[position + 1] << 5) ^ data[position + 2]) & ((1 << DEFLATE_HASH_BITS) - 1);
+            chain[position] = heads[hash];
+            heads[hash] = (int32_t)position;
+        }
+    }
+
+    stream->position = position;
+}
+
+
+/*
+    End a zlib stream, with the end of the block and the checksum.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - stream: Pointer to the stream.
+*/
+static void deflate_finish(DeflateStream* stream) {
+
+    deflate_window(stream, stream->size);
+    BitWriter* writer = &stream->writer;
+    put_symbol(writer, DEFLATE_END_OF_BLOCK);
+    if (writer->bit_count > 0) put_bits(writer, 0, 8 - writer->bit_count);
+    put_big_endian(writer->target, stream->adler);
+    writer->target += 4;
+}
+
+
+/*
+    End a part of a zlib stream: deflate what's left, end the block, and
+    add an empty stored block, which brings the output to a byte boundary,
+    so the next part can follow straight on.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - stream: Pointer to the stream.
+*/
+static void deflate_flush(DeflateStream* stream) {
+
+    deflate_window(stream, stream->size);
+    BitWriter* writer = &stream->writer;
+    put_symbol(writer, DEFLATE_END_OF_BLOCK);
+    put_bits(writer, 0, 3);
+    if (writer->bit_count > 0) put_bits(writer, 0, 8 - writer->bit_count);
+    put_bits(writer, 0x0000, 16);
+    put_bits(writer, 0xFFFF, 16);
+}
+
+
+/*
+    Release a zlib stream's window and hash chains.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - stream: Pointer to the stream.
+*/
+static void deflate_free(DeflateStream* stream) {
+
+    free(stream->window);
+    free(stream->chain);
+    free(stream->heads);
+}
+
+
+/*
+    Measure how far the data at two positions matches, up to deflate's
+    longest match.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - data:      Pointer to the data.
+        - position:  The current position.
+        - candidate: An earlier position.
+        - size:      The number of bytes of data.
+
+    - Returns: The length of the match.
+*/
+static uint32_t match_length(const uint8_t* data, size_t position, size_t candidate, size_t size) {
+
+    size_t limit = size - position;
+    if (limit > DEFLATE_MATCH_MAX) limit = DEFLATE_MATCH_MAX;
+
+    // Compare a word at a time, then find the first differing byte
+    uint32_t length = 0;
+    while (length + 8 <= limit) {
+        uint64_t a, b;
+        memcpy(&a, data + position + length, 8);
+        memcpy(&b, data + candidate + length, 8);
+        if (a != b) break;
+        length += 8;
+    }
+
+    while (length < limit && data[position + length] == data[candidate + length]) length++;
+    return length;
+}
+
+
+/*
+    Pack bits into a deflate stream, writing out whole bytes.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - writer: Pointer to the output state.
+        - value:  The bits to write, least significant first.
+        - count:  The number of bits to write.
+*/
+static void put_bits(BitWriter* writer, uint32_t value, unsigned int count) {
+
+    writer->bits |= (uint64_t)value << writer->bit_count;
+    writer->bit_count += count;
+    while (writer->bit_count >= 8) {
+        *writer->target++ = (uint8_t)writer->bits;
+        writer->bits >>= 8;
+        writer->bit_count -= 8;
+    }
+}
+
+
+/*
+    Write a literal, length or end-of-block symbol's fixed Huffman code.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - writer: Pointer to the output state.
+        - symbol: The symbol, 0 to 287.
+*/
+static void put_symbol(BitWriter* writer, unsigned int symbol) {
+
+    put_bits(writer, FIXED_CODES[symbol], FIXED_CODE_LENGTHS[symbol]);
+}
+
+
+/*
+    Inflate a zlib stream, such as a PNG's image data, into a buffer that
+    it must exactly fill. The checksum isn't checked: PNG chunks have
+    their own.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - data:        Pointer to the zlib stream.
+        - size:        The number of bytes in the stream.
+        - target:      Pointer to the buffer for the inflated data.
+        - target_size: The number of bytes the stream should inflate to.
+
+    - Returns: `true` on success, or `false` if the stream is damaged.
+*/
+static bool inflate_zlib(const uint8_t* data, size_t size, uint8_t* target, size_t target_size) {
+
+    // A two-byte header: deflate, with no preset dictionary
+    if (size < 2 || (data[0] & 0x0F) != 8 || ((data[0] << 8) | data[1]) % 31 != 0 || (data[1] & 0x20) != 0) return false;
+
+    BitReader reader = {.data = data + 2, .size = size - 2};
+    HuffmanCode* codes = malloc(2 * sizeof(HuffmanCode));
+    if (codes == NULL) return false;
+
+    size_t written = 0;
+    bool ok = true;
+    bool last = false;
+    while (ok && !last) {
+        last = get_bits(&reader, 1) == 1;
+        unsigned int type = get_bits(&reader, 2);
+        if (type == 0) {
+            ok = inflate_stored(&reader, target, target_size, &written);
+        } else if (type == 1) {
+            pthread_once(&deflate_tables_once, build_deflate_tables);
+            uint8_t lengths[288 + 30];
+            memcpy(lengths, FIXED_CODE_LENGTHS, 288);
+            memset(lengths + 288, 5, 30);
+            ok = build_huffman(&codes[0], lengths, 288) && build_huffman(&codes[1], lengths + 288, 30);
+            ok = ok && inflate_block(&reader, &codes[0], &codes[1], target, target_size, &written);
+        } else if (type == 2) {
+            ok = read_dynamic_codes(&reader, &codes[0], &codes[1]);
+            ok = ok && inflate_block(&reader, &codes[0], &codes[1], target, target_size, &written);
+        } else {
+            ok = false;
+        }
+
+        ok = ok && !reader.overrun;
+    }
+
+    free(codes);
+    return ok && written == target_size;
+}
+
+
+/*
+    Copy out a stored deflate block, which starts on a byte boundary.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - reader:      Pointer to the deflate input, just after the block type.
+        - target:      Pointer to the inflated data.
+        - target_size: The size of the inflated data buffer.
+        - written:     Pointer to the number of bytes inflated so far.
+
+    - Returns: `true` on success, or `false` if the block is damaged.
+*/
+static bool inflate_stored(BitReader* reader, uint8_t* target, size_t target_size, size_t* written) {
+
+    // Skip to the next byte, and hand back any whole bytes already buffered
+    reader->position -= reader->bit_count / 8;
+    reader->bits = 0;
+    reader->bit_count = 0;
+
+    const uint8_t* data = reader->data + reader->position;
+    if (reader->size - reader->position < 4) return false;
+    uint32_t length = get_short_value(data);
+    if (length != (~get_short_value(data + 2) & 0xFFFF)) return false;
+    if (length > reader->size - reader->position - 4 || length > target_size - *written) return false;
+
+    memcpy(target + *written, data + 4, length);
+    *written += length;
+    reader->position += 4 + length;
+    return true;
+}
+
+
+/*
+    Inflate a Huffman-coded deflate block.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - reader:      Pointer to the deflate input.
+        - literals:    Pointer to the literal and length code.
+        - distances:   Pointer to the distance code.
+        - target:      Pointer to the inflated data.
+        - target_size: The size of the inflated data buffer.
+        - written:     Pointer to the number of bytes inflated so far.
+
+    - Returns: `true` on success, or `false` if the block is damaged.
+*/
+static bool inflate_block(BitReader* reader, const HuffmanCode* literals, const HuffmanCode* distances, uint8_t* target, size_t target_size, size_t* written) {
+
+    size_t count = *written;
+    bool ok = false;
+    while (true) {
+        int symbol = read_symbol(reader, literals);
+        if (symbol < 0) break;
+        if (symbol < DEFLATE_END_OF_BLOCK) {
+            if (count == target_size) break;
+            target[count++] = (uint8_t)symbol;
+            continue;
+        }
+
+        if (symbol == DEFLATE_END_OF_BLOCK) {
+            ok = !reader->overrun;
+            break;
+        }
+
+        symbol -= DEFLATE_END_OF_BLOCK + 1;
+        if (symbol >= 29) break;
+        uint32_t length = LENGTH_BASES[symbol] + get_bits(reader, LENGTH_EXTRA_BITS[symbol]);
+        int code = read_symbol(reader, distances);
+        if (code < 0 || code >= 30) break;
+        uint32_t distance = DISTANCE_BASES[code] + get_bits(reader, DISTANCE_EXTRA_BITS[code]);
+        if (reader->overrun || distance > count || length > target_size - count) break;
+
+        // Matches can overlap the bytes they produce, so copy a byte at a time
+        uint8_t* out = target + count;
+        const uint8_t* from = out - distance;
+        for (uint32_t i = 0 ; i < length ; ++i) out[i] = from[i];
+        count += length;
+    }
+
+    *written = count;
+    return ok;
+}
+
+
+/*
+    Read a dynamic deflate block's Huffman codes, which are sent as code
+    lengths, themselves Huffman coded and run-length encoded.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - reader:    Pointer to the deflate input, just after the block type.
+        - literals:  Pointer to the literal and length code to build.
+        - distances: Pointer to the distance code to build.
+
+    - Returns: `true` on success, or `false` if the codes are damaged.
+*/
+static bool read_dynamic_codes(BitReader* reader, HuffmanCode* literals, HuffmanCode* distances) {
+
+    static const uint8_t order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+    unsigned int literal_count = get_bits(reader, 5) + 257;
+    unsigned int distance_count = get_bits(reader, 5) + 1;
+    unsigned int length_count = get_bits(reader, 4) + 4;
+    if (literal_count > 286 || distance_count > 30) return false;
+
+    uint8_t lengths[286 + 30] = {0};
+    for (unsigned int i = 0 ; i < length_count ; ++i) lengths[order[i]] = (uint8_t)get_bits(reader, 3);
+
+    // The code lengths' code is built in the literal code's space, which isn't needed yet
+    if (!build_huffman(literals, lengths, 19)) return false;
+    uint8_t sizes[286 + 30];
+    unsigned int total = literal_count + distance_count;
+    unsigned int count = 0;
+    while (count < total) {
+        int symbol = read_symbol(reader, literals);
+        if (symbol < 0 || reader->overrun) return false;
+        if (symbol < 16) {
+            sizes[count++] = (uint8_t)symbol;
+            continue;
+        }
+
+        // Repeat the last length, or zero, a number of times
+        uint8_t value = 0;
+        unsigned int repeat;
+        if (symbol == 16) {
+            if (count == 0) return false;
+            value = sizes[count - 1];
+            repeat = 3 + get_bits(reader, 2);
+        } else if (symbol == 17) {
+            repeat = 3 + get_bits(reader, 3);
+        } else {
+            repeat = 11 + get_bits(reader, 7);
+        }
+
+        if (repeat > total - count) return false;
+        while (repeat-- > 0) sizes[count++] = value;
+    }
+
+    if (sizes[DEFLATE_END_OF_BLOCK] == 0) return false;
+    return build_huffman(literals, sizes, literal_count) && build_huffman(distances, sizes + literal_count, distance_count);
+}
+
+
+/*
+    Build a canonical Huffman code from its code lengths, ready to decode.
+    Incomplete codes are allowed, as deflate sends them for a single
+    distance, but over-subscribed ones aren't.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - code:    Pointer to the code to build.
+        - lengths: Pointer to the code length of each symbol, 0 if unused.
+        - count:   The number of symbols.
+
+    - Returns: `true` on success, or `false` if the lengths don't make a code.
+*/
+static bool build_huffman(HuffmanCode* code, const uint8_t* lengths, unsigned int count) {
+
+    memset(code->counts, 0, sizeof(code->counts));
+    for (unsigned int i = 0 ; i < count ; ++i) code->counts[lengths[i]]++;
+    code->counts[0] = 0;
+
+    int left = 1;
+    for (unsigned int length = 1 ; length <= INFLATE_CODE_LENGTH_MAX ; ++length) {
+        left = (left << 1) - code->counts[length];
+        if (left < 0) return false;
+    }
+
+    // Sort the symbols by code length, then by value
+    uint16_t offsets[INFLATE_CODE_LENGTH_MAX + 2];
+    offsets[1] = 0;
+    for (unsigned int length = 1 ; length <= INFLATE_CODE_LENGTH_MAX ; ++length) offsets[length + 1] = offsets[length] + code->counts[length];
+    for (unsigned int i = 0 ; i < count ; ++i) {
+        if (lengths[i] != 0) code->symbols[offsets[lengths[i]]++] = (uint16_t)i;
+    }
+
+    // Enter each short code, bit-reversed as it arrives, under every
+    // pattern of the bits that follow it
+    memset(code->fast, 0, sizeof(code->fast));
+    unsigned int next = 0;
+    unsigned int index = 0;
+    for (unsigned int length = 1 ; length <= INFLATE_FAST_BITS ; ++length) {
+        for (unsigned int i = 0 ; i < code->counts[length] ; ++i) {
+            unsigned int reversed = 0;
+            for (unsigned int bit = 0 ; bit < length ; ++bit) reversed |= ((next >> bit) & 0x01) << (length - 1 - bit);
+            uint16_t entry = (uint16_t)(code->symbols[index++] << 4 | length);
+            for (unsigned int fill = reversed ; fill < (1u << INFLATE_FAST_BITS) ; fill += 1u << length) code->fast[fill] = entry;
+            next++;
+        }
+
+        next <<= 1;
+    }
+
+    return true;
+}
+
+
+/*
+    Decode the next symbol from the input. Short codes are looked up
+    directly; longer ones are found a bit at a time, counting through
+    the codes of each length.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - reader: Pointer to the deflate input.
+        - code:   Pointer to the Huffman code.
+
+    - Returns: The symbol, or -1 if the bits aren't a code.
+*/
+static int read_symbol(BitReader* reader, const HuffmanCode* code) {
+
+    if (reader->bit_count < INFLATE_CODE_LENGTH_MAX) fill_bits(reader);
+    uint16_t entry = code->fast[reader->bits & ((1u << INFLATE_FAST_BITS) - 1)];
+    if (entry != 0) {
+        unsigned int length = entry & 0x0F;
+        if (length > reader->bit_count) {
+            reader->overrun = true;
+            return -1;
+        }
+
+        reader->bits >>= length;
+        reader->bit_count -= length;
+        return entry >> 4;
+    }
+
+    int value = 0;
+    int first = 0;
+    int index = 0;
+    for (unsigned int length = 1 ; length <= INFLATE_CODE_LENGTH_MAX ; ++length) {
+        value |= (int)get_bits(reader, 1);
+        int count = code->counts[length];
+        if (value - count < first) return code->symbols[index + value - first];
+        index += count;
+        first = (first + count) << 1;
+        value <<= 1;
+    }
+
+    return -1;
+}
+
+
+/*
+    Take bits from the deflate input, least significant first.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - reader: Pointer to the deflate input.
+        - count:  The number of bits to take, up to 16.
+
+    - Returns: The bits, or 0 if the input has run out, which is flagged.
+*/
+static uint32_t get_bits(BitReader* reader, unsigned int count) {
+
+    if (reader->bit_count < count) fill_bits(reader);
+    if (reader->bit_count < count) {
+        reader->overrun = true;
+        return 0;
+    }
+
+    uint32_t value = (uint32_t)(reader->bits & ((1u << count) - 1));
+    reader->bits >>= count;
+    reader->bit_count -= count;
+    return value;
+}
+
+
+/*
+    Top up the deflate input's bit buffer with whole bytes.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - reader: Pointer to the deflate input.
+*/
+static void fill_bits(BitReader* reader) {
+
+    while (reader->bit_count <= 56 && reader->position < reader->size) {
+        reader->bits |= (uint64_t)reader->data[reader->position++] << reader->bit_count;
+        reader->bit_count += 8;
+    }
+}
+
+
+/*
+    Add bytes to the end of an animation's GIF data, growing it as needed.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - animation: Pointer to the animation.
+        - data:      Pointer to the bytes to add.
+        - size:      The number of bytes to add.
+
+    - Returns: `true` on success, or `false` if out of memory.
+*/
+static bool append_data(N2BAnimation* animation, const uint8_t* data, size_t size) {
+
+    if (animation->size + size > animation->capacity) {
+        size_t capacity = animation->capacity == 0 ? 65536 : animation->capacity * 2;
+        while (capacity < animation->size + size) capacity *= 2;
+        uint8_t* more = realloc(animation->data, capacity);
+        if (more == NULL) return false;
+        animation->data = more;
+        animation->capacity = capacity;
+    }
+
+    memcpy(animation->data + animation->size, data, size);
+    animation->size += size;
+    return true;
+}
+
+
+/*
+    Add a frame holding part of a screen to an animation, and keep the
+    screen to compare the next with. The frame's pixels are expanded to
+    one colour index byte each, at the animation's scale, using the 8bpp
+    expansion tables.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - animation: Pointer to the animation.
+        - bitmap:    Pointer to the decoded screen.
+        - x:         The left of the area to add, in unscaled pixels.
+        - y:         The top of the area to add.
+        - width:     The width of the area to add.
+        - height:    The height of the area to add.
+
+    - Returns: 0 on success or an error value.
+*/
+static int add_frame(N2BAnimation* animation, const N2BBitmap* bitmap, uint32_t x, uint32_t y, uint32_t width, uint32_t height) {
+
+    unsigned int factor = animation->scale;
+    uint32_t scaled_width = width * factor;
+    uint32_t scaled_height = height * factor;
+    Expander expander;
+    uint8_t* indices = malloc((size_t)scaled_width * scaled_height);
+    uint8_t* expanded = malloc((size_t)N2B_WIDTH * factor);
+    if (indices == NULL || expanded == NULL || !expander_init(&expander, factor, 8)) {
+        free(indices);
+        free(expanded);
+        return N2B_ERROR_NO_MEMORY;
+    }
+
+    // Expand the whole bytes the area spans, then take the area's pixels
+    uint32_t first_byte = x / 8;
+    uint32_t byte_count = (x + width - 1) / 8 - first_byte + 1;
+    for (uint32_t row = 0 ; row < height ; ++row) {
+        uint8_t* target_row = indices + (size_t)row * factor * scaled_width;
+        expand_row(bitmap->pixels + (y + row) * bitmap->stride + first_byte, byte_count, expanded, expander.entries, expander.entry_size);
+        memcpy(target_row, expanded + (x - first_byte * 8) * factor, scaled_width);
+        for (unsigned int copy = 1 ; copy < factor ; ++copy) {
+            memcpy(target_row + copy * scaled_width, target_row, scaled_width);
+        }
+    }
+
+    free(expanded);
+    expander_free(&expander);
+
+    // Graphic control extension, with the frame's delay, then the image
+    // descriptor. Frames are left in place, so later ones overlay them
+    uint32_t left = x * factor;
+    uint32_t top = y * factor;
+    uint8_t control[8] = {0x21, 0xF9, 0x04, GIF_DISPOSE_NONE, animation->delay & 0xFF, animation->delay >> 8, 0x00, 0x00};
+    uint8_t descriptor[11] = {0x2C, left & 0xFF, left >> 8, top & 0xFF, top >> 8,
+                              scaled_width & 0xFF, scaled_width >> 8, scaled_height & 0xFF, scaled_height >> 8,
+                              0x00, GIF_MIN_CODE_SIZE};
+    size_t delay_offset = animation->size + 4;
+    bool success = append_data(animation, control, sizeof(control))
+                && append_data(animation, descriptor, sizeof(descriptor))
+                && lzw_encode(animation, indices, (size_t)scaled_width * scaled_height);
+    free(indices);
+    if (!success) return N2B_ERROR_NO_MEMORY;
+
+    animation->delay_offset = delay_offset;
+    animation->frame_count++;
+    uint32_t row_bytes = bitmap->width / 8;
+    for (uint32_t row = 0 ; row < bitmap->height ; ++row) {
+        memcpy(animation->previous + row * row_bytes, bitmap->pixels + row * bitmap->stride, row_bytes);
+    }
+
+    return N2B_ERROR_NONE;
+}
+
+
+/*
+    LZW-compress colour indices into GIF image data. Strings are held
+    as (prefix code, next index) pairs in a hash table; when all 4096
+    codes are used, a clear code starts a new table.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - animation: Pointer to the animation to add the data to.
+        - indices:   Pointer to the colour indices, one per byte.
+        - count:     The number of indices.
+
+    - Returns: `true` on success, or `false` if out of memory.
+*/
+static bool lzw_encode(N2BAnimation* animation, const uint8_t* indices, size_t count) {
+
+    int32_t* keys = malloc(LZW_TABLE_SIZE * sizeof(int32_t));
+    uint16_t* codes = malloc(LZW_TABLE_SIZE * sizeof(uint16_t));
+    if (keys == NULL || codes == NULL) {
+        free(keys);
+        free(codes);
+        return false;
+    }
+
+    const unsigned int clear_code = 1 << GIF_MIN_CODE_SIZE;
+    const unsigned int end_code = clear_code + 1;
+    unsigned int next_code = end_code + 1;
+    unsigned int width = GIF_MIN_CODE_SIZE + 1;
+    LZWWriter writer = {.block_size = 0, .bits = 0, .bit_count = 0};
+
+    memset(keys, 0xFF, LZW_TABLE_SIZE * sizeof(int32_t));
+    bool success = lzw_put_code(animation, &writer, clear_code, width);
+    unsigned int prefix = indices[0];
+    for (size_t i = 1 ; i < count && success ; ++i) {
+        int32_t key = (int32_t)((prefix << 8) | indices[i]);
+        unsigned int slot = (unsigned int)key % LZW_TABLE_SIZE;
+        while (keys[slot] != -1 && keys[slot] != key) slot = slot + 1 == LZW_TABLE_SIZE ? 0 : slot + 1;
+        if (keys[slot] == key) {
+            prefix = codes[slot];
+            continue;
+        }
+
+        success = lzw_put_code(animation, &writer, prefix, width);
+        if (next_code < GIF_MAX_CODES) {
+            // The decoder widens its codes as its table fills, a code behind us
+            if (next_code == (1u << width)) width++;
+            keys[slot] = key;
+            codes[slot] = (uint16_t)next_code++;
+        } else {
+            success = success && lzw_put_code(animation, &writer, clear_code, width);
+            memset(keys, 0xFF, LZW_TABLE_SIZE * sizeof(int32_t));
+            next_code = end_code + 1;
+            width = GIF_MIN_CODE_SIZE + 1;
+        }
+
+        prefix = indices[i];
+    }
+
+    success = success && lzw_put_code(animation, &writer, prefix, width) && lzw_put_code(animation, &writer, end_code, width);
+    if (success && writer.bit_count > 0) {
+        writer.block[++writer.block_size] = (uint8_t)writer.bits;
+        writer.bit_count = 0;
+    }
+
+    static const uint8_t terminator = 0x00;
+    success = success && lzw_flush(animation, &writer) && append_data(animation, &terminator, 1);
+    free(keys);
+    free(codes);
+    return success;
+}
+
+
+/*
+    Write an LZW code, least significant bit first, flushing full
+    sub-blocks to the GIF data.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - animation: Pointer to the animation to add the data to.
+        - writer:    Pointer to the LZW output state.
+        - code:      The code to write.
+        - width:     The current code width in bits.
+
+    - Returns: `true` on success, or `false` if out of memory.
+*/
+static bool lzw_put_code(N2BAnimation* animation, LZWWriter* writer, unsigned int code, unsigned int width) {
+
+    writer->bits |= (uint32_t)code << writer->bit_count;
+    writer->bit_count += width;
+    while (writer->bit_count >= 8) {
+        writer->block[++writer->block_size] = (uint8_t)writer->bits;
+        writer->bits >>= 8;
+        writer->bit_count -= 8;
+        if (writer->block_size == 255 && !lzw_flush(animation, writer)) return false;
+    }
+
+    return true;
+}
+
+
+/*
+    Write out any pending LZW sub-block, prefixed by its size.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - animation: Pointer to the animation to add the data to.
+        - writer:    Pointer to the LZW output state.
+
+    - Returns: `true` on success, or `false` if out of memory.
+*/
+static bool lzw_flush(N2BAnimation* animation, LZWWriter* writer) {
+
+    if (writer->block_size == 0) return true;
+    writer->block[0] = (uint8_t)writer->block_size;
+    bool success = append_data(animation, writer->block, writer->block_size + 1);
+    writer->block_size = 0;
+    return success;
+}
@@ -0,0 +1,338 @@
+/*
+    libnotepad2bmp
+
+    Copyright © 2025 Tony Smith. All rights reserved.
+
+    Version 0.5.0
+
+    MIT License
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef LIBNOTEPAD2BMP_H
+#define LIBNOTEPAD2BMP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*
+    CONSTANTS
+*/
+#define N2B_VERSION                             "0.5.0"
+
+// NC100 screenshot layout: 64 rows of 64 bytes, of which the
+// first 60 bytes hold 480 pixels and the last four are padding
+#define N2B_RAW_DATA_SIZE                       4096
+#define N2B_RAW_ROW_SIZE                        64
+#define N2B_WIDTH                               480
+#define N2B_HEIGHT                              64
+
+// Screen geometries, told apart by screenshot size. The NC200's screen
+// has twice the NC100's rows, laid out the same way. A screenshot may
+// start with a 128-byte +3DOS file header, which is skipped
+#define N2B_GEOMETRY_NC100                      0
+#define N2B_GEOMETRY_NC200                      1
+#define N2B_GEOMETRY_COUNT                      2
+#define N2B_HEIGHT_MAX                          128
+#define N2B_RAW_DATA_SIZE_MAX                   (N2B_RAW_ROW_SIZE * N2B_HEIGHT_MAX)
+#define N2B_HEADER_SIZE                         128
+#define N2B_SOURCE_SIZE_MAX                     (N2B_HEADER_SIZE + N2B_RAW_DATA_SIZE_MAX)
+#define N2B_SCALE_FACTOR                        3
+#define N2B_SCALE_MAX                           32
+
+// Output resolutions: the screen itself is 72dpi, and a target
+// resolution can be anything up to the largest scale's
+#define N2B_DPI_NATIVE                          72
+#define N2B_DPI_MAX                             (N2B_DPI_NATIVE * N2B_SCALE_MAX)
+
+// Output formats. All but BMP are 1bpp only; raw is headerless pixel data
+#define N2B_FORMAT_BMP                          0
+#define N2B_FORMAT_PNG                          1
+#define N2B_FORMAT_PCX                          2
+#define N2B_FORMAT_RAW                          3
+#define N2B_FORMAT_COUNT                        4
+
+// Upscaling engines. EPX and Scale2x give the same result
+#define N2B_SCALER_NEAREST                      0
+#define N2B_SCALER_SCALE2X                      1
+#define N2B_SCALER_EPX                          N2B_SCALER_SCALE2X
+#define N2B_SCALER_SCALE3X                      2
+#define N2B_SCALER_COUNT                        3
+
+// Dithering for images imported as screenshots
+#define N2B_DITHER_NONE                         0
+#define N2B_DITHER_ORDERED                      1
+#define N2B_DITHER_FLOYD_STEINBERG              2
+#define N2B_DITHER_COUNT                        3
+
+// Text: screens are a grid of character cells, 80 by 8 on the NC100 and
+// 80 by 16 on the NC200. A font holds up to N2B_GLYPH_COUNT_MAX glyphs, hashed
+// into a table of twice that size. Cells that match no glyph read as N2B_TEXT_UNKNOWN
+#define N2B_GLYPH_WIDTH                         6
+#define N2B_GLYPH_HEIGHT                        8
+#define N2B_TEXT_COLUMNS                        (N2B_WIDTH / N2B_GLYPH_WIDTH)
+#define N2B_TEXT_ROWS                           (N2B_HEIGHT_MAX / N2B_GLYPH_HEIGHT)
+#define N2B_TEXT_SIZE_MAX                       (N2B_TEXT_ROWS * (N2B_TEXT_COLUMNS + 1))
+#define N2B_GLYPH_COUNT_MAX                     256
+#define N2B_FONT_TABLE_SIZE                     (N2B_GLYPH_COUNT_MAX * 2)
+#define N2B_TEXT_UNKNOWN                        '?'
+
+// Animation frame time, in hundredths of a second
+#define N2B_DELAY_DEFAULT                       50
+
+#define N2B_ERROR_NONE                          0
+#define N2B_ERROR_OPEN_SOURCE_FILE              1
+#define N2B_ERROR_OPEN_BMP_FILE                 2
+#define N2B_ERROR_READ_SOURCE_FILE              3
+#define N2B_ERROR_WRITE_BMP_FILE                4
+#define N2B_ERROR_NO_MEMORY                     5
+#define N2B_ERROR_BAD_OPTIONS                   6
+#define N2B_ERROR_BUFFER_TOO_SMALL              7
+#define N2B_ERROR_OPEN_CACHE                    8
+#define N2B_ERROR_BAD_IMAGE                     9
+#define N2B_ERROR_BAD_FONT                      10
+#define N2B_ERROR_TRANSFER                      11
+#define N2B_ERROR_NO_DIRECTORY                  12
+#define N2B_ERROR_BAD_SIZE                      13
+
+// Conversion stages timed by `N2BStats`
+#define N2B_STAGE_READ                          0
+#define N2B_STAGE_DECODE                        1
+#define N2B_STAGE_SCALE                         2
+#define N2B_STAGE_HEADER                        3
+#define N2B_STAGE_WRITE                         4
+#define N2B_STAGE_COUNT                         5
+
+
+/*
+    STRUCTURES
+*/
+// A decoded screen: 1bpp pixels, most significant bit leftmost,
+// top row first. A set bit is a black pixel.
+typedef struct {
+    uint32_t            width;
+    uint32_t            height;
+    uint32_t            stride;
+    const uint8_t*      pixels;
+} N2BBitmap;
+
+// A screen's layout in a screenshot
+typedef struct {
+    const char*         name;           // eg. `NC200`
+    uint32_t            width;          // In pixels
+    uint32_t            height;
+    uint32_t            stride;         // Bytes per row, including padding
+    size_t              raw_size;       // Bytes per screenshot, without a file header
+} N2BGeometry;
+
+// Per-stage timings and counters. Times are in nanoseconds.
+// A stats record is not locked: give each thread its own and
+// combine them with `n2b_stats_merge()`
+typedef struct {
+    uint64_t            wall_ns[N2B_STAGE_COUNT];
+    uint64_t            cpu_ns[N2B_STAGE_COUNT];
+    uint64_t            bytes_read;
+    uint64_t            bytes_written;
+    uint64_t            files;
+    uint64_t            failures;
+    uint64_t            cache_hits;
+} N2BStats;
+
+// Output settings for a conversion
+typedef struct {
+    unsigned int        scale;          // 1 to N2B_SCALE_MAX; N2B_SCALE_FACTOR by default
+    unsigned int        depth;          // Bits per pixel: 1, 4, 8, or 0 for the default
+    bool                compress;       // Run-length encode? Needs a depth of 4 or 8
+    unsigned int        format;         // N2B_FORMAT_BMP, or another format, which is always 1bpp
+    unsigned int        scaler;         // N2B_SCALER_NEAREST, or an edge-aware scaler for its own scale
+    unsigned int        dpi;            // Scale to this resolution instead, or 0 to use `scale`
+    unsigned int        threads;        // Encode large images a band per thread on up to this many
+    N2BStats*           stats;          // Record timings here, or NULL not to
+    const char*         cache_dir;      // Reuse BMPs cached here, or NULL not to
+    bool                cache_links;    // Hard-link outputs to read-only cache entries, rather than copy them
+} N2BOptions;
+
+// A screenshot file for `n2b_convert_files()`, the images to write from it,
+// one per set of options, and how it went
+typedef struct {
+    const char*         inpath;
+    const char* const*  outpaths;
+    int                 error;          // N2B_ERROR_NONE if all the images were written
+    size_t              failed_index;   // Of the image that failed, or the options count if the screenshot did
+} N2BFileJob;
+
+// An animated GIF being built in memory, one screen at a time.
+// Each frame after the first holds only the area that changed
+typedef struct {
+    unsigned int        scale;
+    unsigned int        delay;
+    uint32_t            width;          // Of the screens, in unscaled pixels
+    uint32_t            height;
+    unsigned int        frame_count;
+    uint8_t*            previous;       // The last screen, packed
+    uint8_t*            data;           // The GIF so far
+    size_t              size;
+    size_t              capacity;
+    size_t              delay_offset;   // Of the last frame's delay, to extend it
+} N2BAnimation;
+
+// A font ready for reading text. Each glyph is kept as its cell's
+// pixels, a set bit for ink, six bits per row with the top row in the
+// highest bits, alongside its character code
+typedef struct {
+    uint64_t            glyphs[N2B_FONT_TABLE_SIZE];
+    uint8_t             codes[N2B_FONT_TABLE_SIZE];
+} N2BFont;
+
+// Called by `n2b_receive_xmodem()` with a screenshot and its size, less the
+// transfer's padding, once it has all arrived. An error value returned is
+// passed back
+typedef int (*N2BReceiveHandler)(const uint8_t* raw, size_t raw_size, void* context);
+
+// Called by `n2b_walk_dump()` and `n2b_scan_dump()` with each screen found
+// in a dump, which is valid only for the duration of the call, and where
+// its data starts. `name` is the screenshot file's, eg. `s.a`, or NULL
+// for a screen found by its layout. Return non-zero to stop
+typedef int (*N2BScanHandler)(const N2BBitmap* bitmap, const char* name, uint64_t offset, void* context);
+
+// Called by `n2b_encode_stream()` with each piece of an image in turn.
+// Return `false` if the piece couldn't be written, to stop encoding
+typedef bool (*N2BWriteHandler)(const uint8_t* data, size_t size, void* context);
+
+
+/*
+    FUNCTIONS
+*/
+// Set options to the defaults: scaled, 8bpp, uncompressed BMP
+void    n2b_options_init(N2BOptions* options);
+
+// Look a screen geometry up, eg. N2B_GEOMETRY_NC200, or find a screenshot's
+// from its size and any file header: `offset` is set to where the screen starts
+const N2BGeometry* n2b_geometry(unsigned int geometry);
+const N2BGeometry* n2b_detect_geometry(const uint8_t* raw, size_t raw_size, size_t* offset);
+
+// Decode a raw screenshot of any geometry, without copying it:
+// the bitmap refers to the raw data, which must outlive it
+int     n2b_decode(const uint8_t* raw, size_t raw_size, N2BBitmap* bitmap);
+
+// Encode a bitmap as a BMP, PNG, PCX or raw pixels into a caller-supplied buffer,
+// which needs room for `n2b_encoded_size_max()` bytes
+size_t  n2b_encoded_size_max(const N2BBitmap* bitmap, const N2BOptions* options);
+int     n2b_encode(const N2BBitmap* bitmap, const N2BOptions* options, uint8_t* target, size_t target_size, size_t* written);
+
+// Encode a bitmap a piece at a time, passing each piece to a handler, in
+// constant memory however big the image. With a NULL handler, the image
+// is only measured: `written` is set to its size and nothing is output
+int     n2b_encode_stream(const N2BBitmap* bitmap, const N2BOptions* options, N2BWriteHandler handler, void* context, size_t* written);
+
+// Get a format's file name extension, eg. `.bmp`, or look a format up
+// by name, eg. `pcx`, getting N2B_FORMAT_COUNT if there's no such format
+const char* n2b_format_extension(unsigned int format);
+unsigned int n2b_format_from_name(const char* name);
+
+// Convert a screenshot file to an image file. Either path may be `-`
+// for stdin or stdout
+int     n2b_convert_file(const char* inpath, const char* outpath, const N2BOptions* options);
+
+// Convert a screenshot file to several image files, reading and decoding
+// it once: `outpaths[i]` is written with `options[i]`. Stats are kept in
+// `options[0].stats`. On failure, `failed_index` is set to the index of
+// the image that failed, or to `count` if the screenshot couldn't be read
+int     n2b_convert_file_multi(const char* inpath, const char* const* outpaths, const N2BOptions* options, size_t count, size_t* failed_index);
+
+// Convert a screenshot already in memory, eg. one just received, to
+// several image files, as `n2b_convert_file_multi()` does
+int     n2b_convert_raw(const uint8_t* raw, size_t raw_size, const char* const* outpaths, const N2BOptions* options, size_t count, size_t* failed_index);
+
+// Convert many screenshot files, as `n2b_convert_file_multi()` does each one.
+// On Linux, the files are read and the images written in large batches through
+// io_uring, overlapped with encoding; elsewhere, or if io_uring isn't available,
+// they're converted one at a time. Each job records its own outcome; the first
+// error is returned. `n2b_io_uring_available()` says which will be used
+int     n2b_convert_files(N2BFileJob* jobs, size_t job_count, const N2BOptions* options, size_t count);
+bool    n2b_io_uring_available(void);
+
+// Build an animated GIF from a series of screens. Call `n2b_animation_free()`
+// when done with the GIF data returned by `n2b_animation_finish()`
+int     n2b_animation_init(N2BAnimation* animation, const N2BOptions* options, unsigned int delay);
+int     n2b_animation_add(N2BAnimation* animation, const N2BBitmap* bitmap);
+int     n2b_animation_finish(N2BAnimation* animation, const uint8_t** data, size_t* size);
+void    n2b_animation_free(N2BAnimation* animation);
+
+// Convert screenshot files to the frames of an animated GIF file. On
+// failure, `failed_index` is set to the index of the bad screenshot,
+// or to `count` if the GIF could not be written
+int     n2b_animate_files(const char* const* inpaths, size_t count, const char* outpath, const N2BOptions* options, unsigned int delay, size_t* failed_index);
+
+// Find the screenshots in a memory card or disk dump in one pass, and
+// either hand each to a function or convert each to a file in `outdir`.
+// `n2b_walk_dump()` reads the `s.*` files listed in the root directory of
+// the FAT file system the dump starts with, or gives N2B_ERROR_NO_DIRECTORY.
+// `n2b_scan_dump()` looks for screens by their layout instead, eg. in a RAM
+// dump, skipping any that could start at more than one offset, which
+// are counted in `ambiguous`. `n2b_extract_dump()` walks the directory,
+// falling back to a scan only if `scan` is set
+int     n2b_walk_dump(const char* inpath, N2BScanHandler handler, void* context);
+int     n2b_scan_dump(const char* inpath, N2BScanHandler handler, void* context, size_t* ambiguous);
+int     n2b_extract_dump(const char* inpath, const char* outdir, const N2BOptions* options, bool scan, size_t* count, size_t* ambiguous);
+
+// Turn a BMP or PNG image of any size into a raw screenshot of N2B_RAW_DATA_SIZE
+// bytes: the image is resized to fit the screen, centred on white, and dithered
+// to black and white, eg. with N2B_DITHER_FLOYD_STEINBERG. Either path may be `-`
+int     n2b_import(const uint8_t* image, size_t image_size, unsigned int dither, uint8_t* raw);
+int     n2b_import_file(const char* inpath, const char* outpath, unsigned int dither);
+
+// Read the text on a screen, a line per row of cells with trailing spaces
+// removed, matching each cell against a font's glyphs, as drawn or in inverse
+// video. The font comes from a ROM font dump of eight bytes per character,
+// in code order from 0. The text buffer needs room for `N2B_TEXT_SIZE_MAX`
+// bytes for any NC100 or NC200 screen; the text is not zero-terminated
+int     n2b_font_init(N2BFont* font, const uint8_t* data, size_t size);
+int     n2b_font_load(N2BFont* font, const char* path);
+int     n2b_read_text(const N2BBitmap* bitmap, const N2BFont* font, char* text, size_t text_size, size_t* written);
+int     n2b_text_file(const char* inpath, const char* outpath, const N2BFont* font);
+
+// Receive a screenshot sent by XMODEM or XMODEM-CRC over a serial line, or
+// any descriptor, already set up, eg. in raw mode at the right speed. `raw`
+// needs room for N2B_SOURCE_SIZE_MAX bytes, an NC200 screenshot with a +3DOS
+// header. The handler, which may be NULL, is called as soon as the sender
+// ends a transfer of a whole screenshot
+int     n2b_receive_xmodem(int fd, uint8_t* raw, N2BReceiveHandler handler, void* context);
+
+// Remove the least recently used BMPs from a cache directory
+// until it holds no more than `size_max` bytes
+int     n2b_cache_trim(const char* cache_dir, uint64_t size_max);
+
+// Clear a stats record, add one into another, and name a stage
+void    n2b_stats_init(N2BStats* stats);
+void    n2b_stats_merge(N2BStats* total, const N2BStats* part);
+const char* n2b_stage_name(unsigned int stage);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // LIBNOTEPAD2BMP_H
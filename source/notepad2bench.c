@@ -0,0 +1,581 @@
+/*
+    notepad2bench
+
+    Copyright © 2025 Tony Smith. All rights reserved.
+
+    Version 0.5.0
+
+    MIT License
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "libnotepad2bmp.h"
+
+
+/*
+    CONSTANTS
+*/
+#define PATTERN_COUNT                           4
+#define MODE_COUNT                              9
+#define STAGE_COUNT                             4
+#define DEFAULT_FRAMES                          2000
+#define FILE_MODE_COUNT                         2
+
+#define STAGE_READ                              0
+#define STAGE_DECODE                            1
+#define STAGE_ENCODE                            2
+#define STAGE_WRITE                             3
+
+// NC100 text cells
+#define CELL_WIDTH                              6
+#define CELL_HEIGHT                             8
+
+
+/*
+    FORWARD DECLARATIONS
+*/
+void     generate(unsigned int pattern, uint8_t* raw);
+void     set_pixel(uint8_t* raw, unsigned int x, unsigned int y);
+uint32_t next_random(uint32_t* state);
+int      write_corpus(const char* dir);
+int      run_benchmark(const char* dir, unsigned int frames, bool do_json);
+int      run_file_benchmark(const char* dir, unsigned int file_count, bool do_json);
+double   now(void);
+void     show_help(void);
+
+
+/*
+    STRUCTURES
+*/
+// A benchmark output mode: the conversion options under test
+typedef struct {
+    const char*         name;
+    N2BOptions          options;
+} BenchMode;
+
+
+/*
+    BENCHMARK DATA
+*/
+const char* PATTERN_NAMES[PATTERN_COUNT] = {"blank", "text", "noise", "checkerboard"};
+const char* STAGE_NAMES[STAGE_COUNT] = {"read", "decode", "encode", "write"};
+
+BenchMode MODES[MODE_COUNT] = {
+    {"raw",         {.scale = 1}},
+    {"scaled",      {.scale = N2B_SCALE_FACTOR}},
+    {"scaled-1bpp", {.scale = N2B_SCALE_FACTOR, .depth = 1}},
+    {"scaled-rle",  {.scale = N2B_SCALE_FACTOR, .compress = true}},
+    {"scaled-png",  {.scale = N2B_SCALE_FACTOR, .format = N2B_FORMAT_PNG}},
+    {"scaled-pcx",  {.scale = N2B_SCALE_FACTOR, .format = N2B_FORMAT_PCX}},
+    {"scale2x",     {.scale = 2, .scaler = N2B_SCALER_SCALE2X}},
+    {"scale3x",     {.scale = N2B_SCALE_FACTOR, .scaler = N2B_SCALER_SCALE3X}},
+    {"print-png",   {.scale = N2B_SCALE_FACTOR, .dpi = 600, .format = N2B_FORMAT_PNG}}
+};
+
+
+/*
+    MAIN ROUTINE
+*/
+int main(int argc, char* argv[]) {
+
+    char*       dir = NULL;
+    char*       corpus_dir = NULL;
+    unsigned int frames = DEFAULT_FRAMES;
+    unsigned int file_count = 0;
+    bool        do_json = false;
+    int         option_index = 0;
+    int         short_option = -1;
+    // Prevent error reporting by `getopt_long()`
+                opterr = 0;
+    // Define long options
+    static struct option long_options[] = {
+        {"generate", required_argument, NULL, 'g'},
+        {"dir", required_argument, NULL, 'd'},
+        {"frames", required_argument, NULL, 'n'},
+        {"files", required_argument, NULL, 'f'},
+        {"json", no_argument, NULL, 'j'},
+        {"help", no_argument, NULL, 'h'},
+        {0, 0, NULL, 0}
+    };
+
+    // Process args
+    while (1) {
+        short_option = getopt_long(argc, argv, "g:d:n:f:jh", long_options, &option_index);
+        if (short_option == -1) break;
+        switch(short_option) {
+            case 'g':
+                corpus_dir = optarg;
+            break;
+            case 'd':
+                dir = optarg;
+            break;
+            case 'n':
+                frames = atoi(optarg);
+                if (frames < 1) {
+                    fprintf(stderr, "[ERROR] Invalid frame count '%s'\n", optarg);
+                    exit(1);
+                }
+            break;
+            case 'f':
+                file_count = atoi(optarg);
+                if (file_count < 1) {
+                    fprintf(stderr, "[ERROR] Invalid file count '%s'\n", optarg);
+                    exit(1);
+                }
+            break;
+            case 'j':
+                do_json = true;
+            break;
+            case 'h':
+                show_help();
+                exit(0);
+            break;
+            case '?':
+                fprintf(stderr, "[ERROR] Unknown option '%c'\n", optopt);
+                exit(1);
+        }
+    }
+
+    // Just write out the corpus?
+    if (corpus_dir != NULL) {
+        if (write_corpus(corpus_dir) != 0) {
+            fprintf(stderr, "[ERROR] Could not write corpus to %s\n", corpus_dir);
+            exit(1);
+        }
+
+        exit(0);
+    }
+
+    // Benchmark in a scratch directory unless we're given one
+    char scratch[] = "/tmp/notepad2bench.XXXXXX";
+    bool do_remove_dir = false;
+    if (dir == NULL) {
+        dir = mkdtemp(scratch);
+        if (dir == NULL) {
+            fprintf(stderr, "[ERROR] Could not create a scratch directory\n");
+            exit(1);
+        }
+
+        do_remove_dir = true;
+    }
+
+    int error = write_corpus(dir);
+    if (error == 0) {
+        error = file_count > 0 ? run_file_benchmark(dir, file_count, do_json) : run_benchmark(dir, frames, do_json);
+    } else {
+        fprintf(stderr, "[ERROR] Could not write corpus to %s\n", dir);
+    }
+
+    // Tidy up the scratch directory
+    if (do_remove_dir) {
+        char path[1024];
+        for (unsigned int i = 0 ; i < PATTERN_COUNT ; ++i) {
+            snprintf(path, sizeof(path), "%s/%s.a", dir, PATTERN_NAMES[i]);
+            unlink(path);
+        }
+
+        snprintf(path, sizeof(path), "%s/bench.bmp", dir);
+        unlink(path);
+        rmdir(dir);
+    }
+
+    exit(error == 0 ? 0 : 1);
+}
+
+
+/*
+    Generate a synthetic NC100 screenshot, including the four padding
+    bytes per row. Patterns are generated from a fixed seed, so every
+    run, and every version, benchmarks the same data.
+
+    - Parameters:
+        - pattern: The index of the pattern to generate.
+        - raw:     Pointer to an N2B_RAW_DATA_SIZE buffer for the screenshot.
+*/
+void generate(unsigned int pattern, uint8_t* raw) {
+
+    uint32_t seed = 0x4E433130 + pattern;
+    memset(raw, 0, N2B_RAW_DATA_SIZE);
+
+    switch(pattern) {
+        case 1:
+            // Text: a full 80x8 screen of 6x8 character cells, each holding
+            // a random 5x7 glyph, with the odd space between words
+            for (unsigned int row = 0 ; row < N2B_HEIGHT / CELL_HEIGHT ; ++row) {
+                for (unsigned int col = 0 ; col < N2B_WIDTH / CELL_WIDTH ; ++col) {
+                    if (next_random(&seed) % 6 == 0) continue;
+                    uint32_t glyph = next_random(&seed);
+                    for (unsigned int y = 0 ; y < CELL_HEIGHT - 1 ; ++y) {
+                        for (unsigned int x = 0 ; x < CELL_WIDTH - 1 ; ++x) {
+                            if (glyph & (1 << ((y * 5 + x) % 32))) {
+                                set_pixel(raw, col * CELL_WIDTH + x, row * CELL_HEIGHT + y);
+                            }
+                        }
+                    }
+                }
+            }
+            break;
+        case 2:
+            // Noise
+            for (unsigned int y = 0 ; y < N2B_HEIGHT ; ++y) {
+                for (unsigned int x = 0 ; x < N2B_WIDTH / 8 ; ++x) {
+                    raw[y * N2B_RAW_ROW_SIZE + x] = (uint8_t)next_random(&seed);
+                }
+            }
+            break;
+        case 3:
+            // Checkerboard, at single pixel pitch: the worst case for
+            // run-length encoding
+            for (unsigned int y = 0 ; y < N2B_HEIGHT ; ++y) {
+                memset(&raw[y * N2B_RAW_ROW_SIZE], (y & 1) ? 0x55 : 0xAA, N2B_WIDTH / 8);
+            }
+            break;
+        default:
+            // Blank: nothing to do
+            break;
+    }
+}
+
+
+/*
+    Set (blacken) a pixel in a raw screenshot.
+
+    - Parameters:
+        - raw: Pointer to the screenshot data.
+        - x:   The pixel's column.
+        - y:   The pixel's row.
+*/
+void set_pixel(uint8_t* raw, unsigned int x, unsigned int y) {
+
+    raw[y * N2B_RAW_ROW_SIZE + x / 8] |= 0x80 >> (x % 8);
+}
+
+
+/*
+    Get the next value from a xorshift pseudo-random sequence.
+
+    - Parameters:
+        - state: Pointer to the sequence state.
+
+    - Returns: The next value.
+*/
+uint32_t next_random(uint32_t* state) {
+
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+
+/*
+    Write every corpus pattern to a directory as `{pattern}.a`.
+
+    - Parameters:
+        - dir: Pointer to the path to the directory.
+
+    - Returns: 0 on success, otherwise 1.
+*/
+int write_corpus(const char* dir) {
+
+    uint8_t raw[N2B_RAW_DATA_SIZE];
+    char path[1024];
+
+    for (unsigned int i = 0 ; i < PATTERN_COUNT ; ++i) {
+        generate(i, raw);
+        snprintf(path, sizeof(path), "%s/%s.a", dir, PATTERN_NAMES[i]);
+        FILE* outfile = fopen(path, "wb");
+        if (outfile == NULL) return 1;
+        size_t count = fwrite(raw, 1, N2B_RAW_DATA_SIZE, outfile);
+        if (fclose(outfile) != 0 || count != N2B_RAW_DATA_SIZE) return 1;
+    }
+
+    return 0;
+}
+
+
+/*
+    Time each conversion stage for every pattern and mode, and report
+    the results as a table or as JSON.
+
+    Stages are timed separately over the whole run, rather than per frame,
+    so that clock calls don't swamp the shorter stages:
+
+    1. read:   open, read and close the screenshot file.
+    2. decode: map the screenshot to a bitmap.
+    3. encode: expand, scale and pack the pixels and build the BMP.
+    4. write:  create, write and close the BMP file.
+
+    - Parameters:
+        - dir:     Pointer to the path to the corpus directory.
+        - frames:  The number of frames to convert per pattern and mode.
+        - do_json: Should the results be output as JSON?
+
+    - Returns: 0 on success, otherwise 1.
+*/
+int run_benchmark(const char* dir, unsigned int frames, bool do_json) {
+
+    uint8_t raw[N2B_RAW_DATA_SIZE];
+    char source_path[1024];
+    char target_path[1024];
+    snprintf(target_path, sizeof(target_path), "%s/bench.bmp", dir);
+
+    if (do_json) {
+        printf("{\"version\":\"%s\",\"frames\":%u,\"results\":[", N2B_VERSION, frames);
+    } else {
+        printf("notepad2bench %s -- %u frames per test\n\n", N2B_VERSION, frames);
+        printf("%-14s %-12s %-8s %14s %12s\n", "PATTERN", "MODE", "STAGE", "FRAMES/S", "MB/S");
+    }
+
+    bool is_first = true;
+    for (unsigned int p = 0 ; p < PATTERN_COUNT ; ++p) {
+        snprintf(source_path, sizeof(source_path), "%s/%s.a", dir, PATTERN_NAMES[p]);
+
+        for (unsigned int m = 0 ; m < MODE_COUNT ; ++m) {
+            N2BBitmap bitmap;
+            n2b_decode(raw, N2B_RAW_DATA_SIZE, &bitmap);
+            size_t bmp_size = n2b_encoded_size_max(&bitmap, &MODES[m].options);
+            uint8_t* bmp = malloc(bmp_size);
+            if (bmp == NULL) return 1;
+
+            double seconds[STAGE_COUNT] = {0};
+            double bytes[STAGE_COUNT] = {0};
+
+            for (unsigned int frame = 0 ; frame < frames ; ++frame) {
+                // Read
+                double start = now();
+                int fd = open(source_path, O_RDONLY);
+                if (fd == -1 || read(fd, raw, N2B_RAW_DATA_SIZE) != N2B_RAW_DATA_SIZE) {
+                    fprintf(stderr, "[ERROR] Could not read %s\n", source_path);
+                    free(bmp);
+                    return 1;
+                }
+
+                close(fd);
+                double end = now();
+                seconds[STAGE_READ] += end - start;
+                bytes[STAGE_READ] += N2B_RAW_DATA_SIZE;
+
+                // Decode
+                start = end;
+                n2b_decode(raw, N2B_RAW_DATA_SIZE, &bitmap);
+                end = now();
+                seconds[STAGE_DECODE] += end - start;
+                bytes[STAGE_DECODE] += N2B_RAW_DATA_SIZE;
+
+                // Encode
+                size_t written = 0;
+                start = end;
+                n2b_encode(&bitmap, &MODES[m].options, bmp, bmp_size, &written);
+                end = now();
+                seconds[STAGE_ENCODE] += end - start;
+                bytes[STAGE_ENCODE] += written;
+
+                // Write
+                start = end;
+                fd = open(target_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                if (fd == -1 || write(fd, bmp, written) != (ssize_t)written) {
+                    fprintf(stderr, "[ERROR] Could not write %s\n", target_path);
+                    free(bmp);
+                    return 1;
+                }
+
+                close(fd);
+                end = now();
+                seconds[STAGE_WRITE] += end - start;
+                bytes[STAGE_WRITE] += written;
+            }
+
+            free(bmp);
+
+            // Report the mode's stages
+            for (unsigned int s = 0 ; s < STAGE_COUNT ; ++s) {
+                double fps = seconds[s] > 0 ? frames / seconds[s] : 0;
+                double mbps = seconds[s] > 0 ? bytes[s] / seconds[s] / 1e6 : 0;
+                if (do_json) {
+                    printf("%s{\"pattern\":\"%s\",\"mode\":\"%s\",\"stage\":\"%s\",\"seconds\":%.6f,\"bytes\":%.0f,\"frames_per_sec\":%.1f,\"mb_per_sec\":%.2f}",
+                           is_first ? "" : ",", PATTERN_NAMES[p], MODES[m].name, STAGE_NAMES[s], seconds[s], bytes[s], fps, mbps);
+                    is_first = false;
+                } else {
+                    printf("%-14s %-12s %-8s %14.1f %12.2f\n", PATTERN_NAMES[p], MODES[m].name, STAGE_NAMES[s], fps, mbps);
+                }
+            }
+        }
+    }
+
+    if (do_json) printf("]}\n");
+    return 0;
+}
+
+
+/*
+    Time converting a directory of screenshot files, raw and scaled, one
+    file at a time with `n2b_convert_file_multi()`, as the 0.4.0 code did,
+    and in batches with `n2b_convert_files()`, which uses io_uring where
+    available. The screenshots are copies of the synthetic patterns, and
+    are removed afterwards, along with their BMPs.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - dir:        Pointer to the path to the directory to convert in.
+        - file_count: The number of screenshot files to convert.
+        - do_json:    Should the results be output as JSON?
+
+    - Returns: 0 on success, otherwise 1.
+*/
+int run_file_benchmark(const char* dir, unsigned int file_count, bool do_json) {
+
+    char** paths = calloc(2 * (size_t)file_count, sizeof(char*));
+    N2BFileJob* jobs = calloc(file_count, sizeof(N2BFileJob));
+    if (paths == NULL || jobs == NULL) {
+        free(paths);
+        free(jobs);
+        return 1;
+    }
+
+    // Screenshots at even indices, BMPs at odd
+    uint8_t raw[PATTERN_COUNT][N2B_RAW_DATA_SIZE];
+    for (unsigned int i = 0 ; i < PATTERN_COUNT ; ++i) generate(i, raw[i]);
+
+    int error = 0;
+    for (unsigned int created = 0 ; created < file_count && error == 0 ; ++created) {
+        size_t length = strlen(dir) + 32;
+        paths[2 * created] = malloc(length);
+        paths[2 * created + 1] = malloc(length);
+        if (paths[2 * created] == NULL || paths[2 * created + 1] == NULL) {
+            error = 1;
+            break;
+        }
+
+        snprintf(paths[2 * created], length, "%s/file%06u.a", dir, created);
+        snprintf(paths[2 * created + 1], length, "%s/file%06u.a.bmp", dir, created);
+        jobs[created].inpath = paths[2 * created];
+        jobs[created].outpaths = (const char* const*)&paths[2 * created + 1];
+
+        FILE* outfile = fopen(paths[2 * created], "wb");
+        if (outfile == NULL) {
+            error = 1;
+            break;
+        }
+
+        size_t count = fwrite(raw[created % PATTERN_COUNT], 1, N2B_RAW_DATA_SIZE, outfile);
+        if (fclose(outfile) != 0 || count != N2B_RAW_DATA_SIZE) error = 1;
+    }
+
+    if (error != 0) {
+        fprintf(stderr, "[ERROR] Could not write screenshots to %s\n", dir);
+    } else {
+        const char* batched = n2b_io_uring_available() ? "io_uring" : "batched";
+        if (do_json) {
+            printf("{\"version\":\"%s\",\"files\":%u,\"results\":[", N2B_VERSION, file_count);
+        } else {
+            printf("notepad2bench %s -- %u files per test\n\n", N2B_VERSION, file_count);
+            printf("%-12s %-10s %14s %12s\n", "MODE", "I/O", "FILES/S", "SECONDS");
+        }
+
+        // Each run creates its BMPs afresh
+        for (unsigned int m = 0 ; m < FILE_MODE_COUNT && error == 0 ; ++m) {
+            double seconds[2];
+            for (unsigned int i = 0 ; i < file_count ; ++i) unlink(jobs[i].outpaths[0]);
+            double start = now();
+            for (unsigned int i = 0 ; i < file_count && error == 0 ; ++i) {
+                size_t failed_index = 0;
+                error = n2b_convert_file_multi(jobs[i].inpath, jobs[i].outpaths, &MODES[m].options, 1, &failed_index);
+            }
+
+            seconds[0] = now() - start;
+            for (unsigned int i = 0 ; i < file_count ; ++i) unlink(jobs[i].outpaths[0]);
+            start = now();
+            if (error == 0) error = n2b_convert_files(jobs, file_count, &MODES[m].options, 1);
+            seconds[1] = now() - start;
+            if (error != 0) {
+                fprintf(stderr, "[ERROR] Could not convert screenshots in %s\n", dir);
+                break;
+            }
+
+            for (unsigned int i = 0 ; i < 2 ; ++i) {
+                const char* io = i == 0 ? "stdio" : batched;
+                double fps = seconds[i] > 0 ? file_count / seconds[i] : 0;
+                if (do_json) {
+                    printf("%s{\"mode\":\"%s\",\"io\":\"%s\",\"seconds\":%.6f,\"files_per_sec\":%.1f}",
+                           m == 0 && i == 0 ? "" : ",", MODES[m].name, io, seconds[i], fps);
+                } else {
+                    printf("%-12s %-10s %14.1f %12.3f\n", MODES[m].name, io, fps, seconds[i]);
+                }
+            }
+        }
+
+        if (do_json && error == 0) printf("]}\n");
+    }
+
+    for (size_t i = 0 ; i < 2 * (size_t)file_count ; ++i) {
+        if (paths[i] != NULL) unlink(paths[i]);
+        free(paths[i]);
+    }
+
+    free(paths);
+    free(jobs);
+    return error;
+}
+
+
+/*
+    Get the current time from the monotonic clock.
+
+    - Returns: The time in seconds.
+*/
+double now(void) {
+
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+
+/*
+    Display help info.
+*/
+void show_help(void) {
+
+    printf("notepad2bench 0.5.0\n");
+    printf("Copyright © 2025, Tony Smith (@smittytone). Source code available under the MIT licence.\n\n");
+    printf("Usage: notepad2bench [-n/--frames {count}] [-d/--dir {path}] [-j/--json]\n");
+    printf("       notepad2bench --files {count} [-d/--dir {path}] [-j/--json]\n");
+    printf("       notepad2bench -g/--generate {path}\n\n");
+    printf("Notes: Times the read, decode, encode and write stages of converting synthetic\n");
+    printf("       blank, text, noise and checkerboard screenshots, raw and scaled.\n");
+    printf("       Files are read from and written to a scratch directory unless --dir is set.\n");
+    printf("       Use --json to output machine-readable results for comparing versions.\n");
+    printf("       Use --files to time converting a directory of that many screenshots instead:\n");
+    printf("       one file at a time, and in batches, through io_uring where available.\n");
+    printf("       Use --generate to write the synthetic screenshots to a directory.\n");
+}
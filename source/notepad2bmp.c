@@ -3,7 +3,7 @@
 
     Copyright © 2025 Tony Smith. All rights reserved.
 
-    Version 0.4.0
+    Version 0.5.0
 
     MIT License
     Permission is hereby granted, free of charge, to any person obtaining a copy
@@ -29,154 +29,222 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <strings.h>
 #include <stdbool.h>
 #include <getopt.h>
+#include <glob.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+#include "libnotepad2bmp.h"
 
 
 /*
     CONSTANTS
 */
-#define RAW_DATA_SIZE                           4096
-#define UNSCALED_WIDTH                          480
-#define UNSCALED_HEIGHT                         64
-#define UNSCALED_DATA_SIZE                      (UNSCALED_WIDTH * UNSCALED_HEIGHT)
-#define SCALE_FACTOR                            3
-#define SCALED_WIDTH                            (UNSCALED_WIDTH * SCALE_FACTOR)
-#define SCALED_HEIGHT                           (UNSCALED_HEIGHT * SCALE_FACTOR)
-#define SCALED_DATA_SIZE                        (SCALED_WIDTH * SCALED_HEIGHT)
-
-#define BMP_V1_HEADER_DATA_SIZE                 62
-#define BMP_V5_HEADER_DATA_SIZE                 146
-
-#define BMP_HEADER_FILE_SIZE_INDEX              2
-#define DIB_V5_HEADER_WIDTH_INDEX               4
-#define DIB_V5_HEADER_HEIGHT_INDEX              8
-#define DIB_V5_HEADER_BITS_PER_PIXEL_INDEX      14
-#define DIB_V5_HEADER_DATA_SIZE_INDEX           20
-#define DIB_V5_HEADER_H_RESOLUTION_INDEX        24
-#define DIB_V5_HEADER_V_RESOLUTION_INDEX        28
-
-#define ERROR_NONE                              0
-#define ERROR_OPEN_SOURCE_FILE                  1
-#define ERROR_OPEN_BMP_FILE                     2
+#define MAX_JOBS                                64
+
+// Batch workers claim screenshots in chunks, smaller as the batch runs
+// down, so that each chunk's files can be read and written together
+#define BATCH_CHUNK_MAX                         256
+
+#define WATCH_QUEUE_SIZE                        64
+#define WATCH_EVENT_BUFFER_SIZE                 4096
+
+#define DEFAULT_CACHE_SIZE_MB                   256
+#define WATCH_CACHE_TRIM_INTERVAL               256
+
+#define STATS_NONE                              0
+#define STATS_TEXT                              1
+#define STATS_JSON                              2
+
+// Imported images are written as screenshots named like the NC100's own
+#define SCREENSHOT_EXTENSION                    ".a"
+#define NO_IMPORT                               -1
+#define TEXT_EXTENSION                          ".txt"
+
+// Screenshots received over a serial line are named as the NC100 names them
+#define RECEIVE_NAME                            "s"
+#define DEFAULT_BAUD                            9600
+
+// Server mode: one thread watches every connection, and hands whole
+// requests to the workers, so a worker is only ever busy converting.
+// Connections that go quiet are dropped, as are clients that stop
+// taking their images
+#define SERVE_WORKERS_DEFAULT                   16
+#define SERVE_WORKERS_MAX                       256
+#define SERVE_CONNECTIONS_MAX                   1024
+#define SERVE_BACKLOG                           128
+#define SERVE_IDLE_TIMEOUT                      60.0
+#define SERVE_SEND_TIMEOUT_MS                   10000
+#define SERVE_POLL_INTERVAL_MS                  1000
+#define SERVE_REQUEST_MAGIC                     "N2BQ"
+#define SERVE_RESPONSE_MAGIC                    "N2BA"
+#define SERVE_REQUEST_HEADER_SIZE               16
+#define SERVE_RESPONSE_HEADER_SIZE              12
+#define SERVE_FLAG_COMPRESS                     0x01
+#define SERVE_BUFFER_SIZE_MAX                   (4 * 1024 * 1024)
+#define SERVE_RETRY_DELAY_US                    10000
 
 
 /*
     FORWARD DECLARATIONS
 */
-void output_header_bytes(const char* data, FILE *outfile, unsigned int byteCount);
-void scale(char* source, char* destination);
-int  convert(char* inpath, char* outpath, bool do_scale);
 void show_error(int error_code, char* info);
+void show_import_error(int error_code, const char* source_path, const char* target_path);
+void show_text_error(int error_code, const char* source_path, const char* target_path);
+void add_format(unsigned int format, unsigned int* formats, int* format_count);
 void show_help(void);
+char* make_target_path(const char* source_path, bool keep_extension, const char* extension);
+int  add_source_paths(const char* arg, char*** paths, int* path_count, bool images);
+bool is_image(const char* path);
+bool is_screenshot_size(off_t size);
+void* batch_worker(void* context);
+void show_stats(const N2BStats* stats, double wall_time, double cpu_time, int format);
+double clock_seconds(clockid_t clock);
+int  open_cache(const char* cache_dir);
+int  compare_paths(const void* a, const void* b);
 
 
 /*
-    BMP HEADER DATA
-    These are stock values for the size and type of file we are generating. They comprise:
-
-    1. BMP general header
-    2. Device-independent bitmap header (multiple versions included; version 5 used)
-    3. Colour look-up table
-
-    For more on the BMP format see https://en.wikipedia.org/wiki/BMP_file_format
-*/
-char BMP_HEADER[14] = {
-    0x42,0x4D,                  // TYPE (BM)
-    0x92,0x10,0x00,0x00,        // FILE SIZE (4096+14+124+8)
-    0x00,0x00,0x00,0x00,        // RESERVED
-    0x92,0x00,0x00,0x00         // Offset to the pixel data (14+40+8)
-};
-
-/*
-char DIB_V1_HEADER[40] = {
-    0x28,0x00,0x00,0x00,        // HEADER SIZE (40 bytes)
-    0xE0,0x01,0x00,0x00,        // IMAGE WIDTH (480)
-    0x40,0x00,0x00,0x00,        // IMAGE HEIGHT (64)
-    0x01,0x00,                  // COLOUR PLANES (1)
-    0x01,0x00,                  // BITS PER PIXEL (1)
-    0x00,0x00,0x00,0x00,        // COMPRESSION (0)
-    0x00,0x10,0x00,0x00,        // DATA SIZE (4096)
-    0x13,0x0B,0x00,0x00,        // HORIZONTAL RESOLUTION in DOTS PER METRE (calculated from 72dpi)
-    0x13,0x0B,0x00,0x00,        // VERTICAL RESOLUTION in DOTS PER METRE (calculated from 72dpi)
-    0x02,0x00,0x00,0x00,        // NO. COLOURS IN THE PALETTE
-    0x00,0x00,0x00,0x00         // IMPORTANT COLOURS (0 = ALL)
-};
-
-char DIB_V4_HEADER[108] = {
-    0x6C,0x00,0x00,0x00,        // HEADER SIZE (108 bytes)
-    0xE0,0x01,0x00,0x00,        // IMAGE WIDTH (480)
-    0x40,0x00,0x00,0x00,        // IMAGE HEIGHT (64)
-    0x01,0x00,                  // COLOUR PLANES (1)
-    0x01,0x00,                  // BITS PER PIXEL (1)
-    0x00,0x00,0x00,0x00,        // COMPRESSION (0)
-    0x00,0x10,0x00,0x00,        // DATA SIZE (4096)
-    0x13,0x0B,0x00,0x00,        // HORIZONTAL RESOLUTION in DOTS PER METRE (calculated from 72dpi)
-    0x13,0x0B,0x00,0x00,        // VERTICAL RESOLUTION in DOTS PER METRE (calculated from 72dpi)
-    0x02,0x00,0x00,0x00,        // NO. COLOURS IN THE PALETTE
-    0x00,0x00,0x00,0x00,        // IMPORTANT COLOURS (0 = ALL)
-    0x00,0x00,0x00,0x00,        // R MASK
-    0x00,0x00,0x00,0x00,        // G MASK
-    0x00,0x00,0x00,0x00,        // B MASK
-    0x00,0x00,0x00,0x00,        // A MASK
-    0x42,0x47,0x52,0x73,        // COLOUR SPACE TYPE (sRGB)
-    0x00,0x00,0x00,0x00,        // ENDPOINTS
-    0x00,0x00,0x00,0x00,
-    0x00,0x00,0x00,0x00,
-    0x00,0x00,0x00,0x00,
-    0x00,0x00,0x00,0x00,
-    0x00,0x00,0x00,0x00,
-    0x00,0x00,0x00,0x00,
-    0x00,0x00,0x00,0x00,
-    0x00,0x00,0x00,0x00,
-    0x00,0x00,0x00,0x00,        // R GAMMA
-    0x00,0x00,0x00,0x00,        // G GAMMA
-    0x00,0x00,0x00,0x00,        // B GAMMA
-};
-*/
-
-char DIB_V5_HEADER[124] = {
-    0x7C,0x00,0x00,0x00,        // HEADER SIZE (124 bytes)
-    0xE0,0x01,0x00,0x00,        // IMAGE WIDTH (480)
-    0x40,0x00,0x00,0x00,        // IMAGE HEIGHT (64)
-    0x01,0x00,                  // COLOUR PLANES (1)
-    0x01,0x00,                  // BITS PER PIXEL (1)
-    0x00,0x00,0x00,0x00,        // COMPRESSION (0)
-    0x00,0x10,0x00,0x00,        // DATA SIZE (4096)
-    0x13,0x0B,0x00,0x00,        // HORIZONTAL RESOLUTION in DOTS PER METRE (calculated from 72dpi)
-    0x13,0x0B,0x00,0x00,        // VERTICAL RESOLUTION in DOTS PER METRE (calculated from 72dpi)
-    0x02,0x00,0x00,0x00,        // NO. COLOURS IN THE PALETTE
-    0x00,0x00,0x00,0x00,        // IMPORTANT COLOURS (0 = ALL)
-    0x00,0x00,0x00,0x00,        // R MASK
-    0x00,0x00,0x00,0x00,        // G MASK
-    0x00,0x00,0x00,0x00,        // B MASK
-    0x00,0x00,0x00,0x00,        // A MASK
-    0x42,0x47,0x52,0x73,        // COLOUR SPACE TYPE (sRGB)
-    0x00,0x00,0x00,0x00,        // ENDPOINTS
-    0x00,0x00,0x00,0x00,
-    0x00,0x00,0x00,0x00,
-    0x00,0x00,0x00,0x00,
-    0x00,0x00,0x00,0x00,
-    0x00,0x00,0x00,0x00,
-    0x00,0x00,0x00,0x00,
-    0x00,0x00,0x00,0x00,
-    0x00,0x00,0x00,0x00,
-    0x00,0x00,0x00,0x00,        // R GAMMA
-    0x00,0x00,0x00,0x00,        // G GAMMA
-    0x00,0x00,0x00,0x00,        // B GAMMA
-    0x00,0x00,0x00,0x00,        // INTENT
-    0x00,0x00,0x00,0x00,        // PROFILE DATA
-    0x00,0x00,0x00,0x00,        // PROFILE SIZE
-    0x00,0x00,0x00,0x00         // RESERVED
-};
-
-// This CLT contains two colours: white and black
-// (plus an optional 'LCD green' alternative for white)
-const char BMP_CLT[8] = {
-    //0x70,0x9D,0xA8,0x00,      // LCD GREEN IN BGRA
-    0xFF,0xFF,0xFF,0x00,        // WHITE IN BGRA
-    0x00,0x00,0x00,0x00         // BLACK IN BGRA
-};
+    STRUCTURES
+*/
+// FROM 0.5.0
+// The images to write from each screenshot: one set of output
+// options per format, all decoded from the same read
+typedef struct {
+    N2BOptions          options[N2B_FORMAT_COUNT];
+    int                 count;
+} TargetSet;
+
+// FROM 0.5.0
+// Shared state for a batch run. Workers take the next unclaimed
+// source paths under the lock, so each file is converted exactly once.
+typedef struct {
+    char**              paths;
+    int                 path_count;
+    int                 next_path;
+    int                 failure_count;
+    int                 job_count;
+    TargetSet           targets;
+    int                 dither;         // Import images with this dithering, or NO_IMPORT
+    const N2BFont*      font;           // Read screenshots' text with this font, or NULL
+    pthread_mutex_t     lock;
+} BatchState;
+
+char** make_target_paths(const char* source_path, bool keep_extension, const TargetSet* targets);
+void  free_paths(char** paths, int path_count);
+int   convert_to_targets(const char* source_path, char** target_paths, const TargetSet* targets, const char** failed_path);
+int   run_batch(char** paths, int path_count, const TargetSet* targets, int job_count, int dither, const N2BFont* font);
+int   run_watch(const char* dir_path, const TargetSet* targets, int job_count, uint64_t cache_size_max);
+int   receive_screenshot(const char* device_path, long baud, char** target_paths, const TargetSet* targets);
+int   convert_received(const uint8_t* raw, size_t raw_size, void* context);
+bool  baud_to_speed(long baud, speed_t* speed);
+
+// FROM 0.5.0
+// Where a screenshot being received is converted to
+typedef struct {
+    char**              target_paths;
+    const TargetSet*    targets;
+    const char*         failed_path;
+} ReceiveTarget;
+
+// FROM 0.5.0
+// A client's connection in server mode. Its request is read a piece at
+// a time as it arrives; once it's whole, the connection is busy, and
+// left to a worker, until the response has been sent
+typedef struct {
+    int                 fd;
+    size_t              received;
+    size_t              request_size;   // The header's, until it's in, then the whole request's
+    double              last_active;    // When a request was last read or answered
+    bool                busy;           // With a worker
+    bool                closing;        // Set by the worker if the connection can't go on
+    uint8_t             request[SERVE_REQUEST_HEADER_SIZE + N2B_SOURCE_SIZE_MAX];
+} ServeConnection;
+
+// FROM 0.5.0
+// Shared state for server mode. The connections are the dispatching
+// thread's alone; the queue of whole requests, and each connection's
+// `busy` and `closing` flags, are shared with the workers, under the lock
+typedef struct {
+    int                 listen_fd;
+    int                 wake_fds[2];    // A pipe the workers and signals wake the dispatcher with
+    ServeConnection*    connections[SERVE_CONNECTIONS_MAX];
+    int                 connection_count;
+    ServeConnection*    queue[SERVE_CONNECTIONS_MAX];
+    int                 queue_start;
+    int                 queue_count;
+    bool                stopping;
+    int                 request_count;
+    int                 failure_count;
+    pthread_mutex_t     lock;
+    pthread_cond_t      ready;
+} ServeState;
+
+int   run_server(const char* socket_path, int job_count);
+void  serve_connections(ServeState* state);
+void  accept_connection(ServeState* state);
+bool  read_request(ServeState* state, ServeConnection* connection);
+void  close_connection(ServeConnection* connection);
+void  wake_dispatcher(ServeState* state);
+void* serve_worker(void* context);
+bool  serve_request(const ServeConnection* connection, uint8_t** image, size_t* image_capacity, bool* failed);
+bool  send_response(int fd, int status, const uint8_t* image, size_t image_size);
+bool  wait_to_send(int fd);
+bool  stream_response(int fd, const N2BBitmap* bitmap, const N2BOptions* options, bool* failed);
+bool  send_piece(const uint8_t* data, size_t size, void* context);
+void  serve_signal_handler(int signal_number);
+
+// Set by SIGINT or SIGTERM to end server mode, which also write to
+// the pipe that wakes the dispatching thread
+static volatile sig_atomic_t serve_stopped = 0;
+static int serve_wake_fd = -1;
+
+
+#ifdef __linux__
+// FROM 0.5.0
+// Watch mode work queue. The watcher blocks when it is full, so a burst
+// of arrivals is held back rather than queued without limit.
+typedef struct {
+    char*               paths[WATCH_QUEUE_SIZE];
+    int                 head;
+    int                 count;
+    bool                closed;
+    int                 converted_count;
+    int                 failure_count;
+    TargetSet           targets;
+    uint64_t            cache_size_max;
+    pthread_mutex_t     lock;
+    pthread_cond_t      not_empty;
+    pthread_cond_t      not_full;
+} WatchQueue;
+
+void  watch_queue_push(WatchQueue* queue, char* path);
+char* watch_queue_pop(WatchQueue* queue);
+void  watch_queue_add_dir(WatchQueue* queue, const char* dir_path);
+bool  is_screenshot(const char* path);
+bool  is_converted(const char* source_path, const char* target_path);
+void* watch_worker(void* context);
+void  watch_signal_handler(int signal_number);
+
+// Set by SIGINT or SIGTERM to end watch mode
+static volatile sig_atomic_t watch_stopped = 0;
+#endif
 
 
 /*
@@ -192,61 +260,731 @@ int main (int argc, char *argv[] ) {
     int         option_index = 0;
     int         short_option = -1;
     bool        do_free_target_path = false;
+    // FROM 0.5.0
+    // Batch mode vars
+    bool        do_batch = false;
+    int         job_count = 0;
+    unsigned int depth = 0;
+    bool        do_compress = false;
+    int         stats_format = STATS_NONE;
+    char*       watch_path = NULL;
+    char*       cache_dir = NULL;
+    long        cache_size = DEFAULT_CACHE_SIZE_MB;
+    bool        do_cache_link = false;
+    char*       animate_path = NULL;
+    char*       extract_path = NULL;
+    bool        do_scan = false;
+    unsigned int formats[N2B_FORMAT_COUNT];
+    int         format_count = 0;
+    unsigned int scaler = N2B_SCALER_NEAREST;
+    unsigned int scale = 0;
+    unsigned int dpi = 0;
+    bool        do_import = false;
+    int         dither = NO_IMPORT;
+    bool        do_text = false;
+    char*       font_path = NULL;
+    char*       receive_path = NULL;
+    long        baud = 0;
+    char*       serve_path = NULL;
+    int         delay = N2B_DELAY_DEFAULT;
     // Prevent error reporting by `getopt_long()`
                 opterr = 0;
     // Define long options
     static struct option long_options[] = {
         {"rawsize", no_argument, &do_scale, 0},
+        {"batch", no_argument, NULL, 'b'},
+        {"jobs", required_argument, NULL, 'j'},
+        {"depth", required_argument, NULL, 'd'},
+        {"compress", no_argument, NULL, 'c'},
+        {"png", no_argument, NULL, 'p'},
+        {"format", required_argument, NULL, 'f'},
+        {"scaler", required_argument, NULL, 'X'},
+        {"scale", required_argument, NULL, 's'},
+        {"dpi", required_argument, NULL, 'R'},
+        {"import", no_argument, NULL, 'i'},
+        {"dither", required_argument, NULL, 'T'},
+        {"text", no_argument, NULL, 't'},
+        {"font", required_argument, NULL, 'F'},
+        {"receive", required_argument, NULL, 'V'},
+        {"baud", required_argument, NULL, 'B'},
+        {"serve", required_argument, NULL, 'E'},
+        {"stats", optional_argument, NULL, 'S'},
+        {"watch", required_argument, NULL, 'w'},
+        {"animate", required_argument, NULL, 'a'},
+        {"extract", required_argument, NULL, 'x'},
+        {"scan", no_argument, NULL, 'Y'},
+        {"delay", required_argument, NULL, 'D'},
+        {"cache", required_argument, NULL, 'C'},
+        {"cache-size", required_argument, NULL, 'Z'},
+        {"cache-link", no_argument, NULL, 'L'},
         {"help", no_argument, NULL, 'h'},
         {0, 0, NULL, 0}
     };
 
-    // Insufficient or too many args? Print help
-    if (argc < 2 || argc > 4 ) {
+    // Insufficient args? Print help
+    if (argc < 2) {
         show_help();
         exit(0);
     }
 
     // Process args
     while (1) {
-        short_option = getopt_long(argc, argv, "rh", long_options, &option_index);
+        short_option = getopt_long(argc, argv, "rbj:d:cpf:s:w:a:x:ith", long_options, &option_index);
         if (short_option == -1) break;
         switch(short_option) {
             case 'r':
                 do_scale = 0;
             break;
+            case 'b':
+                do_batch = true;
+            break;
+            case 'j':
+                job_count = atoi(optarg);
+                if (job_count < 1) {
+                    fprintf(stderr, "[ERROR] Invalid job count '%s'\n", optarg);
+                    exit(1);
+                }
+            break;
+            case 'd':
+                depth = atoi(optarg);
+                if (depth != 1 && depth != 4 && depth != 8) {
+                    fprintf(stderr, "[ERROR] Invalid bit depth '%s' -- use 1, 4 or 8\n", optarg);
+                    exit(1);
+                }
+            break;
+            case 'c':
+                do_compress = true;
+            break;
+            case 'w':
+                watch_path = optarg;
+            break;
+            case 'p':
+                add_format(N2B_FORMAT_PNG, formats, &format_count);
+            break;
+            case 'f':
+                for (char* name = strtok(optarg, ",") ; name != NULL ; name = strtok(NULL, ",")) {
+                    unsigned int format = n2b_format_from_name(name);
+                    if (format == N2B_FORMAT_COUNT) {
+                        fprintf(stderr, "[ERROR] Invalid format '%s' -- use bmp, png, pcx or raw\n", name);
+                        exit(1);
+                    }
+
+                    add_format(format, formats, &format_count);
+                }
+            break;
+            case 'X':
+                if (strcmp(optarg, "nearest") == 0) {
+                    scaler = N2B_SCALER_NEAREST;
+                } else if (strcmp(optarg, "scale2x") == 0 || strcmp(optarg, "epx") == 0) {
+                    scaler = N2B_SCALER_SCALE2X;
+                } else if (strcmp(optarg, "scale3x") == 0) {
+                    scaler = N2B_SCALER_SCALE3X;
+                } else {
+                    fprintf(stderr, "[ERROR] Invalid scaler '%s' -- use nearest, scale2x, epx or scale3x\n", optarg);
+                    exit(1);
+                }
+            break;
+            case 's':
+                scale = atoi(optarg);
+                if (scale < 1 || scale > N2B_SCALE_MAX) {
+                    fprintf(stderr, "[ERROR] Invalid scale '%s' -- use 1 to %i\n", optarg, N2B_SCALE_MAX);
+                    exit(1);
+                }
+            break;
+            case 'R':
+                dpi = atoi(optarg);
+                if (dpi < N2B_DPI_NATIVE || dpi > N2B_DPI_MAX) {
+                    fprintf(stderr, "[ERROR] Invalid resolution '%s' -- use %i to %i dpi\n", optarg, N2B_DPI_NATIVE, N2B_DPI_MAX);
+                    exit(1);
+                }
+            break;
+            case 'i':
+                do_import = true;
+            break;
+            case 'T':
+                if (strcmp(optarg, "none") == 0) {
+                    dither = N2B_DITHER_NONE;
+                } else if (strcmp(optarg, "ordered") == 0) {
+                    dither = N2B_DITHER_ORDERED;
+                } else if (strcmp(optarg, "floyd-steinberg") == 0 || strcmp(optarg, "fs") == 0) {
+                    dither = N2B_DITHER_FLOYD_STEINBERG;
+                } else {
+                    fprintf(stderr, "[ERROR] Invalid dither '%s' -- use none, ordered or floyd-steinberg\n", optarg);
+                    exit(1);
+                }
+            break;
+            case 't':
+                do_text = true;
+            break;
+            case 'F':
+                font_path = optarg;
+            break;
+            case 'V':
+                receive_path = optarg;
+            break;
+            case 'E':
+                serve_path = optarg;
+            break;
+            case 'B':
+                baud = atol(optarg);
+                speed_t speed;
+                if (!baud_to_speed(baud, &speed)) {
+                    fprintf(stderr, "[ERROR] Invalid baud rate '%s' -- use a standard rate from 300 to 115200\n", optarg);
+                    exit(1);
+                }
+            break;
+            case 'a':
+                animate_path = optarg;
+            break;
+            case 'x':
+                extract_path = optarg;
+            break;
+            case 'Y':
+                do_scan = true;
+            break;
+            case 'D':
+                delay = atoi(optarg);
+                if (delay < 1 || delay > 65535) {
+                    fprintf(stderr, "[ERROR] Invalid frame delay '%s' -- give it in hundredths of a second\n", optarg);
+                    exit(1);
+                }
+            break;
+            case 'C':
+                cache_dir = optarg;
+            break;
+            case 'Z':
+                cache_size = atol(optarg);
+                if (cache_size < 1) {
+                    fprintf(stderr, "[ERROR] Invalid cache size '%s' -- give it in megabytes\n", optarg);
+                    exit(1);
+                }
+            break;
+            case 'L':
+                do_cache_link = true;
+            break;
+            case 'S':
+                if (optarg == NULL || strcmp(optarg, "text") == 0) {
+                    stats_format = STATS_TEXT;
+                } else if (strcmp(optarg, "json") == 0) {
+                    stats_format = STATS_JSON;
+                } else {
+                    fprintf(stderr, "[ERROR] Invalid stats format '%s' -- use text or json\n", optarg);
+                    exit(1);
+                }
+            break;
             case 'h':
                 show_help();
                 exit(0);
             break;
             case '?':
-                printf("[ERROR] Unknown option '%c'\n", optopt);
+                fprintf(stderr, "[ERROR] Unknown option '%c'\n", optopt);
                 exit(1);
         }
     }
 
+    // FROM 0.5.0
+    // Note the first option given that only applies to writing images,
+    // for the modes that write none of their own
+    const char* image_option = NULL;
+    if (depth != 0) {
+        image_option = "--depth";
+    } else if (do_compress) {
+        image_option = "--compress";
+    } else if (format_count > 0) {
+        image_option = "--png or --format";
+    } else if (do_scale == 0) {
+        image_option = "--rawsize";
+    } else if (scale != 0) {
+        image_option = "--scale";
+    } else if (dpi != 0) {
+        image_option = "--dpi";
+    } else if (scaler != N2B_SCALER_NEAREST) {
+        image_option = "--scaler";
+    } else if (stats_format != STATS_NONE) {
+        image_option = "--stats";
+    } else if (cache_dir != NULL) {
+        image_option = "--cache";
+    }
+
+    // FROM 0.5.0
+    // Served conversions come with their own options
+    if (serve_path != NULL && image_option != NULL) {
+        fprintf(stderr, "[ERROR] %s can't be used with --serve\n", image_option);
+        exit(1);
+    }
+
+    // FROM 0.5.0
+    // Imported images become screenshots, which have no image settings
+    if (do_import && image_option != NULL) {
+        fprintf(stderr, "[ERROR] %s only applies to writing images, not to --import\n", image_option);
+        exit(1);
+    }
+
+    // FROM 0.5.0
+    // Nor does reading text write any images
+    if (do_text && image_option != NULL) {
+        fprintf(stderr, "[ERROR] %s only applies to writing images, not to --text\n", image_option);
+        exit(1);
+    }
+
+    // FROM 0.5.0
+    // BMP only supports run-length encoding of 4bpp and 8bpp images
+    if (do_compress && depth == 1) {
+        fprintf(stderr, "[ERROR] Compressed images must have a depth of 4 or 8\n");
+        exit(1);
+    }
+
+    // FROM 0.5.0
+    // Without a format, write the one the output file is named for.
+    // Received screenshots have only the output path
+    if (format_count == 0 && !do_batch && (argc - optind == 2 || (receive_path != NULL && argc - optind == 1))) {
+        const char* dot = strrchr(argv[argc - 1], '.');
+        unsigned int format = dot != NULL ? n2b_format_from_name(dot + 1) : N2B_FORMAT_COUNT;
+        if (format != N2B_FORMAT_COUNT) add_format(format, formats, &format_count);
+    }
+
+    if (format_count == 0) add_format(N2B_FORMAT_BMP, formats, &format_count);
+
+    // FROM 0.5.0
+    // Only BMPs have depths and compression options: the other
+    // formats are always written at 1bpp
+    bool has_bmp = false;
+    for (int i = 0 ; i < format_count ; ++i) has_bmp = has_bmp || formats[i] == N2B_FORMAT_BMP;
+    if (!has_bmp && (do_compress || depth > 1)) {
+        fprintf(stderr, "[ERROR] PNG, PCX and raw images are always 1bpp and can't take --depth or --compress\n");
+        exit(1);
+    }
+
+    // FROM 0.5.0
+    // Animations, extractions and stdout take a single format
+    if (format_count > 1 && (animate_path != NULL || extract_path != NULL)) {
+        fprintf(stderr, "[ERROR] Only one format can be written with --animate or --extract\n");
+        exit(1);
+    }
+
+    // FROM 0.5.0
+    // Only dumps with no file directory are scanned for screens
+    if (do_scan && extract_path == NULL) {
+        fprintf(stderr, "[ERROR] --scan only applies to --extract\n");
+        exit(1);
+    }
+
+    // FROM 0.5.0
+    // Edge-aware scalers set their own scale, and animations don't use them
+    if (scaler != N2B_SCALER_NEAREST && (do_scale == 0 || animate_path != NULL)) {
+        fprintf(stderr, "[ERROR] Scalers can't be used with --rawsize or --animate\n");
+        exit(1);
+    }
+
+    // FROM 0.5.0
+    // A scale can be set instead, but not as well as one of those
+    if (scale != 0 && do_scale == 0) {
+        fprintf(stderr, "[ERROR] Use either --rawsize or --scale\n");
+        exit(1);
+    }
+
+    if (scale != 0 && scaler != N2B_SCALER_NEAREST && scale != (scaler == N2B_SCALER_SCALE2X ? 2 : 3)) {
+        fprintf(stderr, "[ERROR] Scale2x only works at --scale 2, and Scale3x at --scale 3\n");
+        exit(1);
+    }
+
+    // FROM 0.5.0
+    // A target resolution sets the scale too, and needs nearest neighbour scaling
+    if (dpi != 0 && (do_scale == 0 || scale != 0)) {
+        fprintf(stderr, "[ERROR] Use only one of --rawsize, --scale and --dpi\n");
+        exit(1);
+    }
+
+    if (dpi != 0 && (scaler != N2B_SCALER_NEAREST || animate_path != NULL)) {
+        fprintf(stderr, "[ERROR] --dpi can't be used with --scaler or --animate\n");
+        exit(1);
+    }
+
+    // FROM 0.5.0
+    // Importing turns images into screenshots, so takes none of the other modes
+    if (do_import && (watch_path != NULL || animate_path != NULL || extract_path != NULL)) {
+        fprintf(stderr, "[ERROR] --import can't be used with --watch, --animate or --extract\n");
+        exit(1);
+    }
+
+    if (dither != NO_IMPORT && !do_import) {
+        fprintf(stderr, "[ERROR] --dither only applies to --import\n");
+        exit(1);
+    }
+
+    if (do_import && dither == NO_IMPORT) dither = N2B_DITHER_FLOYD_STEINBERG;
+
+    // FROM 0.5.0
+    // Reading text writes no images, and needs the ROM font to match against
+    if (do_text && (do_import || watch_path != NULL || animate_path != NULL || extract_path != NULL)) {
+        fprintf(stderr, "[ERROR] --text can't be used with --import, --watch, --animate or --extract\n");
+        exit(1);
+    }
+
+    if (font_path != NULL && !do_text) {
+        fprintf(stderr, "[ERROR] --font only applies to --text\n");
+        exit(1);
+    }
+
+    // FROM 0.5.0
+    // Received screenshots come off the line, so take no source paths
+    if (receive_path != NULL && (do_batch || do_import || do_text || watch_path != NULL || animate_path != NULL || extract_path != NULL)) {
+        fprintf(stderr, "[ERROR] --receive can't be used with --batch, --import, --text, --watch, --animate or --extract\n");
+        exit(1);
+    }
+
+    if (baud != 0 && receive_path == NULL) {
+        fprintf(stderr, "[ERROR] --baud only applies to --receive\n");
+        exit(1);
+    }
+
+    // FROM 0.5.0
+    // The server takes nothing but a worker count
+    if (serve_path != NULL) {
+        if (do_batch || do_import || do_text || receive_path != NULL || watch_path != NULL || animate_path != NULL || extract_path != NULL) {
+            fprintf(stderr, "[ERROR] --serve can't be used with --batch, --import, --text, --receive, --watch, --animate or --extract\n");
+            exit(1);
+        }
+
+        if (optind < argc) {
+            fprintf(stderr, "[ERROR] --serve takes no source or output filenames\n");
+            exit(1);
+        }
+
+        exit(run_server(serve_path, job_count));
+    }
+
+    N2BFont font;
+    if (do_text) {
+        if (font_path == NULL) {
+            fprintf(stderr, "[ERROR] --text needs the NC100's ROM font -- give its file with --font\n");
+            exit(1);
+        }
+
+        int error = n2b_font_load(&font, font_path);
+        if (error == N2B_ERROR_BAD_FONT) {
+            fprintf(stderr, "[ERROR] Font file %s is not eight bytes per character of six-pixel rows\n", font_path);
+            exit(1);
+        } else if (error != N2B_ERROR_NONE) {
+            fprintf(stderr, "[ERROR] Could not read font file %s\n", font_path);
+            exit(1);
+        }
+    }
+
+    // FROM 0.5.0
+    // Gather the output settings for the library
+    N2BOptions options;
+    n2b_options_init(&options);
+    options.scale = do_scale ? N2B_SCALE_FACTOR : 1;
+    options.depth = depth;
+    options.compress = do_compress;
+    options.scaler = scaler;
+    if (scaler == N2B_SCALER_SCALE2X) options.scale = 2;
+    if (scale != 0) options.scale = scale;
+    options.dpi = dpi;
+
+    // FROM 0.5.0
+    // Reuse BMPs of screens seen before, if asked to
+    uint64_t cache_size_max = (uint64_t)cache_size * 1024 * 1024;
+    if (do_cache_link && cache_dir == NULL) {
+        fprintf(stderr, "[ERROR] --cache-link only applies to --cache\n");
+        exit(1);
+    }
+
+    if (cache_dir != NULL) {
+        if (open_cache(cache_dir) != 0) exit(1);
+        options.cache_dir = cache_dir;
+        options.cache_links = do_cache_link;
+    }
+
+    // FROM 0.5.0
+    // Only time the conversion stages if a report was requested
+    N2BStats stats;
+    double start_wall = 0.0;
+    double start_cpu = 0.0;
+    if (stats_format != STATS_NONE) {
+        n2b_stats_init(&stats);
+        options.stats = &stats;
+        start_wall = clock_seconds(CLOCK_MONOTONIC);
+        start_cpu = clock_seconds(CLOCK_PROCESS_CPUTIME_ID);
+    }
+
+    // FROM 0.5.0
+    // One set of options per format, with the BMP-only settings cleared
+    // for the rest. The first set's stats record covers them all
+    TargetSet targets = {.count = format_count};
+    for (int i = 0 ; i < format_count ; ++i) {
+        targets.options[i] = options;
+        targets.options[i].format = formats[i];
+        if (formats[i] != N2B_FORMAT_BMP) {
+            targets.options[i].depth = 0;
+            targets.options[i].compress = false;
+        }
+    }
+
+    // FROM 0.5.0
+    // Watch mode runs until interrupted, so takes no other paths
+    if (watch_path != NULL) {
+        int error = run_watch(watch_path, &targets, job_count, cache_size_max);
+        if (cache_dir != NULL) n2b_cache_trim(cache_dir, cache_size_max);
+        if (stats_format != STATS_NONE) {
+            show_stats(&stats, clock_seconds(CLOCK_MONOTONIC) - start_wall, clock_seconds(CLOCK_PROCESS_CPUTIME_ID) - start_cpu, stats_format);
+        }
+
+        exit(error);
+    }
+
+    // FROM 0.5.0
+    // Pull every screenshot out of a card or disk dump's file directory,
+    // or, if asked, a scan of any dump, into the current directory or
+    // the one given
+    if (extract_path != NULL) {
+        const char* outdir = optind < argc ? argv[optind] : ".";
+        size_t count = 0;
+        size_t ambiguous = 0;
+        int error = n2b_extract_dump(extract_path, outdir, &targets.options[0], do_scan, &count, &ambiguous);
+        if (error != N2B_ERROR_NONE) {
+            bool is_source = error == N2B_ERROR_OPEN_SOURCE_FILE || error == N2B_ERROR_READ_SOURCE_FILE || error == N2B_ERROR_NO_DIRECTORY;
+            show_error(error, is_source ? extract_path : (char*)outdir);
+        } else {
+            printf("Extracted %zu screenshot%s from %s\n", count, count == 1 ? "" : "s", extract_path);
+            if (ambiguous > 0) printf("Skipped %zu screen%s at ambiguous offsets\n", ambiguous, ambiguous == 1 ? "" : "s");
+        }
+
+        if (stats_format != STATS_NONE) {
+            show_stats(&stats, clock_seconds(CLOCK_MONOTONIC) - start_wall, clock_seconds(CLOCK_PROCESS_CPUTIME_ID) - start_cpu, stats_format);
+        }
+
+        exit(error);
+    }
+
+    // FROM 0.5.0
+    // Take a screenshot straight off a serial line by XMODEM, converting
+    // it the moment it has all arrived, to the file named, if any
+    if (receive_path != NULL) {
+        if (argc - optind > 1) {
+            fprintf(stderr, "[ERROR] --receive takes at most one output filename\n");
+            exit(1);
+        }
+
+        char* output_path = optind < argc ? argv[optind] : RECEIVE_NAME;
+        char* stdout_path = "-";
+        char** target_paths = &stdout_path;
+        if (strcmp(output_path, "-") != 0) {
+            target_paths = make_target_paths(output_path, false, &targets);
+        } else if (targets.count > 1) {
+            fprintf(stderr, "[ERROR] Only one format can be written to stdout\n");
+            exit(1);
+        }
+
+        int error = receive_screenshot(receive_path, baud != 0 ? baud : DEFAULT_BAUD, target_paths, &targets);
+        if (target_paths != &stdout_path) free_paths(target_paths, targets.count);
+        if (cache_dir != NULL) n2b_cache_trim(cache_dir, cache_size_max);
+        if (stats_format != STATS_NONE) {
+            show_stats(&stats, clock_seconds(CLOCK_MONOTONIC) - start_wall, clock_seconds(CLOCK_PROCESS_CPUTIME_ID) - start_cpu, stats_format);
+        }
+
+        exit(error);
+    }
+
     // Process positional args, ie. the file paths
-    // TODO Update to handle multiple paths
-    int arg_count = 0;
-    if (optind < argc) {
-        while (optind < argc) {
-            if (arg_count == 0) {
-                source_path = argv[optind++];
-                arg_count++;
-            } else if (arg_count == 1) {
-                target_path = argv[optind++];
+    if (optind >= argc) {
+        fprintf(stderr, "[ERROR] Missing path to source screenshot\n");
+        exit(1);
+    }
+
+    // FROM 0.5.0
+    // More than two paths, a directory or a pattern can only be a batch
+    int path_count = argc - optind;
+    struct stat path_info;
+    if (path_count > 2) do_batch = true;
+    if (stat(argv[optind], &path_info) == 0) {
+        if (S_ISDIR(path_info.st_mode)) do_batch = true;
+    } else if (strpbrk(argv[optind], "*?[") != NULL) {
+        do_batch = true;
+    }
+
+    // FROM 0.5.0
+    // Turn images into screenshots, each named after its image with
+    // `.a` in place of its extension, unless a single one is named
+    if (do_import) {
+        if (do_batch) {
+            char** paths = NULL;
+            int import_count = 0;
+            for (int i = optind ; i < argc ; ++i) {
+                if (add_source_paths(argv[i], &paths, &import_count, true) != 0) {
+                    fprintf(stderr, "[ERROR] No images found at %s\n", argv[i]);
+                }
+            }
+
+            if (import_count == 0) {
+                fprintf(stderr, "[ERROR] No images to import\n");
+                exit(1);
             }
+
+            int failures = run_batch(paths, import_count, &targets, job_count, dither, NULL);
+            free_paths(paths, import_count);
+            exit(failures > 0 ? 1 : 0);
         }
-    } else {
-        printf("[ERROR] Missing path to source screenshot\n");
-        exit(1);
+
+        source_path = argv[optind];
+        if (path_count > 1) {
+            target_path = argv[optind + 1];
+        } else if (strcmp(source_path, "-") == 0) {
+            target_path = "-";
+        } else {
+            target_path = make_target_path(source_path, false, SCREENSHOT_EXTENSION);
+            do_free_target_path = true;
+        }
+
+        int error = n2b_import_file(source_path, target_path, (unsigned int)dither);
+        if (error != N2B_ERROR_NONE) show_import_error(error, source_path, target_path);
+        if (do_free_target_path) free(target_path);
+        exit(error);
+    }
+
+    // FROM 0.5.0
+    // Read the text on screenshots, writing each alongside its source
+    // with `.txt` added, or, for a single one, in place of its extension
+    if (do_text) {
+        if (do_batch) {
+            char** paths = NULL;
+            int text_count = 0;
+            for (int i = optind ; i < argc ; ++i) {
+                if (add_source_paths(argv[i], &paths, &text_count, false) != 0) {
+                    fprintf(stderr, "[ERROR] No screenshots found at %s\n", argv[i]);
+                }
+            }
+
+            if (text_count == 0) {
+                fprintf(stderr, "[ERROR] No screenshots to read\n");
+                exit(1);
+            }
+
+            int failures = run_batch(paths, text_count, &targets, job_count, NO_IMPORT, &font);
+            free_paths(paths, text_count);
+            exit(failures > 0 ? 1 : 0);
+        }
+
+        source_path = argv[optind];
+        if (path_count > 1) {
+            target_path = argv[optind + 1];
+        } else if (strcmp(source_path, "-") == 0) {
+            target_path = "-";
+        } else {
+            target_path = make_target_path(source_path, false, TEXT_EXTENSION);
+            do_free_target_path = true;
+        }
+
+        int error = n2b_text_file(source_path, target_path, &font);
+        if (error != N2B_ERROR_NONE) show_text_error(error, source_path, target_path);
+        if (do_free_target_path) free(target_path);
+        exit(error);
+    }
+
+    // FROM 0.5.0
+    // Animations take their frames from every positional arg, in order
+    if (animate_path != NULL) {
+        char** paths = NULL;
+        int frame_count = 0;
+        for (int i = optind ; i < argc ; ++i) {
+            if (strcmp(argv[i], "-") == 0) {
+                paths = realloc(paths, (frame_count + 1) * sizeof(char*));
+                paths[frame_count++] = strdup(argv[i]);
+            } else if (add_source_paths(argv[i], &paths, &frame_count, false) != 0) {
+                fprintf(stderr, "[ERROR] No screenshots found at %s\n", argv[i]);
+            }
+        }
+
+        if (frame_count == 0) {
+            fprintf(stderr, "[ERROR] No screenshots to animate\n");
+            exit(1);
+        }
+
+        // Make sure the animation file name ends in '.gif'
+        size_t animate_len = strlen(animate_path);
+        if (strcmp(animate_path, "-") != 0 && (animate_len < 4 || strcmp(animate_path + animate_len - 4, ".gif") != 0)) {
+            target_path = calloc(animate_len + 5, sizeof(char));
+            sprintf(target_path, "%s.gif", animate_path);
+            do_free_target_path = true;
+        } else {
+            target_path = animate_path;
+        }
+
+        size_t failed_index = 0;
+        int error = n2b_animate_files((const char* const*)paths, frame_count, target_path, &targets.options[0], (unsigned int)delay, &failed_index);
+        if (error == N2B_ERROR_BAD_OPTIONS && failed_index > 0 && failed_index < (size_t)frame_count) {
+            // FROM 0.5.0 -- frames can't mix NC100 and NC200 screens
+            fprintf(stderr, "[ERROR] Screenshot %s is not the same size as %s\n", paths[failed_index], paths[0]);
+        } else if (error != N2B_ERROR_NONE) {
+            show_error(error, failed_index < (size_t)frame_count ? paths[failed_index] : target_path);
+        } else if (strcmp(target_path, "-") != 0) {
+            printf("Animated %i screenshots as %s\n", frame_count, target_path);
+        }
+
+        for (int i = 0 ; i < frame_count ; ++i) free(paths[i]);
+        free(paths);
+        if (do_free_target_path) free(target_path);
+        exit(error);
+    }
+
+    if (do_batch) {
+        // Expand every positional arg into source file paths
+        char** paths = NULL;
+        int batch_count = 0;
+        for (int i = optind ; i < argc ; ++i) {
+            if (add_source_paths(argv[i], &paths, &batch_count, false) != 0) {
+                fprintf(stderr, "[ERROR] No screenshots found at %s\n", argv[i]);
+            }
+        }
+
+        if (batch_count == 0) {
+            fprintf(stderr, "[ERROR] No screenshots to convert\n");
+            exit(1);
+        }
+
+        int failures = run_batch(paths, batch_count, &targets, job_count, NO_IMPORT, NULL);
+        if (cache_dir != NULL) n2b_cache_trim(cache_dir, cache_size_max);
+        if (stats_format != STATS_NONE) {
+            show_stats(&stats, clock_seconds(CLOCK_MONOTONIC) - start_wall, clock_seconds(CLOCK_PROCESS_CPUTIME_ID) - start_cpu, stats_format);
+        }
+
+        for (int i = 0 ; i < batch_count ; ++i) free(paths[i]);
+        free(paths);
+        exit(failures > 0 ? 1 : 0);
+    }
+
+    source_path = argv[optind];
+    if (path_count > 1) target_path = argv[optind + 1];
+
+    // FROM 0.5.0
+    // Screenshots read from stdin are written to stdout unless
+    // a destination is given
+    if (target_path == NULL && strcmp(source_path, "-") == 0) target_path = "-";
+
+    // FROM 0.5.0
+    // Several images can't all be written to stdout, so each is named
+    // after the destination, or the source, less any extension
+    char** target_paths = NULL;
+    if (targets.count > 1) {
+        if (target_path != NULL && strcmp(target_path, "-") == 0) {
+            fprintf(stderr, "[ERROR] Only one format can be written to stdout\n");
+            exit(1);
+        }
+
+        target_paths = make_target_paths(target_path != NULL ? target_path : source_path, false, &targets);
+        target_path = NULL;
     }
 
     // Check the target path
-    if (target_path != NULL) {
+    const char* extension = n2b_format_extension(targets.options[0].format);
+    if (target_paths != NULL) {
+        // Already named
+    } else if (target_path != NULL && strcmp(target_path, "-") != 0) {
         // FROM 0.3.0
         // Make sure the supplied destination file name ends in '.bmp'
-        if (strstr(target_path, ".bmp") == NULL) {
+        // FROM 0.5.0 -- or the extension of the format being written
+        if (strstr(target_path, extension) == NULL) {
             // NOTE Above call succeeds on first `.bmp` found, so we'll currently
             //      not come here on files ending in, say, `.bmp.xxx`. We should
             //      really check that the file ENDS in `.bmp`.
@@ -256,35 +994,36 @@ int main (int argc, char *argv[] ) {
             char* tmp_target_path = calloc(target_len + 5, sizeof(char));
             do_free_target_path = true;
             strcpy(tmp_target_path, target_path);
-            strcpy(&tmp_target_path[target_len], ".bmp");
+            strcpy(&tmp_target_path[target_len], extension);
             target_path = tmp_target_path;
         }
-    } else {
+    } else if (target_path == NULL) {
         // FROM 0.3.0
         // Use the source file as the basis for the destination file name
         // if no destination file name is provided.
-        // Determine the length of the source filename minus any extension
-        int length = 0;
-        const char* result = strchr(source_path, '.');
-        if (result != NULL) {
-            length = result - source_path;
-        } else {
-            length = strlen(source_path);
-        }
-
-        // Allocate zeroed memory for the name and write in the source
-        // name and then append the standard file extension
-        target_path = calloc(length + 5, sizeof(char));
+        target_path = make_target_path(source_path, false, extension);
         do_free_target_path = true;
-        strncpy(target_path, source_path, length);
-        strcpy(&target_path[0] + length, ".bmp");
     }
 
+    // FROM 0.5.0
+    // A single large image, eg. for print, is encoded on every core,
+    // or as many threads as the job count
+    if (job_count == 0) job_count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (job_count > MAX_JOBS) job_count = MAX_JOBS;
+    for (int i = 0 ; i < targets.count ; ++i) targets.options[i].threads = job_count > 0 ? (unsigned int)job_count : 1;
+
     // FROM 0.4.0
     // Use the `convert()` function
-    int error = convert(source_path, target_path, do_scale);
-    if (error != 0) {
-        show_error(error, error == ERROR_OPEN_SOURCE_FILE ? source_path : target_path);
+    // FROM 0.5.0 -- now `n2b_convert_file_multi()` in the library,
+    //               which writes every format from one read
+    const char* failed_path = NULL;
+    int error = convert_to_targets(source_path, target_paths != NULL ? target_paths : &target_path, &targets, &failed_path);
+    if (error != 0) show_error(error, (char*)failed_path);
+    if (target_paths != NULL) free_paths(target_paths, targets.count);
+
+    if (cache_dir != NULL) n2b_cache_trim(cache_dir, cache_size_max);
+    if (stats_format != STATS_NONE) {
+        show_stats(&stats, clock_seconds(CLOCK_MONOTONIC) - start_wall, clock_seconds(CLOCK_PROCESS_CPUTIME_ID) - start_cpu, stats_format);
     }
 
     // Free the generated-path memory
@@ -296,194 +1035,1705 @@ int main (int argc, char *argv[] ) {
 
 
 /*
-    Write a block of bytes to a file.
+    Generate a BMP file path from a source file path, replacing any
+    extension with `.bmp`, or appending `.bmp` to keep the extension.
+    Batches need the latter: NC100 screenshots differ only by extension,
+    eg. `s.a`, `s.b`, so they would otherwise all become `s.bmp`.
+
+    FROM 0.5.0 -- moved out of `main()`, and takes the output extension
 
     - Parameters:
-        - data:      Pointer to a header data.
-        - outfile:   Pointer to open output file record.
-        - byteCount: Number of bytes in the header data.
-*/
-void output_header_bytes(const char* data, FILE* outfile, unsigned int byteCount) {
+        - source_path:    Pointer to the path to the source file.
+        - keep_extension: Should the source extension be retained?
+        - extension:      Pointer to the output extension, eg. `.bmp`.
 
-    for (unsigned int i = 0 ; i < byteCount ; ++i) {
-        fputc(data[i], outfile);
+    - Returns: A pointer to the new path, which the caller must free.
+*/
+char* make_target_path(const char* source_path, bool keep_extension, const char* extension) {
+
+    // Determine the length of the source filename minus any extension.
+    // Only look for the extension in the file name, not the directories
+    int length = strlen(source_path);
+    const char* name = strrchr(source_path, '/');
+    name = (name == NULL) ? source_path : name + 1;
+    const char* result = strrchr(name, '.');
+    if (result != NULL && result != name && !keep_extension) {
+        length = result - source_path;
     }
+
+    // Allocate zeroed memory for the name and write in the source
+    // name and then append the standard file extension
+    char* target_path = calloc(length + strlen(extension) + 1, sizeof(char));
+    strncpy(target_path, source_path, length);
+    strcpy(&target_path[0] + length, extension);
+    return target_path;
 }
 
 
 /*
-    Upscale pixel data.
-    Currently we scale only by a factor of 3 (72dpi to 216dpi).
+    Make the destination file paths for a screenshot, one per format,
+    as `make_target_path()` does.
 
-    FROM 0.2.0
+    FROM 0.5.0
 
     - Parameters:
-        - data: Pointer to the raw bit per pixel data.
-        - dest: Pointer to the scaled byte per pixel data.
-*/
-void scale(char* source, char* target) {
+        - source_path:    Pointer to the source (or destination base) path.
+        - keep_extension: Should the source extension be retained?
+        - targets:        Pointer to the formats to write.
 
-    // Buffer for the bit-per-pixel to byte-per-pixel conversion
-    char tmp[UNSCALED_DATA_SIZE] = {0};
+    - Returns: The paths, which the caller must free with `free_paths()`.
+*/
+char** make_target_paths(const char* source_path, bool keep_extension, const TargetSet* targets) {
 
-    // Convert each byte of the source into eight bytes, with one byte
-    // per pixel in place of one byte per eight pixels.
-    char* ptr = tmp;
-    for (int row = 0 ; row < 64 ; ++row) {
-        // Ignore the four-byte alignment padding in the source
-        for (int col = 0 ; col < 60 ; ++col) {
-            char byte = source[(63 - row) * 64 + col];
-            for (int bit = 0 ; bit < 8 ; ++bit) {
-                char pixel = (byte & (1 << (7 - bit))) >> (7 - bit);
-                *ptr = pixel > 0 ? 0x01 : 0x00;
-                ptr++;
-            }
-        }
+    char** target_paths = calloc(targets->count, sizeof(char*));
+    for (int i = 0 ; i < targets->count ; ++i) {
+        target_paths[i] = make_target_path(source_path, keep_extension, n2b_format_extension(targets->options[i].format));
     }
 
-    // Delta values cover the eight bytes neighbouring the destination
-    // byte mapped to a byte in the source buffer
-    const int delta[9] = {-1441, -1440, -1439, -1, 0, 1, 1439, 1440, 1441};
-    char* destinationPtr = target;
-    ptr = tmp;
+    return target_paths;
+}
 
-    for (unsigned int i = 0 ; i < UNSCALED_DATA_SIZE ; ++i) {
-        char byte = *ptr;
-        ptr++;
 
-        if (i % UNSCALED_WIDTH == 0) {
-            // On a new row, so move the pointer on three whole rows
-            destinationPtr = target + (((i / UNSCALED_WIDTH) * SCALE_FACTOR) + 1) * SCALED_WIDTH;
-        } else {
-            destinationPtr += 3;
-        }
+/*
+    Free a list of paths and the paths in it.
 
-        // Fill in the neighbours in the destination buffer
-        for (unsigned int j = 0; j < 9 ; ++j) {
-            char* neighbourPtr = destinationPtr + delta[j];
-            if (neighbourPtr < target + SCALED_DATA_SIZE) {
-                *neighbourPtr = byte;
-            }
-        }
-    }
+    FROM 0.5.0
+
+    - Parameters:
+        - paths:      Pointer to the list.
+        - path_count: The number of paths in the list.
+*/
+void free_paths(char** paths, int path_count) {
+
+    for (int i = 0 ; i < path_count ; ++i) free(paths[i]);
+    free(paths);
 }
 
 
 /*
-    Convert a single screenshot file to BMP.
+    Convert a screenshot to every requested format, reading it once.
 
-    FROM 0.4.0
+    FROM 0.5.0
 
     - Parameters:
-        - inpath:   Pointer to the path to the source file.
-        - outpath:  Pointer to the path to the destination file.
-        - do_scale: Should the image be scaled too?
+        - source_path:  Pointer to the path to the screenshot.
+        - target_paths: Pointer to the destination paths, one per format.
+        - targets:      Pointer to the formats' output options.
+        - failed_path:  Pointer to a variable set to the path that failed, if any.
 
     - Returns: 0 on success or an error value.
- */
-int convert(char* inpath, char* outpath, bool do_scale) {
+*/
+int convert_to_targets(const char* source_path, char** target_paths, const TargetSet* targets, const char** failed_path) {
+
+    size_t failed_index = 0;
+    int error = n2b_convert_file_multi(source_path, (const char* const*)target_paths, targets->options, targets->count, &failed_index);
+    *failed_path = failed_index < (size_t)targets->count ? target_paths[failed_index] : source_path;
+    return error;
+}
+
+
+/*
+    Receive a screenshot by XMODEM on a serial line, and convert it to
+    every requested format as soon as the transfer of it ends. A terminal
+    is put in raw mode at the given speed for the transfer, then set
+    back; anything else, eg. a pipe or socket, is used as it is.
+
+    FROM 0.5.0
 
-    char original[RAW_DATA_SIZE] = {0};
-    char scaled[SCALED_DATA_SIZE] = {0};
-    FILE* infile = NULL;
-    FILE* outfile = NULL;
+    - Parameters:
+        - device_path:  Pointer to the path to the serial device, eg. `/dev/ttyUSB0`.
+        - baud:         The line speed, in bits per second.
+        - target_paths: Pointer to the destination paths, one per format.
+        - targets:      Pointer to the formats' output options.
+
+    - Returns: 0 on success or an error value.
+*/
+int receive_screenshot(const char* device_path, long baud, char** target_paths, const TargetSet* targets) {
 
-    // Read in the Amstrad screen grab data
-    infile = fopen (inpath, "rb");
-    if (infile == NULL) return ERROR_OPEN_SOURCE_FILE;
+    int fd = open(device_path, O_RDWR | O_NOCTTY);
+    if (fd == -1) {
+        fprintf(stderr, "[ERROR] Could not open serial device %s\n", device_path);
+        return N2B_ERROR_OPEN_SOURCE_FILE;
+    }
 
-    for (unsigned int row = 0 ; row < 64 ; ++row) {
-        for (int col = 0 ; col < 64 ; ++col) {
-            // Ignore the four NC100 padding bytes per row
-            int byte = fgetc(infile);
-            if (col < 60) original[row * 64 + col] = byte;
+    struct termios saved;
+    bool is_terminal = tcgetattr(fd, &saved) == 0;
+    if (is_terminal) {
+        struct termios line = saved;
+        speed_t speed = B9600;
+        baud_to_speed(baud, &speed);
+        cfmakeraw(&line);
+        cfsetispeed(&line, speed);
+        cfsetospeed(&line, speed);
+        line.c_cflag |= CLOCAL | CREAD;
+        line.c_cc[VMIN] = 1;
+        line.c_cc[VTIME] = 0;
+        if (tcsetattr(fd, TCSANOW, &line) != 0) {
+            fprintf(stderr, "[ERROR] Could not set up serial device %s\n", device_path);
+            close(fd);
+            return N2B_ERROR_OPEN_SOURCE_FILE;
         }
+
+        tcflush(fd, TCIFLUSH);
+    }
+
+    ReceiveTarget target = {.target_paths = target_paths, .targets = targets, .failed_path = NULL};
+    uint8_t raw[N2B_SOURCE_SIZE_MAX];
+    int error = n2b_receive_xmodem(fd, raw, convert_received, &target);
+    if (is_terminal) {
+        tcdrain(fd);
+        tcsetattr(fd, TCSANOW, &saved);
     }
 
-    // Close the source file
-    fclose(infile);
+    close(fd);
+    if (error == N2B_ERROR_TRANSFER) {
+        fprintf(stderr, "[ERROR] XMODEM transfer on %s failed\n", device_path);
+    } else if (error == N2B_ERROR_READ_SOURCE_FILE) {
+        fprintf(stderr, "[ERROR] XMODEM transfer on %s ended before the whole screenshot arrived\n", device_path);
+    } else if (error == N2B_ERROR_BAD_SIZE) {
+        fprintf(stderr, "[ERROR] XMODEM transfer on %s sent more or other than an NC100 or NC200 screenshot\n", device_path);
+    } else if (error != N2B_ERROR_NONE) {
+        show_error(error, (char*)target.failed_path);
+    } else if (strcmp(target_paths[0], "-") != 0) {
+        printf("Received screenshot as %s\n", target_paths[0]);
+    }
+
+    return error;
+}
 
-    // Open for output
-    outfile = fopen (outpath, "wb");
-    if (outfile == NULL) return ERROR_OPEN_BMP_FILE;
 
-    if (do_scale) {
-        // Change standard BMP header values to match the scaled image
-        unsigned int size = SCALED_DATA_SIZE + BMP_V5_HEADER_DATA_SIZE;
-        BMP_HEADER[BMP_HEADER_FILE_SIZE_INDEX]     = (char)(size & 0xFF);;
-        BMP_HEADER[BMP_HEADER_FILE_SIZE_INDEX + 1] = (char)((size & 0xFF00) >> 8);;
-        BMP_HEADER[BMP_HEADER_FILE_SIZE_INDEX + 2] = (char)((size & 0xFF0000) >> 16);;
+/*
+    Convert a screenshot as soon as `n2b_receive_xmodem()` has it all.
 
-        DIB_V5_HEADER[DIB_V5_HEADER_WIDTH_INDEX]      = (char)(SCALED_WIDTH & 0xFF);
-        DIB_V5_HEADER[DIB_V5_HEADER_WIDTH_INDEX + 1]  = (char)((SCALED_WIDTH & 0xFF00) >> 8);
-        DIB_V5_HEADER[DIB_V5_HEADER_HEIGHT_INDEX]     = (char)SCALED_HEIGHT;
+    FROM 0.5.0
 
-        DIB_V5_HEADER[DIB_V5_HEADER_BITS_PER_PIXEL_INDEX] = 8;
+    - Parameters:
+        - raw:      Pointer to the screenshot data.
+        - raw_size: The number of bytes of screenshot data.
+        - context:  Pointer to the ReceiveTarget.
 
-        size = SCALED_DATA_SIZE;
-        DIB_V5_HEADER[DIB_V5_HEADER_DATA_SIZE_INDEX]     = (char)(size & 0xFF);
-        DIB_V5_HEADER[DIB_V5_HEADER_DATA_SIZE_INDEX + 1] = (char)((size & 0xFF00) >> 8);
-        DIB_V5_HEADER[DIB_V5_HEADER_DATA_SIZE_INDEX + 2] = (char)((size & 0xFF0000) >> 16);
+    - Returns: 0 on success or an error value.
+*/
+int convert_received(const uint8_t* raw, size_t raw_size, void* context) {
 
-        DIB_V5_HEADER[DIB_V5_HEADER_H_RESOLUTION_INDEX]     = 0x38;
-        DIB_V5_HEADER[DIB_V5_HEADER_H_RESOLUTION_INDEX + 1] = 0x21;
-        DIB_V5_HEADER[DIB_V5_HEADER_V_RESOLUTION_INDEX]     = 0x38;
-        DIB_V5_HEADER[DIB_V5_HEADER_V_RESOLUTION_INDEX + 1] = 0x21;
-    }
+    ReceiveTarget* target = (ReceiveTarget*)context;
+    size_t failed_index = 0;
+    int error = n2b_convert_raw(raw, raw_size, (const char* const*)target->target_paths, target->targets->options, target->targets->count, &failed_index);
+    if (failed_index < (size_t)target->targets->count) target->failed_path = target->target_paths[failed_index];
+    return error;
+}
 
-    // Write out the BMP headers in order
-    output_header_bytes(BMP_HEADER, outfile, 14);
-    output_header_bytes(DIB_V5_HEADER, outfile, 124);
-    output_header_bytes(BMP_CLT, outfile, 8);
 
-    if (do_scale) {
-        // Upscale the image using nearest neighbour mode
-        scale(original, scaled);
+/*
+    Get the terminal speed setting for a baud rate.
 
-        // Write out the scaled data
-        for (unsigned int i = 0 ; i < SCALED_DATA_SIZE ; ++i) {
-            fputc(scaled[i], outfile);
-        }
-    } else {
-        // Write out the raw data
-        for (unsigned int row = 0 ; row < 64 ; ++row) {
-            // Exclude the padding rows
-            for (unsigned int col = 0 ; col < 60 ; ++col) {
-                // Read in the byte from the bottom rather than the
-                // top of the array, as BMP reverses Amstrad's row order
-                uint8_t byte = original[(63 - row) * 64 + col];
-                fputc(byte, outfile);
-            }
-        }
-    }
+    FROM 0.5.0
 
-    // Close the file now we're done
-    fclose(outfile);
+    - Parameters:
+        - baud:  The rate, in bits per second.
+        - speed: Pointer to a variable set to the speed.
 
-    return ERROR_NONE;
+    - Returns: `true` if the rate is a standard one, otherwise `false`.
+*/
+bool baud_to_speed(long baud, speed_t* speed) {
+
+    switch(baud) {
+        case 300:       *speed = B300;      return true;
+        case 1200:      *speed = B1200;     return true;
+        case 2400:      *speed = B2400;     return true;
+        case 4800:      *speed = B4800;     return true;
+        case 9600:      *speed = B9600;     return true;
+        case 19200:     *speed = B19200;    return true;
+        case 38400:     *speed = B38400;    return true;
+        case 57600:     *speed = B57600;    return true;
+        case 115200:    *speed = B115200;   return true;
+        default:        return false;
+    }
 }
 
 
 /*
-    Display an error message.
+    Add an output format to the list of those requested, unless it's
+    already there.
 
-    FROM 0.4.0
+    FROM 0.5.0
 
     - Parameters:
-        - error_code: The error to report.
-        - info:       Pointer to extra message data
+        - format:       The format.
+        - formats:      Pointer to the list, with room for every format.
+        - format_count: Pointer to the number of formats in the list.
 */
-void show_error(int error_code, char* info) {
+void add_format(unsigned int format, unsigned int* formats, int* format_count) {
 
-    switch(error_code) {
-        case ERROR_OPEN_SOURCE_FILE:
-            printf("ERROR] Could not open Amstrad screenshot file %s\n", info);
+    for (int i = 0 ; i < *format_count ; ++i) {
+        if (formats[i] == format) return;
+    }
+
+    formats[(*format_count)++] = format;
+}
+
+
+/*
+    Add the screenshot paths referenced by a command line arg to a list.
+    The arg can be a file, a directory (all of whose screenshot-sized files
+    are added) or a glob pattern, for shells that don't expand them.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - arg:        Pointer to the command line arg.
+        - paths:      Pointer to the growable list of paths.
+        - path_count: Pointer to the number of paths in the list.
+        - images:     Take a directory's BMPs and PNGs instead of its screenshots?
+
+    - Returns: 0 if any paths were added, otherwise 1.
+*/
+int add_source_paths(const char* arg, char*** paths, int* path_count, bool images) {
+
+    int start_count = *path_count;
+    struct stat path_info;
+
+    if (stat(arg, &path_info) == 0) {
+        if (S_ISDIR(path_info.st_mode)) {
+            // Add every visible, screenshot-sized file in the directory,
+            // or every image
+            DIR* dir = opendir(arg);
+            if (dir == NULL) return 1;
+            struct dirent* entry;
+            while ((entry = readdir(dir)) != NULL) {
+                if (entry->d_name[0] == '.') continue;
+                char* path = calloc(strlen(arg) + strlen(entry->d_name) + 2, sizeof(char));
+                sprintf(path, "%s/%s", arg, entry->d_name);
+                bool is_file = stat(path, &path_info) == 0 && S_ISREG(path_info.st_mode);
+                if (is_file && (images ? is_image(path) : is_screenshot_size(path_info.st_size))) {
+                    *paths = realloc(*paths, (*path_count + 1) * sizeof(char*));
+                    (*paths)[(*path_count)++] = path;
+                } else {
+                    free(path);
+                }
+            }
+
+            closedir(dir);
+
+            // Directories list in no particular order, so sort the
+            // files to convert or animate them predictably
+            qsort(*paths + start_count, *path_count - start_count, sizeof(char*), compare_paths);
+        } else {
+            // A file, so add it as is
+            *paths = realloc(*paths, (*path_count + 1) * sizeof(char*));
+            (*paths)[(*path_count)++] = strdup(arg);
+        }
+    } else {
+        // Not a file so try it as a pattern
+        glob_t matches;
+        if (glob(arg, 0, NULL, &matches) == 0) {
+            *paths = realloc(*paths, (*path_count + matches.gl_pathc) * sizeof(char*));
+            for (size_t i = 0 ; i < matches.gl_pathc ; ++i) {
+                (*paths)[(*path_count)++] = strdup(matches.gl_pathv[i]);
+            }
+        }
+
+        globfree(&matches);
+    }
+
+    return *path_count > start_count ? 0 : 1;
+}
+
+
+/*
+    Is a file one that can be imported, by its name?
+
+    FROM 0.5.0
+
+    - Parameters:
+        - path: Pointer to the path to the file.
+
+    - Returns: `true` if its extension is `.bmp` or `.png`, in either case.
+*/
+bool is_image(const char* path) {
+
+    const char* dot = strrchr(path, '.');
+    return dot != NULL && (strcasecmp(dot, ".bmp") == 0 || strcasecmp(dot, ".png") == 0);
+}
+
+
+/*
+    Is a file the size of a screenshot of any geometry, with or
+    without a file header?
+
+    FROM 0.5.0
+
+    - Parameters:
+        - size: The file's size.
+
+    - Returns: `true` if it's an NC100's or an NC200's, otherwise `false`.
+*/
+bool is_screenshot_size(off_t size) {
+
+    for (unsigned int i = 0 ; i < N2B_GEOMETRY_COUNT ; ++i) {
+        size_t raw_size = n2b_geometry(i)->raw_size;
+        if ((size_t)size == raw_size || (size_t)size == raw_size + N2B_HEADER_SIZE) return true;
+    }
+
+    return false;
+}
+
+
+/*
+    Convert a set of screenshots using a pool of worker threads,
+    reporting any errors per file.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - paths:      Pointer to the list of source file paths.
+        - path_count: The number of paths in the list.
+        - targets:    Pointer to the formats' output options.
+        - job_count:  The number of workers, or 0 for one per core.
+        - dither:     Import images as screenshots with this dithering
+                      instead, or NO_IMPORT to convert screenshots.
+        - font:       Read the screenshots' text with this font instead,
+                      or NULL to convert them.
+
+    - Returns: The number of files that could not be converted.
+*/
+int run_batch(char** paths, int path_count, const TargetSet* targets, int job_count, int dither, const N2BFont* font) {
+
+    BatchState state = {
+        .paths = paths,
+        .path_count = path_count,
+        .next_path = 0,
+        .failure_count = 0,
+        .targets = *targets,
+        .dither = dither,
+        .font = font
+    };
+
+    pthread_mutex_init(&state.lock, NULL);
+
+    // Size the pool to the cores, but don't start idle workers
+    if (job_count == 0) job_count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (job_count < 1) job_count = 1;
+    if (job_count > MAX_JOBS) job_count = MAX_JOBS;
+    if (job_count > path_count) job_count = path_count;
+    state.job_count = job_count;
+
+    // Conversion keeps the screenshot buffer on the stack, so make
+    // sure the workers' stacks are large enough on all platforms
+    pthread_t workers[MAX_JOBS];
+    pthread_attr_t attributes;
+    pthread_attr_init(&attributes);
+    pthread_attr_setstacksize(&attributes, 1024 * 1024);
+
+    int started = 0;
+    for (int i = 0 ; i < job_count ; ++i) {
+        if (pthread_create(&workers[started], &attributes, batch_worker, &state) == 0) started++;
+    }
+
+    // Fall back to converting on this thread if no workers could start
+    if (started == 0) batch_worker(&state);
+    for (int i = 0 ; i < started ; ++i) pthread_join(workers[i], NULL);
+
+    pthread_attr_destroy(&attributes);
+    pthread_mutex_destroy(&state.lock);
+
+    if (dither != NO_IMPORT) {
+        printf("Imported %i of %i images\n", path_count - state.failure_count, path_count);
+    } else if (font != NULL) {
+        printf("Read the text of %i of %i screenshots\n", path_count - state.failure_count, path_count);
+    } else {
+        printf("Converted %i of %i screenshots\n", path_count - state.failure_count, path_count);
+    }
+    return state.failure_count;
+}
+
+
+/*
+    Batch worker thread body: convert files until none are left.
+    Screenshots are claimed a chunk at a time, for the library to read
+    and write together; images to import and text to read, one at a
+    time. If stats are being kept, each worker times into its own
+    record and adds it to the batch's when done, so timing takes no locks.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - context: Pointer to the shared batch state.
+
+    - Returns: NULL.
+*/
+void* batch_worker(void* context) {
+
+    BatchState* state = (BatchState*)context;
+    TargetSet targets = state->targets;
+    N2BStats stats;
+    if (targets.options[0].stats != NULL) {
+        n2b_stats_init(&stats);
+        for (int i = 0 ; i < targets.count ; ++i) targets.options[i].stats = &stats;
+    }
+
+    bool converting = state->dither == NO_IMPORT && state->font == NULL;
+    while (1) {
+        pthread_mutex_lock(&state->lock);
+        int index = state->next_path;
+        int claim = 1;
+        if (converting) {
+            claim = (state->path_count - index) / (2 * state->job_count);
+            if (claim < 1) claim = 1;
+            if (claim > BATCH_CHUNK_MAX) claim = BATCH_CHUNK_MAX;
+        }
+
+        state->next_path += claim;
+        pthread_mutex_unlock(&state->lock);
+        if (index >= state->path_count) break;
+        if (index + claim > state->path_count) claim = state->path_count - index;
+
+        char* source_path = state->paths[index];
+        if (state->dither != NO_IMPORT) {
+            char* target_path = make_target_path(source_path, false, SCREENSHOT_EXTENSION);
+            int error = n2b_import_file(source_path, target_path, (unsigned int)state->dither);
+            if (error != N2B_ERROR_NONE) {
+                pthread_mutex_lock(&state->lock);
+                state->failure_count++;
+                show_import_error(error, source_path, target_path);
+                pthread_mutex_unlock(&state->lock);
+            }
+
+            free(target_path);
+            continue;
+        }
+
+        if (state->font != NULL) {
+            char* target_path = make_target_path(source_path, true, TEXT_EXTENSION);
+            int error = n2b_text_file(source_path, target_path, state->font);
+            if (error != N2B_ERROR_NONE) {
+                pthread_mutex_lock(&state->lock);
+                state->failure_count++;
+                show_text_error(error, source_path, target_path);
+                pthread_mutex_unlock(&state->lock);
+            }
+
+            free(target_path);
+            continue;
+        }
+
+        N2BFileJob jobs[BATCH_CHUNK_MAX];
+        char** target_paths[BATCH_CHUNK_MAX];
+        for (int i = 0 ; i < claim ; ++i) {
+            target_paths[i] = make_target_paths(state->paths[index + i], true, &targets);
+            jobs[i].inpath = state->paths[index + i];
+            jobs[i].outpaths = (const char* const*)target_paths[i];
+        }
+
+        if (n2b_convert_files(jobs, claim, targets.options, targets.count) != N2B_ERROR_NONE) {
+            pthread_mutex_lock(&state->lock);
+            for (int i = 0 ; i < claim ; ++i) {
+                if (jobs[i].error == N2B_ERROR_NONE) continue;
+                state->failure_count++;
+                size_t failed = jobs[i].failed_index;
+                show_error(jobs[i].error, failed < (size_t)targets.count ? target_paths[i][failed] : state->paths[index + i]);
+            }
+
+            pthread_mutex_unlock(&state->lock);
+        }
+
+        for (int i = 0 ; i < claim ; ++i) free_paths(target_paths[i], targets.count);
+    }
+
+    if (targets.options[0].stats != NULL) {
+        pthread_mutex_lock(&state->lock);
+        n2b_stats_merge(state->targets.options[0].stats, &stats);
+        pthread_mutex_unlock(&state->lock);
+    }
+
+    return NULL;
+}
+
+
+/*
+    Watch a directory and convert each screenshot written or moved into
+    it as soon as it is complete, until interrupted. Screenshots already
+    in the directory are converted first unless they have an up-to-date
+    BMP. Conversions run on a pool of workers fed by a bounded queue.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - dir_path:       Pointer to the path to the directory to watch.
+        - targets:        Pointer to the formats' output options.
+        - job_count:      The number of workers, or 0 for one per core.
+        - cache_size_max: The cache size limit in bytes, if caching.
+
+    - Returns: 0 on a clean exit, 1 if the directory could not be watched.
+*/
+#ifdef __linux__
+int run_watch(const char* dir_path, const TargetSet* targets, int job_count, uint64_t cache_size_max) {
+
+    int watch_fd = inotify_init1(IN_CLOEXEC);
+    if (watch_fd == -1 || inotify_add_watch(watch_fd, dir_path, IN_CLOSE_WRITE | IN_MOVED_TO) == -1) {
+        fprintf(stderr, "[ERROR] Could not watch directory %s\n", dir_path);
+        if (watch_fd != -1) close(watch_fd);
+        return 1;
+    }
+
+    WatchQueue queue = {
+        .head = 0,
+        .count = 0,
+        .closed = false,
+        .converted_count = 0,
+        .failure_count = 0,
+        .targets = *targets,
+        .cache_size_max = cache_size_max
+    };
+
+    pthread_mutex_init(&queue.lock, NULL);
+    pthread_cond_init(&queue.not_empty, NULL);
+    pthread_cond_init(&queue.not_full, NULL);
+
+    // Stop cleanly on SIGINT or SIGTERM. They're blocked everywhere but
+    // in the watcher's wait for events, which unblocks them atomically, so
+    // one that arrives just before the wait still ends it
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = watch_signal_handler;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    sigset_t stop_signals, old_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, &old_signals);
+
+    if (job_count == 0) job_count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (job_count < 1) job_count = 1;
+    if (job_count > MAX_JOBS) job_count = MAX_JOBS;
+
+    pthread_t workers[MAX_JOBS];
+    pthread_attr_t attributes;
+    pthread_attr_init(&attributes);
+    pthread_attr_setstacksize(&attributes, 1024 * 1024);
+
+    int started = 0;
+    for (int i = 0 ; i < job_count ; ++i) {
+        if (pthread_create(&workers[started], &attributes, watch_worker, &queue) == 0) started++;
+    }
+
+    pthread_attr_destroy(&attributes);
+
+    int error = 0;
+    if (started == 0) {
+        fprintf(stderr, "[ERROR] Could not start any workers\n");
+        error = 1;
+    } else {
+        // Catch up on anything that arrived while we weren't watching
+        watch_queue_add_dir(&queue, dir_path);
+        printf("Watching %s for screenshots\n", dir_path);
+        fflush(stdout);
+    }
+
+    // Events are read in batches into an aligned buffer
+    char events[WATCH_EVENT_BUFFER_SIZE] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while (error == 0 && !watch_stopped) {
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET(watch_fd, &readable);
+        if (pselect(watch_fd + 1, &readable, NULL, NULL, NULL, &old_signals) == -1) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "[ERROR] Could not wait for events for directory %s\n", dir_path);
+            error = 1;
+            break;
+        }
+
+        ssize_t length = read(watch_fd, events, sizeof(events));
+        if (length <= 0) {
+            if (length == -1 && errno == EINTR) continue;
+            fprintf(stderr, "[ERROR] Could not read events for directory %s\n", dir_path);
+            error = 1;
+            break;
+        }
+
+        for (char* next = events ; next < events + length ; ) {
+            const struct inotify_event* event = (const struct inotify_event*)next;
+            next += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                // Events were dropped, so rescan to be sure nothing's missed
+                watch_queue_add_dir(&queue, dir_path);
+                continue;
+            }
+
+            // Ignore hidden files and our own output
+            if (event->len == 0 || event->name[0] == '.') continue;
+            size_t name_length = strlen(event->name);
+            bool is_output = false;
+            for (int i = 0 ; i < queue.targets.count ; ++i) {
+                is_output = is_output || (name_length > 4 && strcmp(event->name + name_length - 4, n2b_format_extension(queue.targets.options[i].format)) == 0);
+            }
+
+            if (is_output) continue;
+
+            char* path = calloc(strlen(dir_path) + strlen(event->name) + 2, sizeof(char));
+            sprintf(path, "%s/%s", dir_path, event->name);
+            if (is_screenshot(path)) {
+                watch_queue_push(&queue, path);
+            } else {
+                free(path);
+            }
+        }
+    }
+
+    pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+
+    // Let the workers finish what's queued, then stop them
+    pthread_mutex_lock(&queue.lock);
+    queue.closed = true;
+    pthread_cond_broadcast(&queue.not_empty);
+    pthread_mutex_unlock(&queue.lock);
+    for (int i = 0 ; i < started ; ++i) pthread_join(workers[i], NULL);
+
+    close(watch_fd);
+    pthread_cond_destroy(&queue.not_full);
+    pthread_cond_destroy(&queue.not_empty);
+    pthread_mutex_destroy(&queue.lock);
+
+    printf("Converted %i screenshots, %i failed\n", queue.converted_count, queue.failure_count);
+    return error;
+}
+
+
+/*
+    Add a path to the watch queue, waiting for space if it is full.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - queue: Pointer to the watch queue.
+        - path:  Pointer to the path, which the queue takes ownership of.
+*/
+void watch_queue_push(WatchQueue* queue, char* path) {
+
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == WATCH_QUEUE_SIZE) pthread_cond_wait(&queue->not_full, &queue->lock);
+    queue->paths[(queue->head + queue->count) % WATCH_QUEUE_SIZE] = path;
+    queue->count++;
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+
+/*
+    Take the next path from the watch queue, waiting for one if
+    the queue is empty.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - queue: Pointer to the watch queue.
+
+    - Returns: The path, which the caller must free, or NULL once the
+               queue is closed and empty.
+*/
+char* watch_queue_pop(WatchQueue* queue) {
+
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == 0 && !queue->closed) pthread_cond_wait(&queue->not_empty, &queue->lock);
+
+    char* path = NULL;
+    if (queue->count > 0) {
+        path = queue->paths[queue->head];
+        queue->head = (queue->head + 1) % WATCH_QUEUE_SIZE;
+        queue->count--;
+        pthread_cond_signal(&queue->not_full);
+    }
+
+    pthread_mutex_unlock(&queue->lock);
+    return path;
+}
+
+
+/*
+    Queue every screenshot in a directory.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - queue:    Pointer to the watch queue.
+        - dir_path: Pointer to the path to the directory.
+*/
+void watch_queue_add_dir(WatchQueue* queue, const char* dir_path) {
+
+    char** paths = NULL;
+    int path_count = 0;
+    add_source_paths(dir_path, &paths, &path_count, false);
+    for (int i = 0 ; i < path_count ; ++i) watch_queue_push(queue, paths[i]);
+    free(paths);
+}
+
+
+/*
+    Check whether a path is a screenshot: a regular file of the right size.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - path: Pointer to the path to check.
+
+    - Returns: `true` if the file could be a screenshot, otherwise `false`.
+*/
+bool is_screenshot(const char* path) {
+
+    struct stat path_info;
+    return stat(path, &path_info) == 0 && S_ISREG(path_info.st_mode) && is_screenshot_size(path_info.st_size);
+}
+
+
+/*
+    Check whether a BMP is at least as new as its source screenshot.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - source_path: Pointer to the path to the screenshot.
+        - target_path: Pointer to the path to the BMP.
+
+    - Returns: `true` if the BMP is up to date, otherwise `false`.
+*/
+bool is_converted(const char* source_path, const char* target_path) {
+
+    struct stat source_info, target_info;
+    if (stat(source_path, &source_info) != 0 || stat(target_path, &target_info) != 0) return false;
+    if (target_info.st_mtim.tv_sec != source_info.st_mtim.tv_sec) {
+        return target_info.st_mtim.tv_sec > source_info.st_mtim.tv_sec;
+    }
+
+    return target_info.st_mtim.tv_nsec >= source_info.st_mtim.tv_nsec;
+}
+
+
+/*
+    Watch worker thread body: convert queued screenshots until the
+    queue is closed, skipping any that have an up-to-date BMP.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - context: Pointer to the watch queue.
+
+    - Returns: NULL.
+*/
+void* watch_worker(void* context) {
+
+    WatchQueue* queue = (WatchQueue*)context;
+    TargetSet targets = queue->targets;
+    N2BStats stats;
+    if (targets.options[0].stats != NULL) {
+        n2b_stats_init(&stats);
+        for (int i = 0 ; i < targets.count ; ++i) targets.options[i].stats = &stats;
+    }
+
+    char* source_path;
+    while ((source_path = watch_queue_pop(queue)) != NULL) {
+        // An image is up to date if the first format's is
+        char** target_paths = make_target_paths(source_path, true, &targets);
+        if (!is_converted(source_path, target_paths[0])) {
+            const char* failed_path = NULL;
+            int error = convert_to_targets(source_path, target_paths, &targets, &failed_path);
+            bool do_trim = false;
+            pthread_mutex_lock(&queue->lock);
+            if (error == N2B_ERROR_NONE) {
+                queue->converted_count++;
+                do_trim = queue->converted_count % WATCH_CACHE_TRIM_INTERVAL == 0;
+                printf("Converted %s\n", source_path);
+                fflush(stdout);
+            } else {
+                queue->failure_count++;
+                show_error(error, (char*)failed_path);
+            }
+
+            pthread_mutex_unlock(&queue->lock);
+
+            // Watching never ends, so keep the cache trimmed as we go
+            const char* cache_dir = targets.options[0].cache_dir;
+            if (do_trim && cache_dir != NULL) n2b_cache_trim(cache_dir, queue->cache_size_max);
+        }
+
+        free_paths(target_paths, targets.count);
+        free(source_path);
+    }
+
+    if (targets.options[0].stats != NULL) {
+        pthread_mutex_lock(&queue->lock);
+        n2b_stats_merge(queue->targets.options[0].stats, &stats);
+        pthread_mutex_unlock(&queue->lock);
+    }
+
+    return NULL;
+}
+
+
+/*
+    Ask watch mode to stop.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - signal_number: The signal received.
+*/
+void watch_signal_handler(int signal_number) {
+
+    (void)signal_number;
+    watch_stopped = 1;
+}
+#else
+int run_watch(const char* dir_path, const TargetSet* targets, int job_count, uint64_t cache_size_max) {
+
+    (void)targets;
+    (void)job_count;
+    (void)cache_size_max;
+    fprintf(stderr, "[ERROR] Can't watch %s: watch mode needs Linux inotify\n", dir_path);
+    return 1;
+}
+#endif
+
+
+/*
+    Serve conversions on a Unix domain socket until interrupted.
+
+    Each request is a 16-byte header then the screenshot:
+        0   "N2BQ"
+        4   Format: N2B_FORMAT_*
+        5   Depth: 1, 4, 8, or 0 for the default
+        6   Flags: bit 0 to compress
+        7   Scaler: N2B_SCALER_*
+        8   Scale, 16-bit little endian, or 0 for the default
+        10  Resolution in dpi, 16-bit little endian, or 0 to use the scale
+        12  Screenshot size, 32-bit little endian: an NC100's or an NC200's,
+            which may include a +3DOS file header
+    and each response a 12-byte header then the image:
+        0   "N2BA"
+        4   Status, 32-bit little endian: N2B_ERROR_*
+        8   Image size, 32-bit little endian, 0 on error
+    A client may send any number of requests on one connection.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - socket_path: Pointer to the path to serve on.
+        - job_count:   The number of workers, or 0 for the default.
+
+    - Returns: 0 on a clean exit, 1 if the socket could not be served.
+*/
+int run_server(const char* socket_path, int job_count) {
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "[ERROR] Socket path %s is too long\n", socket_path);
+        return 1;
+    }
+
+    strcpy(address.sun_path, socket_path);
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd == -1) {
+        fprintf(stderr, "[ERROR] Could not create a socket\n");
+        return 1;
+    }
+
+    // Replace a socket left behind by a server that has gone, but not one
+    // in use, nor anything that isn't a socket
+    int bound = bind(listen_fd, (struct sockaddr*)&address, sizeof(address));
+    if (bound == -1 && errno == EADDRINUSE) {
+        struct stat path_info;
+        if (lstat(socket_path, &path_info) == 0 && !S_ISSOCK(path_info.st_mode)) {
+            fprintf(stderr, "[ERROR] %s is in use and is not a socket\n", socket_path);
+            close(listen_fd);
+            return 1;
+        }
+
+        int probe_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        bool is_stale = probe_fd != -1 && connect(probe_fd, (struct sockaddr*)&address, sizeof(address)) == -1 && errno == ECONNREFUSED;
+        if (probe_fd != -1) close(probe_fd);
+        if (is_stale) {
+            unlink(socket_path);
+            bound = bind(listen_fd, (struct sockaddr*)&address, sizeof(address));
+        } else {
+            fprintf(stderr, "[ERROR] Socket %s is already being served\n", socket_path);
+            close(listen_fd);
+            return 1;
+        }
+    }
+
+    if (bound == -1 || listen(listen_fd, SERVE_BACKLOG) == -1) {
+        fprintf(stderr, "[ERROR] Could not serve on socket %s\n", socket_path);
+        close(listen_fd);
+        return 1;
+    }
+
+    // Take connections without ever blocking the dispatcher, and let
+    // it be woken when a worker is done or the server is to stop
+    ServeState* state = calloc(1, sizeof(ServeState));
+    if (state == NULL || pipe(state->wake_fds) == -1) {
+        fprintf(stderr, "[ERROR] Could not serve on socket %s\n", socket_path);
+        free(state);
+        close(listen_fd);
+        unlink(socket_path);
+        return 1;
+    }
+
+    state->listen_fd = listen_fd;
+    fcntl(listen_fd, F_SETFL, fcntl(listen_fd, F_GETFL) | O_NONBLOCK);
+    for (int i = 0 ; i < 2 ; ++i) fcntl(state->wake_fds[i], F_SETFL, fcntl(state->wake_fds[i], F_GETFL) | O_NONBLOCK);
+    serve_wake_fd = state->wake_fds[1];
+    pthread_mutex_init(&state->lock, NULL);
+    pthread_cond_init(&state->ready, NULL);
+
+    // Stop cleanly on SIGINT or SIGTERM, as watch mode does, and don't
+    // die on writing to a client that has hung up
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = serve_signal_handler;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    action.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &action, NULL);
+
+    // Workers never take the stop signals: only the dispatcher does
+    sigset_t stop_signals, old_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, &old_signals);
+
+    if (job_count == 0) job_count = SERVE_WORKERS_DEFAULT;
+    if (job_count > SERVE_WORKERS_MAX) job_count = SERVE_WORKERS_MAX;
+
+    // Workers only convert in memory, so need little stack
+    pthread_t workers[SERVE_WORKERS_MAX];
+    pthread_attr_t attributes;
+    pthread_attr_init(&attributes);
+    pthread_attr_setstacksize(&attributes, 256 * 1024);
+
+    int started = 0;
+    for (int i = 0 ; i < job_count ; ++i) {
+        if (pthread_create(&workers[started], &attributes, serve_worker, state) == 0) started++;
+    }
+
+    pthread_attr_destroy(&attributes);
+    pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+
+    int error = 0;
+    if (started == 0) {
+        fprintf(stderr, "[ERROR] Could not start any workers\n");
+        error = 1;
+    } else {
+        printf("Serving conversions on %s with %i workers\n", socket_path, started);
+        fflush(stdout);
+        serve_connections(state);
+    }
+
+    // Stop taking connections, and let workers finish the requests
+    // already read before the connections close
+    pthread_mutex_lock(&state->lock);
+    state->stopping = true;
+    pthread_cond_broadcast(&state->ready);
+    pthread_mutex_unlock(&state->lock);
+    for (int i = 0 ; i < started ; ++i) pthread_join(workers[i], NULL);
+
+    for (int i = 0 ; i < state->connection_count ; ++i) close_connection(state->connections[i]);
+    serve_wake_fd = -1;
+    close(state->wake_fds[0]);
+    close(state->wake_fds[1]);
+    close(listen_fd);
+    unlink(socket_path);
+    pthread_mutex_destroy(&state->lock);
+    pthread_cond_destroy(&state->ready);
+
+    printf("Served %i requests, %i failed\n", state->request_count, state->failure_count);
+    free(state);
+    return error;
+}
+
+
+/*
+    Watch the listening socket and every connection until the server is
+    told to stop: take new connections, read requests as their pieces
+    arrive, and queue each whole one for the workers. A connection is
+    left alone while a worker has it, and closed once the worker is done
+    with it for good, or when it has been idle for `SERVE_IDLE_TIMEOUT`
+    seconds, so clients that connect and wait hold no worker.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - state: Pointer to the server's state.
+*/
+void serve_connections(ServeState* state) {
+
+    struct pollfd lines[SERVE_CONNECTIONS_MAX + 2];
+    ServeConnection* polled[SERVE_CONNECTIONS_MAX];
+
+    while (!serve_stopped) {
+        int line_count = 0;
+        lines[line_count++] = (struct pollfd){.fd = state->wake_fds[0], .events = POLLIN};
+
+        // At the limit, new clients wait in the backlog
+        int listen_line = -1;
+        if (state->connection_count < SERVE_CONNECTIONS_MAX) {
+            listen_line = line_count;
+            lines[line_count++] = (struct pollfd){.fd = state->listen_fd, .events = POLLIN};
+        }
+
+        double now = clock_seconds(CLOCK_MONOTONIC);
+        int polled_count = 0;
+        pthread_mutex_lock(&state->lock);
+        for (int i = 0 ; i < state->connection_count ; ) {
+            ServeConnection* connection = state->connections[i];
+            if (connection->busy) {
+                i++;
+                continue;
+            }
+
+            if (connection->closing || now - connection->last_active > SERVE_IDLE_TIMEOUT) {
+                close_connection(connection);
+                state->connections[i] = state->connections[--state->connection_count];
+                continue;
+            }
+
+            polled[polled_count++] = connection;
+            lines[line_count++] = (struct pollfd){.fd = connection->fd, .events = POLLIN};
+            i++;
+        }
+
+        pthread_mutex_unlock(&state->lock);
+
+        // Interrupted by a stop signal, or time to look for idle connections
+        if (poll(lines, line_count, SERVE_POLL_INTERVAL_MS) <= 0) continue;
+
+        if (lines[0].revents != 0) {
+            uint8_t drained[64];
+            while (read(state->wake_fds[0], drained, sizeof(drained)) > 0) {}
+        }
+
+        if (listen_line != -1 && lines[listen_line].revents != 0) accept_connection(state);
+
+        int first_polled = line_count - polled_count;
+        for (int i = 0 ; i < polled_count ; ++i) {
+            if (lines[first_polled + i].revents != 0 && !read_request(state, polled[i])) polled[i]->closing = true;
+        }
+    }
+}
+
+
+/*
+    Take a new connection, if one is still waiting. Its socket never
+    blocks, so a worker sending to a client that has stopped taking its
+    image can give up on it.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - state: Pointer to the server's state.
+*/
+void accept_connection(ServeState* state) {
+
+    int fd = accept(state->listen_fd, NULL, NULL);
+    if (fd == -1) return;
+
+    ServeConnection* connection = malloc(sizeof(ServeConnection));
+    if (connection == NULL) {
+        close(fd);
+        return;
+    }
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    connection->fd = fd;
+    connection->received = 0;
+    connection->request_size = SERVE_REQUEST_HEADER_SIZE;
+    connection->last_active = clock_seconds(CLOCK_MONOTONIC);
+    connection->busy = false;
+    connection->closing = false;
+    state->connections[state->connection_count++] = connection;
+}
+
+
+/*
+    Read what has arrived of a connection's request, never past its
+    end, so a client can send its next request without waiting. Once the
+    header is in, it's checked, and once the screenshot is in too, the
+    request is queued for a worker.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - state:      Pointer to the server's state.
+        - connection: Pointer to the connection, which has data waiting.
+
+    - Returns: Whether the connection can go on, ie. false if the client
+               hung up or sent a bad header.
+*/
+bool read_request(ServeState* state, ServeConnection* connection) {
+
+    ssize_t length = read(connection->fd, connection->request + connection->received, connection->request_size - connection->received);
+    if (length == -1 && (errno == EINTR || errno == EAGAIN)) return true;
+    if (length <= 0) return false;
+
+    connection->received += (size_t)length;
+    connection->last_active = clock_seconds(CLOCK_MONOTONIC);
+    if (connection->received < connection->request_size) return true;
+
+    // A malformed frame leaves the stream out of step, so can only be refused
+    if (connection->request_size == SERVE_REQUEST_HEADER_SIZE) {
+        const uint8_t* request = connection->request;
+        uint32_t raw_size = request[12] | (request[13] << 8) | (request[14] << 16) | ((uint32_t)request[15] << 24);
+        if (memcmp(request, SERVE_REQUEST_MAGIC, 4) != 0 || raw_size < N2B_RAW_DATA_SIZE || raw_size > N2B_SOURCE_SIZE_MAX) {
+            send_response(connection->fd, N2B_ERROR_BAD_OPTIONS, NULL, 0);
+            return false;
+        }
+
+        connection->request_size += raw_size;
+        return true;
+    }
+
+    pthread_mutex_lock(&state->lock);
+    connection->busy = true;
+    state->queue[(state->queue_start + state->queue_count) % SERVE_CONNECTIONS_MAX] = connection;
+    state->queue_count++;
+    pthread_cond_signal(&state->ready);
+    pthread_mutex_unlock(&state->lock);
+    return true;
+}
+
+
+/*
+    Close a connection and free it.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - connection: Pointer to the connection.
+*/
+void close_connection(ServeConnection* connection) {
+
+    close(connection->fd);
+    free(connection);
+}
+
+
+/*
+    Wake the dispatching thread from `poll()`, eg. when a worker has
+    finished with a connection. A full pipe already will.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - state: Pointer to the server's state.
+*/
+void wake_dispatcher(ServeState* state) {
+
+    uint8_t byte = 0;
+    ssize_t written = write(state->wake_fds[1], &byte, 1);
+    (void)written;
+}
+
+
+/*
+    Server worker: convert queued requests until the server stops and
+    the queue is empty. The image buffer is kept from one request to the
+    next, and never grows beyond `SERVE_BUFFER_SIZE_MAX`.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - context: Pointer to the server's ServeState.
+
+    - Returns: NULL.
+*/
+void* serve_worker(void* context) {
+
+    ServeState* state = (ServeState*)context;
+
+    // Start with room for a screenshot at the default settings
+    uint8_t blank[N2B_RAW_DATA_SIZE] = {0};
+    N2BBitmap bitmap;
+    N2BOptions options;
+    n2b_options_init(&options);
+    n2b_decode(blank, sizeof(blank), &bitmap);
+    size_t image_capacity = n2b_encoded_size_max(&bitmap, &options);
+    uint8_t* image = malloc(image_capacity);
+    if (image == NULL) image_capacity = 0;
+
+    pthread_mutex_lock(&state->lock);
+    while (true) {
+        while (state->queue_count == 0 && !state->stopping) pthread_cond_wait(&state->ready, &state->lock);
+        if (state->queue_count == 0) break;
+
+        ServeConnection* connection = state->queue[state->queue_start];
+        state->queue_start = (state->queue_start + 1) % SERVE_CONNECTIONS_MAX;
+        state->queue_count--;
+        pthread_mutex_unlock(&state->lock);
+
+        bool failed = false;
+        bool can_go_on = serve_request(connection, &image, &image_capacity, &failed);
+
+        // Hand the connection back for its next request, or to be closed
+        pthread_mutex_lock(&state->lock);
+        if (can_go_on) {
+            state->request_count++;
+            if (failed) state->failure_count++;
+        }
+
+        connection->received = 0;
+        connection->request_size = SERVE_REQUEST_HEADER_SIZE;
+        connection->last_active = clock_seconds(CLOCK_MONOTONIC);
+        connection->closing = !can_go_on;
+        connection->busy = false;
+        wake_dispatcher(state);
+    }
+
+    pthread_mutex_unlock(&state->lock);
+    free(image);
+    return NULL;
+}
+
+
+/*
+    Convert a connection's whole request and send the image back.
+    An image that could outgrow `SERVE_BUFFER_SIZE_MAX` is streamed instead
+    of buffered, so a client asking for huge images can't pin the memory.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - connection:     Pointer to the connection, with its request read.
+        - image:          Pointer to the worker's image buffer, which may be grown.
+        - image_capacity: Pointer to the size of the image buffer.
+        - failed:         Pointer to a bool, set if the conversion failed.
+
+    - Returns: Whether the connection can take another request.
+*/
+bool serve_request(const ServeConnection* connection, uint8_t** image, size_t* image_capacity, bool* failed) {
+
+    const uint8_t* request = connection->request;
+    int fd = connection->fd;
+    size_t raw_size = connection->request_size - SERVE_REQUEST_HEADER_SIZE;
+
+    N2BOptions options;
+    n2b_options_init(&options);
+    options.format = request[4];
+    options.depth = request[5];
+    options.compress = (request[6] & SERVE_FLAG_COMPRESS) != 0;
+    options.scaler = request[7];
+    unsigned int scale = request[8] | (request[9] << 8);
+    if (scale != 0) options.scale = scale;
+    options.dpi = request[10] | (request[11] << 8);
+    options.threads = 1;
+
+    N2BBitmap bitmap;
+    size_t image_size = 0;
+    int error = n2b_decode(request + SERVE_REQUEST_HEADER_SIZE, raw_size, &bitmap);
+    if (error == N2B_ERROR_NONE) {
+        size_t size_max = n2b_encoded_size_max(&bitmap, &options);
+        if (size_max == 0) {
+            error = N2B_ERROR_BAD_OPTIONS;
+        } else if (size_max > SERVE_BUFFER_SIZE_MAX) {
+            return stream_response(fd, &bitmap, &options, failed);
+        } else if (size_max > *image_capacity) {
+            uint8_t* grown = realloc(*image, size_max);
+            if (grown == NULL) {
+                error = N2B_ERROR_NO_MEMORY;
+            } else {
+                *image = grown;
+                *image_capacity = size_max;
+            }
+        }
+    }
+
+    if (error == N2B_ERROR_NONE) error = n2b_encode(&bitmap, &options, *image, *image_capacity, &image_size);
+    *failed = error != N2B_ERROR_NONE;
+    return send_response(fd, error, *image, error == N2B_ERROR_NONE ? image_size : 0);
+}
+
+
+/*
+    Send a response header and its image in one write, if the socket allows.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - fd:         The connection's socket.
+        - status:     The conversion's error value.
+        - image:      Pointer to the image, or NULL to send the header alone,
+                      eg. ahead of an image to be streamed.
+        - image_size: The size of the image.
+
+    - Returns: Whether the response was all sent.
+*/
+bool send_response(int fd, int status, const uint8_t* image, size_t image_size) {
+
+    uint8_t header[SERVE_RESPONSE_HEADER_SIZE];
+    memcpy(header, SERVE_RESPONSE_MAGIC, 4);
+    for (int i = 0 ; i < 4 ; ++i) {
+        header[4 + i] = (uint8_t)((uint32_t)status >> (8 * i));
+        header[8 + i] = (uint8_t)((uint32_t)image_size >> (8 * i));
+    }
+
+    struct iovec parts[2] = {
+        {.iov_base = header, .iov_len = sizeof(header)},
+        {.iov_base = (void*)image, .iov_len = image_size}
+    };
+
+    struct iovec* next = parts;
+    int count = image != NULL && image_size > 0 ? 2 : 1;
+    while (count > 0) {
+        ssize_t length = writev(fd, next, count);
+        if (length == -1 && errno == EINTR) continue;
+        if (length == -1 && errno == EAGAIN && wait_to_send(fd)) continue;
+        if (length <= 0) return false;
+
+        // Step past what was written, which may end part way through either
+        size_t written = (size_t)length;
+        while (count > 0 && written >= next->iov_len) {
+            written -= next->iov_len;
+            next++;
+            count--;
+        }
+
+        if (count > 0) {
+            next->iov_base = (uint8_t*)next->iov_base + written;
+            next->iov_len -= written;
+        }
+    }
+
+    return true;
+}
+
+
+/*
+    Wait for a connection to take more of a response, for as long as
+    `SERVE_SEND_TIMEOUT_MS` allows.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - fd: The connection's socket.
+
+    - Returns: Whether the socket can be written, ie. false if the client
+               has stopped reading.
+*/
+bool wait_to_send(int fd) {
+
+    struct pollfd line = {.fd = fd, .events = POLLOUT};
+    while (true) {
+        int ready = poll(&line, 1, SERVE_SEND_TIMEOUT_MS);
+        if (ready == -1 && errno == EINTR) continue;
+        return ready > 0 && (line.revents & POLLOUT) != 0;
+    }
+}
+
+
+/*
+    Send a response whose image is too big to buffer. The image is encoded
+    once just to measure it, so that the header can carry its size, then
+    again a piece at a time straight to the socket.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - fd:      The connection's socket.
+        - bitmap:  Pointer to the decoded screen.
+        - options: Pointer to the client's options.
+        - failed:  Pointer to a bool, set if the conversion failed.
+
+    - Returns: Whether the connection can take another request.
+*/
+bool stream_response(int fd, const N2BBitmap* bitmap, const N2BOptions* options, bool* failed) {
+
+    size_t image_size = 0;
+    int error = n2b_encode_stream(bitmap, options, NULL, NULL, &image_size);
+    *failed = error != N2B_ERROR_NONE;
+    if (error != N2B_ERROR_NONE) return send_response(fd, error, NULL, 0);
+    if (!send_response(fd, N2B_ERROR_NONE, NULL, image_size)) return false;
+
+    // Once the header is out, a failure can only be reported by hanging up
+    size_t written = 0;
+    error = n2b_encode_stream(bitmap, options, send_piece, &fd, &written);
+    if (error != N2B_ERROR_NONE || written != image_size) {
+        *failed = true;
+        return false;
+    }
+
+    return true;
+}
+
+
+/*
+    Write handler for `stream_response()`: send a piece of an image.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - data:    Pointer to the piece.
+        - size:    The size of the piece.
+        - context: Pointer to the connection's socket.
+
+    - Returns: Whether the piece was all sent.
+*/
+bool send_piece(const uint8_t* data, size_t size, void* context) {
+
+    int fd = *(int*)context;
+    size_t total = 0;
+    while (total < size) {
+        ssize_t length = write(fd, data + total, size - total);
+        if (length == -1 && errno == EINTR) continue;
+        if (length == -1 && errno == EAGAIN && wait_to_send(fd)) continue;
+        if (length <= 0) return false;
+        total += (size_t)length;
+    }
+
+    return true;
+}
+
+
+/*
+    Signal handler for SIGINT and SIGTERM in server mode.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - signal_number: The signal received.
+*/
+void serve_signal_handler(int signal_number) {
+
+    (void)signal_number;
+    serve_stopped = 1;
+    if (serve_wake_fd != -1) {
+        int saved_errno = errno;
+        uint8_t byte = 0;
+        ssize_t written = write(serve_wake_fd, &byte, 1);
+        (void)written;
+        errno = saved_errno;
+    }
+}
+
+
+/*
+    Make sure the cache directory exists, creating it if need be,
+    and that it's usable.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - cache_dir: Pointer to the path to the cache directory.
+
+    - Returns: 0 if the cache can be used, otherwise 1.
+*/
+int open_cache(const char* cache_dir) {
+
+    struct stat dir_info;
+    if (mkdir(cache_dir, 0755) != 0 && errno != EEXIST) {
+        show_error(N2B_ERROR_OPEN_CACHE, (char*)cache_dir);
+        return 1;
+    }
+
+    if (stat(cache_dir, &dir_info) != 0 || !S_ISDIR(dir_info.st_mode) || access(cache_dir, R_OK | W_OK | X_OK) != 0) {
+        show_error(N2B_ERROR_OPEN_CACHE, (char*)cache_dir);
+        return 1;
+    }
+
+    return 0;
+}
+
+
+/*
+    Order paths alphabetically, for `qsort()`.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - a: Pointer to a path pointer.
+        - b: Pointer to another path pointer.
+
+    - Returns: Negative, zero or positive as `a` sorts before, with or after `b`.
+*/
+int compare_paths(const void* a, const void* b) {
+
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+
+/*
+    Report the conversion stats on stderr, as a table or as a single
+    line of JSON for monitoring tools. Stage times are summed across
+    batch workers, so may exceed the elapsed time.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - stats:     Pointer to the stats to report.
+        - wall_time: The elapsed time of the run in seconds.
+        - cpu_time:  The process CPU time of the run in seconds.
+        - format:    `STATS_TEXT` or `STATS_JSON`.
+*/
+void show_stats(const N2BStats* stats, double wall_time, double cpu_time, int format) {
+
+    double rate = wall_time > 0.0 ? (double)stats->files / wall_time : 0.0;
+
+    if (format == STATS_JSON) {
+        fprintf(stderr, "{\"files\":%llu,\"failures\":%llu,\"cache_hits\":%llu,\"bytes_read\":%llu,\"bytes_written\":%llu,",
+                (unsigned long long)stats->files, (unsigned long long)stats->failures, (unsigned long long)stats->cache_hits,
+                (unsigned long long)stats->bytes_read, (unsigned long long)stats->bytes_written);
+        fprintf(stderr, "\"wall_s\":%.6f,\"cpu_s\":%.6f,\"files_per_s\":%.1f,\"stages\":{", wall_time, cpu_time, rate);
+        for (unsigned int i = 0 ; i < N2B_STAGE_COUNT ; ++i) {
+            fprintf(stderr, "%s\"%s\":{\"wall_ns\":%llu,\"cpu_ns\":%llu}", i > 0 ? "," : "", n2b_stage_name(i),
+                    (unsigned long long)stats->wall_ns[i], (unsigned long long)stats->cpu_ns[i]);
+        }
+
+        fprintf(stderr, "}}\n");
+        return;
+    }
+
+    fprintf(stderr, "Stage        Wall (ms)     CPU (ms)\n");
+    for (unsigned int i = 0 ; i < N2B_STAGE_COUNT ; ++i) {
+        fprintf(stderr, "%-8s %12.3f %12.3f\n", n2b_stage_name(i), stats->wall_ns[i] / 1e6, stats->cpu_ns[i] / 1e6);
+    }
+
+    fprintf(stderr, "Files:   %llu converted, %llu failed, %llu from cache, %.1f per second\n",
+            (unsigned long long)stats->files, (unsigned long long)stats->failures, (unsigned long long)stats->cache_hits, rate);
+    fprintf(stderr, "Bytes:   %llu read, %llu written\n",
+            (unsigned long long)stats->bytes_read, (unsigned long long)stats->bytes_written);
+    fprintf(stderr, "Time:    %.3f s elapsed, %.3f s CPU\n", wall_time, cpu_time);
+}
+
+
+/*
+    Read a clock.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - clock: The clock to read, eg. `CLOCK_MONOTONIC`.
+
+    - Returns: The clock's time in seconds.
+*/
+double clock_seconds(clockid_t clock) {
+
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+
+/*
+    Display an error message.
+
+    FROM 0.4.0
+
+    - Parameters:
+        - error_code: The error to report.
+        - info:       Pointer to extra message data
+*/
+void show_error(int error_code, char* info) {
+
+    switch(error_code) {
+        case N2B_ERROR_OPEN_SOURCE_FILE:
+            fprintf(stderr, "[ERROR] Could not open Amstrad screenshot file %s\n", info);
+            break;
+        case N2B_ERROR_OPEN_BMP_FILE:
+            fprintf(stderr, "[ERROR] Could not create BMP file %s\n", info);
+            break;
+        case N2B_ERROR_READ_SOURCE_FILE:
+            fprintf(stderr, "[ERROR] Amstrad screenshot file %s is incomplete\n", info);
+            break;
+        case N2B_ERROR_WRITE_BMP_FILE:
+            fprintf(stderr, "[ERROR] Could not write all of BMP file %s\n", info);
+            break;
+        case N2B_ERROR_NO_MEMORY:
+            fprintf(stderr, "[ERROR] Out of memory converting to %s\n", info);
+            break;
+        case N2B_ERROR_BAD_OPTIONS:
+            fprintf(stderr, "[ERROR] Invalid options for converting to %s\n", info);
+            break;
+        case N2B_ERROR_OPEN_CACHE:
+            fprintf(stderr, "[ERROR] Could not use cache directory %s\n", info);
+            break;
+        case N2B_ERROR_NO_DIRECTORY:
+            fprintf(stderr, "[ERROR] Found no file directory in %s -- add --scan to search it for screens instead\n", info);
+            break;
+        default:
+            fprintf(stderr, "[ERROR] Unknown.\n");
+    }
+}
+
+
+/*
+    Display an error from importing an image as a screenshot.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - error_code:  The error value.
+        - source_path: Pointer to the path to the image.
+        - target_path: Pointer to the path to the screenshot.
+*/
+void show_import_error(int error_code, const char* source_path, const char* target_path) {
+
+    switch(error_code) {
+        case N2B_ERROR_OPEN_SOURCE_FILE:
+            fprintf(stderr, "[ERROR] Could not open image file %s\n", source_path);
+            break;
+        case N2B_ERROR_READ_SOURCE_FILE:
+            fprintf(stderr, "[ERROR] Could not read image file %s\n", source_path);
+            break;
+        case N2B_ERROR_BAD_IMAGE:
+            fprintf(stderr, "[ERROR] Image file %s is not a BMP or non-interlaced PNG that can be read\n", source_path);
+            break;
+        case N2B_ERROR_OPEN_BMP_FILE:
+            fprintf(stderr, "[ERROR] Could not create screenshot file %s\n", target_path);
+            break;
+        case N2B_ERROR_WRITE_BMP_FILE:
+            fprintf(stderr, "[ERROR] Could not write all of screenshot file %s\n", target_path);
+            break;
+        case N2B_ERROR_NO_MEMORY:
+            fprintf(stderr, "[ERROR] Out of memory importing %s\n", source_path);
+            break;
+        default:
+            fprintf(stderr, "[ERROR] Unknown.\n");
+    }
+}
+
+
+/*
+    Display an error from reading the text on a screenshot.
+
+    FROM 0.5.0
+
+    - Parameters:
+        - error_code:  The error value.
+        - source_path: Pointer to the path to the screenshot.
+        - target_path: Pointer to the path to the text file.
+*/
+void show_text_error(int error_code, const char* source_path, const char* target_path) {
+
+    switch(error_code) {
+        case N2B_ERROR_OPEN_SOURCE_FILE:
+            fprintf(stderr, "[ERROR] Could not open Amstrad screenshot file %s\n", source_path);
+            break;
+        case N2B_ERROR_READ_SOURCE_FILE:
+            fprintf(stderr, "[ERROR] Amstrad screenshot file %s is incomplete\n", source_path);
+            break;
+        case N2B_ERROR_OPEN_BMP_FILE:
+            fprintf(stderr, "[ERROR] Could not create text file %s\n", target_path);
             break;
-        case ERROR_OPEN_BMP_FILE:
-            printf("ERROR] Could not create BMP file %s\n", info);
+        case N2B_ERROR_WRITE_BMP_FILE:
+            fprintf(stderr, "[ERROR] Could not write all of text file %s\n", target_path);
             break;
         default:
-            printf("ERROR] Unknown.\n");
+            fprintf(stderr, "[ERROR] Unknown.\n");
     }
 }
 
@@ -495,9 +2745,74 @@ void show_error(int error_code, char* info) {
 */
 void show_help(void) {
 
-    printf("notepad2bmp 0.4.0\n");
+    printf("notepad2bmp 0.5.0\n");
     printf("Copyright © 2025, Tony Smith (@smittytone). Source code available under the MIT licence.\n\n");
-    printf("Usage: notepad2bmp {source filename} [output filename] [-r/--rawsize]\n\n");
+    printf("Usage: notepad2bmp {source filename} [output filename] [-r/--rawsize] [-d/--depth {1|4|8}]\n");
+    printf("                   [-c/--compress] [-p/--png] [--dpi {72-%i}] [-j/--jobs {count}]\n", N2B_DPI_MAX);
+    printf("       notepad2bmp {source files, directories or patterns...} [-b/--batch] [-j/--jobs {count}]\n");
+    printf("                   [-r/--rawsize] [-d/--depth {1|4|8}] [-c/--compress] [-p/--png]\n");
+    printf("       notepad2bmp -w/--watch {directory} [-j/--jobs {count}] [-r/--rawsize] [-d/--depth {1|4|8}]\n");
+    printf("                   [-c/--compress] [-p/--png]\n");
+    printf("       notepad2bmp {source files, directories or patterns...} -a/--animate {output filename}\n");
+    printf("                   [--delay {hundredths}] [-r/--rawsize]\n");
+    printf("       notepad2bmp -x/--extract {card, disk or RAM dump} [output directory] [--scan]\n");
+    printf("                   [-r/--rawsize] [-d/--depth {1|4|8}] [-c/--compress] [-p/--png]\n");
+    printf("       notepad2bmp -i/--import {BMP or PNG files, directories or patterns...} [screenshot filename]\n");
+    printf("                   [--dither {none|ordered|floyd-steinberg}] [-j/--jobs {count}]\n");
+    printf("       notepad2bmp --receive {serial device} [output filename] [--baud {rate}]\n");
+    printf("       notepad2bmp --serve {socket path} [-j/--jobs {count}]\n");
+    printf("       notepad2bmp -t/--text --font {ROM font file} {source files, directories or patterns...}\n");
+    printf("                   [text filename] [-j/--jobs {count}]\n");
+    printf("       Single, batch and watch forms also take [--scaler {nearest|scale2x|epx|scale3x}]\n");
+    printf("       and [-f/--format {bmp,png,pcx,raw}]\n");
+    printf("       Forms other than --import, --text and --serve also take [-s/--scale {1-%i}] in place\n", N2B_SCALE_MAX);
+    printf("       of [-r/--rawsize], and [--stats[=text|json]] [--cache {directory}] [--cache-size {MB}]\n");
+    printf("       [--cache-link]\n\n");
     printf("Notes: If no output filename is provided, the name of the source file is used.\n");
     printf("       If no output filename extension is provided, .bmp is added.\n");
+    printf("       Images are written at 8 bits per pixel when scaled and 1 bit per pixel\n");
+    printf("       when not. Use --depth to choose 1, 4 or 8 bits per pixel for either.\n");
+    printf("       Use --compress to run-length encode 4bpp or 8bpp images (8bpp by default).\n");
+    printf("       Images are scaled 3x unless --rawsize or another --scale is given. Large\n");
+    printf("       scales, eg. for print, are written a band at a time, so take no more memory.\n");
+    printf("       Use --dpi to scale to a print resolution instead, eg. --dpi 300 for a\n");
+    printf("       2000 x 267 image. Large images are encoded on one thread per core unless\n");
+    printf("       a job count is set.\n");
+    printf("       Use --scaler to smooth edges when scaling: scale3x works at 3x, and scale2x (or\n");
+    printf("       epx, which is the same) at 2x.\n");
+    printf("       Use --png, or an output filename ending in .png, to write 1bpp PNGs instead.\n");
+    printf("       Use --format to write one or more of BMP, PNG, PCX and raw 1bpp pixel data\n");
+    printf("       from a single read of each screenshot, eg. --format bmp,pcx.\n");
+    printf("       More than two paths, a directory or a pattern are converted as a batch, each\n");
+    printf("       file written alongside its source with .bmp appended, eg. s.a -> s.a.bmp.\n");
+    printf("       Use --batch to convert two files this way.\n");
+    printf("       Batches use one worker per core unless a job count is set.\n");
+    printf("       Use - as the source filename to read stdin, and as the output filename to\n");
+    printf("       write stdout. Screenshots read from stdin are written to stdout by default.\n");
+    printf("       Watch mode converts screenshots as they arrive in the directory, and those\n");
+    printf("       already there without an up-to-date BMP, until interrupted.\n");
+    printf("       Use --animate to write the screenshots, in order, as the frames of an animated\n");
+    printf("       GIF. Each frame is shown for half a second unless a delay is set.\n");
+    printf("       Use --extract to convert every screenshot file, eg. s.a -> s.a.bmp, listed in\n");
+    printf("       the FAT directory of a memory card or disk dump. Add --scan to search a dump\n");
+    printf("       with no directory, eg. of RAM, for screens instead, naming each after the dump\n");
+    printf("       and its offset in it, eg. ram-0001a0c0.bmp. Screens whose offset can't be told\n");
+    printf("       are skipped and counted.\n");
+    printf("       Use --import to turn BMPs and PNGs into screenshots for the NC100: each image\n");
+    printf("       is resized to fit the screen, eg. picture.png -> picture.a, and dithered with\n");
+    printf("       Floyd-Steinberg error diffusion unless another dither is set.\n");
+    printf("       Use --text to read the text on screenshots, eg. s.a -> s.txt, by matching each\n");
+    printf("       character cell, as drawn or inverted, against a dump of the NC100's ROM font:\n");
+    printf("       eight bytes per character, one per row. Unknown characters read as '?'.\n");
+    printf("       Use --receive to take a screenshot sent from the NC100 by XMODEM, converting it\n");
+    printf("       as soon as it arrives, to s.bmp unless named. The line runs at 9600 baud\n");
+    printf("       unless a rate is set.\n");
+    printf("       Use --serve to convert screenshots sent over a Unix domain socket, each framed\n");
+    printf("       with its own options, until interrupted. Sixteen requests are converted at\n");
+    printf("       once unless a job count is set. See the README for the framing.\n");
+    printf("       Use --cache to reuse the BMPs of identical screens converted before. The cache\n");
+    printf("       is trimmed to 256MB, least recently used first, unless a size is set. Cached\n");
+    printf("       BMPs are copied, or hard-linked, read-only, with --cache-link.\n");
+    printf("       Use --stats to report per-stage times, byte counts and files per second on\n");
+    printf("       stderr, or --stats=json for a single line of JSON.\n");
 }
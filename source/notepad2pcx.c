@@ -3,7 +3,7 @@
 
     Copyright © 2025 Tony Smith. All rights reserved.
 
-    Version 0.1.0
+    Version 0.2.0
 
     MIT License
     Permission is hereby granted, free of charge, to any person obtaining a copy
@@ -27,6 +27,13 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+
+
+/*
+    FORWARD DECLARATIONS
+*/
+int encode_row(const uint8_t* row, int length, uint8_t* target);
 
 
 /*
@@ -75,23 +82,59 @@ int main (int argc, char *argv[] ) {
     }
 
     // Write out the rows: PCX
-    for (int row = 0 ; row < 64 ; ++row) {
-        for (int col = 0 ; col < 60 ; ++col) {
-            // Read in the byte...
-            char byte = fgetc(source_file);
-
-            // ...and write it out
-            fputc(0xC1, pcx_file);
-            fputc(byte, pcx_file);
+    // FROM 0.2.0 -- run-length encode each row
+    uint8_t row[64];
+    uint8_t encoded[120];
+    for (int i = 0 ; i < 64 ; ++i) {
+        // Read in the row, including the four padding bytes,
+        // which we can ignore for PCX
+        if (fread(row, 1, 64, source_file) != 64) {
+            printf("[ERROR] File %s is incomplete.\n" , argv[1]);
+            exit(1);
         }
 
-        // Four padding bytes, which we can ignore for PCX
-        fgetc(source_file);
-        fgetc(source_file);
-        fgetc(source_file);
-        fgetc(source_file);
+        // ...and write it out
+        int length = encode_row(row, 60, encoded);
+        if (fwrite(encoded, 1, length, pcx_file) != (size_t)length) {
+            printf("[ERROR] Cannot write file %s.\n" , argv[2]);
+            exit(1);
+        }
     }
 
     fclose(source_file);
     fclose(pcx_file);
 }
+
+
+/*
+    Run-length encode a row of PCX data. Runs of up to 63 identical bytes
+    are written as a count byte (0xC0 + count) then the data byte. Single
+    bytes are written as is, unless their top two bits are set, in which
+    case they need a count of one to tell them from count bytes.
+
+    FROM 0.2.0
+
+    - Parameters:
+        - row:    Pointer to the row data.
+        - length: The number of bytes in the row.
+        - target: Pointer to the output buffer, which needs room for
+                  up to twice the row length.
+
+    - Returns: The number of bytes written.
+*/
+int encode_row(const uint8_t* row, int length, uint8_t* target) {
+
+    int count = 0;
+    int i = 0;
+
+    while (i < length) {
+        int run = 1;
+        while (i + run < length && run < 63 && row[i + run] == row[i]) run++;
+
+        if (run > 1 || row[i] >= 0xC0) target[count++] = 0xC0 | run;
+        target[count++] = row[i];
+        i += run;
+    }
+
+    return count;
+}
@@ -0,0 +1,288 @@
+#!/usr/bin/env python3
+"""
+    Regression tests for `notepad2bmp --extract`: the `s.*` files of a FAT
+    disk image must come out under their own names, however their clusters
+    lie, and a dump with no directory must be refused unless scanned. With
+    `--scan`, screens planted at random offsets must be found where they
+    were put, and byte for byte as a direct conversion would make them,
+    while dump contents that merely share a screen's layout, and screens
+    whose offset can't be told, must not come out as screenshots.
+
+    Usage: tests/test_extract.py [path to notepad2bmp]
+"""
+
+import os
+import random
+import subprocess
+import sys
+import tempfile
+
+ROW_SIZE = 64
+VISIBLE_SIZE = 60
+SCREEN_SIZE = 4096
+NC200_SCREEN_SIZE = 8192
+HEADER_SIZE = 128
+
+SECTOR_SIZE = 512
+CLUSTER_SIZE = 1024
+FAT_SECTORS = 12
+ROOT_ENTRIES = 64
+TOTAL_SECTORS = 2880
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+SAMPLE = os.path.join(HERE, "..", "samples", "screenshot.a")
+
+
+def make_screen(rng):
+    # Text-like rows of ink, some rows blank, but never the top or bottom
+    # row, so that each screen can only be found at one offset
+    screen = bytearray(SCREEN_SIZE)
+    for row in range(64):
+        if 0 < row < 63 and rng.random() < 0.3:
+            continue
+        for col in range(VISIBLE_SIZE):
+            screen[row * ROW_SIZE + col] = rng.randrange(1, 256)
+    return bytes(screen)
+
+
+def make_header(length):
+    header = bytearray(HEADER_SIZE)
+    header[0:9] = b"PLUS3DOS\x1a"
+    header[9] = 1
+    header[11:15] = (HEADER_SIZE + length).to_bytes(4, "little")
+    header[127] = sum(header[:127]) & 0xFF
+    return bytes(header)
+
+
+def make_fat_image(files):
+    # A 1.44MB FAT12 disk with 1KB clusters. Each file is given as its
+    # 8.3 name, attributes, data and the clusters to put it in
+    fat = bytearray(FAT_SECTORS * SECTOR_SIZE)
+    fat[0:3] = b"\xf0\xff\xff"
+    root = bytearray(ROOT_ENTRIES * 32)
+    image = bytearray(TOTAL_SECTORS * SECTOR_SIZE)
+    data_start = (1 + 2 * FAT_SECTORS + ROOT_ENTRIES * 32 // SECTOR_SIZE) * SECTOR_SIZE
+
+    def set_entry(cluster, value):
+        index = cluster * 3 // 2
+        pair = fat[index] | fat[index + 1] << 8
+        pair = (pair & 0x000F) | value << 4 if cluster & 1 else (pair & 0xF000) | value
+        fat[index:index + 2] = pair.to_bytes(2, "little")
+
+    for index, (name, attributes, data, clusters) in enumerate(files):
+        entry = bytearray(32)
+        entry[0:11] = name
+        entry[11] = attributes
+        entry[26:28] = (clusters[0] if clusters else 0).to_bytes(2, "little")
+        entry[28:32] = len(data).to_bytes(4, "little")
+        root[index * 32:index * 32 + 32] = entry
+        for position, cluster in enumerate(clusters):
+            set_entry(cluster, clusters[position + 1] if position + 1 < len(clusters) else 0xFFF)
+            piece = data[position * CLUSTER_SIZE:(position + 1) * CLUSTER_SIZE]
+            offset = data_start + (cluster - 2) * CLUSTER_SIZE
+            image[offset:offset + len(piece)] = piece
+
+    boot = bytearray(SECTOR_SIZE)
+    boot[0:3] = b"\xeb\x3c\x90"
+    boot[3:11] = b"NC200   "
+    boot[11:13] = SECTOR_SIZE.to_bytes(2, "little")
+    boot[13] = CLUSTER_SIZE // SECTOR_SIZE
+    boot[14:16] = (1).to_bytes(2, "little")
+    boot[16] = 2
+    boot[17:19] = ROOT_ENTRIES.to_bytes(2, "little")
+    boot[19:21] = TOTAL_SECTORS.to_bytes(2, "little")
+    boot[21] = 0xF0
+    boot[22:24] = FAT_SECTORS.to_bytes(2, "little")
+    boot[510:512] = b"\x55\xaa"
+    image[0:SECTOR_SIZE] = boot
+    image[SECTOR_SIZE:SECTOR_SIZE + len(fat)] = fat
+    image[SECTOR_SIZE + len(fat):SECTOR_SIZE + 2 * len(fat)] = fat
+    image[SECTOR_SIZE + 2 * len(fat):SECTOR_SIZE + 2 * len(fat) + len(root)] = root
+    return bytes(image)
+
+
+def run_extract(binary, work, name, dump, scan):
+    dump_path = os.path.join(work, name + ".img")
+    out_dir = os.path.join(work, name)
+    os.mkdir(out_dir)
+    with open(dump_path, "wb") as file:
+        file.write(dump)
+    result = subprocess.run([binary, "--extract", dump_path, out_dir] + (["--scan"] if scan else []), capture_output=True, text=True)
+    found = {}
+    for file_name in sorted(os.listdir(out_dir)):
+        with open(os.path.join(out_dir, file_name), "rb") as file:
+            found[file_name] = file.read()
+    return result, found
+
+
+def extract(binary, work, name, dump):
+    # Scan the dump, keying the screens found by their offsets
+    result, files = run_extract(binary, work, name, dump, True)
+    if result.returncode != 0:
+        raise AssertionError("exit status %d: %s" % (result.returncode, result.stderr.strip()))
+    found = {int(file_name[len(name) + 1:].split(".")[0], 16): data for file_name, data in files.items()}
+    return found, result.stdout
+
+
+def convert(binary, work, screen):
+    source_path = os.path.join(work, "direct.a")
+    target_path = os.path.join(work, "direct.bmp")
+    with open(source_path, "wb") as file:
+        file.write(screen)
+    subprocess.run([binary, source_path, target_path], check=True, capture_output=True)
+    with open(target_path, "rb") as file:
+        return file.read()
+
+
+def test_planted(binary, work):
+    # Zero fill broken by short records and +3DOS files, with screens planted
+    # at unaligned offsets well clear of them, and two screenshot files that
+    # start right after their +3DOS headers. The sample's bottom row is
+    # blank, so only its header fixes where it starts
+    rng = random.Random(15)
+    with open(SAMPLE, "rb") as file:
+        screens = [file.read()] + [make_screen(rng) for _ in range(23)]
+    dump = bytearray()
+    planted = {}
+    for index, screen in enumerate(screens):
+        dump += bytes(rng.randrange(SCREEN_SIZE, 3 * SCREEN_SIZE))
+        for _ in range(rng.randrange(0, 4)):
+            dump += rng.randbytes(rng.randrange(1, 48)) + bytes(rng.randrange(200, 2000))
+        if index % 6 == 5:
+            text = b"Notes copied from the NC100\r\n" * rng.randrange(1, 40)
+            dump += make_header(len(text)) + text + bytes(SCREEN_SIZE)
+        if index in (0, 12):
+            dump += make_header(SCREEN_SIZE)
+        planted[len(dump)] = screen
+        dump += screen
+    dump += bytes(2 * SCREEN_SIZE)
+
+    found, _ = extract(binary, work, "planted", bytes(dump))
+    if sorted(found) != sorted(planted):
+        missing = ["%08x" % offset for offset in sorted(set(planted) - set(found))]
+        extra = ["%08x" % offset for offset in sorted(set(found) - set(planted))]
+        raise AssertionError("missing %s, extra %s" % (missing, extra))
+    for offset, screen in planted.items():
+        if found[offset] != convert(binary, work, screen):
+            raise AssertionError("screen at %08x differs from a direct conversion" % offset)
+
+
+def test_text_record(binary, work):
+    found, _ = extract(binary, work, "text", bytes(8192) + b"Shopping list: eggs, milk\r\n" + bytes(8192))
+    if found:
+        raise AssertionError("found %s" % ["%08x" % offset for offset in found])
+
+
+def test_zero_run(binary, work):
+    found, _ = extract(binary, work, "run", b"\xff" * 8192 + bytes(SCREEN_SIZE + 200) + b"\xff" * 8192)
+    if found:
+        raise AssertionError("found %s" % ["%08x" % offset for offset in found])
+
+
+def test_header(binary, work):
+    # Two screens, then a +3DOS file whose header follows a screen's worth
+    # of zero fill
+    rng = random.Random(3)
+    first = make_screen(rng)
+    second = make_screen(rng)
+    text = b"Letter to the bank\r\n" * 50
+    dump = bytes(SCREEN_SIZE) + first + bytes(5000) + second + bytes(3000) + make_header(len(text)) + text + bytes(SCREEN_SIZE)
+    found, _ = extract(binary, work, "header", dump)
+    expected = [SCREEN_SIZE, 2 * SCREEN_SIZE + 5000]
+    if sorted(found) != expected:
+        raise AssertionError("found %s" % ["%08x" % offset for offset in sorted(found)])
+
+
+def test_blank_edges(binary, work):
+    # A screen of text whose top and bottom rows are blank, in zero fill,
+    # matches a row either side of where it was put just as well
+    rng = random.Random(8)
+    screen = bytearray(make_screen(rng))
+    screen[0:ROW_SIZE] = bytes(ROW_SIZE)
+    screen[63 * ROW_SIZE:] = bytes(ROW_SIZE)
+    found, output = extract(binary, work, "edges", bytes(0x2000) + bytes(screen) + bytes(0x2000))
+    if found:
+        raise AssertionError("found %s" % ["%08x" % offset for offset in found])
+    if "Skipped 1 screen at ambiguous offsets" not in output:
+        raise AssertionError("reported %r" % output.strip())
+
+
+def test_directory(binary, work):
+    # Screenshot files, one NC200's and one fragmented with its clusters
+    # out of order, among a deleted screenshot, a long name entry, a
+    # directory, a file of the wrong size and other files
+    rng = random.Random(24)
+    with open(SAMPLE, "rb") as file:
+        sample = file.read()
+    nc200 = bytes(rng.randrange(0, 256) for _ in range(NC200_SCREEN_SIZE))
+    fragmented = make_header(SCREEN_SIZE) + make_screen(rng)
+    deleted = make_screen(rng)
+    files = [
+        (b"NC200   VOL", 0x08, b"", []),
+        (b"S       A  ", 0x20, sample, [2, 3, 4, 5]),
+        (b"Bs\x00.\x00a\x00\x00\x00\xff\xff", 0x0F, b"", []),
+        (b"S       B  ", 0x20, nc200, [40, 41, 42, 43, 44, 45, 46, 47]),
+        (b"\xe5       C  ", 0x20, deleted, [60, 61, 62, 63]),
+        (b"S       D  ", 0x20, fragmented, [30, 12, 13, 6, 31]),
+        (b"S       E  ", 0x10, b"", [70]),
+        (b"S       F  ", 0x20, b"x" * 100, [80]),
+        (b"LETTER  TXT", 0x20, sample, [90, 91, 92, 93]),
+    ]
+    result, found = run_extract(binary, work, "disk", make_fat_image(files), False)
+    if result.returncode != 0:
+        raise AssertionError("exit status %d: %s" % (result.returncode, result.stderr.strip()))
+    if sorted(found) != ["s.a.bmp", "s.b.bmp", "s.d.bmp"]:
+        raise AssertionError("found %s" % sorted(found))
+    for name, screen in (("s.a.bmp", sample), ("s.b.bmp", nc200), ("s.d.bmp", fragmented)):
+        if found[name] != convert(binary, work, screen):
+            raise AssertionError("%s differs from a direct conversion" % name)
+    if "Extracted 3 screenshots from" not in result.stdout:
+        raise AssertionError("reported %r" % result.stdout.strip())
+
+
+def test_truncated_directory(binary, work):
+    # A disk image cut off before the last of a screenshot's clusters
+    with open(SAMPLE, "rb") as file:
+        sample = file.read()
+    image = make_fat_image([(b"S       A  ", 0x20, sample, [2, 3, 4, 500])])
+    result, _ = run_extract(binary, work, "cut", image[:0x5000 + 400 * CLUSTER_SIZE], False)
+    if result.returncode == 0 or "is incomplete" not in result.stderr:
+        raise AssertionError("exit status %d: %r" % (result.returncode, result.stderr.strip()))
+
+
+def test_no_directory(binary, work):
+    with open(SAMPLE, "rb") as file:
+        screen = file.read()
+    result, found = run_extract(binary, work, "ram", bytes(1000) + screen + bytes(1000), False)
+    if result.returncode == 0 or found:
+        raise AssertionError("exit status %d, found %s" % (result.returncode, sorted(found)))
+    if "add --scan" not in result.stderr:
+        raise AssertionError("reported %r" % result.stderr.strip())
+
+
+def test_count_message(binary, work):
+    with open(SAMPLE, "rb") as file:
+        screen = file.read()
+    _, output = extract(binary, work, "one", bytes(1000) + make_header(SCREEN_SIZE) + screen + bytes(1000))
+    if "Extracted 1 screenshot from" not in output:
+        raise AssertionError("reported %r" % output.strip())
+
+
+def main():
+    binary = os.path.abspath(sys.argv[1] if len(sys.argv) > 1 else os.path.join(HERE, "..", "source", "notepad2bmp"))
+    tests = [test_directory, test_truncated_directory, test_no_directory, test_planted, test_text_record, test_zero_run,
+             test_header, test_blank_edges, test_count_message]
+    failures = 0
+    for test in tests:
+        with tempfile.TemporaryDirectory() as work:
+            try:
+                test(binary, work)
+                print("PASS %s" % test.__name__)
+            except AssertionError as error:
+                print("FAIL %s: %s" % (test.__name__, error))
+                failures += 1
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,297 @@
+#!/usr/bin/env python3
+"""
+    Tests for `notepad2bmp --receive`: a scripted XMODEM sender on one side
+    of a pty pair drives the receiver on the other, with CRCs, checksums
+    and 1KB blocks, NC200 screenshots and +3DOS headers, and with a
+    corrupted block, a block sent twice, a transfer that ends early, one
+    that sends too much and one that's cancelled. A received screenshot
+    must convert byte for byte as the file sent does.
+
+    The checksum test waits out the receiver's requests for CRCs, so
+    takes about ten seconds.
+
+    Usage: tests/test_xmodem.py [path to notepad2bmp]
+"""
+
+import os
+import pty
+import random
+import select
+import subprocess
+import sys
+import tempfile
+import tty
+
+SOH = 0x01
+STX = 0x02
+EOT = 0x04
+ACK = 0x06
+NAK = 0x15
+CAN = 0x18
+CRC = ord("C")
+
+BLOCK_SIZE = 128
+LONG_BLOCK_SIZE = 1024
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+SAMPLE = os.path.join(HERE, "..", "samples", "screenshot.a")
+
+NC200_SCREEN_SIZE = 8192
+HEADER_SIZE = 128
+PADDING = 0x1A
+
+
+def crc16(data):
+    crc = 0
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) & 0xFFFF if crc & 0x8000 else (crc << 1) & 0xFFFF
+    return crc
+
+
+class Sender:
+    # The sending end of a pty, with the receiver started on the other
+
+    def __init__(self, binary, work):
+        self.master, self.slave = pty.openpty()
+        tty.setraw(self.master)
+        self.output_path = os.path.join(work, "received.bmp")
+        self.process = subprocess.Popen([binary, "--receive", os.ttyname(self.slave), self.output_path],
+                                        stdout=subprocess.PIPE, stderr=subprocess.PIPE, text=True)
+
+    def read(self, timeout=5):
+        ready, _, _ = select.select([self.master], [], [], timeout)
+        if not ready:
+            raise AssertionError("receiver sent nothing for %d seconds" % timeout)
+        return os.read(self.master, 1)[0]
+
+    def wait_for(self, wanted, timeout):
+        # Skip the requests made while the sender ignores them
+        while True:
+            byte = self.read(timeout)
+            if byte == wanted:
+                return
+
+    def send_block(self, number, data, use_crc, corrupt=False):
+        packet = bytes([STX if len(data) == LONG_BLOCK_SIZE else SOH, number & 0xFF, 0xFF - (number & 0xFF)]) + data
+        packet += crc16(data).to_bytes(2, "big") if use_crc else bytes([sum(data) & 0xFF])
+        if corrupt:
+            packet = packet[:50] + bytes([packet[50] ^ 0x01]) + packet[51:]
+        os.write(self.master, packet)
+        return self.read()
+
+    def finish(self):
+        try:
+            stdout, stderr = self.process.communicate(timeout=30)
+        finally:
+            if self.process.poll() is None:
+                self.process.kill()
+                self.process.wait()
+            os.close(self.master)
+            os.close(self.slave)
+        return self.process.returncode, stdout, stderr
+
+
+def blocks_of(data, size):
+    # The last block is padded out, as XMODEM senders do
+    return [data[i:i + size].ljust(size, bytes([PADDING])) for i in range(0, len(data), size)]
+
+
+def send_file(sender, data, size, use_crc):
+    for index, block in enumerate(blocks_of(data, size)):
+        reply = sender.send_block(index + 1, block, use_crc)
+        if reply != ACK:
+            raise AssertionError("block %d got %#x, not ACK" % (index + 1, reply))
+    os.write(sender.master, bytes([EOT]))
+    if sender.read() != ACK:
+        raise AssertionError("EOT not acknowledged")
+
+
+def convert(binary, work, data):
+    source_path = os.path.join(work, "direct.a")
+    target_path = os.path.join(work, "direct.bmp")
+    with open(source_path, "wb") as file:
+        file.write(data)
+    subprocess.run([binary, source_path, target_path], check=True, capture_output=True)
+    with open(target_path, "rb") as file:
+        return file.read()
+
+
+def check_received(binary, work, sender, data=None):
+    status, stdout, stderr = sender.finish()
+    if status != 0:
+        raise AssertionError("exit status %d: %s" % (status, stderr.strip()))
+    if "Received screenshot as" not in stdout:
+        raise AssertionError("reported %r" % stdout.strip())
+    with open(sender.output_path, "rb") as file:
+        if file.read() != convert(binary, work, data if data is not None else sample()):
+            raise AssertionError("received image differs from a direct conversion")
+
+
+def check_failed(sender, message):
+    status, _, stderr = sender.finish()
+    if status == 0:
+        raise AssertionError("exit status 0")
+    if message not in stderr:
+        raise AssertionError("reported %r" % stderr.strip())
+    if os.path.exists(sender.output_path):
+        raise AssertionError("an image was written")
+
+
+def sample():
+    with open(SAMPLE, "rb") as file:
+        return file.read()
+
+
+def nc200_screen():
+    rng = random.Random(200)
+    return bytes(rng.randrange(0, 256) if i % 64 < 60 else 0 for i in range(NC200_SCREEN_SIZE))
+
+
+def with_header(data):
+    header = bytearray(HEADER_SIZE)
+    header[0:9] = b"PLUS3DOS\x1a"
+    header[9] = 1
+    header[11:15] = (HEADER_SIZE + len(data)).to_bytes(4, "little")
+    header[127] = sum(header[:127]) & 0xFF
+    return bytes(header) + data
+
+
+def test_crc(binary, work):
+    sender = Sender(binary, work)
+    sender.wait_for(CRC, 5)
+    send_file(sender, sample(), BLOCK_SIZE, True)
+    check_received(binary, work, sender)
+
+
+def test_checksum(binary, work):
+    # A sender that only knows checksums ignores the receiver's requests
+    # for CRCs until it gives up on them and asks with a NAK
+    sender = Sender(binary, work)
+    sender.wait_for(NAK, 15)
+    send_file(sender, sample(), BLOCK_SIZE, False)
+    check_received(binary, work, sender)
+
+
+def test_long_blocks(binary, work):
+    sender = Sender(binary, work)
+    sender.wait_for(CRC, 5)
+    send_file(sender, sample(), LONG_BLOCK_SIZE, True)
+    check_received(binary, work, sender)
+
+
+def test_corrupted_block(binary, work):
+    sender = Sender(binary, work)
+    sender.wait_for(CRC, 5)
+    blocks = blocks_of(sample(), BLOCK_SIZE)
+    for index, block in enumerate(blocks):
+        if index == 5:
+            reply = sender.send_block(index + 1, block, True, corrupt=True)
+            if reply != NAK:
+                raise AssertionError("corrupted block got %#x, not NAK" % reply)
+        if sender.send_block(index + 1, block, True) != ACK:
+            raise AssertionError("block %d not acknowledged" % (index + 1))
+    os.write(sender.master, bytes([EOT]))
+    sender.read()
+    check_received(binary, work, sender)
+
+
+def test_repeated_block(binary, work):
+    # As a sender does when an ACK is lost: the block must be acknowledged
+    # again, but stored only once
+    sender = Sender(binary, work)
+    sender.wait_for(CRC, 5)
+    blocks = blocks_of(sample(), BLOCK_SIZE)
+    for index, block in enumerate(blocks):
+        if sender.send_block(index + 1, block, True) != ACK:
+            raise AssertionError("block %d not acknowledged" % (index + 1))
+        if index == 7 and sender.send_block(index + 1, block, True) != ACK:
+            raise AssertionError("repeated block not acknowledged")
+    os.write(sender.master, bytes([EOT]))
+    sender.read()
+    check_received(binary, work, sender)
+
+
+def test_short_transfer(binary, work):
+    sender = Sender(binary, work)
+    sender.wait_for(CRC, 5)
+    send_file(sender, sample()[:-BLOCK_SIZE], BLOCK_SIZE, True)
+    check_failed(sender, "ended before the whole screenshot arrived")
+
+
+def test_nc200(binary, work):
+    # Twice an NC100 screen: none of it may be cut off
+    sender = Sender(binary, work)
+    sender.wait_for(CRC, 5)
+    send_file(sender, nc200_screen(), LONG_BLOCK_SIZE, True)
+    check_received(binary, work, sender, nc200_screen())
+
+
+def test_nc200_header(binary, work):
+    # 8320 bytes, so the last 1KB block is mostly padding
+    sender = Sender(binary, work)
+    sender.wait_for(CRC, 5)
+    data = with_header(nc200_screen())
+    send_file(sender, data, LONG_BLOCK_SIZE, True)
+    check_received(binary, work, sender, data)
+
+
+def test_nc100_header(binary, work):
+    sender = Sender(binary, work)
+    sender.wait_for(CRC, 5)
+    data = with_header(sample())
+    send_file(sender, data, BLOCK_SIZE, True)
+    check_received(binary, work, sender, data)
+
+
+def test_wrong_size(binary, work):
+    # More than an NC100 screen but less than an NC200 one
+    sender = Sender(binary, work)
+    sender.wait_for(CRC, 5)
+    send_file(sender, sample() + bytes(LONG_BLOCK_SIZE), LONG_BLOCK_SIZE, True)
+    check_failed(sender, "more or other than")
+
+
+def test_too_long(binary, work):
+    # The receiver gives up once a block starts past the largest screenshot
+    sender = Sender(binary, work)
+    sender.wait_for(CRC, 5)
+    blocks = blocks_of(sample() + nc200_screen(), LONG_BLOCK_SIZE)
+    for index, block in enumerate(blocks):
+        reply = sender.send_block(index + 1, block, True)
+        if reply != ACK:
+            break
+    if reply != CAN or index * LONG_BLOCK_SIZE < HEADER_SIZE + NC200_SCREEN_SIZE:
+        raise AssertionError("block %d got %#x, not CAN" % (index + 1, reply))
+    check_failed(sender, "more or other than")
+
+
+def test_cancel(binary, work):
+    sender = Sender(binary, work)
+    sender.wait_for(CRC, 5)
+    for index, block in enumerate(blocks_of(sample(), BLOCK_SIZE)[:3]):
+        if sender.send_block(index + 1, block, True) != ACK:
+            raise AssertionError("block %d not acknowledged" % (index + 1))
+    os.write(sender.master, bytes([CAN, CAN]))
+    check_failed(sender, "XMODEM transfer on")
+
+
+def main():
+    binary = os.path.abspath(sys.argv[1] if len(sys.argv) > 1 else os.path.join(HERE, "..", "source", "notepad2bmp"))
+    tests = [test_crc, test_checksum, test_long_blocks, test_corrupted_block, test_repeated_block, test_nc200, test_nc200_header,
+             test_nc100_header, test_short_transfer, test_wrong_size, test_too_long, test_cancel]
+    failures = 0
+    for test in tests:
+        with tempfile.TemporaryDirectory() as work:
+            try:
+                test(binary, work)
+                print("PASS %s" % test.__name__)
+            except AssertionError as error:
+                print("FAIL %s: %s" % (test.__name__, error))
+                failures += 1
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())